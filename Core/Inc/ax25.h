@@ -28,6 +28,40 @@ along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
 //for AX.25 329 bytes is the theoretical max size assuming 2-byte Control, 1-byte PID, 256-byte info field and 8 digi address fields
 #define AX25_FRAME_MAX_SIZE (329) //single frame max length
 
+/**
+ * @brief Transmit traffic classes, ordered by priority (highest first)
+ */
+enum Ax25TxClass
+{
+	AX25_TX_CLASS_DIGI = 0, //digipeated frames
+	AX25_TX_CLASS_HOST, //frames from KISS host
+	AX25_TX_CLASS_BEACON, //own beacons
+
+	AX25_TX_CLASS_COUNT
+};
+
+struct Ax25TxQueueStats
+{
+	uint8_t depth; //current number of queued frames
+	uint8_t maxDepth; //max number of queued frames
+	uint32_t sent; //transmitted frames
+	uint32_t dropped; //frames dropped because queue was full
+	uint32_t waitSum; //sum of queue wait times in SysTick ticks
+	uint32_t waitMax; //max queue wait time in SysTick ticks
+};
+
+struct Ax25RxStats
+{
+	uint32_t decoded; //frames received with correct CRC
+	uint32_t crcErrors; //frames with incorrect CRC
+	uint32_t aborted; //frames aborted by 7 consecutive ones (not checked when FX.25 is enabled)
+	uint32_t tooLong; //frames exceeding maximum frame size
+	uint32_t fx25Corrected; //FX.25 frames with errors corrected
+	uint32_t fx25Failed; //FX.25 frames with uncorrectable errors
+	uint32_t il2pCorrected; //IL2P frames with errors corrected
+	uint32_t il2pFailed; //IL2P frames with uncorrectable errors
+};
+
 enum Ax25RxStage
 {
 	RX_STAGE_IDLE = 0,
@@ -36,6 +70,9 @@ enum Ax25RxStage
 #ifdef ENABLE_FX25
 	RX_STAGE_FX25_FRAME,
 #endif
+#ifdef ENABLE_IL2P
+	RX_STAGE_IL2P_FRAME,
+#endif
 };
 
 struct Ax25ProtoConfig
@@ -46,6 +83,18 @@ struct Ax25ProtoConfig
 	uint8_t allowNonAprs : 1; //allow non-APRS packets
 	uint8_t fx25 : 1; //enable FX.25 (AX.25 + FEC)
 	uint8_t fx25Tx : 1; //enable TX in FX.25
+	uint8_t fx25Adaptive : 1; //choose FX.25 parity size from channel quality instead of frame size
+	uint8_t fx25MinParity; //min parity size (16, 32 or 64) for adaptive FX.25
+	uint8_t fx25MaxParity; //max parity size (16, 32 or 64) for adaptive FX.25
+	uint8_t il2p : 1; //enable IL2P reception
+	uint8_t il2pTx : 1; //enable TX in IL2P
+	uint8_t il2pCrc : 1; //append and check trailing IL2P CRC
+	uint8_t txWeighted : 1; //use weighted round-robin instead of strict priority between TX classes
+	uint8_t txMaxFrames; //max frames per transmission, 0 - unlimited
+	uint16_t txMaxTime; //max transmission time in ms, 0 - unlimited
+	uint8_t persistence; //p-persistence parameter, transmit probability is (persistence + 1) / 256
+	uint16_t slotTime; //slot time for p-persistence in ms
+	uint8_t fullDuplex : 1; //transmit without waiting for a free channel
 };
 
 extern struct Ax25ProtoConfig Ax25Config;
@@ -55,10 +104,45 @@ extern struct Ax25ProtoConfig Ax25Config;
  * @brief Write frame to transmit buffer
  * @param *data Data to transmit
  * @param size Data size
+ * @param class TX class (queue) to use
  * @return Pointer to internal frame handle or NULL on failure
- * @attention This function will block if transmission is already in progress
  */
-void *Ax25WriteTxFrame(uint8_t *data, uint16_t size);
+void *Ax25WriteTxFrame(uint8_t *data, uint16_t size, enum Ax25TxClass class);
+
+/**
+ * @brief Request acknowledgment of frame transmission
+ * @param *handle Frame handle returned by Ax25WriteTxFrame()
+ * @param tag Non-zero tag to be returned by Ax25GetNextTxAck() after the frame is transmitted
+ * @attention Must be called right after Ax25WriteTxFrame()
+ */
+void Ax25SetTxFrameAckTag(void *handle, uint32_t tag);
+
+/**
+ * @brief Get tag of next transmitted frame that requested acknowledgment
+ * @param *tag Output tag
+ * @return True if tag was read, false if nothing to acknowledge
+ */
+bool Ax25GetNextTxAck(uint32_t *tag);
+
+/**
+ * @brief Get TX class queue statistics
+ * @param class TX class
+ * @param *stats Output statistics
+ */
+void Ax25GetTxQueueStats(enum Ax25TxClass class, struct Ax25TxQueueStats *stats);
+
+/**
+ * @brief Get demodulator reception statistics
+ * @param modem Demodulator number
+ * @param *stats Output statistics
+ */
+void Ax25GetRxStats(uint8_t modem, struct Ax25RxStats *stats);
+
+/**
+ * @brief Get number of received frames dropped because RX buffer was full
+ * @return Number of dropped frames
+ */
+uint32_t Ax25GetRxDropped(void);
 
 /**
  * @brief Get bitmap of "frame received" flags for each decoder. A non-zero value means that a frame was received
@@ -78,7 +162,7 @@ void Ax25ClearReceivedFrameBitmap(void);
  * @param *peak Signak positive peak value in %
  * @param *valley Signal negative peak value in %
  * @param *level Signal level in %
- * @param *corrected Number of bytes corrected in FX.25 mode. 255 is returned if not a FX.25 packet.
+ * @param *corrected Number of bytes corrected in FX.25 or IL2P mode. 255 is returned if not a FX.25 or IL2P packet.
  * @return True if frame was read, false if no more frames to read
  */
 bool Ax25ReadNextRxFrame(uint8_t **dst, uint16_t *size, int8_t *peak, int8_t *valley, uint8_t *level, uint8_t *corrected);
@@ -109,14 +193,20 @@ uint8_t Ax25GetTxBit(void);
 
 /**
  * @brief Initialize transmission and start when possible
+ * @attention Transmission is started by a timer after quiet time and p-persistence slots
  */
 void Ax25TransmitBuffer(void);
 
 /**
- * @brief Start transmitting when possible
- * @attention Must be continuously polled in main loop
+ * @brief Check if there are frames waiting for transmission or being transmitted
+ * @return True if transmission is pending
+ */
+bool Ax25IsTransmitPending(void);
+
+/**
+ * @brief Recalculate TXDelay, TXTail and max transmission length after Ax25Config change
  */
-void Ax25TransmitCheck(void);
+void Ax25UpdateTiming(void);
 
 /**
  * @brief Initialize AX25 module
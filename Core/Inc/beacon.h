@@ -24,33 +24,75 @@ along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdint.h>
 
 #define BEACON_MAX_PAYLOAD_SIZE 100
+#define BEACON_MAX_JITTER 120 //max beacon deferral time in seconds
 
 struct Beacon
 {
-	uint8_t enable; //enable beacon
+	//fields are ordered by size, so that there is no padding between them
+	uint64_t next; //next beacon timestamp
 	uint32_t interval; //interval in seconds
 	uint32_t delay; //delay in seconds
+	uint32_t hash; //cached frame duplicate protection hash
+	uint16_t size; //cached frame size
+	uint8_t enable; //enable beacon
+	uint8_t telemetry; //send telemetry report built from digipeater counters instead of information field
 	uint8_t data[BEACON_MAX_PAYLOAD_SIZE + 1]; //information field
 	uint8_t path[15]; //path, 2 parts max, e.g. WIDE1<sp>1SP2<sp><sp><sp>2<NUL>, <NUL> can be at byte 0, 7 and 14
-	uint32_t next; //next beacon timestamp
 };
 
 extern struct Beacon beacon[8];
 
+struct BeaconConfig
+{
+	uint8_t jitter; //max time in seconds a beacon can be deferred while the channel is busy
+};
+
+extern struct BeaconConfig BeaconConfig;
+
+struct BeaconStats
+{
+	uint32_t sent; //beacons written to TX buffer
+	uint32_t deferred; //beacons deferred because the channel was busy
+	uint32_t forced; //beacons sent to busy channel after max deferral time
+};
+
 /**
  * @brief Send specified beacon
  * @param number Beacon number (0-7)
+ * @details Telemetry beacons send APRS telemetry report (T#) with digipeater counters.
+ * Definitions (PARM, UNIT, EQNS and BITS) are sent before the first and every 16th report.
  */
 void BeaconSend(uint8_t number);
 
 
 /**
- * @brief Check if any beacon should be transmitted and transmit if necessary
+ * @brief Calculate and cache beacon frame sizes and their duplicate protection hashes
+ * @details Frames themselves are not stored, BeaconSend() builds them again unless the frame buffer already holds the beacon
+ * @attention Must be called after callsign, destination or beacon contents are changed
+ */
+void BeaconUpdate(void);
+
+/**
+ * @brief Transmit beacons whose time has come and restart timer for the nearest one
+ * @attention Called by beacon timer. Must be also called after beacon configuration is changed.
  */
 void BeaconCheck(void);
 
 /**
- * @brief Initialize beacon module
+ * @brief Schedule all beacons again, counting their delays from now, and restart beacon timer
+ * @attention Must be called after beacon is enabled or disabled or its interval or delay is changed
+ */
+void BeaconReschedule(void);
+
+/**
+ * @brief Get beacon statistics
+ * @param *stats Output statistics
+ */
+void BeaconGetStats(struct BeaconStats *stats);
+
+/**
+ * @brief Initialize beacon module and start beacon timer
+ * @details Beacons with the same delay and intervals that are multiples of each other are spread evenly across the shortest interval
  */
 void BeaconInit(void);
 
@@ -0,0 +1,60 @@
+/*
+Copyright 2020-2025 Piotr Wilkon
+
+This file is part of VP-Digi.
+
+VP-Digi is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+VP-Digi is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CHANNEL_H_
+#define CHANNEL_H_
+
+#include <stdint.h>
+
+enum ChannelWindow
+{
+	CHANNEL_WINDOW_1MIN = 0,
+	CHANNEL_WINDOW_5MIN,
+	CHANNEL_WINDOW_15MIN,
+
+	CHANNEL_WINDOW_COUNT
+};
+
+/**
+ * @brief Sample channel state (DCD and PTT)
+ * @attention Must be called from SysTick interrupt, once every tick
+ */
+void ChannelSample(void);
+
+/**
+ * @brief Get channel utilization (own transmissions included)
+ * @param window Averaging window
+ * @return Channel utilization in 0.1% units (0-1000)
+ */
+uint16_t ChannelGetUtilization(enum ChannelWindow window);
+
+/**
+ * @brief Get own transmitter duty cycle
+ * @param window Averaging window
+ * @return Duty cycle in 0.1% units (0-1000)
+ */
+uint16_t ChannelGetDutyCycle(enum ChannelWindow window);
+
+/**
+ * @brief Get time when the channel was last seen busy (DCD active)
+ * @return SysTick counter value (lower 32 bits)
+ */
+uint32_t ChannelGetLastBusy(void);
+
+#endif /* CHANNEL_H_ */
@@ -58,19 +58,43 @@ int16_t Random(int16_t min, int16_t max);
  */
 int64_t StrToInt(const char *str, uint16_t len);
 
-///**
-// * @brief Convert AX25 frame to TNC2 (readable) format
-// * @param *from Input AX25 frame
-// * @param len Input frame length
-// * @param *to Destination buffer, will be NULL terminated
-// * @param limit Destination buffer size limit
-// */
-//void ConvertToTNC2(uint8_t *from, uint16_t fromlen, uint8_t *to, uint16_t limit);
+/**
+ * @brief Convert signed number to decimal string
+ * @param n Number
+ * @param *out Output buffer, at least 11 bytes long. The string is not NULL terminated.
+ * @return Number of characters written
+ */
+uint8_t NumberToString(int32_t n, char *out);
+
+/**
+ * @brief Append NULL terminated string to buffer
+ * @param *dst Destination buffer
+ * @param index Destination buffer index to start at
+ * @param *src String to append
+ * @return Destination buffer index after the appended string
+ * @warning Destination buffer size is not checked
+ */
+uint16_t StrAppend(char *dst, uint16_t index, const char *src);
+
+#define TNC2_HEADER_MAX_SIZE 112 //source, destination and 8 path elements with separators
+
+/**
+ * @brief Convert AX25 frame header to TNC2 (readable) format
+ * @param *from Input AX25 frame
+ * @param len Input frame length
+ * @param *to Destination buffer, at least TNC2_HEADER_MAX_SIZE bytes long. The string is not NULL terminated.
+ * @param **info Pointer to information field in input frame or NULL if not an UI frame
+ * @param *infoLen Information field length
+ * @return Number of characters written (addresses with the ':' separator)
+ */
+uint16_t ConvertToTNC2(const uint8_t *from, uint16_t len, char *to, const uint8_t **info, uint16_t *infoLen);
 
 /**
  * @brief Convert AX25 frame to TNC2 (readable) format and send it through available ports
  * @param *from Input AX25 frame
  * @param len Input frame length
+ * @attention At most TERM_MONITOR_PREFIX_MAX_SIZE bytes may be sent before and only a line ending after this call,
+ * so that the whole line fits in the monitor queue.
  */
 void SendTNC2(uint8_t *from, uint16_t len);
 
@@ -38,18 +38,42 @@ struct _DigiConfig
 	uint8_t callFilter[20][7]; //callsign filter array
 	uint8_t callFilterEnable; //enable filter by call for every alias
 	uint8_t filterPolarity : 1; //filter polarity: 0 - blacklist, 1- whitelist
+	uint8_t throttle; //throttling under channel congestion enable for each alias
+	uint8_t loadLimit; //channel utilization (%) above which throttled aliases are restricted, 0 - disabled
 };
 
 extern struct _DigiConfig DigiConfig; //digipeater state
 
+/**
+ * @brief Digipeater decision for a received frame
+ */
+enum DigiResult
+{
+	DIGI_IGNORED = 0, //not processed: digipeater disabled, no path, path used up or no matching alias
+	DIGI_DIGIPEATED, //frame pushed to TX buffer
+	DIGI_DUPLICATE, //duplicate frame dropped
+	DIGI_FILTERED, //frame rejected by call filter or direct-only rule
+	DIGI_THROTTLED, //frame dropped because of channel congestion
+	DIGI_VISCOUS_HELD, //frame stored in viscous-delay buffer
+	DIGI_VISCOUS_CANCELLED, //frame digipeated by someone else, viscous-delayed copy dropped
+	DIGI_DROPPED, //no space in buffers, frame dropped
+};
+
+struct DigiStats
+{
+	uint32_t duplicates; //duplicate frames dropped
+	uint32_t viscousCancelled; //viscous-delayed frames dropped because digipeated by someone else
+};
+
 
 /**
  * @brief Digipeater entry point
  * @param[in] *frame Pointer to frame buffer
  * @param[in] len Frame length
+ * @return Decision taken for this frame
  * Decides whether the frame should be digipeated or not, processes it and pushes to TX buffer if needed
  */
-void DigiDigipeat(uint8_t *frame, uint16_t len);
+enum DigiResult DigiDigipeat(uint8_t *frame, uint16_t len);
 
 /**
  * @brief Store duplicate protection hash for frame
@@ -58,6 +82,20 @@ void DigiDigipeat(uint8_t *frame, uint16_t len);
  */
 void DigiStoreDeDupe(uint8_t *buf, uint16_t size);
 
+/**
+ * @brief Calculate duplicate protection hash for frame
+ * @param *buf Frame buffer
+ * @param size Frame size
+ * @return Frame hash or 0 if frame is malformed
+ */
+uint32_t DigiGetHash(uint8_t *buf, uint16_t size);
+
+/**
+ * @brief Store precalculated duplicate protection hash
+ * @param hash Frame hash
+ */
+void DigiStoreDeDupeHash(uint32_t hash);
+
 /**
  * @brief Initialize digipeater
  */
@@ -65,8 +103,14 @@ void DigiInitialize(void);
 
 /**
  * @brief Update internal digipeater state
- * @attention Should be called in main loop
+ * @details Called periodically by digipeater state timer
  */
 void DigiUpdateState(void);
 
+/**
+ * @brief Get digipeater statistics
+ * @param *stats Output statistics
+ */
+void DigiGetStats(struct DigiStats *stats);
+
 #endif /* DIGIPEATER_H_ */
@@ -27,7 +27,8 @@ along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "stm32f1xx.h"
 
-#define UART_LL_ENABLE(port) (port->CR1 |= USART_CR1_RXNEIE | USART_CR1_TE | USART_CR1_RE | USART_CR1_UE | USART_CR1_IDLEIE)
+//received bytes are handled by DMA, so only IDLE interrupt is used
+#define UART_LL_ENABLE(port) (port->CR1 |= USART_CR1_TE | USART_CR1_RE | USART_CR1_UE | USART_CR1_IDLEIE)
 #define UART_LL_DISABLE(port) (port->CR1 &= (~USART_CR1_RXNEIE) & (~USART_CR1_TE) & (~USART_CR1_RE) &  (~USART_CR1_UE) & (~USART_CR1_IDLEIE))
 
 #define UART_LL_CHECK_RX_NOT_EMPTY(port) (port->SR & USART_SR_RXNE)
@@ -45,6 +46,11 @@ along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
 #define UART_LL_PUT_DATA(port, data) (port->DR = (data))
 
 
+#define UART_LL_ENABLE_TX_DMA(port) (port->CR3 |= USART_CR3_DMAT)
+#define UART_LL_DISABLE_TX_DMA(port) (port->CR3 &= ~USART_CR3_DMAT)
+#define UART_LL_ENABLE_RX_DMA(port) (port->CR3 |= USART_CR3_DMAR)
+#define UART_LL_DISABLE_RX_DMA(port) (port->CR3 &= ~USART_CR3_DMAR)
+
 #define UART_LL_UART1_INTERUPT_HANDLER USART1_IRQHandler
 #define UART_LL_UART2_INTERUPT_HANDLER USART2_IRQHandler
 
@@ -54,6 +60,75 @@ along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
 #define UART_LL_UART1_IRQ USART1_IRQn
 #define UART_LL_UART2_IRQ USART2_IRQn
 
+/*
+ * UART TX is handled by DMA
+ * USART1 TX is connected to DMA1 channel 4, USART2 TX is connected to DMA1 channel 7
+ */
+#define UART_LL_UART1_TX_DMA_INTERRUPT_HANDLER DMA1_Channel4_IRQHandler
+#define UART_LL_UART2_TX_DMA_INTERRUPT_HANDLER DMA1_Channel7_IRQHandler
+
+#define UART_LL_UART1_TX_DMA_CHANNEL DMA1_Channel4
+#define UART_LL_UART2_TX_DMA_CHANNEL DMA1_Channel7
+
+#define UART_LL_UART1_TX_DMA_IRQ DMA1_Channel4_IRQn
+#define UART_LL_UART2_TX_DMA_IRQ DMA1_Channel7_IRQn
+
+#define UART_LL_UART1_TX_DMA_TRANSFER_COMPLETE_FLAG (DMA1->ISR & DMA_ISR_TCIF4)
+#define UART_LL_UART1_TX_DMA_CLEAR_TRANSFER_COMPLETE_FLAG() (DMA1->IFCR = DMA_IFCR_CTCIF4)
+#define UART_LL_UART2_TX_DMA_TRANSFER_COMPLETE_FLAG (DMA1->ISR & DMA_ISR_TCIF7)
+#define UART_LL_UART2_TX_DMA_CLEAR_TRANSFER_COMPLETE_FLAG() (DMA1->IFCR = DMA_IFCR_CTCIF7)
+
+#define UART_LL_TX_DMA_INITIALIZE(channel, port) do { \
+	RCC->AHBENR |= RCC_AHBENR_DMA1EN; \
+	channel->CCR &= ~DMA_CCR_EN; \
+	/* 8 bit memory and peripheral, memory to peripheral, memory pointer increment and interrupt generation */ \
+	channel->CCR = DMA_CCR_MINC | DMA_CCR_DIR | DMA_CCR_TCIE; \
+	channel->CPAR = (uintptr_t)&(port->DR); \
+} while(0); \
+
+#define UART_LL_TX_DMA_START(channel, buffer, size) do { \
+	channel->CCR &= ~DMA_CCR_EN; \
+	channel->CMAR = (uintptr_t)(buffer); \
+	channel->CNDTR = (size); \
+	channel->CCR |= DMA_CCR_EN; \
+} while(0); \
+
+#define UART_LL_TX_DMA_STOP(channel) (channel->CCR &= ~DMA_CCR_EN)
+
+/*
+ * UART RX is handled by DMA in circular mode
+ * USART1 RX is connected to DMA1 channel 5, USART2 RX is connected to DMA1 channel 6
+ */
+#define UART_LL_UART1_RX_DMA_INTERRUPT_HANDLER DMA1_Channel5_IRQHandler
+#define UART_LL_UART2_RX_DMA_INTERRUPT_HANDLER DMA1_Channel6_IRQHandler
+
+#define UART_LL_UART1_RX_DMA_CHANNEL DMA1_Channel5
+#define UART_LL_UART2_RX_DMA_CHANNEL DMA1_Channel6
+
+#define UART_LL_UART1_RX_DMA_IRQ DMA1_Channel5_IRQn
+#define UART_LL_UART2_RX_DMA_IRQ DMA1_Channel6_IRQn
+
+#define UART_LL_UART1_RX_DMA_TRANSFER_FLAG (DMA1->ISR & (DMA_ISR_HTIF5 | DMA_ISR_TCIF5))
+#define UART_LL_UART1_RX_DMA_CLEAR_TRANSFER_FLAG() (DMA1->IFCR = DMA_IFCR_CHTIF5 | DMA_IFCR_CTCIF5)
+#define UART_LL_UART2_RX_DMA_TRANSFER_FLAG (DMA1->ISR & (DMA_ISR_HTIF6 | DMA_ISR_TCIF6))
+#define UART_LL_UART2_RX_DMA_CLEAR_TRANSFER_FLAG() (DMA1->IFCR = DMA_IFCR_CHTIF6 | DMA_IFCR_CTCIF6)
+//number of half buffer boundaries passed (0-2), counted to detect overruns
+#define UART_LL_UART1_RX_DMA_HALVES_PASSED (((DMA1->ISR & DMA_ISR_HTIF5) ? 1 : 0) + ((DMA1->ISR & DMA_ISR_TCIF5) ? 1 : 0))
+#define UART_LL_UART2_RX_DMA_HALVES_PASSED (((DMA1->ISR & DMA_ISR_HTIF6) ? 1 : 0) + ((DMA1->ISR & DMA_ISR_TCIF6) ? 1 : 0))
+
+#define UART_LL_RX_DMA_INITIALIZE(channel, port, buffer, size) do { \
+	RCC->AHBENR |= RCC_AHBENR_DMA1EN; \
+	channel->CCR &= ~DMA_CCR_EN; \
+	/* 8 bit memory and peripheral, peripheral to memory, memory pointer increment, circular mode, half and full transfer interrupts */ \
+	channel->CCR = DMA_CCR_MINC | DMA_CCR_CIRC | DMA_CCR_HTIE | DMA_CCR_TCIE; \
+	channel->CPAR = (uintptr_t)&(port->DR); \
+	channel->CMAR = (uintptr_t)(buffer); \
+	channel->CNDTR = (size); \
+	channel->CCR |= DMA_CCR_EN; \
+} while(0); \
+
+#define UART_LL_RX_DMA_GET_REMAINING(channel) (channel->CNDTR)
+
 #define UART_LL_UART1_INITIALIZE_PERIPHERAL(baudrate) do { \
 	RCC->APB2ENR |= RCC_APB2ENR_IOPAEN; \
 	RCC->APB2ENR |= RCC_APB2ENR_USART1EN; \
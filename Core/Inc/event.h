@@ -0,0 +1,51 @@
+/*
+Copyright 2020-2025 Piotr Wilkon
+
+This file is part of VP-Digi.
+
+VP-Digi is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+VP-Digi is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EVENT_H_
+#define EVENT_H_
+
+#include <stdint.h>
+
+enum Event
+{
+	EVENT_FRAME_RECEIVED = 1 << 0, //AX.25 frame received by modem
+	EVENT_RX_DATA = 1 << 1, //data received on USB or UART (KISS frame or terminal line)
+	EVENT_OUTPUT = 1 << 2, //frame or monitor output queued by main loop, UART TX buffer drained or transmission finished, handle it in next pass
+	EVENT_TIMER = 1 << 3, //timer deadline reached
+};
+
+/**
+ * @brief Post event(s)
+ * @param events Bitmap of events from enum Event
+ * @attention Can be called from interrupts
+ */
+void EventPost(uint32_t events);
+
+/**
+ * @brief Get and clear all posted events
+ * @return Bitmap of posted events
+ */
+uint32_t EventGet(void);
+
+/**
+ * @brief Sleep until an interrupt occurs, unless there are events pending
+ */
+void EventSleep(void);
+
+#endif /* EVENT_H_ */
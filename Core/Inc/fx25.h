@@ -47,9 +47,30 @@ const struct Fx25Mode* Fx25GetModeForTag(uint64_t tag);
  * @brief Get FX.25 mode for given payload size
  * @param size Payload size including flags and CRC
  * @return FX.25 mode structure pointer or NULL if standard AX.25 must be used
+ * @details If adaptive mode is enabled, the smallest block whose expected number of byte errors is within the limit for its parity size is used
  */
 const struct Fx25Mode* Fx25GetModeForSize(uint16_t size);
 
+/**
+ * @brief Update channel quality estimate with received block
+ * @param errors Number of byte errors in the block
+ * @param *mode FX.25 mode of the block
+ * @attention Called from main loop only, once per received frame or block that no decoder could correct
+ */
+void Fx25UpdateChannelQuality(uint8_t errors, const struct Fx25Mode *mode);
+
+/**
+ * @brief Get channel quality estimate
+ * @return Average number of byte errors per received block, scaled to 255-byte block, in 1/256 units
+ */
+uint16_t Fx25GetChannelErrors(void);
+
+/**
+ * @brief Get parity size that adaptive mode uses for the biggest blocks with current channel quality
+ * @return Parity size (16, 32 or 64)
+ */
+uint8_t Fx25GetAdaptiveParity(void);
+
 /**
  * @brief Encode AX.25 message in FX.25
  * @param *buffer AX.25 message (bit-stuffed, with CRC and padding)
@@ -66,6 +87,30 @@ void Fx25Encode(uint8_t *buffer, const struct Fx25Mode *mode);
  */
 bool Fx25Decode(uint8_t *buffer, const struct Fx25Mode *mode, uint8_t *fixed);
 
+#ifdef ENABLE_PROFILING
+
+#define FX25_BENCH_ERROR_STEPS 5 //number of measured error counts: 0, T/8, T/4, 3T/8 and T/2
+
+struct Fx25BenchResult
+{
+	uint32_t encode; //encoding time in CPU cycles
+	uint32_t decode[FX25_BENCH_ERROR_STEPS]; //decoding time in CPU cycles for each error count
+	bool failed; //decoding failed or produced incorrect data
+};
+
+/**
+ * @brief Measure Reed-Solomon encoding and decoding time for FX.25 mode
+ * @param *mode FX.25 mode
+ * @param lwfec True to measure LwFEC, false to measure in-tree kernels
+ * @param *benchBuffer Work buffer, at least FX25_MAX_BLOCK_SIZE bytes long
+ * @param *result Output results
+ * @details Each measurement is repeated and the shortest time is taken, so that interrupts are not counted
+ * @attention Blocks for up to tens of milliseconds
+ */
+void Fx25Benchmark(const struct Fx25Mode *mode, bool lwfec, uint8_t *benchBuffer, struct Fx25BenchResult *result);
+
+#endif
+
 /**
  * @brief Initialize FX.25 module
  */
@@ -0,0 +1,89 @@
+/*
+Copyright 2020-2025 Piotr Wilkon
+
+This file is part of VP-Digi.
+
+VP-Digi is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+VP-Digi is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef IL2P_H_
+#define IL2P_H_
+
+#ifdef ENABLE_IL2P
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define IL2P_SYNC_WORD 0xF15E48 //24-bit sync word, sent MSB first
+#define IL2P_PREAMBLE 0x55 //byte sent before each sync word
+#define IL2P_HEADER_SIZE 13 //header size without parity
+#define IL2P_HEADER_PARITY 2 //header parity size
+#define IL2P_ENCODED_HEADER_SIZE (IL2P_HEADER_SIZE + IL2P_HEADER_PARITY)
+#define IL2P_MAX_PAYLOAD_SIZE 1023 //max payload size that fits in the header
+#define IL2P_CRC_SIZE 4 //trailing CRC size
+
+/**
+ * @brief Encode AX.25 frame in IL2P
+ * @param *frame AX.25 frame without CRC
+ * @param size Frame size
+ * @param *buffer Output buffer for header, payload and parity (sync word not included)
+ * @param bufferSize Output buffer size
+ * @return Encoded frame size or 0 if the frame does not fit in the buffer
+ * @details Transparent (type 0) header and max FEC are always used
+ */
+uint16_t Il2pEncode(const uint8_t *frame, uint16_t size, uint8_t *buffer, uint16_t bufferSize);
+
+/**
+ * @brief Decode/fix IL2P header
+ * @param *header Received header with parity, descrambled header is stored in place
+ * @param *encodedSize Output payload size with parity, that is number of bytes following the header
+ * @param *fixed Number of bytes fixed
+ * @return True if header is valid, false if uncorrectable or not supported
+ */
+bool Il2pDecodeHeader(uint8_t *header, uint16_t *encodedSize, uint8_t *fixed);
+
+/**
+ * @brief Decode/fix IL2P payload and rebuild AX.25 frame
+ * @param *header Header decoded with Il2pDecodeHeader()
+ * @param *buffer Received payload with parity, AX.25 frame (without CRC) is stored in place
+ * @param bufferSize Buffer size
+ * @param *size Output frame size
+ * @param *fixed Number of bytes fixed
+ * @return True if frame is valid, false if uncorrectable or does not fit in the buffer
+ */
+bool Il2pDecode(const uint8_t *header, uint8_t *buffer, uint16_t bufferSize, uint16_t *size, uint8_t *fixed);
+
+/**
+ * @brief Encode trailing IL2P CRC
+ * @param crc AX.25 frame check sequence of the frame
+ * @param *buffer Output buffer for IL2P_CRC_SIZE bytes
+ */
+void Il2pEncodeCrc(uint16_t crc, uint8_t *buffer);
+
+/**
+ * @brief Decode trailing IL2P CRC
+ * @param *buffer Received IL2P_CRC_SIZE bytes
+ * @return AX.25 frame check sequence
+ * @details A single bit error in each byte is corrected
+ */
+uint16_t Il2pDecodeCrc(const uint8_t *buffer);
+
+/**
+ * @brief Initialize IL2P module
+ */
+void Il2pInit(void);
+
+#endif
+
+#endif /* IL2P_H_ */
@@ -28,6 +28,8 @@ along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
  * @param *port UART structure
  * @param *buf Frame buffer
  * @param size Frame size
+ * @details Never waits for UART TX buffer space. The part of the frame that does not fit is sent later by KissHandleAck().
+ * Only one frame can be pending, further frames that do not fit are dropped and counted in txOverflow.
  */
 void KissSend(Uart *port, uint8_t *buf, uint16_t size);
 
@@ -38,5 +40,18 @@ void KissSend(Uart *port, uint8_t *buf, uint16_t size);
  */
 void KissParse(Uart *port, uint8_t data);
 
+/**
+ * @brief Drop KISS frame being received and ignore data up to the next frame end
+ * @param *port UART structure
+ * @details Used when received data was lost. The drop is counted and ACKMODE frame is refused.
+ */
+void KissResync(Uart *port);
+
 void KissProcess(Uart *port);
+
+/**
+ * @brief Send pending KISS frame remainder, ACKMODE acknowledgments for transmitted frames and requested statistics to KISS ports
+ * @attention Must be polled in main loop
+ */
+void KissHandleAck(void);
 #endif /* KISS_H_ */
@@ -95,6 +95,12 @@ enum ModemPrefilter ModemGetFilterType(uint8_t modem);
  */
 uint8_t ModemDcdState(void);
 
+/**
+ * @brief Get current PTT state
+ * @return 1 if transmitting (including TX test mode), 0 otherwise
+ */
+uint8_t ModemIsTransmitting(void);
+
 /**
  * @brief Check if there is a TX test mode enabled
  * @return 1 if in TX test mode, 0 otherwise
@@ -0,0 +1,121 @@
+/*
+Copyright 2020-2025 Piotr Wilkon
+
+This file is part of VP-Digi.
+
+VP-Digi is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+VP-Digi is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stdint.h>
+
+enum ProfileZone
+{
+	PROFILE_MODEM_RX = 0, //demodulator DMA interrupt
+	PROFILE_MODEM_DAC, //DAC/PWM sample interrupt
+	PROFILE_MODEM_BAUD, //TX baudrate timer interrupt
+	PROFILE_UART, //UART and UART DMA interrupts
+	PROFILE_USB, //USB interrupt
+	PROFILE_MAIN, //single main loop pass (interrupts included, sleep excluded)
+
+	PROFILE_ZONE_COUNT
+};
+
+struct ProfileStats
+{
+	uint32_t count; //number of calls
+	uint32_t min, max; //min and max duration in CPU cycles
+	uint64_t sum; //total duration in CPU cycles
+};
+
+#ifdef ENABLE_PROFILING
+
+#include "systick.h"
+
+/**
+ * @brief Start measuring zone duration
+ * @param zone Zone (enum ProfileZone)
+ * @attention Must be placed in the same scope as PROFILE_END()
+ */
+#define PROFILE_BEGIN(zone) uint32_t profileStart_##zone = SysTickGetCycles()
+
+/**
+ * @brief Finish measuring zone duration
+ * @param zone Zone (enum ProfileZone)
+ */
+#define PROFILE_END(zone) ProfileRecord(zone, SysTickGetCycles() - profileStart_##zone)
+
+/**
+ * @brief Store zone duration
+ * @param zone Zone
+ * @param cycles Duration in CPU cycles
+ */
+/**
+ * @brief Paint unused RAM between static data and the stack with a known pattern
+ * @attention Must be called at the very beginning of main()
+ */
+void ProfileInit(void);
+
+void ProfileRecord(enum ProfileZone zone, uint32_t cycles);
+
+/**
+ * @brief Store time spent sleeping
+ * @param cycles Duration in CPU cycles
+ * @attention Must be called with interrupts disabled
+ */
+void ProfileIdle(uint32_t cycles);
+
+/**
+ * @brief Update CPU load
+ * @attention Must be called from SysTick interrupt, once every tick
+ */
+void ProfileTick(void);
+
+/**
+ * @brief Get zone statistics
+ * @param zone Zone
+ * @param *stats Output statistics
+ */
+void ProfileGetStats(enum ProfileZone zone, struct ProfileStats *stats);
+
+/**
+ * @brief Get CPU load
+ * @param *current CPU load in the last second in 0.1% units
+ * @param *peak Peak CPU load in 0.1% units
+ */
+void ProfileGetLoad(uint16_t *current, uint16_t *peak);
+
+/**
+ * @brief Clear all statistics
+ */
+void ProfileClear(void);
+
+/**
+ * @brief Get stack high-water mark since reset
+ * @param *used Max stack size used so far in bytes (including interrupts)
+ * @param *reserved Stack size reserved by the linker script in bytes
+ * @param *available RAM available for the stack in bytes (from the end of static data)
+ */
+void ProfileGetStack(uint32_t *used, uint32_t *reserved, uint32_t *available);
+
+#else
+
+#define PROFILE_BEGIN(zone)
+#define PROFILE_END(zone)
+
+#endif
+
+#endif /* PROFILE_H_ */
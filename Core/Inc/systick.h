@@ -29,12 +29,30 @@ along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
  */
 void SysTickInit(void);
 
+/**
+ * @brief Increment SysTick counter
+ * @attention Must be called from SysTick interrupt only
+ */
+void SysTickIncrement(void);
+
 /**
  * @brief Get current SysTick counter value
- * @return Current SysTick counter value
+ * @return Lower 32 bits of SysTick counter. Wraps around after ~497 days, so use only for time differences.
  */
 uint32_t SysTickGet(void);
 
+/**
+ * @brief Get current SysTick counter value as monotonic 64-bit time base
+ * @return Current SysTick counter value
+ */
+uint64_t SysTickGet64(void);
+
+/**
+ * @brief Get CPU cycle counter value (DWT CYCCNT)
+ * @return Free-running cycle counter. Wraps around after ~60 s at 72 MHz, so use only for time differences.
+ */
+uint32_t SysTickGetCycles(void);
+
 /**
  * @brief Execute a blocking delay
  * @param ms Time in milliseconds
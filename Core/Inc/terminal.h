@@ -23,11 +23,18 @@ along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
 #include "uart.h"
 #include <stdint.h>
 
+#define TERM_MONITOR_PREFIX_MAX_SIZE 100 //max size of text sent before a frame in the same monitor line
+//TNC2 text of a frame is longer than the frame by at most 4 characters for each of the 10 addresses
+#define TERM_MONITOR_LINE_MAX_SIZE (TERM_MONITOR_PREFIX_MAX_SIZE + AX25_FRAME_MAX_SIZE + 40 + 2) //prefix, frame in TNC2 format and line ending
+#define TERM_MONITOR_BUFFER_SIZE (TERM_MONITOR_LINE_MAX_SIZE + 1) //monitor output queue size, shared by all ports, fits the longest line
+
 /**
  * @brief Send data to all available ports
  * @param mode Output mode/data type
  * @param *data Data buffer
  * @param size Data size
+ * @attention Monitor output is only queued and sent later by TermHandleMonitor().
+ * If a port falls behind, its oldest queued messages (lines) are dropped.
  */
 void TermSendToAll(enum UartMode mode, uint8_t *data, uint16_t size);
 
@@ -38,6 +45,12 @@ void TermSendToAll(enum UartMode mode, uint8_t *data, uint16_t size);
  */
 void TermSendNumberToAll(enum UartMode mode, int32_t n);
 
+/**
+ * @brief Send queued monitor output to ports in monitor mode
+ * @attention Must be polled in main loop
+ */
+void TermHandleMonitor(void);
+
 
 /**
  * @brief Handle "special" terminal cases like backspace or local echo
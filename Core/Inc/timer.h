@@ -0,0 +1,84 @@
+/*
+Copyright 2020-2025 Piotr Wilkon
+
+This file is part of VP-Digi.
+
+VP-Digi is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+VP-Digi is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TIMER_H_
+#define TIMER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TIMER_MAX_COUNT 8 //max number of simultaneously running timers
+#define TIMER_INACTIVE 0xFF
+
+struct Timer
+{
+	uint64_t deadline; //expiry time in SysTick ticks
+	void (*callback)(void); //called from main loop on expiry
+	uint8_t index; //position in deadline heap or TIMER_INACTIVE
+};
+
+/**
+ * @brief Static initializer for a timer
+ * @param cb Expiry callback
+ */
+#define TIMER_INIT(cb) {.deadline = 0, .callback = (cb), .index = TIMER_INACTIVE}
+
+/**
+ * @brief Start or restart timer
+ * @param *t Timer
+ * @param delay Delay in SysTick ticks, 0 to expire in next main loop pass
+ * @return True on success, false if there are too many running timers
+ */
+bool TimerStart(struct Timer *t, uint32_t delay);
+
+/**
+ * @brief Start or restart timer with absolute deadline
+ * @param *t Timer
+ * @param deadline Expiry time in SysTick ticks (see SysTickGet64())
+ * @return True on success, false if there are too many running timers
+ */
+bool TimerStartAt(struct Timer *t, uint64_t deadline);
+
+/**
+ * @brief Stop timer
+ * @param *t Timer
+ * @details Callback of a timer that has already expired is not called, even if called from another timer callback
+ */
+void TimerStop(struct Timer *t);
+
+/**
+ * @brief Check if timer is running
+ * @param *t Timer
+ * @return True if running
+ */
+bool TimerIsActive(struct Timer *t);
+
+/**
+ * @brief Check if the nearest deadline has been reached and post timer event if so
+ * @attention Must be called from SysTick interrupt, after the counter is incremented
+ */
+void TimerCheck(void);
+
+/**
+ * @brief Call callbacks of all expired timers
+ * @attention Must be called from main loop when timer event is posted
+ */
+void TimerProcess(void);
+
+#endif /* TIMER_H_ */
@@ -0,0 +1,97 @@
+/*
+Copyright 2020-2025 Piotr Wilkon
+
+This file is part of VP-Digi.
+
+VP-Digi is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+VP-Digi is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+
+//frame processing stages, in pipeline order
+enum TraceStage
+{
+	TRACE_STAGE_RX = 0, //frame decoded (final flag detected)
+	TRACE_STAGE_HANDLE, //frame taken from RX buffer by main loop
+	TRACE_STAGE_DIGI, //frame passed to digipeater
+	TRACE_STAGE_QUEUE, //frame stored in TX queue
+	TRACE_STAGE_KEYUP, //transmitter keyed up (or already on air when frame was queued)
+	TRACE_STAGE_AIR, //frame transmission started
+
+	TRACE_STAGE_COUNT
+};
+
+#define TRACE_NONE 0 //no trace record
+#define TRACE_BUCKET_COUNT 14 //latency histogram buckets: <256 us, <512 us, ... , >=1.05 s
+#define TRACE_BUCKET_MIN_US 256 //upper bound of the first bucket
+
+#ifdef ENABLE_TRACE
+
+/**
+ * @brief Start trace record for a received frame and stamp TRACE_STAGE_RX
+ * @return Trace record ID
+ * @attention Called from interrupt
+ */
+uint16_t TraceStart(void);
+
+/**
+ * @brief Stamp frame processing stage
+ * @param id Trace record ID, TRACE_NONE is ignored
+ * @param stage Stage reached. Stamping TRACE_STAGE_AIR completes the record.
+ */
+void TraceStamp(uint16_t id, enum TraceStage stage);
+
+/**
+ * @brief Store transmitter key-up time
+ */
+void TraceKeyUp(void);
+
+/**
+ * @brief Set ID of the frame being processed by main loop
+ * @param id Trace record ID or TRACE_NONE
+ */
+void TraceSetCurrent(uint16_t id);
+
+/**
+ * @brief Get ID of the frame being processed by main loop
+ * @return Trace record ID or TRACE_NONE
+ */
+uint16_t TraceGetCurrent(void);
+
+/**
+ * @brief Get latency histogram
+ * @param stage Histogram of latency from the previous stage to this one. TRACE_STAGE_RX for the total RX to air latency.
+ * @param *buckets Output buffer for TRACE_BUCKET_COUNT bucket counts
+ */
+void TraceGetHistogram(enum TraceStage stage, uint16_t *buckets);
+
+/**
+ * @brief Clear all histograms
+ */
+void TraceClear(void);
+
+#else
+
+static inline uint16_t TraceStart(void) {return TRACE_NONE;}
+static inline void TraceStamp(uint16_t id, enum TraceStage stage) {}
+static inline void TraceKeyUp(void) {}
+static inline void TraceSetCurrent(uint16_t id) {}
+static inline uint16_t TraceGetCurrent(void) {return TRACE_NONE;}
+
+#endif
+
+#endif /* TRACE_H_ */
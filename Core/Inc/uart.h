@@ -26,6 +26,15 @@ along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
 #include "drivers/uart_ll.h"
 
 #define UART_BUFFER_SIZE 130
+#define UART_TX_BUFFER_SIZE 128 //UART1 and UART2 TX ring size, longer KISS frames are sent in parts as the ring drains
+#define UART_RX_DMA_BUFFER_SIZE 128 //UART1 and UART2 circular RX DMA buffer size
+
+//received KISS frames are stored contiguously and the buffer holds one frame of max size, so each frame is processed
+//before the next one is received: UART data is parsed in the main loop, which processes a frame as soon as it is complete,
+//and USB reception is held (the host is NAKed) until the frame is processed. Frames that do not fit anyway
+//(e.g. after a receive overrun) are dropped and counted (kissDropped), ACKMODE frames are refused with NAK
+#define UART_KISS_BUFFER_SIZE (AX25_FRAME_MAX_SIZE + 3) //must fit a frame of max size with KISS command and ACKMODE sequence number
+#define UART_KISS_FRAME_COUNT 4 //max number of received KISS frames waiting for processing
 
 enum UartMode
 {
@@ -42,26 +51,52 @@ enum UartDataType
 	DATA_USB,
 };
 
+struct UartKissFrame
+{
+	uint16_t start; //frame start index in KISS buffer
+	uint16_t size; //frame size including KISS command
+};
+
 typedef struct
 {
 	volatile USART_TypeDef *port; //UART peripheral
+	volatile DMA_Channel_TypeDef *txDma; //TX DMA channel
+	volatile DMA_Channel_TypeDef *rxDma; //RX DMA channel
+	uint8_t *rxDmaBuffer; //circular RX DMA buffer, NULL for USB
+	uint16_t rxDmaTail; //next byte to be processed in RX DMA buffer
+	uint32_t rxDmaRead; //number of bytes processed since RX DMA start
+	volatile uint32_t rxDmaHalves; //number of RX DMA half and full transfers since RX DMA start
+	uint32_t rxOverrun; //number of times unprocessed data in RX DMA buffer was overwritten
+	volatile uint8_t rxEvent; //RX DMA half/full transfer or line idle occurred
+	volatile uint8_t rxIdle; //line idle occurred
 	uint32_t baudrate; //baudrate 1200-115200
 	volatile enum UartDataType rxType; //rx status
 	uint8_t enabled : 1;
 	uint8_t isUsb : 1;
 	volatile uint8_t rxBuffer[UART_BUFFER_SIZE];
 	volatile uint16_t rxBufferHead;
-	uint8_t txBuffer[UART_BUFFER_SIZE];
+	uint8_t *txBuffer; //TX ring, NULL for USB
 	volatile uint16_t txBufferHead, txBufferTail;
-	volatile uint8_t txBufferFull : 1;
+	volatile uint16_t txDmaSize; //number of bytes being transmitted by DMA, 0 if DMA is idle
+	volatile uint32_t txOverflow; //number of bytes dropped because TX ring was full
 	enum UartMode mode;
 	enum UartMode defaultMode;
 	volatile uint16_t lastRxBufferHead; //for special characters handling
-	volatile uint8_t kissBuffer[AX25_FRAME_MAX_SIZE + 1];
-	volatile uint16_t kissBufferHead;
-	volatile uint8_t kissProcessingOngoing;
-	volatile uint8_t kissTempBuffer[10];
-	volatile uint16_t kissTempBufferHead;
+	volatile uint8_t kissBuffer[UART_KISS_BUFFER_SIZE]; //unescaped KISS frames, each stored contiguously
+	volatile uint16_t kissRxStart; //start index of KISS frame being received
+	volatile uint16_t kissRxSize; //size of KISS frame being received
+	volatile uint8_t kissRxDrop; //KISS frame being received does not fit and will be dropped
+	volatile uint8_t kissRxEscape; //last byte received was frame escape
+	volatile uint8_t kissRxHeader[3]; //command and ACKMODE sequence number of KISS frame being received
+	volatile uint8_t kissRxHeaderSize;
+	volatile uint8_t kissFrameFull;
+	struct UartKissFrame kissFrame[UART_KISS_FRAME_COUNT]; //queue of received KISS frames
+	volatile uint8_t kissFrameHead, kissFrameTail;
+	volatile uint32_t kissDropped; //number of KISS frames dropped because of no space
+	uint32_t kissRxFrames; //number of KISS data frames received from host
+	uint32_t kissTxFrames; //number of KISS data frames sent to host
+	volatile uint32_t rxBytes; //number of bytes received
+	uint32_t txBytes; //number of bytes sent
 } Uart;
 
 extern Uart Uart1, Uart2, UartUsb;
@@ -71,6 +106,7 @@ extern Uart Uart1, Uart2, UartUsb;
  * @brief Send byte
  * @param[in] *port UART
  * @param[in] data Data
+ * @attention Blocks until there is space in TX buffer
  */
 void UartSendByte(Uart *port, uint8_t data);
 
@@ -79,6 +115,7 @@ void UartSendByte(Uart *port, uint8_t data);
  * @param *port UART
  * @param *data Buffer
  * @param len Buffer length or 0 for null-terminated string
+ * @attention Blocks until all data is stored in TX buffer
  */
 void UartSendString(Uart *port, void *data, uint16_t datalen);
 
@@ -86,9 +123,33 @@ void UartSendString(Uart *port, void *data, uint16_t datalen);
  * @brief Send signed number
  * @param *port UART
  * @param n Number
+ * @attention Blocks until all data is stored in TX buffer
  */
 void UartSendNumber(Uart *port, int32_t n);
 
+/**
+ * @brief Write data to TX buffer without blocking
+ * @param *port UART
+ * @param *data Buffer
+ * @param len Buffer length or 0 for null-terminated string
+ * @return Number of bytes actually written. Remaining bytes are dropped and counted in txOverflow.
+ */
+uint16_t UartWrite(Uart *port, const void *data, uint16_t len);
+
+/**
+ * @brief Write signed number to TX buffer without blocking
+ * @param *port UART
+ * @param n Number
+ * @return Number of bytes actually written
+ */
+uint16_t UartWriteNumber(Uart *port, int32_t n);
+
+/**
+ * @brief Get free space in TX buffer
+ * @param *port UART
+ * @return Number of bytes that can be written without blocking
+ */
+uint16_t UartGetTxFree(Uart *port);
 
 /**
  * @brief Initialize UART structures
@@ -105,6 +166,15 @@ void UartInit(Uart *port, USART_TypeDef *uart, uint32_t baud);
  */
 void UartConfig(Uart *port, uint8_t state);
 
+/**
+ * @brief Process bytes received by RX DMA (KISS and terminal handling)
+ * @param *port UART port
+ * @details If unprocessed data was overwritten, it is discarded, the overrun is counted
+ * and the KISS frame being received is dropped
+ * @attention Must be polled in main loop
+ */
+void UartHandleRx(Uart *port);
+
 /**
  * @brief Clear RX buffer and flags
  * @param *port UART port
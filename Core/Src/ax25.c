@@ -26,23 +26,30 @@ along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
 #include <string.h>
 #include "systick.h"
 #include "digipeater.h"
+#include "event.h"
+#include "timer.h"
+#include "channel.h"
+#include "trace.h"
 
 struct Ax25ProtoConfig Ax25Config;
 
 #ifdef ENABLE_FX25
 #include "fx25.h"
 #endif
+#ifdef ENABLE_IL2P
+#include "il2p.h"
+#endif
 
-#define FRAME_MAX_COUNT (10) //max count of frames in buffer
+#define FRAME_MAX_COUNT (8) //max count of frames in buffer
 #define FRAME_BUFFER_SIZE (FRAME_MAX_COUNT * AX25_FRAME_MAX_SIZE) //circular frame buffer length
 
 #define STATIC_HEADER_FLAG_COUNT 4 //number of flags sent before each frame
 #define STATIC_FOOTER_FLAG_COUNT 8 //number of flags sent after each frame
 
-#define MAX_TRANSMIT_RETRY_COUNT 8 //max number of retries if channel is busy
-
 #define SYNC_BYTE 0x7E //preamble/postamble octet
 
+#define FEC_BUFFER_SIZE 255 //FX.25 block or IL2P frame
+
 struct FrameHandle
 {
 	uint16_t start;
@@ -54,6 +61,9 @@ struct FrameHandle
 #ifdef ENABLE_FX25
 	struct Fx25Mode *fx25Mode;
 #endif
+#ifdef ENABLE_TRACE
+	uint16_t trace; //trace record ID
+#endif
 };
 
 static uint8_t rxBuffer[FRAME_BUFFER_SIZE]; //circular buffer for received frames
@@ -62,19 +72,71 @@ static struct FrameHandle rxFrame[FRAME_MAX_COUNT];
 static uint8_t rxFrameHead = 0;
 static uint8_t rxFrameTail = 0;
 static bool rxFrameBufferFull = false;
+static uint32_t rxDropped = 0; //frames dropped because RX buffer was full
 
-static uint8_t txBuffer[FRAME_BUFFER_SIZE];  //circular TX frame buffer
-static uint16_t txBufferHead = 0; //circular TX buffer write index
-static uint16_t txBufferTail = 0;
-static struct FrameHandle txFrame[FRAME_MAX_COUNT];
-static uint8_t txFrameHead = 0;
-static uint8_t txFrameTail = 0;
-static bool txFrameBufferFull = false;
+static uint8_t txBuffer[FRAME_BUFFER_SIZE];  //TX frame buffer, split between TX classes
 
+//TX buffer share of each class in 1/10 of the buffer: digipeater, host (KISS), beacon
+static const uint8_t txClassBufferShare[AX25_TX_CLASS_COUNT] = {4, 4, 2};
+//weights for weighted scheduling (frames per round): digipeater, host (KISS), beacon
+static const uint8_t txClassWeight[AX25_TX_CLASS_COUNT] = {4, 2, 1};
+
+#define TX_QUEUE_FRAME_COUNT (6) //max count of frames in each TX class queue
+
+struct TxFrameHandle
+{
+	uint16_t start;
+	uint16_t size;
+	uint32_t timestamp; //tick when frame was queued
+	uint32_t ackTag; //tag reported after transmission, 0 if not needed
+#ifdef ENABLE_FX25
+	const struct Fx25Mode *fx25Mode;
+#endif
+#ifdef ENABLE_IL2P
+	bool il2p; //frame is encoded in IL2P
+#endif
+#ifdef ENABLE_TRACE
+	uint16_t trace; //trace record ID of the received frame this frame originates from
+#endif
+};
+
+struct TxQueue
+{
+	uint8_t *buffer; //circular buffer for this class (part of txBuffer)
+	uint16_t bufferSize;
+	uint16_t bufferHead; //circular buffer write index
+	uint16_t bufferTail; //circular buffer read index
+	struct TxFrameHandle frame[TX_QUEUE_FRAME_COUNT];
+	uint8_t frameHead;
+	uint8_t frameTail;
+	bool frameBufferFull;
+	struct Ax25TxQueueStats stats;
+};
+
+static struct TxQueue txQueue[AX25_TX_CLASS_COUNT];
+
+static struct TxFrameHandle *txCurrent = NULL; //frame being transmitted
+static enum Ax25TxClass txCurrentClass; //class of the frame being transmitted
+static enum Ax25TxClass txRoundClass = 0; //class being served in weighted scheduling
+static uint8_t txRoundCredit = 0; //frames left for the class being served in weighted scheduling
+static uint8_t txFramesElapsed = 0; //frames transmitted during current transmission
+static uint32_t txBytesElapsed = 0; //bytes transmitted during current transmission
+static uint32_t txMaxBytes = 0; //max number of bytes in a single transmission, 0 if unlimited
+
+#define TX_ACK_COUNT (8)
+static volatile uint32_t txAck[TX_ACK_COUNT]; //tags of transmitted frames waiting to be acknowledged
+static volatile uint8_t txAckHead = 0, txAckTail = 0;
+
+#if defined(ENABLE_FX25) || defined(ENABLE_IL2P)
+static uint8_t txFecBuffer[FEC_BUFFER_SIZE]; //encoded FX.25 or IL2P frame
+#endif
 #ifdef ENABLE_FX25
-static uint8_t txFx25Buffer[FX25_MAX_BLOCK_SIZE];
 static uint8_t txTagByteIdx = 0;
 #endif
+#ifdef ENABLE_IL2P
+static uint8_t txSyncByteIdx = 0; //IL2P preamble and sync word byte index
+static uint8_t txIl2pLastBit = 0; //last IL2P bit, used for reversing NRZI encoding
+#endif
 
 static uint8_t frameReceived; //a bitmap of receivers that received the frame
 
@@ -93,6 +155,10 @@ enum TxStage
 	//stages used in FX.25 mode additionally
 	TX_STAGE_CORRELATION_TAG,
 #endif
+#ifdef ENABLE_IL2P
+	//stages used in IL2P mode additionally
+	TX_STAGE_IL2P_SYNC,
+#endif
 };
 
 enum TxInitStage
@@ -111,8 +177,8 @@ static uint8_t txCrcByteIdx = 0; //currently transmitted byte of CRC
 static uint8_t txBitstuff = 0; //bit-stuffing counter
 static uint16_t txTailElapsed; //counter of TXTail bytes already sent
 static uint16_t txCrc = 0xFFFF; //current CRC
-static uint32_t txQuiet = 0; //quit time + current tick value
-static uint8_t txRetries = 0; //number of TX retries
+static void transmitCheck(void);
+static struct Timer txTimer = TIMER_INIT(transmitCheck); //quiet/slot time timer
 static enum TxInitStage txInitStage; //current TX initialization stage
 static enum TxStage txStage; //current TX stage
 
@@ -130,12 +196,27 @@ struct RxState
 	struct Fx25Mode *fx25Mode;
 	uint64_t tag; //received correlation tag
 #endif
+#ifdef ENABLE_IL2P
+	uint32_t il2pRaw; //received raw (not NRZI decoded) bits
+	uint8_t il2pHeader[IL2P_ENCODED_HEADER_SIZE]; //received IL2P header
+	uint8_t il2pHeaderIdx; //number of received IL2P header bytes, IL2P_ENCODED_HEADER_SIZE if not receiving header
+	uint8_t il2pBitIdx; //bit index in IL2P byte being received
+	uint8_t il2pFixed; //number of bytes fixed in IL2P header
+	uint16_t il2pSize; //expected IL2P payload size with parity
+#endif
+	struct Ax25RxStats stats; //reception statistics
 };
 
 static struct RxState rxState[MODEM_MAX_DEMODULATOR_COUNT];
 
 static uint16_t lastCrc = 0; //CRC of the last received frame. If not 0, a frame was successfully received
 static uint16_t rxMultiplexDelay = 0; //simple delay for decoder multiplexer to avoid receiving the same frame twice
+#ifdef ENABLE_FX25
+static struct FrameHandle *lastFrame = NULL; //handle of the last received frame, until it is read or the multiplexer delay elapses
+static uint8_t rxFx25FailedDelay = 0; //if not 0, FX.25 block could not be decoded and the multiplexer waits for the other decoders
+static const struct Fx25Mode *rxFx25FailedMode = NULL; //mode of failed block, T/2+1 byte errors are assumed
+static uint8_t rxFx25FailedCount = 0; //FX.25 blocks not decoded by any decoder, not yet counted in channel quality
+#endif
 
 static uint16_t txDelay; //number of TXDelay bytes to send
 static uint16_t txTail; //number of TXTail bytes to send
@@ -161,6 +242,25 @@ static void calculateCRC(uint8_t bit, uint16_t *crc)
     }
 }
 
+//CRC of a nibble, used for calculating CRC 4 bits at a time
+static const uint16_t crcNibble[16] =
+{
+	0x0000, 0x1081, 0x2102, 0x3183, 0x4204, 0x5285, 0x6306, 0x7387,
+	0x8408, 0x9489, 0xA50A, 0xB58B, 0xC60C, 0xD68D, 0xE70E, 0xF78F,
+};
+
+/**
+ * @brief Recalculate CRC for one byte
+ * @param byte Input byte
+ * @param crc Current CRC
+ * @return Updated CRC
+ */
+static uint16_t calculateCRCByte(uint8_t byte, uint16_t crc)
+{
+	crc = (crc >> 4) ^ crcNibble[(crc ^ byte) & 0xF];
+	return (crc >> 4) ^ crcNibble[(crc ^ (byte >> 4)) & 0xF];
+}
+
 uint8_t Ax25GetReceivedFrameBitmap(void)
 {
 	return frameReceived;
@@ -171,295 +271,559 @@ void Ax25ClearReceivedFrameBitmap(void)
 	frameReceived = 0;
 }
 
-#ifdef ENABLE_FX25
-static void removeLastFrameFromRxBuffer(void)
+#if defined(ENABLE_FX25) || defined(ENABLE_IL2P)
+/**
+ * @brief Check if decoded frame is allowed (APRS or non-APRS frames allowed)
+ * @param *frame Frame without CRC
+ * @param size Frame size
+ * @return True if allowed
+ */
+static bool isFrameAllowed(const uint8_t *frame, uint16_t size)
 {
-	rxBufferHead = rxFrame[rxFrameHead].start;
-	if(rxFrameHead == 0)
-		rxFrameHead = FRAME_MAX_COUNT - 1;
-	else
-		rxFrameHead--;
-	rxFrameBufferFull = false;
-}
-
+	uint16_t pathEnd = 0;
+	while((pathEnd < size) && !(frame[pathEnd] & 1))
+		pathEnd++;
 
+	return Ax25Config.allowNonAprs || (((pathEnd + 2) < size) && (frame[pathEnd + 1] == 0x03) && (frame[pathEnd + 2] == 0xF0));
+}
 
-static void *writeFx25Frame(uint8_t *data, uint16_t size)
+/**
+ * @brief Store frame decoded from linear buffer in RX buffer
+ * @param *frame Frame without CRC
+ * @param size Frame size
+ * @return Frame handle or NULL if there is no space left
+ */
+static struct FrameHandle* storeDecodedFrame(const uint8_t *frame, uint16_t size)
 {
-	//first calculate how big the frame can be
-	//this includes 2 flags, 2 CRC bytes and all bits added by bitstuffing
-	//bitstuffing occurs after 5 consecutive ones, so in worst scenario
-	//bits inserted by bitstuffing can occupy up to frame size / 5 additional bytes
-	//also add 1 in case there is a remainder when dividing
-	const struct Fx25Mode *fx25Mode = fx25Mode = Fx25GetModeForSize(size + 4 + (size / 5) + 1);
-	uint16_t requiredSize = size;
-	if(NULL != fx25Mode)
-		requiredSize = fx25Mode->K + fx25Mode->T;
-	else
-		return NULL; //frame will not fit in FX.25
-
-	uint16_t freeSize = GET_FREE_SIZE(FRAME_BUFFER_SIZE, txBufferHead, txBufferTail);
-	if(freeSize < requiredSize) //check if there is enough size to store full FX.25 (or AX.25) frame
+	if(rxFrameBufferFull)
 	{
-		return NULL; //if not, it may fit in standard AX.25
+		rxDropped++;
+		return NULL;
 	}
 
-	txFrame[txFrameHead].size = requiredSize;
-	txFrame[txFrameHead].start = txBufferHead;
-	txFrame[txFrameHead].fx25Mode = (struct Fx25Mode*)fx25Mode;
+	struct FrameHandle *h = &rxFrame[rxFrameHead];
+	h->start = rxBufferHead;
+	h->size = size;
 
-	memset(txFx25Buffer, 0, sizeof(txFx25Buffer));
+	//copy to circular buffer in at most two parts
+	uint16_t part = FRAME_BUFFER_SIZE - rxBufferHead;
+	if(part > size)
+		part = size;
+	memcpy(&rxBuffer[rxBufferHead], frame, part);
+	memcpy(rxBuffer, &frame[part], size - part);
+	rxBufferHead = (rxBufferHead + size) % FRAME_BUFFER_SIZE;
 
-	uint16_t index = 0;
-	//header flag
-	txFx25Buffer[index++] = 0x7E;
+	__disable_irq();
+	rxFrameHead++;
+	rxFrameHead %= FRAME_MAX_COUNT;
+	if(rxFrameHead == rxFrameTail)
+		rxFrameBufferFull = true;
+	__enable_irq();
 
-	uint16_t crc = 0xFFFF;
+	return h;
+}
+#endif
 
-	uint8_t bits = 0; //bit counter within a byte
-	uint8_t bitstuff = 0;
-	for(uint16_t i = 0; i < size + 2; i++)
-	{
-		for(uint8_t k = 0; k < 8; k++)
-		{
-			txFx25Buffer[index] >>= 1;
-			bits++;
-			if(i < size) //frame data
-			{
-				if((data[i] >> k) & 1)
-				{
-					calculateCRC(1, &crc);
-					bitstuff++;
-					txFx25Buffer[index] |= 0x80;
-				}
-				else
-				{
-					calculateCRC(0, &crc);
-					bitstuff = 0;
-				}
-			}
-			else //crc
-			{
-				uint8_t c = 0;
-				if(i == size)
-					c = (crc & 0xFF) ^ 0xFF;
-				else
-					c = (crc >> 8) ^ 0xFF;
+#ifdef ENABLE_FX25
+//bit stuffing information for each byte (sent LSB first):
+//0x80 if the byte contains 5 consecutive ones, otherwise number of trailing ones (sent first) in bits 0-3
+//and number of leading ones (sent last) in bits 4-7
+//bytes that contain no run of 5 ones together with the ones left from the previous byte can be processed at once
+static const uint8_t stuffInfo[256] =
+{
+	0x00, 0x01, 0x00, 0x02, 0x00, 0x01, 0x00, 0x03, 0x00, 0x01, 0x00, 0x02, 0x00, 0x01, 0x00, 0x04,
+	0x00, 0x01, 0x00, 0x02, 0x00, 0x01, 0x00, 0x03, 0x00, 0x01, 0x00, 0x02, 0x00, 0x01, 0x00, 0x80,
+	0x00, 0x01, 0x00, 0x02, 0x00, 0x01, 0x00, 0x03, 0x00, 0x01, 0x00, 0x02, 0x00, 0x01, 0x00, 0x04,
+	0x00, 0x01, 0x00, 0x02, 0x00, 0x01, 0x00, 0x03, 0x00, 0x01, 0x00, 0x02, 0x00, 0x01, 0x80, 0x80,
+	0x00, 0x01, 0x00, 0x02, 0x00, 0x01, 0x00, 0x03, 0x00, 0x01, 0x00, 0x02, 0x00, 0x01, 0x00, 0x04,
+	0x00, 0x01, 0x00, 0x02, 0x00, 0x01, 0x00, 0x03, 0x00, 0x01, 0x00, 0x02, 0x00, 0x01, 0x00, 0x80,
+	0x00, 0x01, 0x00, 0x02, 0x00, 0x01, 0x00, 0x03, 0x00, 0x01, 0x00, 0x02, 0x00, 0x01, 0x00, 0x04,
+	0x00, 0x01, 0x00, 0x02, 0x00, 0x01, 0x00, 0x03, 0x00, 0x01, 0x00, 0x02, 0x80, 0x80, 0x80, 0x80,
+	0x10, 0x11, 0x10, 0x12, 0x10, 0x11, 0x10, 0x13, 0x10, 0x11, 0x10, 0x12, 0x10, 0x11, 0x10, 0x14,
+	0x10, 0x11, 0x10, 0x12, 0x10, 0x11, 0x10, 0x13, 0x10, 0x11, 0x10, 0x12, 0x10, 0x11, 0x10, 0x80,
+	0x10, 0x11, 0x10, 0x12, 0x10, 0x11, 0x10, 0x13, 0x10, 0x11, 0x10, 0x12, 0x10, 0x11, 0x10, 0x14,
+	0x10, 0x11, 0x10, 0x12, 0x10, 0x11, 0x10, 0x13, 0x10, 0x11, 0x10, 0x12, 0x10, 0x11, 0x80, 0x80,
+	0x20, 0x21, 0x20, 0x22, 0x20, 0x21, 0x20, 0x23, 0x20, 0x21, 0x20, 0x22, 0x20, 0x21, 0x20, 0x24,
+	0x20, 0x21, 0x20, 0x22, 0x20, 0x21, 0x20, 0x23, 0x20, 0x21, 0x20, 0x22, 0x20, 0x21, 0x20, 0x80,
+	0x30, 0x31, 0x30, 0x32, 0x30, 0x31, 0x30, 0x33, 0x30, 0x31, 0x30, 0x32, 0x30, 0x31, 0x30, 0x34,
+	0x40, 0x41, 0x40, 0x42, 0x40, 0x41, 0x40, 0x43, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80,
+};
 
-				if((c >> k) & 1)
-				{
-					bitstuff++;
-					txFx25Buffer[index] |= 0x80;
-				}
-				else
-				{
-					bitstuff = 0;
-				}
-			}
+/**
+ * @brief Bit stream writer used for bit stuffing and unstuffing
+ */
+struct BitWriter
+{
+	uint8_t *buffer; //output buffer
+	uint16_t index; //number of complete bytes written
+	uint32_t bits; //bits not yet written, LSB first
+	uint8_t count; //number of bits not yet written
+	uint8_t ones; //number of consecutive ones
+};
 
-			if(bits == 8)
-			{
-				bits = 0;
-				index++;
-			}
-			if(bitstuff == 5)
-			{
-				bits++;
-				bitstuff = 0;
-				txFx25Buffer[index] >>= 1;
-				if(bits == 8)
-				{
-					bits = 0;
-					index++;
-				}
-			}
-		}
+/**
+ * @brief Write complete bytes to the output buffer
+ * @param *w Bit writer
+ */
+static inline void bitWriterFlush(struct BitWriter *w)
+{
+	while(w->count >= 8)
+	{
+		w->buffer[w->index++] = w->bits & 0xFF;
+		w->bits >>= 8;
+		w->count -= 8;
 	}
+}
 
-	//pad with flags
-	while(index < fx25Mode->K)
+/**
+ * @brief Write byte with bit stuffing
+ * @param *w Bit writer
+ * @param byte Input byte
+ */
+static void bitStuffByte(struct BitWriter *w, uint8_t byte)
+{
+	uint8_t info = stuffInfo[byte];
+	if(!(info & 0x80) && ((w->ones + (info & 0xF)) < 5)) //no stuffing needed, write whole byte
+	{
+		w->bits |= (uint32_t)byte << w->count;
+		w->count += 8;
+		w->ones = info >> 4; //byte contains a zero, so only leading ones are left
+	}
+	else
 	{
 		for(uint8_t k = 0; k < 8; k++)
 		{
-			txFx25Buffer[index] >>= 1;
-			bits++;
-
-			if((0x7E >> k) & 1)
+			if((byte >> k) & 1)
 			{
-				txFx25Buffer[index] |= 0x80;
+				w->bits |= (uint32_t)1 << w->count;
+				w->ones++;
 			}
-
-			if(bits == 8)
+			else
+				w->ones = 0;
+			w->count++;
+			if(w->ones == 5) //insert 0 after 5 ones
 			{
-				bits = 0;
-				index++;
+				w->ones = 0;
+				w->count++;
 			}
 		}
 	}
+	bitWriterFlush(w);
+}
+
+/**
+ * @brief Encode frame as FX.25 block into FX.25 TX buffer
+ * @param *data Frame data
+ * @param size Frame size
+ * @return FX.25 mode used or NULL if frame does not fit in FX.25
+ */
+static const struct Fx25Mode *encodeFx25Frame(uint8_t *data, uint16_t size)
+{
+	//first calculate how big the frame can be
+	//this includes 2 flags, 2 CRC bytes and all bits added by bitstuffing
+	//bitstuffing occurs after 5 consecutive ones, so in worst scenario
+	//bits inserted by bitstuffing can occupy up to frame size / 5 additional bytes
+	//also add 1 in case there is a remainder when dividing
+	const struct Fx25Mode *fx25Mode = Fx25GetModeForSize(size + 4 + (size / 5) + 1);
+	if(NULL == fx25Mode)
+		return NULL; //frame will not fit in FX.25
 
-	Fx25Encode(txFx25Buffer, fx25Mode);
+	struct BitWriter w = {.buffer = txFecBuffer, .index = 0, .bits = 0, .count = 0, .ones = 0};
 
-	for(uint16_t i = 0; i < (fx25Mode->K + fx25Mode->T); i++)
+	//header flag
+	txFecBuffer[w.index++] = 0x7E;
+
+	uint16_t crc = 0xFFFF;
+	for(uint16_t i = 0; i < size; i++)
 	{
-		txBuffer[txBufferHead++] = txFx25Buffer[i];
-		txBufferHead %= FRAME_BUFFER_SIZE;
+		crc = calculateCRCByte(data[i], crc);
+		bitStuffByte(&w, data[i]);
 	}
+	crc ^= 0xFFFF;
+	bitStuffByte(&w, crc & 0xFF);
+	bitStuffByte(&w, crc >> 8);
 
-	void *ret = &txFrame[txFrameHead];
-	txFrameHead++;
-	txFrameHead %= FRAME_MAX_COUNT;
-	if(txFrameHead == txFrameTail)
-		txFrameBufferFull = true;
-	return ret;
-}
-
-static struct FrameHandle* parseFx25Frame(uint8_t *frame, uint16_t size, uint16_t *crc)
-{
-	struct FrameHandle *h = &rxFrame[rxFrameHead];
-	uint16_t initialRxBufferHead = rxBufferHead;
-	if(!rxFrameBufferFull)
+	//pad with flags, every byte of the block is written, so the buffer does not need to be cleared
+	while(w.index < fx25Mode->K)
 	{
-		rxFrame[rxFrameHead++].start = rxBufferHead;
-		rxFrameHead %= FRAME_MAX_COUNT;
-		if(rxFrameHead == txFrameHead)
-			rxFrameBufferFull = true;
+		w.bits |= (uint32_t)0x7E << w.count;
+		w.count += 8;
+		bitWriterFlush(&w);
 	}
-	else
-		return NULL;
 
+	Fx25Encode(txFecBuffer, fx25Mode);
+
+	return fx25Mode;
+}
+
+/**
+ * @brief Remove bit stuffing and check decoded FX.25 frame
+ * @param *frame Decoded FX.25 block, used also as a linear output buffer
+ * @param size Block size
+ * @param *crc Output frame CRC
+ * @return Frame size without CRC or 0 if frame is incorrect
+ */
+static uint16_t parseFx25Frame(uint8_t *frame, uint16_t size, uint16_t *crc)
+{
 	uint16_t i = 0; //input data index
-	uint16_t k = 0; //output data size
-	while(frame[i] == 0x7E)
+	while((i < size) && (frame[i] == 0x7E))
 		i++;
 
-	uint8_t bitstuff = 0;
-	uint8_t outBit = 0;
+	//output is never longer than input, so the frame can be unstuffed in place
+	struct BitWriter w = {.buffer = frame, .index = 0, .bits = 0, .count = 0, .ones = 0};
 	for(; i < size; i++)
 	{
+		uint8_t byte = frame[i];
+		uint8_t info = stuffInfo[byte];
+		if(!(info & 0x80) && ((w.ones + (info & 0xF)) < 5)) //no stuffed bits and no flag, copy whole byte
+		{
+			w.bits |= (uint32_t)byte << w.count;
+			w.count += 8;
+			w.ones = info >> 4;
+			bitWriterFlush(&w);
+			continue;
+		}
+
 		for(uint8_t b = 0; b < 8; b++)
 		{
-			if(frame[i] & (1 << b))
+			if(byte & (1 << b))
 			{
-				rxBuffer[rxBufferHead] >>= 1;
-				rxBuffer[rxBufferHead] |= 0x80;
-				bitstuff++;
+				w.bits |= (uint32_t)1 << w.count;
+				w.ones++;
 			}
 			else
 			{
-				if(bitstuff == 5) //zero after 5 ones, normal bitstuffing
+				if(w.ones == 5) //zero after 5 ones, normal bitstuffing
 				{
-					bitstuff = 0;
+					w.ones = 0;
 					continue;
 				}
-				else if(bitstuff == 6) //zero after 6 ones, this is a flag
+				else if(w.ones == 6) //zero after 6 ones, this is a flag
 				{
 					goto endParseFx25Frame;
 				}
-				else if(bitstuff >= 7) //zero after 7 ones, illegal byte
+				else if(w.ones >= 7) //zero after 7 ones, illegal byte
 				{
-					removeLastFrameFromRxBuffer();
-					return NULL;
+					return 0;
 				}
-				bitstuff = 0;
-				rxBuffer[rxBufferHead] >>= 1;
-			}
-			outBit++;
-			if(outBit == 8)
-			{
-				k++;
-				rxBufferHead++;
-				rxBufferHead %= FRAME_BUFFER_SIZE;
-				outBit = 0;
+				w.ones = 0;
 			}
+			w.count++;
 		}
+		bitWriterFlush(&w);
 	}
 
 endParseFx25Frame:
+	bitWriterFlush(&w);
+	if(w.index <= 2)
+		return 0;
+
+	uint16_t k = w.index - 2; //frame size without CRC
 	*crc = 0xFFFF;
-	i = initialRxBufferHead;
+	for(uint16_t j = 0; j < k; j++)
+		*crc = calculateCRCByte(frame[j], *crc);
+	*crc ^= 0xFFFF;
 
-	for(uint16_t j = 0; j < (k - 2); j++)
-	{
-		for(uint8_t b = 0; b < 8; b++)
-			calculateCRC((rxBuffer[i] >> b) & 1, crc);
+	if((frame[k] != (*crc & 0xFF)) || (frame[k + 1] != ((*crc >> 8) & 0xFF))) //check CRC
+		return 0;
 
-		i++;
-		i %= FRAME_BUFFER_SIZE;
-	}
+	if(!isFrameAllowed(frame, k))
+		return 0;
+
+	return k;
+}
+#endif
 
+#ifdef ENABLE_IL2P
+/**
+ * @brief Decode received IL2P payload and store the frame in RX buffer
+ * @param *rx Demodulator RX state with IL2P header and payload received
+ * @param modem Demodulator number
+ */
+static void il2pFrameEnd(struct RxState *rx, uint8_t modem)
+{
+	uint16_t size;
+	uint8_t fixed;
+	uint16_t receivedCrc = 0;
+	if(Ax25Config.il2pCrc) //CRC follows the payload, so read it before the frame is decoded in place
+		receivedCrc = Il2pDecodeCrc(&rx->frame[rx->frameIdx - IL2P_CRC_SIZE]);
 
-	*crc ^= 0xFFFF;
-	if((rxBuffer[i] == (*crc & 0xFF) )
-		&& (rxBuffer[(i + 1) % FRAME_BUFFER_SIZE] == ((*crc >> 8) & 0xFF))) //check CRC
+	uint16_t crc = 0xFFFF;
+	if(Il2pDecode(rx->il2pHeader, rx->frame, AX25_FRAME_MAX_SIZE, &size, &fixed))
 	{
-		uint16_t pathEnd = initialRxBufferHead;
-		for(uint16_t j = 0; j < (k - 2); j++)
+		//AX.25 CRC is needed for multiplexing decoders even if IL2P CRC is not used
+		for(uint16_t i = 0; i < size; i++)
+			crc = calculateCRCByte(rx->frame[i], crc);
+		crc ^= 0xFFFF;
+	}
+	else
+		size = 0;
+
+	if((0 == size) || (Ax25Config.il2pCrc && (crc != receivedCrc))) //uncorrectable or miscorrected
+		rx->stats.il2pFailed++;
+	else if(isFrameAllowed(rx->frame, size))
+	{
+		fixed += rx->il2pFixed;
+		if(fixed > 0)
+			rx->stats.il2pCorrected++;
+		rx->stats.decoded++;
+		rx->frameReceived = 1;
+
+		if(crc != lastCrc) //the other decoder has not received this frame yet
 		{
-			if(rxBuffer[pathEnd] & 1)
-				break;
-			pathEnd++;
-			pathEnd %= FRAME_BUFFER_SIZE;
+			struct FrameHandle *h = storeDecodedFrame(rx->frame, size);
+			if(h != NULL)
+			{
+				ModemGetSignalLevel(modem, &h->peak, &h->valley, &h->level);
+				h->corrected = fixed;
+#ifdef ENABLE_FX25
+				h->fx25Mode = NULL;
+				lastFrame = h;
+#endif
+#ifdef ENABLE_TRACE
+				h->trace = TraceStart();
+#endif
+				lastCrc = crc;
+			}
 		}
+	}
+	rx->rx = RX_STAGE_IDLE;
+	rx->receivedByte = 0;
+	rx->receivedBitIdx = 0;
+	rx->frameIdx = 0;
+	rx->crc = 0xFFFF;
+}
+
+/**
+ * @brief Parse incoming bit as IL2P
+ * @param *rx Demodulator RX state
+ * @param bit Incoming bit (NRZI decoded)
+ * @param modem Demodulator number
+ * @return True if the bit belongs to IL2P payload and must not be parsed as AX.25
+ * @details The header is received alongside AX.25, so that a false sync word does not break AX.25 reception
+ */
+static bool il2pBitParse(struct RxState *rx, uint8_t bit, uint8_t modem)
+{
+	//IL2P does not use NRZI, so restore raw bits. The polarity is unknown, so it is fixed when the sync word is found
+	rx->il2pRaw = (rx->il2pRaw << 1) | ((rx->il2pRaw & 1) ^ (bit == 0));
+
+	if(rx->rx == RX_STAGE_IL2P_FRAME) //receiving payload
+	{
+		if(++rx->il2pBitIdx < 8)
+			return true;
+		rx->il2pBitIdx = 0;
+		rx->frame[rx->frameIdx++] = rx->il2pRaw & 0xFF;
+		if(rx->frameIdx == rx->il2pSize)
+			il2pFrameEnd(rx, modem);
+		return true;
+	}
 
-		if(Ax25Config.allowNonAprs || (((rxBuffer[(pathEnd + 1) % FRAME_BUFFER_SIZE] == 0x03) && (rxBuffer[(pathEnd + 2) % FRAME_BUFFER_SIZE] == 0xF0))))
+	if(rx->il2pHeaderIdx < IL2P_ENCODED_HEADER_SIZE) //receiving header
+	{
+		if(++rx->il2pBitIdx < 8)
+			return false;
+		rx->il2pBitIdx = 0;
+		rx->il2pHeader[rx->il2pHeaderIdx++] = rx->il2pRaw & 0xFF;
+		if((rx->il2pHeaderIdx == IL2P_ENCODED_HEADER_SIZE)
+				&& Il2pDecodeHeader(rx->il2pHeader, &rx->il2pSize, &rx->il2pFixed))
 		{
-			h->size = k - 2;
-			return h;
+			if(Ax25Config.il2pCrc)
+				rx->il2pSize += IL2P_CRC_SIZE;
+			if(rx->il2pSize > AX25_FRAME_MAX_SIZE)
+				return false;
+			rx->frameIdx = 0;
+			if(0 == rx->il2pSize) //header-only frame
+				il2pFrameEnd(rx, modem);
+			else
+				rx->rx = RX_STAGE_IL2P_FRAME;
+			return true;
 		}
+		return false;
 	}
 
-	removeLastFrameFromRxBuffer();
-	return NULL;
+	//accept sync word with at most 1 bit error in either polarity
+	uint32_t diff = (rx->il2pRaw ^ IL2P_SYNC_WORD) & 0xFFFFFF;
+	if((diff & (diff - 1)) != 0)
+	{
+		diff ^= 0xFFFFFF;
+		if((diff & (diff - 1)) != 0)
+			return false;
+		rx->il2pRaw = ~rx->il2pRaw; //inverted polarity, invert all following bits
+	}
+	rx->il2pHeaderIdx = 0;
+	rx->il2pBitIdx = 0;
+	return false;
 }
 #endif
 
-void *Ax25WriteTxFrame(uint8_t *data, uint16_t size)
+/**
+ * @brief Check if TX class queue is empty
+ * @param *q Queue
+ * @return True if empty
+ */
+static bool txQueueEmpty(const struct TxQueue *q)
 {
-	if(txFrameBufferFull)
+	return (q->frameHead == q->frameTail) && !q->frameBufferFull;
+}
+
+/**
+ * @brief Get number of frames in TX class queue
+ * @param *q Queue
+ * @return Number of frames
+ */
+static uint8_t txQueueDepth(const struct TxQueue *q)
+{
+	if(q->frameBufferFull)
+		return TX_QUEUE_FRAME_COUNT;
+	return (q->frameHead + TX_QUEUE_FRAME_COUNT - q->frameTail) % TX_QUEUE_FRAME_COUNT;
+}
+
+void *Ax25WriteTxFrame(uint8_t *data, uint16_t size, enum Ax25TxClass class)
+{
+	if(class >= AX25_TX_CLASS_COUNT)
 		return NULL;
 
+	struct TxQueue *q = &txQueue[class];
+	if(q->frameBufferFull)
+	{
+		q->stats.dropped++;
+		return NULL;
+	}
+
+	struct TxFrameHandle *h = &q->frame[q->frameHead];
+	uint8_t *source = data;
+	h->size = size;
+
+#ifdef ENABLE_IL2P
+	h->il2p = false;
+	if(Ax25Config.il2pTx)
+	{
+		//IL2P frame must fit in the buffer, otherwise FX.25 or standard AX.25 is used
+		uint16_t il2pSize = Il2pEncode(data, size, txFecBuffer, sizeof(txFecBuffer) - (Ax25Config.il2pCrc ? IL2P_CRC_SIZE : 0));
+		if((il2pSize > 0) && Ax25Config.il2pCrc)
+		{
+			uint16_t crc = 0xFFFF;
+			for(uint16_t i = 0; i < size; i++)
+				crc = calculateCRCByte(data[i], crc);
+			Il2pEncodeCrc(crc ^ 0xFFFF, &txFecBuffer[il2pSize]);
+			il2pSize += IL2P_CRC_SIZE;
+		}
+		if((il2pSize > 0) && (GET_FREE_SIZE(q->bufferSize, q->bufferHead, q->bufferTail) > il2pSize))
+		{
+			h->il2p = true;
+			h->size = il2pSize;
+			source = txFecBuffer;
+		}
+	}
+#endif
 #ifdef ENABLE_FX25
-	if(Ax25Config.fx25 && Ax25Config.fx25Tx)
+	h->fx25Mode = NULL;
+	if(Ax25Config.fx25 && Ax25Config.fx25Tx
+#ifdef ENABLE_IL2P
+		&& !h->il2p
+#endif
+		)
 	{
-		void *ret = writeFx25Frame(data, size);
-		if(ret)
-			return ret;
+		const struct Fx25Mode *fx25Mode = encodeFx25Frame(data, size);
+		//check if there is enough space to store full FX.25 frame, if not, it may fit in standard AX.25
+		if((NULL != fx25Mode) && (GET_FREE_SIZE(q->bufferSize, q->bufferHead, q->bufferTail) > (fx25Mode->K + fx25Mode->T)))
+		{
+			h->fx25Mode = fx25Mode;
+			h->size = fx25Mode->K + fx25Mode->T;
+			source = txFecBuffer;
+		}
 	}
 #endif
 
-	if(GET_FREE_SIZE(FRAME_BUFFER_SIZE, txBufferHead, txBufferTail) < size)
+	if(GET_FREE_SIZE(q->bufferSize, q->bufferHead, q->bufferTail) <= h->size)
 	{
+		q->stats.dropped++;
 		return NULL;
 	}
 
-	txFrame[txFrameHead].size = size;
-	txFrame[txFrameHead].start = txBufferHead;
-
-#ifdef ENABLE_FX25
-	txFrame[txFrameHead].fx25Mode = NULL;
+	h->start = q->bufferHead;
+	h->timestamp = SysTickGet();
+	h->ackTag = 0;
+#ifdef ENABLE_TRACE
+	h->trace = TraceGetCurrent(); //set only if the frame is queued while processing a received frame
+	TraceStamp(h->trace, TRACE_STAGE_QUEUE);
 #endif
 
-
-	for(uint16_t i = 0; i < size; i++)
+	for(uint16_t i = 0; i < h->size; i++)
 	{
-		txBuffer[txBufferHead++] = data[i];
-		txBufferHead %= FRAME_BUFFER_SIZE;
+		q->buffer[q->bufferHead++] = source[i];
+		q->bufferHead %= q->bufferSize;
 	}
 
+	__disable_irq();
+	q->frameHead++;
+	q->frameHead %= TX_QUEUE_FRAME_COUNT;
+	if(q->frameHead == q->frameTail)
+		q->frameBufferFull = true;
+	uint8_t depth = txQueueDepth(q);
+	if(depth > q->stats.maxDepth)
+		q->stats.maxDepth = depth;
+	__enable_irq();
+	EventPost(EVENT_OUTPUT);
+	return h;
+}
 
-	void *ret = &txFrame[txFrameHead];
+void Ax25SetTxFrameAckTag(void *handle, uint32_t tag)
+{
 	__disable_irq();
-	txFrameHead++;
-	txFrameHead %= FRAME_MAX_COUNT;
-	if(txFrameHead == txFrameTail)
-		txFrameBufferFull = true;
+	((struct TxFrameHandle*)handle)->ackTag = tag;
 	__enable_irq();
-	return ret;
 }
 
+bool Ax25GetNextTxAck(uint32_t *tag)
+{
+	if(txAckHead == txAckTail)
+		return false;
+
+	*tag = txAck[txAckTail];
+	txAckTail = (txAckTail + 1) % TX_ACK_COUNT;
+	return true;
+}
+
+void Ax25GetTxQueueStats(enum Ax25TxClass class, struct Ax25TxQueueStats *stats)
+{
+	if(class >= AX25_TX_CLASS_COUNT)
+		return;
+
+	__disable_irq();
+	*stats = txQueue[class].stats;
+	stats->depth = txQueueDepth(&txQueue[class]);
+	__enable_irq();
+}
+
+void Ax25GetRxStats(uint8_t modem, struct Ax25RxStats *stats)
+{
+	if(modem >= MODEM_MAX_DEMODULATOR_COUNT)
+		return;
+
+	__disable_irq();
+	*stats = rxState[modem].stats;
+	__enable_irq();
+}
+
+uint32_t Ax25GetRxDropped(void)
+{
+	return rxDropped;
+}
 
 bool Ax25ReadNextRxFrame(uint8_t **dst, uint16_t *size, int8_t *peak, int8_t *valley, uint8_t *level, uint8_t *corrected)
 {
+#ifdef ENABLE_FX25
+	while(rxFx25FailedCount)
+	{
+		__disable_irq();
+		rxFx25FailedCount--;
+		const struct Fx25Mode *mode = rxFx25FailedMode;
+		__enable_irq();
+		Fx25UpdateChannelQuality((mode->T / 2) + 1, mode);
+	}
+#endif
+
 	if((rxFrameHead == rxFrameTail) && !rxFrameBufferFull)
 		return false;
 
@@ -474,13 +838,29 @@ bool Ax25ReadNextRxFrame(uint8_t **dst, uint16_t *size, int8_t *peak, int8_t *va
 	*valley = rxFrame[rxFrameTail].valley;
 	*level = rxFrame[rxFrameTail].level;
 	*size = rxFrame[rxFrameTail].size;
-	*corrected = rxFrame[rxFrameTail].corrected;
+#ifdef ENABLE_TRACE
+	TraceSetCurrent(rxFrame[rxFrameTail].trace);
+	TraceStamp(rxFrame[rxFrameTail].trace, TRACE_STAGE_HANDLE);
+#endif
 
 	__disable_irq();
+	//the other decoders may still improve FX.25 result of the last frame, so read it with interrupts disabled
+	*corrected = rxFrame[rxFrameTail].corrected;
+#ifdef ENABLE_FX25
+	const struct Fx25Mode *fx25Mode = rxFrame[rxFrameTail].fx25Mode;
+	if(lastFrame == &rxFrame[rxFrameTail])
+		lastFrame = NULL;
+#endif
 	rxFrameBufferFull = false;
 	rxFrameTail++;
 	rxFrameTail %= FRAME_MAX_COUNT;
 	__enable_irq();
+
+#ifdef ENABLE_FX25
+	//one channel quality sample per frame, with the best result of all decoders
+	if(NULL != fx25Mode)
+		Fx25UpdateChannelQuality((AX25_NOT_FX25 == *corrected) ? ((fx25Mode->T / 2) + 1) : *corrected, fx25Mode);
+#endif
 	return true;
 }
 
@@ -492,6 +872,20 @@ enum Ax25RxStage Ax25GetRxStage(uint8_t modem)
 
 void Ax25BitParse(uint8_t bit, uint8_t modem)
 {
+#ifdef ENABLE_FX25
+	if(rxFx25FailedDelay) //FX.25 block failed, wait for other decoders, which might decode it
+	{
+		rxFx25FailedDelay++;
+		if(rxFx25FailedDelay > (4 * MODEM_MAX_DEMODULATOR_COUNT))
+		{
+			rxFx25FailedDelay = 0;
+			if(rxFx25FailedCount < UINT8_MAX)
+				rxFx25FailedCount++;
+			EventPost(EVENT_FRAME_RECEIVED);
+		}
+	}
+#endif
+
 	if(lastCrc != 0) //there was a frame received
 	{
 		rxMultiplexDelay++;
@@ -499,17 +893,27 @@ void Ax25BitParse(uint8_t bit, uint8_t modem)
 		{
 			lastCrc = 0;
 			rxMultiplexDelay = 0;
+#ifdef ENABLE_FX25
+			lastFrame = NULL;
+#endif
 			for(uint8_t i = 0; i < MODEM_MAX_DEMODULATOR_COUNT; i++)
 			{
 				frameReceived |= ((rxState[i].frameReceived > 0) << i);
 				rxState[i].frameReceived = 0;
 			}
+			if(frameReceived)
+				EventPost(EVENT_FRAME_RECEIVED);
 		}
 
 	}
 
 	struct RxState *rx = (struct RxState*)&(rxState[modem]);
 
+#ifdef ENABLE_IL2P
+	if(Ax25Config.il2p && il2pBitParse(rx, bit, modem))
+		return;
+#endif
+
 	rx->rawData <<= 1; //store incoming bit
 	rx->rawData |= (bit > 0);
 
@@ -542,6 +946,7 @@ void Ax25BitParse(uint8_t bit, uint8_t modem)
 					rx->crc ^= 0xFFFF;
 					if((rx->frame[rx->frameIdx - 2] == (rx->crc & 0xFF)) && (rx->frame[rx->frameIdx - 1] == ((rx->crc >> 8) & 0xFF))) //check CRC
 					{
+						rx->stats.decoded++;
 						uint16_t i = 13;
 						//start from 13, which is the SSID of source
 						for(; i < (rx->frameIdx - 2); i++) //look for path end bit
@@ -565,8 +970,12 @@ void Ax25BitParse(uint8_t bit, uint8_t modem)
 									ModemGetSignalLevel(modem, &rxFrame[rxFrameHead].peak, &rxFrame[rxFrameHead].valley, &rxFrame[rxFrameHead].level);
 #ifdef ENABLE_FX25
 									rxFrame[rxFrameHead].fx25Mode = NULL;
+									lastFrame = &rxFrame[rxFrameHead];
 #endif
 									rxFrame[rxFrameHead].corrected = AX25_NOT_FX25;
+#ifdef ENABLE_TRACE
+									rxFrame[rxFrameHead].trace = TraceStart();
+#endif
 									__disable_irq();
 									rxFrame[rxFrameHead++].size = rx->frameIdx;
 									rxFrameHead %= FRAME_MAX_COUNT;
@@ -580,9 +989,13 @@ void Ax25BitParse(uint8_t bit, uint8_t modem)
 										rxBufferHead %= FRAME_BUFFER_SIZE;
 									}
 								}
+								else
+									rxDropped++;
 							}
 						}
 					}
+					else
+						rx->stats.crcErrors++;
 				}
 			}
 			rx->rx = RX_STAGE_FLAG;
@@ -592,7 +1005,7 @@ void Ax25BitParse(uint8_t bit, uint8_t modem)
 			rx->crc = 0xFFFF;
 			return;
 		}
-		else
+		else if(rx->rx == RX_STAGE_FLAG) //frame starts only after a flag, stay idle otherwise
 			rx->rx = RX_STAGE_FRAME;
 
 #ifndef ENABLE_FX25
@@ -601,6 +1014,8 @@ void Ax25BitParse(uint8_t bit, uint8_t modem)
 		//because FX.25 parity bytes and tags contain >= 7 consecutive ones
 		if((rx->rawData & 0x7F) == 0x7F) //received 7 consecutive ones, this is an error
 		{
+			if((rx->rx == RX_STAGE_FRAME) && (rx->frameIdx >= 17)) //don't count noise or trailing flags
+				rx->stats.aborted++;
 			rx->rx = RX_STAGE_IDLE;
 			rx->receivedByte = 0;
 			rx->receivedBitIdx = 0;
@@ -622,10 +1037,7 @@ void Ax25BitParse(uint8_t bit, uint8_t modem)
 	{
 		if(rx->frameIdx >= 2)
 		{
-			for(uint8_t k = 0; k < 8; k++)
-			{
-				calculateCRC((rx->frame[rx->frameIdx - 2] >> k) & 1, &(rx->crc));
-			}
+			rx->crc = calculateCRCByte(rx->frame[rx->frameIdx - 2], rx->crc);
 		}
 
 #ifdef ENABLE_FX25
@@ -634,20 +1046,45 @@ void Ax25BitParse(uint8_t bit, uint8_t modem)
 		{
 			uint8_t fixed = 0;
 			bool fecSuccess = Fx25Decode(rx->frame, rx->fx25Mode, &fixed);
+			if(!fecSuccess)
+			{
+				rx->stats.fx25Failed++;
+				fixed = AX25_NOT_FX25;
+			}
+			else if(fixed > 0)
+				rx->stats.fx25Corrected++;
 			uint16_t crc;
-			struct FrameHandle *h = parseFx25Frame(rx->frame, rx->frameIdx, &crc);
-			if(h != NULL)
+			uint16_t size = parseFx25Frame(rx->frame, rx->frameIdx, &crc);
+			if(size > 0)
 			{
+				rx->stats.decoded++;
 				rx->frameReceived = 1;
-				ModemGetSignalLevel(modem, &h->peak, &h->valley, &h->level);
-				if(fecSuccess)
+				rxFx25FailedDelay = 0; //block decoded, even if other decoders failed
+				if(crc != lastCrc) //the other decoder has not received this frame yet
 				{
-					h->corrected = fixed;
-					h->fx25Mode = rx->fx25Mode;
+					struct FrameHandle *h = storeDecodedFrame(rx->frame, size);
+					if(h != NULL)
+					{
+						ModemGetSignalLevel(modem, &h->peak, &h->valley, &h->level);
+						h->corrected = fixed;
+						h->fx25Mode = rx->fx25Mode;
+#ifdef ENABLE_TRACE
+						h->trace = TraceStart();
+#endif
+					}
+					lastFrame = h;
+					lastCrc = crc;
 				}
-				else
-					h->corrected = AX25_NOT_FX25;
-				lastCrc = crc;
+				else if((lastFrame != NULL) && ((lastFrame->fx25Mode == NULL) || (fixed < lastFrame->corrected))) //keep the best result
+				{
+					lastFrame->corrected = fixed;
+					lastFrame->fx25Mode = rx->fx25Mode;
+				}
+			}
+			else if(!fecSuccess && (lastCrc == 0) && !rxFx25FailedDelay) //count block once, unless some decoder decodes it
+			{
+				rxFx25FailedDelay = 1;
+				rxFx25FailedMode = rx->fx25Mode;
 			}
 			rx->rx = RX_STAGE_FLAG;
 			rx->receivedByte = 0;
@@ -655,11 +1092,11 @@ void Ax25BitParse(uint8_t bit, uint8_t modem)
 			rx->frameIdx = 0;
 			return;
 		}
-#else
-		rx->rx = RX_STAGE_FRAME;
 #endif
 		if(rx->frameIdx >= AX25_FRAME_MAX_SIZE) //frame is too long
 		{
+			if(rx->rx == RX_STAGE_FRAME)
+				rx->stats.tooLong++;
 			rx->rx = RX_STAGE_IDLE;
 			rx->receivedByte = 0;
 			rx->receivedBitIdx = 0;
@@ -676,183 +1113,302 @@ void Ax25BitParse(uint8_t bit, uint8_t modem)
 }
 
 
-uint8_t Ax25GetTxBit(void)
+/**
+ * @brief Estimate number of bytes on air needed to transmit a frame
+ * @param *h Frame handle
+ * @return Byte count
+ */
+static uint16_t getFrameAirSize(const struct TxFrameHandle *h)
 {
-	if(txBitIdx == 8)
+#ifdef ENABLE_FX25
+	if(NULL != h->fx25Mode)
+		return h->size + 8; //block and correlation tag
+#endif
+#ifdef ENABLE_IL2P
+	if(h->il2p)
+		return h->size + 4; //preamble byte, sync word and encoded frame
+#endif
+	return h->size + (h->size / 5) + 2 + STATIC_FOOTER_FLAG_COUNT; //worst case bit stuffing, CRC and flags
+}
+
+/**
+ * @brief Pick next frame to transmit according to scheduling policy and per-transmission limits
+ * @return Frame handle or NULL if transmission should end
+ */
+static struct TxFrameHandle *selectNextFrame(void)
+{
+	if((Ax25Config.txMaxFrames > 0) && (txFramesElapsed >= Ax25Config.txMaxFrames))
+		return NULL;
+
+	int8_t class = -1;
+	if(Ax25Config.txWeighted) //weighted round-robin
 	{
-		txBitIdx = 0;
-		if(txStage == TX_STAGE_PREAMBLE) //transmitting preamble (TXDelay)
+		for(uint8_t i = 0; i <= AX25_TX_CLASS_COUNT; i++)
 		{
-			if(txDelayElapsed < txDelay)
+			if((txRoundCredit > 0) && !txQueueEmpty(&txQueue[txRoundClass]))
 			{
-				txByte = SYNC_BYTE;
-				txDelayElapsed++;
+				class = txRoundClass;
+				break;
 			}
-			else
+			txRoundClass = (txRoundClass + 1) % AX25_TX_CLASS_COUNT;
+			txRoundCredit = txClassWeight[txRoundClass];
+		}
+	}
+	else //strict priority
+	{
+		for(uint8_t i = 0; i < AX25_TX_CLASS_COUNT; i++)
+		{
+			if(!txQueueEmpty(&txQueue[i]))
 			{
+				class = i;
+				break;
+			}
+		}
+	}
+
+	if(class < 0) //no more frames
+		return NULL;
+
+	struct TxQueue *q = &txQueue[class];
+	struct TxFrameHandle *h = &q->frame[q->frameTail];
+
+	//always transmit at least one frame, then check if next frame fits in the key-up time limit
+	if((txMaxBytes > 0) && (txFramesElapsed > 0) && ((txBytesElapsed + getFrameAirSize(h) + txTail) > txMaxBytes))
+		return NULL;
+
+	if(Ax25Config.txWeighted)
+		txRoundCredit--;
+
+	uint32_t wait = SysTickGet() - h->timestamp;
+	q->stats.waitSum += wait;
+	if(wait > q->stats.waitMax)
+		q->stats.waitMax = wait;
+
+	txCurrentClass = class;
+	txFramesElapsed++;
+	return h;
+}
+
+/**
+ * @brief Remove frame that was just transmitted from its queue
+ */
+static void releaseCurrentFrame(void)
+{
+	struct TxQueue *q = &txQueue[txCurrentClass];
+	q->bufferTail = (txCurrent->start + txCurrent->size) % q->bufferSize;
+	q->frameTail++;
+	q->frameTail %= TX_QUEUE_FRAME_COUNT;
+	q->frameBufferFull = false;
+	q->stats.sent++;
+	if(0 != txCurrent->ackTag)
+	{
+		uint8_t next = (txAckHead + 1) % TX_ACK_COUNT;
+		if(next != txAckTail) //drop acknowledgment if there is no space
+		{
+			txAck[txAckHead] = txCurrent->ackTag;
+			txAckHead = next;
+			EventPost(EVENT_OUTPUT); //let main loop send the acknowledgment
+		}
+	}
+	txCurrent = NULL;
+}
+
+/**
+ * @brief Select next frame and set appropriate TX stage
+ * @param flagsSent True if flags were just sent and the next AX.25 frame does not need header flags
+ */
+static void startNextFrame(bool flagsSent)
+{
+	txCurrent = selectNextFrame();
+	txByteIdx = 0;
+	if(NULL == txCurrent) //no more frames or limit reached
+	{
+		txStage = TX_STAGE_TAIL;
+		return;
+	}
+#ifdef ENABLE_TRACE
+	TraceStamp(txCurrent->trace, TRACE_STAGE_AIR);
+#endif
+#ifdef ENABLE_FX25
+	if(NULL != txCurrent->fx25Mode)
+	{
+		txStage = TX_STAGE_CORRELATION_TAG;
+		txTagByteIdx = 0;
+		return;
+	}
+#endif
+#ifdef ENABLE_IL2P
+	if(txCurrent->il2p)
+	{
+		txStage = TX_STAGE_IL2P_SYNC;
+		txSyncByteIdx = 0;
+		return;
+	}
+#endif
+	txFlagsElapsed = 0;
+	if(flagsSent)
+		txStage = TX_STAGE_DATA;
+	else
+		txStage = TX_STAGE_HEADER_FLAGS;
+}
+
+/**
+ * @brief Load next byte to be transmitted to txByte
+ * @return False if transmission is over
+ */
+static bool loadNextTxByte(void)
+{
+	while(1)
+	{
+		switch(txStage)
+		{
+			case TX_STAGE_PREAMBLE: //transmitting preamble (TXDelay)
+				if(txDelayElapsed < txDelay)
+				{
+					txByte = SYNC_BYTE;
+					txDelayElapsed++;
+					return true;
+				}
 				txDelayElapsed = 0;
+				startNextFrame(false);
+				break;
 #ifdef ENABLE_FX25
-				if(NULL != txFrame[txFrameTail].fx25Mode)
+			case TX_STAGE_CORRELATION_TAG: //FX.25 correlation tag
+				if(txTagByteIdx < 8)
 				{
-					txStage = TX_STAGE_CORRELATION_TAG;
-					txTagByteIdx = 0;
+					txByte = (txCurrent->fx25Mode->tag >> (8 * txTagByteIdx)) & 0xFF;
+					txTagByteIdx++;
+					return true;
 				}
-				else
+				txStage = TX_STAGE_DATA;
+				break;
 #endif
-					txStage = TX_STAGE_HEADER_FLAGS;
-			}
-		}
-#ifdef ENABLE_FX25
-transmitTag:
-		if(txStage == TX_STAGE_CORRELATION_TAG) //FX.25 correlation tag
-		{
-			if(txTagByteIdx < 8)
-				txByte = (txFrame[txFrameTail].fx25Mode->tag >> (8 * txTagByteIdx)) & 0xFF;
-			else
+#ifdef ENABLE_IL2P
+			case TX_STAGE_IL2P_SYNC: //IL2P preamble byte and sync word
+				if(txSyncByteIdx < 4)
+				{
+					txByte = ((((uint32_t)IL2P_PREAMBLE << 24) | IL2P_SYNC_WORD) >> (8 * (3 - txSyncByteIdx))) & 0xFF;
+					txSyncByteIdx++;
+					return true;
+				}
 				txStage = TX_STAGE_DATA;
-
-			txTagByteIdx++;
-		}
+				break;
 #endif
-		if(txStage == TX_STAGE_HEADER_FLAGS) //transmitting initial flags
-		{
-			if(txFlagsElapsed < STATIC_HEADER_FLAG_COUNT)
-			{
-				txByte = 0x7E;
-				txFlagsElapsed++;
-			}
-			else
-			{
+			case TX_STAGE_HEADER_FLAGS: //transmitting initial flags
+				if(txFlagsElapsed < STATIC_HEADER_FLAG_COUNT)
+				{
+					txByte = 0x7E;
+					txFlagsElapsed++;
+					return true;
+				}
 				txFlagsElapsed = 0;
-				txStage = TX_STAGE_DATA; //transmit data
-			}
-		}
-		if(txStage == TX_STAGE_DATA) //transmitting normal data
-		{
-transmitNormalData:
-			__disable_irq();
-			if((txFrameHead != txFrameTail) || txFrameBufferFull)
-			{
-				__enable_irq();
-				if(txByteIdx < txFrame[txFrameTail].size) //send buffer
+				txStage = TX_STAGE_DATA;
+				break;
+			case TX_STAGE_DATA: //transmitting normal data
+				if(txByteIdx < txCurrent->size)
 				{
-					txByte = txBuffer[(txFrame[txFrameTail].start + txByteIdx) % FRAME_BUFFER_SIZE];
+					struct TxQueue *q = &txQueue[txCurrentClass];
+					txByte = q->buffer[(txCurrent->start + txByteIdx) % q->bufferSize];
 					txByteIdx++;
+					return true;
 				}
+				txByteIdx = 0;
 #ifdef ENABLE_FX25
-				else if(txFrame[txFrameTail].fx25Mode != NULL)
+				if(NULL != txCurrent->fx25Mode) //FX.25 block contains CRC and flags already
 				{
-					__disable_irq();
-					txFrameBufferFull = false;
-					txFrameTail++;
-					txFrameTail %= FRAME_MAX_COUNT;
-					txByteIdx = 0;
-					__enable_irq();
-					if((txFrameHead != txFrameTail) || txFrameBufferFull)
-					{
-						if(txFrame[txFrameTail].fx25Mode != NULL)
-						{
-							txStage = TX_STAGE_CORRELATION_TAG;
-							txTagByteIdx = 0;
-							goto transmitTag;
-						}
-						else
-							goto transmitNormalData;
-					}
-					else
-						goto transmitTail;
+					releaseCurrentFrame();
+					startNextFrame(false);
+					break;
 				}
 #endif
-				else
+#ifdef ENABLE_IL2P
+				if(txCurrent->il2p) //IL2P frame has no CRC and flags
 				{
-					txStage = TX_STAGE_CRC; //transmit CRC
-					txCrcByteIdx = 0;
+					releaseCurrentFrame();
+					startNextFrame(false);
+					break;
+				}
+#endif
+				txStage = TX_STAGE_CRC;
+				txCrcByteIdx = 0;
+				break;
+			case TX_STAGE_CRC: //transmitting CRC
+				if(txCrcByteIdx <= 1)
+				{
+					txByte = (txCrc & 0xFF) ^ 0xFF;
+					txCrc >>= 8;
+					txCrcByteIdx++;
+					return true;
 				}
-			}
-			else //no more frames
-			{
-transmitTail:
-				__enable_irq();
-				txByteIdx = 0;
-				txBitIdx = 0;
-				txStage = TX_STAGE_TAIL;
-			}
-		}
-		if(txStage == TX_STAGE_CRC) //transmitting CRC
-		{
-			if(txCrcByteIdx <= 1)
-			{
-				txByte = (txCrc & 0xFF) ^ 0xFF;
-				txCrc >>= 8;
-				txCrcByteIdx++;
-			}
-			else
-			{
 				txCrc = 0xFFFF;
 				txStage = TX_STAGE_FOOTER_FLAGS; //now transmit flags
 				txFlagsElapsed = 0;
-			}
-
-		}
-		if(txStage == TX_STAGE_FOOTER_FLAGS)
-		{
-			if(txFlagsElapsed < STATIC_FOOTER_FLAG_COUNT)
-			{
-				txByte = 0x7E;
-				txFlagsElapsed++;
-			}
-			else
-			{
+				break;
+			case TX_STAGE_FOOTER_FLAGS:
+				if(txFlagsElapsed < STATIC_FOOTER_FLAG_COUNT)
+				{
+					txByte = 0x7E;
+					txFlagsElapsed++;
+					return true;
+				}
 				txFlagsElapsed = 0;
-				__disable_irq();
-				txFrameBufferFull = false;
-				txFrameTail++;
-				txFrameTail %= FRAME_MAX_COUNT;
-				txByteIdx = 0;
-#ifdef ENABLE_FX25
-				if(((txFrameHead != txFrameTail) || txFrameBufferFull) && (txFrame[txFrameTail].fx25Mode != NULL))
+				releaseCurrentFrame();
+				startNextFrame(true); //there might be a next frame to transmit
+				break;
+			case TX_STAGE_TAIL: //transmitting tail
+				if(txTailElapsed < txTail)
 				{
-					__enable_irq();
-					txStage = TX_STAGE_CORRELATION_TAG;
-					txTagByteIdx = 0;
-					goto transmitTag;
+					txByte = SYNC_BYTE;
+					txTailElapsed++;
+					return true;
 				}
-#endif
-				__enable_irq();
-				txStage = TX_STAGE_DATA; //return to normal data transmission stage. There might be a next frame to transmit
-				goto transmitNormalData;
-			}
-		}
-		if(txStage == TX_STAGE_TAIL) //transmitting tail
-		{
-			if(txTailElapsed < txTail)
-			{
-				txByte = SYNC_BYTE;
-				txTailElapsed++;
-			}
-			else //tail transmitted, stop transmission
-			{
 				txTailElapsed = 0;
-				txStage = TX_STAGE_IDLE;
-				txCrc = 0xFFFF;
-				txBitstuff = 0;
-				txByte = 0;
-				txInitStage = TX_INIT_OFF;
-				txBufferTail = txBufferHead;
-				ModemTransmitStop();
-				return 0;
-			}
+				return false;
+			default:
+				return false;
 		}
+	}
+}
 
+uint8_t Ax25GetTxBit(void)
+{
+	if(txBitIdx == 8)
+	{
+		txBitIdx = 0;
+		if(!loadNextTxByte()) //tail transmitted, stop transmission
+		{
+			txStage = TX_STAGE_IDLE;
+			txCrc = 0xFFFF;
+			txBitstuff = 0;
+			txByte = 0;
+			txInitStage = TX_INIT_OFF;
+			ModemTransmitStop();
+			EventPost(EVENT_OUTPUT); //let main loop start next transmission if frames were queued in the meantime
+			return 0;
+		}
+		txBytesElapsed++;
 	}
 
 	uint8_t txBit = 0;
+#ifdef ENABLE_IL2P
+	//transmitting in IL2P mode: MSB first, no NRZI encoding
+	//NRZI is always applied by the modem, so the bit is precoded here to cancel it
+	if((txStage == TX_STAGE_IL2P_SYNC) || ((txStage == TX_STAGE_DATA) && txCurrent->il2p))
+	{
+		uint8_t bit = txByte >> 7;
+		txByte <<= 1;
+		txBitIdx++;
+		txBit = (bit == txIl2pLastBit); //keep the symbol if the bit does not change
+		txIl2pLastBit = bit;
+	}
+	else
+#endif
 	//transmitting normal data or CRC in AX.25 mode
-	if(
+	if(((txStage == TX_STAGE_DATA) || (txStage == TX_STAGE_CRC))
 #ifdef ENABLE_FX25
-		(NULL == txFrame[txFrameTail].fx25Mode) &&
+		&& (NULL == txCurrent->fx25Mode)
 #endif
-		((txStage == TX_STAGE_DATA) || (txStage == TX_STAGE_CRC)))
+		)
 	{
 		if(txBitstuff == 5) //5 consecutive ones transmitted
 		{
@@ -898,13 +1454,33 @@ void Ax25TransmitBuffer(void)
 	 if(txInitStage == TX_INIT_TRANSMITTING)
 	 	return;
 
-	 if((txFrameHead != txFrameTail) || txFrameBufferFull)
+	 for(uint8_t i = 0; i < AX25_TX_CLASS_COUNT; i++)
 	 {
-	 	txQuiet = (SysTickGet() + (Ax25Config.quietTime / SYSTICK_INTERVAL) + Random(0, 200 / SYSTICK_INTERVAL)); //calculate required delay
-	 	txInitStage = TX_INIT_WAITING;
+		 if(!txQueueEmpty(&txQueue[i]))
+		 {
+			txInitStage = TX_INIT_WAITING;
+			if(Ax25Config.fullDuplex)
+				TimerStart(&txTimer, 0); //no need to wait in full duplex mode
+			else
+				TimerStart(&txTimer, Ax25Config.quietTime / SYSTICK_INTERVAL); //wait for quiet time
+			return;
+		 }
 	 }
 }
 
+bool Ax25IsTransmitPending(void)
+{
+	if(txInitStage != TX_INIT_OFF)
+		return true;
+
+	for(uint8_t i = 0; i < AX25_TX_CLASS_COUNT; i++)
+	{
+		if(!txQueueEmpty(&txQueue[i]))
+			return true;
+	}
+	return false;
+}
+
 
 
 /**
@@ -918,47 +1494,54 @@ static void transmitStart(void)
 	txByte = 0;
 	txBitIdx = 0;
 	txFlagsElapsed = 0;
+	txFramesElapsed = 0;
+	txBytesElapsed = 0;
+	TraceKeyUp();
 	ModemTransmitStart();
 }
 
 
 /**
  * @brief Start transmitting when possible
- * @attention Must be continuously polled in main loop
+ * @attention Called on quiet/slot timer expiry
  */
-void Ax25TransmitCheck(void)
+static void transmitCheck(void)
 {
-	 if(txInitStage == TX_INIT_OFF) //TX not initialized at all, nothing to transmit
-	 	return;
-	 if(txInitStage == TX_INIT_TRANSMITTING) //already transmitting
+	 if(txInitStage != TX_INIT_WAITING) //nothing to transmit or already transmitting
 	 	return;
 
 	 if(ModemIsTxTestOngoing()) //TX test is enabled, wait for now
+	 {
+	 	TimerStart(&txTimer, 1);
 	 	return;
+	 }
 
-	 if(txQuiet < SysTickGet()) //quit time has elapsed
+	 if(!Ax25Config.fullDuplex) //channel must be free for the whole quiet time
 	 {
-	 	if(!ModemDcdState()) //channel is free
+	 	uint32_t quiet = Ax25Config.quietTime / SYSTICK_INTERVAL;
+	 	uint32_t idle = ModemDcdState() ? 0 : (SysTickGet() - ChannelGetLastBusy());
+	 	if(idle < quiet)
 	 	{
-	 		txInitStage = TX_INIT_TRANSMITTING; //transmit right now
-	 		txRetries = 0;
-	 		transmitStart();
-	 	}
-	 	else //channel is busy
-	 	{
-	 		if(txRetries == MAX_TRANSMIT_RETRY_COUNT) //timeout
-	 		{
-	 			txInitStage = TX_INIT_TRANSMITTING; //transmit right now
-	 			txRetries = 0;
-	 			transmitStart();
-	 		}
-	 		else //still trying
-	 		{
-	 			txQuiet = SysTickGet() + Random(100 / SYSTICK_INTERVAL, 500 / SYSTICK_INTERVAL); //try again after some random time
-	 			txRetries++;
-	 		}
+	 		TimerStart(&txTimer, quiet - idle);
+	 		return;
 	 	}
 	 }
+
+	 //p-persistence: transmit with probability of (persistence + 1) / 256, otherwise wait for the next slot
+	 if(Ax25Config.fullDuplex || (Random(0, 256) <= Ax25Config.persistence))
+	 {
+	 	txInitStage = TX_INIT_TRANSMITTING; //transmit right now
+	 	transmitStart();
+	 }
+	 else
+	 	TimerStart(&txTimer, Ax25Config.slotTime / SYSTICK_INTERVAL);
+}
+
+void Ax25UpdateTiming(void)
+{
+	txDelay = ((float)Ax25Config.txDelayLength / (8.f * 1000.f / ModemGetBaudrate())); //change milliseconds to byte count
+	txTail = ((float)Ax25Config.txTailLength / (8.f * 1000.f / ModemGetBaudrate()));
+	txMaxBytes = ((float)Ax25Config.txMaxTime / (8.f * 1000.f / ModemGetBaudrate()));
 }
 
 void Ax25Init(void)
@@ -967,8 +1550,23 @@ void Ax25Init(void)
 
 	memset((void*)rxState, 0, sizeof(rxState));
 	for(uint8_t i = 0; i < (sizeof(rxState) / sizeof(rxState[0])); i++)
+	{
 		rxState[i].crc = 0xFFFF;
+#ifdef ENABLE_IL2P
+		rxState[i].il2pHeaderIdx = IL2P_ENCODED_HEADER_SIZE;
+#endif
+	}
 
-	txDelay = ((float)Ax25Config.txDelayLength / (8.f * 1000.f / ModemGetBaudrate())); //change milliseconds to byte count
-	txTail = ((float)Ax25Config.txTailLength / (8.f * 1000.f / ModemGetBaudrate()));
+	Ax25UpdateTiming();
+
+	uint16_t offset = 0;
+	for(uint8_t i = 0; i < AX25_TX_CLASS_COUNT; i++)
+	{
+		memset(&txQueue[i], 0, sizeof(txQueue[i]));
+		txQueue[i].buffer = &txBuffer[offset];
+		txQueue[i].bufferSize = (FRAME_BUFFER_SIZE / 10) * txClassBufferShare[i];
+		offset += txQueue[i].bufferSize;
+	}
+	txRoundClass = 0;
+	txRoundCredit = txClassWeight[txRoundClass]; //start with full credit, so that the first class is not skipped
 }
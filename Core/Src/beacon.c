@@ -24,21 +24,59 @@ along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
 #include <systick.h>
 #include "ax25.h"
 #include "terminal.h"
+#include "timer.h"
+#include "modem.h"
+#include "channel.h"
 
 struct Beacon beacon[8];
+struct BeaconConfig BeaconConfig;
 
-static uint32_t beaconDelay[8] = {0};
+#define BEACON_RETRY_TIME (1000 / SYSTICK_INTERVAL) //channel check interval for deferred beacons
+
+static struct BeaconStats beaconStats;
+static uint8_t deferred = 0; //bitmap of beacons that are currently deferred
+
+static struct Timer beaconTimer = TIMER_INIT(BeaconCheck); //expires at the nearest beacon time
 static uint8_t buf[150]; //frame buffer
+static uint8_t built = 0xFF; //number of beacon whose frame is currently stored in the frame buffer
+
+#define BEACON_TELEMETRY_DEFINITION_PERIOD 16 //definition packets are sent with every n-th telemetry report
+#define BEACON_TELEMETRY_MAX_VALUE 255 //max value of APRS telemetry analog channel
+
+struct TelemetryCounters
+{
+	uint32_t rx;
+	uint32_t digi;
+	uint32_t duplicates;
+	uint32_t rxDropped;
+	uint32_t txDropped[AX25_TX_CLASS_COUNT];
+};
+
+//state of the telemetry beacon, there can be only one
+static struct
+{
+	uint16_t sequence;
+	struct TelemetryCounters counters; //counter values at the previous report
+	uint8_t definitionsPending; //bitmap of definition packets not sent yet, retried with each report
+} telemetry;
+
+//telemetry definitions: received frames, digipeated frames, duplicates dropped (saturated at 255), channel utilization,
+//TX duty cycle (in 0.4% units) and overflows of digipeater, KISS host and beacon TX queues and RX buffer since previous report
+static const char *const telemetryDefinition[] =
+{
+	"PARM.Rx,Digi,Dupes,Chan,Duty,DigOvf,HstOv,BcOv,RxOv",
+	"UNIT.pkt,pkt,pkt,%,%,full,full,full,full",
+	"EQNS.0,1,0,0,1,0,0,1,0,0,0.4,0,0,0.4,0",
+	"BITS.11111111,VP-Digi load",
+};
 
 /**
- * @brief Send specified beacon
- * @param[in] no Beacon number (0-7)
+ * @brief Build beacon frame header (addresses, control and PID) in the frame buffer
+ * @param number Beacon number (0-7)
+ * @return Header size
  */
-void BeaconSend(uint8_t number)
+static uint16_t buildHeader(uint8_t number)
 {
-	if(beacon[number].enable == 0)
-		return; //beacon disabled
-
 	uint16_t idx = 0;
 
 	for(uint8_t i = 0; i < sizeof(GeneralConfig.dest); i++) //add destination address
@@ -69,62 +107,343 @@ void BeaconSend(uint8_t number)
 	buf[idx - 1] |= 1; //add c-bit on the last element
 	buf[idx++] = 0x03; //control
 	buf[idx++] = 0xF0; //pid
+
+	return idx;
+}
+
+/**
+ * @brief Build beacon frame in the frame buffer
+ * @param number Beacon number (0-7)
+ * @return Frame size
+ */
+static uint16_t buildFrame(uint8_t number)
+{
+	uint16_t idx = buildHeader(number);
+
 	for(uint8_t i = 0; i < strlen((char*)beacon[number].data); i++)
 	{
 		buf[idx++] = beacon[number].data[i]; //copy beacon comment
 	}
 
+	built = number;
+	return idx;
+}
+
+/**
+ * @brief Build telemetry definition packet (APRS message to own callsign) in the frame buffer
+ * @param number Beacon number (0-7)
+ * @param definition Definition index
+ * @return Frame size
+ */
+static uint16_t buildTelemetryDefinition(uint8_t number, uint8_t definition)
+{
+	uint16_t idx = buildHeader(number);
+
+	buf[idx++] = ':';
+	uint16_t start = idx;
+	for(uint8_t i = 0; i < sizeof(GeneralConfig.call); i++)
+	{
+		if(GeneralConfig.call[i] != (' ' << 1))
+			buf[idx++] = GeneralConfig.call[i] >> 1;
+	}
+	if(GeneralConfig.callSsid)
+	{
+		buf[idx++] = '-';
+		idx += NumberToString(GeneralConfig.callSsid, (char*)&buf[idx]);
+	}
+	while((idx - start) < 9) //addressee is padded to 9 characters
+		buf[idx++] = ' ';
+	buf[idx++] = ':';
+
+	idx = StrAppend((char*)buf, idx, telemetryDefinition[definition]);
+
+	built = 0xFF;
+	return idx;
+}
+
+/**
+ * @brief Limit telemetry value to analog channel range
+ * @param value Value
+ * @return Value limited to 0-255
+ */
+static uint32_t limitTelemetry(uint32_t value)
+{
+	return (value > BEACON_TELEMETRY_MAX_VALUE) ? BEACON_TELEMETRY_MAX_VALUE : value;
+}
+
+/**
+ * @brief Build telemetry report from current counters in the frame buffer
+ * @param number Beacon number (0-7)
+ * @param *current Current counter values, to be stored as the previous ones if the report is sent
+ * @return Frame size
+ */
+static uint16_t buildTelemetry(uint8_t number, struct TelemetryCounters *current)
+{
+	struct TelemetryCounters *previous = &telemetry.counters;
+	uint32_t value[5];
+
+	current->rx = 0;
+	struct Ax25RxStats rxStats;
+	for(uint8_t i = 0; i < ModemGetDemodulatorCount(); i++)
+	{
+		Ax25GetRxStats(i, &rxStats);
+		current->rx += rxStats.decoded;
+	}
+	value[0] = current->rx - previous->rx;
+
+	struct Ax25TxQueueStats txStats;
+	uint8_t bits = 0;
+	for(uint8_t i = 0; i < AX25_TX_CLASS_COUNT; i++)
+	{
+		Ax25GetTxQueueStats(i, &txStats);
+		current->txDropped[i] = txStats.dropped;
+		if(current->txDropped[i] != previous->txDropped[i])
+			bits |= (1 << i);
+		if(AX25_TX_CLASS_DIGI == i)
+			current->digi = txStats.sent;
+	}
+	value[1] = current->digi - previous->digi;
+	current->rxDropped = Ax25GetRxDropped();
+	if(current->rxDropped != previous->rxDropped)
+		bits |= (1 << AX25_TX_CLASS_COUNT);
+
+	struct DigiStats digiStats;
+	DigiGetStats(&digiStats);
+	current->duplicates = digiStats.duplicates;
+	value[2] = current->duplicates - previous->duplicates;
+
+	//utilization and duty cycle are in permille, scale them to 0-250
+	value[3] = ChannelGetUtilization(CHANNEL_WINDOW_15MIN) / 4;
+	value[4] = ChannelGetDutyCycle(CHANNEL_WINDOW_15MIN) / 4;
+
+	uint16_t idx = buildHeader(number);
+	buf[idx++] = 'T';
+	buf[idx++] = '#';
+	buf[idx++] = '0' + (telemetry.sequence / 100);
+	buf[idx++] = '0' + ((telemetry.sequence / 10) % 10);
+	buf[idx++] = '0' + (telemetry.sequence % 10);
+	for(uint8_t i = 0; i < 5; i++)
+	{
+		buf[idx++] = ',';
+		idx += NumberToString(limitTelemetry(value[i]), (char*)&buf[idx]);
+	}
+	buf[idx++] = ',';
+	for(uint8_t i = 0; i < 8; i++)
+		buf[idx++] = (bits & (1 << i)) ? '1' : '0';
+
+	built = 0xFF;
+	return idx;
+}
+
+void BeaconUpdate(void)
+{
+	//there is not enough RAM to keep all frames, so only sizes and hashes are cached
+	//and the frame buffer keeps the last built frame, which is the only one in typical setups
+	//with more beacons the frame is copied again on each transmission, but the hash is not recalculated
+	built = 0xFF;
+	for(uint8_t i = 0; i < 8; i++)
+	{
+		if((beacon[i].enable == 0) || beacon[i].telemetry) //telemetry is built on each transmission
+			continue;
+		beacon[i].size = buildFrame(i);
+		beacon[i].hash = DigiGetHash(buf, beacon[i].size);
+	}
+}
+
+/**
+ * @brief Write frame from the frame buffer to TX buffer
+ * @param number Beacon number (0-7)
+ * @param size Frame size
+ * @param hash Frame duplicate protection hash
+ * @return True on success
+ */
+static bool transmitFrame(uint8_t number, uint16_t size, uint32_t hash)
+{
 	void *handle = NULL;
-	if(NULL != (handle = Ax25WriteTxFrame(buf, idx))) //try to write frame to TX buffer
+	if(NULL != (handle = Ax25WriteTxFrame(buf, size, AX25_TX_CLASS_BEACON))) //try to write frame to TX buffer
 	{
         if(GeneralConfig.kissMonitor) //monitoring mode, send own frames to KISS ports
         {
-        	TermSendToAll(MODE_KISS, buf, idx);
+        	TermSendToAll(MODE_KISS, buf, size);
         }
 
-		DigiStoreDeDupe(buf, idx); //store frame hash in duplicate protection buffer (to prevent from digipeating own packets)
+		DigiStoreDeDupeHash(hash); //store frame hash in duplicate protection buffer (to prevent from digipeating own packets)
 
 		TermSendToAll(MODE_MONITOR, (uint8_t*)"(AX.25) Transmitting beacon ", 0);
 
 		TermSendNumberToAll(MODE_MONITOR, number);
 		TermSendToAll(MODE_MONITOR, (uint8_t*)": ", 0);
-		SendTNC2(buf, idx);
+		SendTNC2(buf, size);
 		TermSendToAll(MODE_MONITOR, (uint8_t*)"\r\n", 0);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Send specified beacon
+ * @param[in] no Beacon number (0-7)
+ */
+void BeaconSend(uint8_t number)
+{
+	if(beacon[number].enable == 0)
+		return; //beacon disabled
+
+	if(beacon[number].telemetry)
+	{
+		if((telemetry.sequence % BEACON_TELEMETRY_DEFINITION_PERIOD) == 0)
+			telemetry.definitionsPending = (1 << (sizeof(telemetryDefinition) / sizeof(*telemetryDefinition))) - 1;
+		for(uint8_t i = 0; i < (sizeof(telemetryDefinition) / sizeof(*telemetryDefinition)); i++) //send definitions first
+		{
+			if(!(telemetry.definitionsPending & (1 << i)))
+				continue;
+			uint16_t size = buildTelemetryDefinition(number, i);
+			if(transmitFrame(number, size, DigiGetHash(buf, size)))
+				telemetry.definitionsPending &= ~(1 << i);
+		}
+		struct TelemetryCounters current;
+		uint16_t size = buildTelemetry(number, &current);
+		if(transmitFrame(number, size, DigiGetHash(buf, size)))
+		{
+			//counters and sequence number advance only when the report is sent, so that nothing is lost
+			telemetry.counters = current;
+			telemetry.sequence = (telemetry.sequence + 1) % 1000;
+			beaconStats.sent++;
+		}
+		return;
 	}
 
+	if(built != number) //frame buffer holds some other beacon
+		buildFrame(number);
+
+	if(transmitFrame(number, beacon[number].size, beacon[number].hash))
+		beaconStats.sent++;
 }
 
 /**
- * @brief Check if any beacon should be transmitted and transmit if necessary
+ * @brief Transmit beacons whose time has come and restart timer for the nearest one
+ * @details Due beacons are deferred while the channel is busy or other frames are pending, but no longer than the jitter time.
+ * All beacons that are due at the same time are written to the TX buffer together, so that they are sent in a single transmission.
  */
 void BeaconCheck(void)
 {
+	uint64_t now = SysTickGet64();
+	uint64_t nearest = UINT64_MAX;
+	//check channel before writing anything, so that beacons written in this pass do not defer each other
+	bool busy = ModemDcdState() || Ax25IsTransmitPending();
+
 	for(uint8_t i = 0; i < 8; i++)
 	{
-		if(beacon[i].enable == 0)
+		if((beacon[i].enable == 0) || (beacon[i].interval == 0))
+		{
+			deferred &= ~(1 << i);
 			continue;
+		}
 
-		if((beacon[i].interval > 0) && ((SysTickGet() >= beacon[i].next) || (beacon[i].next == 0)))
+		if(now >= beacon[i].next)
 		{
-			if(beaconDelay[i] > SysTickGet()) //check for beacon delay (only for the very first transmission)
+			uint64_t limit = beacon[i].next + (BeaconConfig.jitter * SYSTICK_FREQUENCY);
+			if(busy && (now < limit)) //defer
+			{
+				if(!(deferred & (1 << i)))
+				{
+					deferred |= (1 << i);
+					beaconStats.deferred++;
+				}
+				uint64_t retry = now + BEACON_RETRY_TIME;
+				if(retry > limit)
+					retry = limit;
+				if(retry < nearest)
+					nearest = retry;
 				continue;
-			beacon[i].next = SysTickGet() + beacon[i].interval; //save next beacon timestamp
-			beaconDelay[i] = 0;
+			}
+
+			if(busy)
+				beaconStats.forced++;
+			deferred &= ~(1 << i);
+
+			beacon[i].next += beacon[i].interval; //keep beacon in its slot
+			if(beacon[i].next <= now) //missed slots, e.g. after configuration change
+				beacon[i].next = now + beacon[i].interval;
 			BeaconSend(i);
 		}
+		if(beacon[i].next < nearest)
+			nearest = beacon[i].next;
 	}
+
+	if(nearest != UINT64_MAX)
+		TimerStartAt(&beaconTimer, nearest);
 }
 
+void BeaconGetStats(struct BeaconStats *stats)
+{
+	*stats = beaconStats;
+}
 
 /**
- * @brief Initialize beacon module
+ * @brief Get base interval of beacon slot group
+ * @param number Beacon number (0-7)
+ * @return Shortest interval of enabled beacon with the same delay that divides the beacon interval
+ * @details Beacons whose intervals are multiples of the same base interval would be sent together
+ * every now and then, so they form a group and share the base interval
  */
-void BeaconInit(void)
+static uint32_t getSlotBase(uint8_t number)
 {
+	uint32_t base = beacon[number].interval;
 	for(uint8_t i = 0; i < 8; i++)
 	{
-		beaconDelay[i] = (beacon[i].delay * SYSTICK_FREQUENCY) + SysTickGet() + (30000 / SYSTICK_INTERVAL); //set delay for beacons and add constant 30 seconds of delay
-		beacon[i].next = 0;
+		if(beacon[i].enable && beacon[i].interval && (beacon[i].delay == beacon[number].delay)
+				&& (beacon[i].interval < base) && ((beacon[number].interval % beacon[i].interval) == 0))
+			base = beacon[i].interval;
 	}
+	return base;
 }
 
+/**
+ * @brief Schedule all beacons
+ * @param start Start timestamp, to which beacon delays are added
+ * @details Beacons in the same group are spread evenly across the base interval, so that they are never sent together
+ */
+static void schedule(uint64_t start)
+{
+	uint32_t base[8];
+	for(uint8_t i = 0; i < 8; i++)
+		base[i] = (beacon[i].enable && beacon[i].interval) ? getSlotBase(i) : 0;
+
+	for(uint8_t i = 0; i < 8; i++)
+	{
+		uint8_t slot = 0, slots = 0;
+		if(base[i])
+		{
+			for(uint8_t j = 0; j < 8; j++)
+			{
+				if((base[j] == base[i]) && (beacon[j].delay == beacon[i].delay))
+				{
+					if(j < i)
+						slot++;
+					slots++;
+				}
+			}
+		}
+		beacon[i].next = (beacon[i].delay * SYSTICK_FREQUENCY) + start;
+		if(slots > 1)
+			beacon[i].next += (uint64_t)base[i] * slot / slots;
+	}
+	deferred = 0;
+}
+
+void BeaconReschedule(void)
+{
+	schedule(SysTickGet64());
+	BeaconCheck();
+}
+
+/**
+ * @brief Initialize beacon module
+ */
+void BeaconInit(void)
+{
+	BeaconUpdate();
+	schedule(SysTickGet64() + (30000 / SYSTICK_INTERVAL)); //add constant 30 seconds of delay
+	BeaconCheck();
+}
@@ -0,0 +1,97 @@
+/*
+Copyright 2020-2025 Piotr Wilkon
+
+This file is part of VP-Digi.
+
+VP-Digi is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+VP-Digi is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "channel.h"
+#include "modem.h"
+#include "systick.h"
+
+//averages are exponentially weighted (just like load averages), updated once per second
+//and stored as 16.16 fixed point fractions
+#define CHANNEL_FIXED_ONE 65536
+//decay factors for 1-second updates: exp(-1/60), exp(-1/300) and exp(-1/900) in 16.16 format
+static const uint32_t channelDecay[CHANNEL_WINDOW_COUNT] = {64453, 65318, 65463};
+
+static uint8_t busyTicks = 0; //ticks with busy channel in current second
+static uint8_t txTicks = 0; //ticks with PTT on in current second
+static uint8_t sampleCount = 0; //ticks sampled in current second
+static volatile uint32_t lastBusy = 0; //tick of last DCD detection
+
+static volatile uint32_t utilization[CHANNEL_WINDOW_COUNT]; //channel utilization averages
+static volatile uint32_t dutyCycle[CHANNEL_WINDOW_COUNT]; //TX duty cycle averages
+
+/**
+ * @brief Update exponentially weighted average
+ * @param average Current average (16.16)
+ * @param sample New sample (16.16)
+ * @param decay Decay factor (16.16)
+ * @return Updated average
+ */
+static uint32_t updateAverage(uint32_t average, uint32_t sample, uint32_t decay)
+{
+	return (uint32_t)(((uint64_t)average * decay + (uint64_t)sample * (CHANNEL_FIXED_ONE - decay) + (CHANNEL_FIXED_ONE >> 1)) >> 16);
+}
+
+void ChannelSample(void)
+{
+	if(ModemIsTransmitting())
+	{
+		//DCD is not updated while transmitting, so own transmission is always counted as busy channel
+		busyTicks++;
+		txTicks++;
+	}
+	else if(ModemDcdState())
+	{
+		busyTicks++;
+		lastBusy = SysTickGet();
+	}
+
+	if(++sampleCount < SYSTICK_FREQUENCY)
+		return;
+
+	uint32_t busy = ((uint32_t)busyTicks * CHANNEL_FIXED_ONE) / SYSTICK_FREQUENCY;
+	uint32_t tx = ((uint32_t)txTicks * CHANNEL_FIXED_ONE) / SYSTICK_FREQUENCY;
+	for(uint8_t i = 0; i < CHANNEL_WINDOW_COUNT; i++)
+	{
+		utilization[i] = updateAverage(utilization[i], busy, channelDecay[i]);
+		dutyCycle[i] = updateAverage(dutyCycle[i], tx, channelDecay[i]);
+	}
+
+	busyTicks = 0;
+	txTicks = 0;
+	sampleCount = 0;
+}
+
+uint16_t ChannelGetUtilization(enum ChannelWindow window)
+{
+	if(window >= CHANNEL_WINDOW_COUNT)
+		return 0;
+	return (utilization[window] * 1000 + (CHANNEL_FIXED_ONE >> 1)) >> 16;
+}
+
+uint32_t ChannelGetLastBusy(void)
+{
+	return lastBusy;
+}
+
+uint16_t ChannelGetDutyCycle(enum ChannelWindow window)
+{
+	if(window >= CHANNEL_WINDOW_COUNT)
+		return 0;
+	return (dutyCycle[window] * 1000 + (CHANNEL_FIXED_ONE >> 1)) >> 16;
+}
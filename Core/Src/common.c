@@ -22,6 +22,7 @@ along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
 #include "common.h"
 #include "ax25.h"
 #include "usbd_cdc_if.h"
+#include "terminal.h"
 
 struct _GeneralConfig GeneralConfig =
 {
@@ -84,95 +85,114 @@ int16_t Random(int16_t min, int16_t max)
     return max ? (rand() % max + min) : min;
 }
 
-static void sendTNC2ToUart(Uart *uart, uint8_t *from, uint16_t len)
+uint8_t NumberToString(int32_t n, char *out)
 {
-	for(uint8_t i = 0; i < 6; i++) //source call
+	char digits[10];
+	uint8_t count = 0;
+	uint8_t len = 0;
+	uint32_t u = (uint32_t)n;
+	if(n < 0)
 	{
-		if((from[7 + i] >> 1) != ' ') //skip spaces
-		{
-			UartSendByte(uart, from[7 + i] >> 1);
-		}
+		out[len++] = '-';
+		u = -u;
 	}
 
-	uint8_t ssid = ((from[13] >> 1) & 0b00001111); //store ssid
-	if(ssid > 0) //SSID >0
+	do //store digits starting from the least significant one
 	{
-		UartSendByte(uart, '-'); //add -
-		UartSendNumber(uart, ssid);
+		digits[count++] = '0' + (u % 10);
+		u /= 10;
 	}
+	while(u);
+
+	while(count)
+		out[len++] = digits[--count];
+
+	return len;
+}
 
-	UartSendByte(uart, '>'); //first separator
+uint16_t StrAppend(char *dst, uint16_t index, const char *src)
+{
+	while(*src)
+		dst[index++] = *src++;
+	return index;
+}
 
-	for(uint8_t i = 0; i < 6; i++) //destination call
+/**
+ * @brief Convert AX.25 address field to readable format
+ * @param *from AX.25 address field (7 bytes)
+ * @param *to Destination buffer
+ * @return Number of characters written
+ */
+static uint8_t addressToString(const uint8_t *from, char *to)
+{
+	uint8_t len = 0;
+	for(uint8_t i = 0; i < 6; i++)
 	{
 		if((from[i] >> 1) != ' ') //skip spaces
-		{
-			UartSendByte(uart, from[i] >> 1);
-		}
+			to[len++] = from[i] >> 1;
 	}
-	ssid = ((from[6] >> 1) & 0b00001111); //store ssid
 
-	if(ssid > 0) //SSID >0
+	uint8_t ssid = ((from[6] >> 1) & 0b00001111);
+	if(ssid > 0)
 	{
-		UartSendByte(uart, '-'); //add -
-		UartSendNumber(uart, ssid);
+		to[len++] = '-';
+		len += NumberToString(ssid, &to[len]);
 	}
+	return len;
+}
 
-	uint16_t nextPathEl = 14; //next path element index
-
-    if(!(from[13] & 1)) //no c-bit in source address, there is a digi path
-    {
-        do //analyze all path elements
-        {
-            UartSendByte(uart, ','); //path separator
-
-        	for(uint8_t i = 0; i < 6; i++) //copy element
-        	{
-        		if((from[nextPathEl + i] >> 1) != ' ') //skip spaces
-        		{
-        			UartSendByte(uart, from[nextPathEl + i] >> 1);
-        		}
-        	}
-
-            ssid = ((from[nextPathEl + 6] >> 1) & 0b00001111); //store ssid
-        	if(ssid > 0) //SSID >0
-        	{
-        		UartSendByte(uart, '-'); //add -
-        		UartSendNumber(uart, ssid);
-        	}
-            if((from[nextPathEl + 6] & 0x80)) //h-bit in ssid
-            	UartSendByte(uart, '*'); //add *
-
-            nextPathEl += 7; //next path element
-            if(nextPathEl > 56) //too many path elements
-            	break;
-        }
-        while((from[nextPathEl - 1] & 1) == 0); //loop until the c-bit is found
-
-    }
+uint16_t ConvertToTNC2(const uint8_t *from, uint16_t len, char *to, const uint8_t **info, uint16_t *infoLen)
+{
+	uint16_t n = addressToString(&from[7], to); //source call
+	to[n++] = '>'; //first separator
+	n += addressToString(from, &to[n]); //destination call
 
-	UartSendByte(uart, ':'); //separator
+	uint16_t nextPathEl = 14; //next path element index
 
-    if((from[nextPathEl] & 0b11101111) == 0b00000011) //check if UI packet
-    {
-		nextPathEl += 2; //skip Control and PID
+	if(!(from[13] & 1)) //no c-bit in source address, there is a digi path
+	{
+		do //analyze all path elements
+		{
+			to[n++] = ','; //path separator
+			n += addressToString(&from[nextPathEl], &to[n]);
+			if((from[nextPathEl + 6] & 0x80)) //h-bit in ssid
+				to[n++] = '*';
+
+			nextPathEl += 7; //next path element
+			if(nextPathEl > 56) //too many path elements
+				break;
+		}
+		while((from[nextPathEl - 1] & 1) == 0); //loop until the c-bit is found
+	}
 
-		UartSendString(uart, &(from[nextPathEl]), len - nextPathEl); //send information field
-    }
-    else
-    	UartSendString(uart, "<not UI packet>", 0);
+	to[n++] = ':'; //separator
 
-    UartSendByte(uart, 0); //terminate with NULL
+	*info = NULL;
+	*infoLen = 0;
+	if(((from[nextPathEl] & 0b11101111) == 0b00000011) && (len >= (nextPathEl + 2))) //check if UI packet
+	{
+		*info = &from[nextPathEl + 2]; //skip Control and PID
+		*infoLen = len - nextPathEl - 2;
+	}
+	return n;
 }
 
 void SendTNC2(uint8_t *from, uint16_t len)
 {
-	if(UartUsb.mode == MODE_MONITOR)
-		sendTNC2ToUart(&UartUsb, from, len);
-	if(Uart1.mode == MODE_MONITOR)
-		sendTNC2ToUart(&Uart1, from, len);
-	if(Uart2.mode == MODE_MONITOR)
-		sendTNC2ToUart(&Uart2, from, len);
+	static char header[TNC2_HEADER_MAX_SIZE];
+
+	if((UartUsb.mode != MODE_MONITOR) && (Uart1.mode != MODE_MONITOR) && (Uart2.mode != MODE_MONITOR))
+		return;
+
+	const uint8_t *info;
+	uint16_t infoLen;
+	uint16_t n = ConvertToTNC2(from, len, header, &info, &infoLen);
+
+	TermSendToAll(MODE_MONITOR, (uint8_t*)header, n);
+	if(NULL == info)
+		TermSendToAll(MODE_MONITOR, (uint8_t*)"<not UI packet>", 0);
+	else if(infoLen > 0)
+		TermSendToAll(MODE_MONITOR, (uint8_t*)info, infoLen); //information field is sent directly from the frame
 }
 
 uint32_t Crc32(uint32_t crc0, uint8_t *s, uint64_t n)
@@ -26,348 +26,772 @@ along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
 #include "ax25.h"
 #include "beacon.h"
 #include "stm32f1xx.h"
+#include <stddef.h>
+#include <string.h>
 
 #define CONFIG_ADDRESS 0x800F000
-#define CONFIG_PAGE_COUNT 2
-#define CONFIG_PAGE_SIZE 1024 //1024 words (2048 bytes)
+#define CONFIG_PAGE_SIZE 1024 //page size in bytes
+#define CONFIG_PAGE_COUNT 4
+#define CONFIG_BANK_SIZE 2048 //size of each of the two banks used alternately
+
+//each bank starts with a header, followed by records appended on each save:
+//address (16 bits), size (16 bits), data (size bytes, padded to 16 bits), CRC32 of address, size and data
+//records are valid only if followed by a commit record, which is written as the last one during each save
+#define CONFIG_BANK_MAGIC 0x5650
+#define CONFIG_BANK_HEADER_SIZE 8 //magic, version, sequence number, inverted sequence number
+#define CONFIG_RECORD_OVERHEAD 8 //address, size, CRC32
+#define CONFIG_RECORD_COMMIT 0xFFFE //commit record address
+#define CONFIG_PADDED(size) (((size) + 1) & ~1)
+#define CONFIG_COMPARE_CHUNK 16 //number of stored bytes read at once to find changed bytes
+
+//configuration image versions
+#define CONFIG_VERSION_LEGACY 1 //struct ConfigImageV1 written directly to flash, without bank header
+#define CONFIG_VERSION_LOG 2 //struct ConfigImageV1 stored in records
+#define CONFIG_VERSION 3 //struct ConfigImage stored in records
 
 #define CONFIG_FLAG_WRITTEN 0x6B
 
+/**
+ * @brief Current configuration image
+ * @attention New fields must be added at the end. Fields missing in older images are read as 0xFF.
+ */
+struct __attribute__((packed)) ConfigImage
+{
+	uint8_t call[6];
+	uint8_t callSsid;
+	uint8_t dest[6];
+	uint8_t kissMonitor;
+	uint8_t modem;
+	uint8_t modemFlags; //bit 0 - PWM, bit 1 - flat audio input
+	uint8_t defaultMode[3]; //USB, UART1, UART2
+	uint32_t baudrate[2]; //UART1, UART2
+	uint16_t txDelay;
+	uint16_t txTail;
+	uint16_t quietTime;
+	uint8_t allowNonAprs;
+	uint8_t fx25; //bit 0 - FX.25 enabled, bit 1 - FX.25 TX enabled, bit 2 - adaptive parity size
+	uint8_t txWeighted;
+	uint8_t txMaxFrames;
+	uint16_t txMaxTime;
+	uint8_t persistence;
+	uint16_t slotTime;
+	uint8_t fullDuplex;
+	uint8_t beaconEnable; //bitmap
+	uint16_t beaconInterval[8]; //minutes
+	uint16_t beaconDelay[8]; //minutes
+	uint8_t beaconData[8][BEACON_MAX_PAYLOAD_SIZE];
+	uint8_t beaconPath[8][14];
+	uint8_t digiEnable;
+	uint8_t digiAliasEnable;
+	uint8_t digiAlias[8][6];
+	uint8_t digiSsid[4];
+	uint8_t digiMax[4];
+	uint8_t digiRep[4];
+	uint8_t digiTraced;
+	uint8_t digiViscous;
+	uint8_t digiDirectOnly;
+	uint8_t digiDupeTime;
+	uint8_t digiCallFilterEnable;
+	uint8_t digiFilterPolarity;
+	uint8_t digiCallFilter[20][7];
+	uint8_t digiThrottle;
+	uint8_t digiLoadLimit;
+	uint8_t beaconJitter; //seconds
+	uint8_t beaconTelemetry; //inverted bitmap, so that beacons are not switched to telemetry when the field is missing
+	uint8_t fx25MinParity;
+	uint8_t fx25MaxParity;
+	uint8_t il2p; //bit 0 - IL2P enabled, bit 1 - IL2P TX enabled, bit 2 - IL2P CRC disabled
+};
+
+/**
+ * @brief Configuration image used by older versions
+ * @details All fields are 16-bit or n*16-bit long
+ */
+struct __attribute__((packed)) ConfigImageV1
+{
+	uint16_t flag; //configuration written flag
+	uint8_t call[6];
+	uint16_t callSsid;
+	uint16_t txDelay;
+	uint16_t txTail;
+	uint16_t quietTime;
+	uint32_t baudrate[2];
+	uint16_t beaconEnable;
+	uint16_t beaconInterval[8];
+	uint16_t beaconDelay[8];
+	uint8_t beaconData[8][100];
+	uint8_t beaconPath[8][14];
+	uint16_t digiEnable;
+	uint16_t digiAliasEnable;
+	uint16_t digiViscous; //viscous-delay settings in higher half, direct-only in lower half
+	uint8_t digiAlias[4][6]; //5 bytes used
+	uint8_t digiAliasNew[4][8]; //6 bytes used
+	uint16_t digiMax[4];
+	uint16_t digiRep[4];
+	uint16_t digiTraced;
+	uint16_t digiDupeTime;
+	uint16_t digiCallFilterEnable;
+	uint8_t digiCallFilter[20][7];
+	uint16_t digiFilterPolarity;
+	uint16_t digiSsid[4];
+	uint16_t modemFlags;
+	uint16_t kissMonitor;
+	uint8_t dest[6];
+	uint16_t allowNonAprs;
+	uint16_t fx25;
+	uint16_t modem;
+	uint16_t defaultMode[3];
+	uint16_t digiThrottle;
+	uint16_t digiLoadLimit;
+	uint16_t txWeighted;
+	uint16_t txMaxFrames;
+	uint16_t txMaxTime;
+	uint16_t persistence;
+	uint16_t slotTime;
+	uint16_t fullDuplex;
+};
+
+_Static_assert(sizeof(struct ConfigImageV1) == 1242, "Version 1 configuration layout must not change");
+_Static_assert(sizeof(struct ConfigImage) <= (CONFIG_BANK_SIZE - CONFIG_BANK_HEADER_SIZE - 2 * CONFIG_RECORD_OVERHEAD), "Configuration image does not fit in bank");
 
-//these are relative addresses, absolute address is calculated as relative address + MEM_CONFIG
-//all fields are 16-bit or n*16-bit long, as data in flash is stored in 16-bit words
-#define CONFIG_FLAG 0 //configuration written flag
-#define CONFIG_CALL 2
-#define CONFIG_SSID 8
-#define CONFIG_TXDELAY 10
-#define CONFIG_TXTAIL 12
-#define CONFIG_TXQUIET 14
-#define CONFIG_RS1BAUD 16
-#define CONFIG_RS2BAUD 20
-#define CONFIG_BEACONS 24
-#define CONFIG_BCIV 26 //beacon intervals
-#define CONFIG_BCDL 42 //beacon delays
-#define CONFIG_BC0 58 //beacon information fields, null terminated
-#define CONFIG_BC1 158
-#define CONFIG_BC2 258
-#define CONFIG_BC3 358
-#define CONFIG_BC4 458
-#define CONFIG_BC5 558
-#define CONFIG_BC6 658
-#define CONFIG_BC7 758
-#define CONFIG_BCP0 858 //beacon paths, 14 bytes each
-#define CONFIG_BCP1 872
-#define CONFIG_BCP2 886
-#define CONFIG_BCP3 900
-#define CONFIG_BCP4 914
-#define CONFIG_BCP5 928
-#define CONFIG_BCP6 942
-#define CONFIG_BCP7 956
-#define CONFIG_DIGION 970
-#define CONFIG_DIGIEN 972
-#define CONFIG_DIGIVISC 974 //viscous-delay settings in higher half, direct-only in lower half
-#define CONFIG_DIGIAL0 976
-#define CONFIG_DIGIAL1 982
-#define CONFIG_DIGIAL2 988
-#define CONFIG_DIGIAL3 994
-#define CONFIG_DIGIAL4 1000
-#define CONFIG_DIGIAL5 1008
-#define CONFIG_DIGIAL6 1016
-#define CONFIG_DIGIAL7 1024
-#define CONFIG_DIGIMAX0 1032
-#define CONFIG_DIGIMAX1 1034
-#define CONFIG_DIGIMAX2 1036
-#define CONFIG_DIGIMAX3 1038
-#define CONFIG_DIGIREP0 1040
-#define CONFIG_DIGIREP1 1042
-#define CONFIG_DIGIREP2 1044
-#define CONFIG_DIGIREP3 1046
-#define CONFIG_DIGITRACE 1048
-#define CONFIG_DIGIDEDUPE 1050
-#define CONFIG_DIGICALLFILEN 1052
-#define CONFIG_DIGIFILLIST 1054
-#define CONFIG_DIGIFILTYPE 1194
-#define CONFIG_DIGISSID4 1196
-#define CONFIG_DIGISSID5 1198
-#define CONFIG_DIGISSID6 1200
-#define CONFIG_DIGISSID7 1202
-#define CONFIG_PWM_FLAT 1204
-#define CONFIG_KISSMONITOR 1206
-#define CONFIG_DEST 1208
-#define CONFIG_ALLOWNONAPRS 1214
-#define CONFIG_FX25 1216
-#define CONFIG_MODEM 1218
-#define CONFIG_MODE_USB 1220
-#define CONFIG_MODE_UART1 1222
-#define CONFIG_MODE_UART2 1224
-#define CONFIG_XXX 1226 //next address (not used)
+#define FIELD_SIZE(type, name) sizeof(((struct type*)0)->name)
+#define READ(name) readValue(offsetof(struct ConfigImage, name), FIELD_SIZE(ConfigImage, name))
+#define READ_ARRAY(name, data) readField(offsetof(struct ConfigImage, name), (data), FIELD_SIZE(ConfigImage, name))
+#define READ_V1(name) readValue(offsetof(struct ConfigImageV1, name), FIELD_SIZE(ConfigImageV1, name))
+#define READ_ARRAY_V1(name, data) readField(offsetof(struct ConfigImageV1, name), (data), FIELD_SIZE(ConfigImageV1, name))
+#define WRITE(name, value) writeValue(offsetof(struct ConfigImage, name), (value), FIELD_SIZE(ConfigImage, name))
+#define WRITE_ARRAY(name, data) writeField(offsetof(struct ConfigImage, name), (data), FIELD_SIZE(ConfigImage, name))
 
+struct ConfigBank
+{
+	uint32_t start; //bank address
+	uint16_t version; //image version, 0 if no configuration is stored
+	uint16_t sequence; //sequence number, incremented each time the configuration is moved to the other bank
+	uint16_t end; //end of the last committed record
+	bool dirty; //bank contains data after the last commit and can not be appended to
+};
+
+static struct ConfigBank bank; //bank currently in use
+
+static uint32_t writeStart; //address of bank being written
+static uint16_t writePos; //offset of record being written or next free offset
+static bool writeAll; //write all fields, not only the changed ones
+static bool writeError; //bank full or programming failed
+static bool recordOpen; //record is being written
+static uint16_t recordAddress; //address of data in record being written
+static uint16_t recordSize; //data size of record being written
+static uint8_t recordPending; //data byte waiting for the second half of the word
+
+/**
+ * @brief Read word from flash
+ * @param[in] address Absolute address
+ * @return Data (word)
+ */
+static uint16_t flashRead(uint32_t address)
+{
+	return *(volatile uint16_t*)address;
+}
 
 /**
- * @brief Write word to configuration part in flash
- * @param[in] address Relative address
+ * @brief Program word in flash and verify it
+ * @param[in] address Absolute address
  * @param[in] data Data to write
+ * @return True on success
  * @warning Flash must be unlocked first
  */
-static void write(uint32_t address, uint16_t data)
+static bool flashProgram(uint32_t address, uint16_t data)
 {
-    FLASH->CR |= FLASH_CR_PG; //programming mode
+	FLASH->CR |= FLASH_CR_PG; //programming mode
 
-    *((volatile uint16_t*)(address + CONFIG_ADDRESS)) = data; //store data
+	*((volatile uint16_t*)address) = data; //store data
 
-	while (FLASH->SR & FLASH_SR_BSY);; //wait for completion
-	if(!(FLASH->SR & FLASH_SR_EOP)) //an error occurred
-		FLASH->CR &= ~FLASH_CR_PG;
-	else
-		FLASH->SR |= FLASH_SR_EOP;
+	while (FLASH->SR & FLASH_SR_BSY)
+		;
+	FLASH->CR &= ~FLASH_CR_PG;
+	FLASH->SR = FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPRTERR; //clear flags
+	return flashRead(address) == data;
 }
 
 /**
- * @brief Write data array to configuration part in flash
- * @param[in] address Relative address
- * @param[in] *data Data to write
- * @param[in] len Data length
+ * @brief Erase flash pages
+ * @param[in] address Absolute address of the first page
+ * @param[in] count Number of pages
+ * @return True on success
  * @warning Flash must be unlocked first
  */
-static void writeString(uint32_t address, uint8_t *data, uint16_t len)
+static bool flashErase(uint32_t address, uint8_t count)
 {
-	uint16_t i = 0;
-	for(; i < (len / 2); i++)
+	bool ok = true;
+	while (FLASH->SR & FLASH_SR_BSY)
+		;
+	FLASH->CR |= FLASH_CR_PER; //erase mode
+	for(uint8_t i = 0; i < count; i++)
 	{
-		write(address + (i << 1), *(data + (i << 1)) | (*(data + 1 + (i << 1)) << 8)); //program memory
+		FLASH->AR = address + (CONFIG_PAGE_SIZE * i);
+		FLASH->CR |= FLASH_CR_STRT; //start erase
+		while (FLASH->SR & FLASH_SR_BSY)
+			;
+		if(!(FLASH->SR & FLASH_SR_EOP))
+		{
+			ok = false;
+			break;
+		}
+		FLASH->SR |= FLASH_SR_EOP;
 	}
-	if((len % 2) > 0)
+	FLASH->CR &= ~FLASH_CR_PER;
+	return ok;
+}
+
+/**
+ * @brief Check bank and find the end of committed records
+ * @param[in] index Bank number
+ * @param[out] *b Bank state
+ */
+static void scanBank(uint8_t index, struct ConfigBank *b)
+{
+	b->start = CONFIG_ADDRESS + (index * CONFIG_BANK_SIZE);
+	b->version = 0;
+	b->end = 0;
+	b->dirty = false;
+	b->sequence = flashRead(b->start + 4);
+
+	uint16_t version = flashRead(b->start + 2);
+	uint16_t imageSize;
+	if(version == CONFIG_VERSION)
+		imageSize = sizeof(struct ConfigImage);
+	else if(version == CONFIG_VERSION_LOG)
+		imageSize = sizeof(struct ConfigImageV1);
+	else
+		return;
+	uint16_t inverted = ~b->sequence;
+	if((flashRead(b->start) != CONFIG_BANK_MAGIC) || (flashRead(b->start + 6) != inverted))
+		return;
+
+	uint16_t pos = CONFIG_BANK_HEADER_SIZE;
+	while((pos + CONFIG_RECORD_OVERHEAD) <= CONFIG_BANK_SIZE)
 	{
-		write(address + (i << 1), *(data + (i << 1))); //store last byte if number of bytes is odd
+		uint16_t address = flashRead(b->start + pos);
+		uint16_t size = flashRead(b->start + pos + 2);
+		if((pos + CONFIG_RECORD_OVERHEAD + CONFIG_PADDED((uint32_t)size)) > CONFIG_BANK_SIZE)
+			break;
+		if((address != CONFIG_RECORD_COMMIT) && ((address + size) > imageSize))
+			break;
+		uint32_t crcAddress = b->start + pos + 4 + CONFIG_PADDED(size);
+		uint32_t crc = flashRead(crcAddress) | ((uint32_t)flashRead(crcAddress + 2) << 16);
+		if(Crc32(CRC32_INIT, (uint8_t*)(b->start + pos), size + 4) != crc)
+			break;
+		pos += CONFIG_RECORD_OVERHEAD + CONFIG_PADDED(size);
+		if(address == CONFIG_RECORD_COMMIT)
+			b->end = pos;
+	}
+	if(0 == b->end)
+		return;
+	b->version = version;
+
+	//anything after the last commit is a leftover of an interrupted save
+	for(pos = b->end; pos < CONFIG_BANK_SIZE; pos += 2)
+	{
+		if(flashRead(b->start + pos) != 0xFFFF)
+		{
+			b->dirty = true;
+			break;
+		}
 	}
 }
 
 /**
- * @brief Read single word from configuration part in flash
- * @param[in] address Relative address
- * @return Data (word)
+ * @brief Find bank with the most recent valid configuration
  */
-static uint16_t read(uint32_t address)
+static void findBank(void)
 {
-	return *(volatile uint16_t*)((address + CONFIG_ADDRESS));
+	struct ConfigBank other;
+	scanBank(0, &bank);
+	scanBank(1, &other);
+	if((other.version != 0) && ((bank.version == 0) || ((int16_t)(other.sequence - bank.sequence) > 0)))
+		bank = other;
+
+	//no valid bank, check if there is a configuration stored by older versions
+	if((bank.version == 0) && (flashRead(CONFIG_ADDRESS) == CONFIG_FLAG_WRITTEN))
+		bank.version = CONFIG_VERSION_LEGACY;
 }
 
 /**
-* @brief Read array from configuration part in flash
-* @param[in] address Relative address
-* @param[out] *data Data
-* @param[in] len Byte count
-*/
-static void readString(uint32_t address, uint8_t *data, uint16_t len)
+ * @brief Read data from configuration image
+ * @param[in] address Image offset
+ * @param[out] *data Output buffer
+ * @param[in] size Data size
+ * @details Bytes not stored are read as 0xFF.
+ * All records are scanned for every field, because there is not enough RAM to assemble the whole image
+ * at once. With a bank full of small records, loading takes a few milliseconds (see test/config_flash.c).
+ */
+static void readField(uint16_t address, void *data, uint16_t size)
 {
-	uint16_t i = 0;
-	for(; i < (len >> 1); i++)
+	uint8_t *out = data;
+	if(bank.version == CONFIG_VERSION_LEGACY)
 	{
-		*(data + (i << 1)) = (uint8_t)read(address + (i << 1));
-		*(data + 1 + (i << 1)) = (uint8_t)read(address + 1 + (i << 1));
+		memcpy(out, (uint8_t*)(CONFIG_ADDRESS + address), size);
+		return;
 	}
-	if((len % 2) > 0)
+
+	memset(out, 0xFF, size);
+	uint16_t pos = CONFIG_BANK_HEADER_SIZE;
+	while(pos < bank.end) //records are applied in order, so that the most recent data is copied last
 	{
-		*(data + (i << 1)) = (uint8_t)read(address + (i << 1));
+		uint16_t recAddress = flashRead(bank.start + pos);
+		uint16_t recSize = flashRead(bank.start + pos + 2);
+		if(recAddress != CONFIG_RECORD_COMMIT)
+		{
+			uint16_t from = (address > recAddress) ? address : recAddress;
+			uint16_t to = ((address + size) < (recAddress + recSize)) ? (address + size) : (recAddress + recSize);
+			if(from < to)
+				memcpy(&out[from - address], (uint8_t*)(bank.start + pos + 4 + from - recAddress), to - from);
+		}
+		pos += CONFIG_RECORD_OVERHEAD + CONFIG_PADDED(recSize);
 	}
 }
 
-void ConfigErase(void)
+/**
+ * @brief Read little-endian value from configuration image
+ * @param[in] address Image offset
+ * @param[in] size Value size (1, 2 or 4 bytes)
+ * @return Value
+ */
+static uint32_t readValue(uint16_t address, uint8_t size)
 {
-	FLASH->KEYR = 0x45670123; //unlock memory
-    FLASH->KEYR = 0xCDEF89AB;
-	while (FLASH->SR & FLASH_SR_BSY)
-		;
-	FLASH->CR |= FLASH_CR_PER; //erase mode
-	for(uint8_t i = 0; i < CONFIG_PAGE_COUNT; i++)
+	uint8_t buf[4];
+	uint32_t value = 0;
+	readField(address, buf, size);
+	while(size--)
+		value = (value << 8) | buf[size];
+	return value;
+}
+
+/**
+ * @brief Start record in the bank being written
+ * @param[in] address Image offset of record data
+ */
+static void openRecord(uint16_t address)
+{
+	recordOpen = true;
+	recordAddress = address;
+	recordSize = 0;
+	if(writeError)
+		return;
+	if((writePos + CONFIG_RECORD_OVERHEAD) > CONFIG_BANK_SIZE)
 	{
-		FLASH->AR = CONFIG_ADDRESS + (CONFIG_PAGE_SIZE * i);
-    	FLASH->CR |= FLASH_CR_STRT; //start erase
-    	while (FLASH->SR & FLASH_SR_BSY)
-    		;
-    	if(!(FLASH->SR & FLASH_SR_EOP))
-    	{
-        	FLASH->CR &= ~FLASH_CR_PER;
-    		return;
-    	}
-    	else
-    		FLASH->SR |= FLASH_SR_EOP;
+		writeError = true;
+		return;
 	}
-    FLASH->CR &= ~FLASH_CR_PER;
+	//size is programmed when the record is closed, so that an unfinished record is never valid
+	writeError |= !flashProgram(writeStart + writePos, address);
 }
 
 /**
- * @brief Store configuration from RAM to Flash
+ * @brief Finish record in the bank being written
  */
-void ConfigWrite(void)
+static void closeRecord(void)
+{
+	if(!recordOpen)
+		return;
+	recordOpen = false;
+	if(writeError)
+		return;
+
+	uint32_t start = writeStart + writePos;
+	if(recordSize & 1)
+		writeError |= !flashProgram(start + 4 + recordSize - 1, recordPending | 0xFF00);
+	writeError |= !flashProgram(start + 2, recordSize);
+	uint32_t crc = Crc32(CRC32_INIT, (uint8_t*)start, recordSize + 4);
+	writeError |= !flashProgram(start + 4 + CONFIG_PADDED(recordSize), crc & 0xFFFF);
+	writeError |= !flashProgram(start + 6 + CONFIG_PADDED(recordSize), crc >> 16);
+	writePos += CONFIG_RECORD_OVERHEAD + CONFIG_PADDED(recordSize);
+}
+
+/**
+ * @brief Write byte to configuration image
+ * @param[in] address Image offset
+ * @param[in] data Data to write
+ * @details Consecutive bytes are written to a single record
+ */
+static void writeByte(uint16_t address, uint8_t data)
 {
-	ConfigErase();
-
-	writeString(CONFIG_CALL, GeneralConfig.call, 6);
-	write(CONFIG_SSID, GeneralConfig.callSsid);
-	writeString(CONFIG_DEST, GeneralConfig.dest, 6);
-	write(CONFIG_TXDELAY, Ax25Config.txDelayLength);
-	write(CONFIG_TXTAIL, Ax25Config.txTailLength);
-	write(CONFIG_TXQUIET, Ax25Config.quietTime);
-	writeString(CONFIG_RS1BAUD, (uint8_t*)&Uart1.baudrate, 4);
-	writeString(CONFIG_RS2BAUD, (uint8_t*)&Uart2.baudrate, 4);
-
-	write(CONFIG_BEACONS, (beacon[0].enable > 0) | ((beacon[1].enable > 0) << 1) | ((beacon[2].enable > 0) << 2) | ((beacon[3].enable > 0) << 3) | ((beacon[4].enable > 0) << 4) | ((beacon[5].enable > 0) << 5) | ((beacon[6].enable > 0) << 6) | ((beacon[7].enable > 0) << 7));
-	for(uint8_t s = 0; s < 8; s++)
+	if(writeError)
+		return;
+
+	if(recordOpen && (address != (recordAddress + recordSize)))
+		closeRecord();
+	if(!recordOpen)
+		openRecord(address);
+	if(writeError || ((writePos + CONFIG_RECORD_OVERHEAD + CONFIG_PADDED(recordSize + 1)) > CONFIG_BANK_SIZE))
 	{
-		write(CONFIG_BCIV + (2 * s), beacon[s].interval / 6000);
+		writeError = true;
+		return;
 	}
-	for(uint8_t s = 0; s < 8; s++)
+
+	if(recordSize & 1)
+		writeError |= !flashProgram(writeStart + writePos + 4 + recordSize - 1, recordPending | ((uint16_t)data << 8));
+	else
+		recordPending = data;
+	recordSize++;
+}
+
+/**
+ * @brief Write data to configuration image
+ * @param[in] address Image offset
+ * @param[in] *data Data to write
+ * @param[in] size Data size
+ * @details Unchanged bytes are skipped unless all fields are written.
+ * Stored data is read in chunks, so that the records are not scanned for every byte.
+ */
+static void writeField(uint16_t address, const void *data, uint16_t size)
+{
+	const uint8_t *in = data;
+	uint8_t old[CONFIG_COMPARE_CHUNK];
+	for(uint16_t i = 0; i < size; i++)
 	{
-		write(CONFIG_BCDL + (2 * s), beacon[s].delay / 60);
+		uint8_t k = i % CONFIG_COMPARE_CHUNK;
+		if(!writeAll && (0 == k))
+			readField(address + i, old, ((size - i) < CONFIG_COMPARE_CHUNK) ? (size - i) : CONFIG_COMPARE_CHUNK);
+		if(writeAll || (old[k] != in[i]))
+			writeByte(address + i, in[i]);
 	}
-	writeString(CONFIG_BC0, beacon[0].data, 100);
-	writeString(CONFIG_BC1, beacon[1].data, 100);
-	writeString(CONFIG_BC2, beacon[2].data, 100);
-	writeString(CONFIG_BC3, beacon[3].data, 100);
-	writeString(CONFIG_BC4, beacon[4].data, 100);
-	writeString(CONFIG_BC5, beacon[5].data, 100);
-	writeString(CONFIG_BC6, beacon[6].data, 100);
-	writeString(CONFIG_BC7, beacon[7].data, 100);
-	writeString(CONFIG_BCP0, beacon[0].path, 14);
-	writeString(CONFIG_BCP1, beacon[1].path, 14);
-	writeString(CONFIG_BCP2, beacon[2].path, 14);
-	writeString(CONFIG_BCP3, beacon[3].path, 14);
-	writeString(CONFIG_BCP4, beacon[4].path, 14);
-	writeString(CONFIG_BCP5, beacon[5].path, 14);
-	writeString(CONFIG_BCP6, beacon[6].path, 14);
-	writeString(CONFIG_BCP7, beacon[7].path, 14);
-	write(CONFIG_DIGION, DigiConfig.enable);
-	write(CONFIG_DIGIEN, DigiConfig.enableAlias);
-	write(CONFIG_DIGIVISC, ((uint16_t)DigiConfig.viscous << 8) | (uint16_t)DigiConfig.directOnly);
-	writeString(CONFIG_DIGIAL0, DigiConfig.alias[0], 5);
-	writeString(CONFIG_DIGIAL1, DigiConfig.alias[1], 5);
-	writeString(CONFIG_DIGIAL2, DigiConfig.alias[2], 5);
-	writeString(CONFIG_DIGIAL3, DigiConfig.alias[3], 5);
-	writeString(CONFIG_DIGIAL4, DigiConfig.alias[4], 6);
-	writeString(CONFIG_DIGIAL5, DigiConfig.alias[5], 6);
-	writeString(CONFIG_DIGIAL6, DigiConfig.alias[6], 6);
-	writeString(CONFIG_DIGIAL7, DigiConfig.alias[7], 6);
-	write(CONFIG_DIGISSID4, DigiConfig.ssid[0]);
-	write(CONFIG_DIGISSID5, DigiConfig.ssid[1]);
-	write(CONFIG_DIGISSID6, DigiConfig.ssid[2]);
-	write(CONFIG_DIGISSID7, DigiConfig.ssid[3]);
-	write(CONFIG_DIGIMAX0, DigiConfig.max[0]);
-	write(CONFIG_DIGIMAX1, DigiConfig.max[1]);
-	write(CONFIG_DIGIMAX2, DigiConfig.max[2]);
-	write(CONFIG_DIGIMAX3, DigiConfig.max[3]);
-	write(CONFIG_DIGIREP0, DigiConfig.rep[0]);
-	write(CONFIG_DIGIREP1, DigiConfig.rep[1]);
-	write(CONFIG_DIGIREP2, DigiConfig.rep[2]);
-	write(CONFIG_DIGIREP3, DigiConfig.rep[3]);
-	write(CONFIG_DIGITRACE, DigiConfig.traced);
-	write(CONFIG_DIGIDEDUPE, DigiConfig.dupeTime);
-	write(CONFIG_DIGICALLFILEN, DigiConfig.callFilterEnable);
-	write(CONFIG_DIGIFILTYPE, DigiConfig.filterPolarity);
-	writeString(CONFIG_DIGIFILLIST, DigiConfig.callFilter[0], sizeof(DigiConfig.callFilter));
-	write(CONFIG_PWM_FLAT, ModemConfig.usePWM | (ModemConfig.flatAudioIn << 1));
-	write(CONFIG_KISSMONITOR, GeneralConfig.kissMonitor);
-	write(CONFIG_ALLOWNONAPRS, Ax25Config.allowNonAprs);
-	write(CONFIG_FX25, Ax25Config.fx25 | (Ax25Config.fx25Tx << 1));
-	write(CONFIG_MODEM, ModemConfig.modem);
-	write(CONFIG_MODE_USB, UartUsb.defaultMode);
-	write(CONFIG_MODE_UART1, Uart1.defaultMode);
-	write(CONFIG_MODE_UART2, Uart2.defaultMode);
-
-	write(CONFIG_FLAG, CONFIG_FLAG_WRITTEN);
+}
 
-	FLASH->CR &= ~FLASH_CR_PG;
+/**
+ * @brief Write little-endian value to configuration image
+ * @param[in] address Image offset
+ * @param[in] value Value to write
+ * @param[in] size Value size (1, 2 or 4 bytes)
+ */
+static void writeValue(uint16_t address, uint32_t value, uint8_t size)
+{
+	uint8_t buf[4];
+	for(uint8_t i = 0; i < size; i++)
+	{
+		buf[i] = value & 0xFF;
+		value >>= 8;
+	}
+	writeField(address, buf, size);
+}
+
+void ConfigErase(void)
+{
+	FLASH->KEYR = 0x45670123; //unlock memory
+    FLASH->KEYR = 0xCDEF89AB;
+	flashErase(CONFIG_ADDRESS, CONFIG_PAGE_COUNT);
 	FLASH->CR |= FLASH_CR_LOCK;
+}
+
+/**
+ * @brief Write all configuration fields
+ * @attention Fields should be written in image order, so that the complete image is stored as a single record
+ */
+static void writeFields(void)
+{
+	WRITE_ARRAY(call, GeneralConfig.call);
+	WRITE(callSsid, GeneralConfig.callSsid);
+	WRITE_ARRAY(dest, GeneralConfig.dest);
+	WRITE(kissMonitor, GeneralConfig.kissMonitor);
+	WRITE(modem, ModemConfig.modem);
+	WRITE(modemFlags, ModemConfig.usePWM | (ModemConfig.flatAudioIn << 1));
+	WRITE(defaultMode[0], UartUsb.defaultMode);
+	WRITE(defaultMode[1], Uart1.defaultMode);
+	WRITE(defaultMode[2], Uart2.defaultMode);
+	WRITE(baudrate[0], Uart1.baudrate);
+	WRITE(baudrate[1], Uart2.baudrate);
+	WRITE(txDelay, Ax25Config.txDelayLength);
+	WRITE(txTail, Ax25Config.txTailLength);
+	WRITE(quietTime, Ax25Config.quietTime);
+	WRITE(allowNonAprs, Ax25Config.allowNonAprs);
+	WRITE(fx25, Ax25Config.fx25 | (Ax25Config.fx25Tx << 1) | (Ax25Config.fx25Adaptive << 2));
+	WRITE(txWeighted, Ax25Config.txWeighted);
+	WRITE(txMaxFrames, Ax25Config.txMaxFrames);
+	WRITE(txMaxTime, Ax25Config.txMaxTime);
+	WRITE(persistence, Ax25Config.persistence);
+	WRITE(slotTime, Ax25Config.slotTime);
+	WRITE(fullDuplex, Ax25Config.fullDuplex);
+
+	uint8_t enable = 0;
+	for(uint8_t i = 0; i < 8; i++)
+		enable |= (beacon[i].enable > 0) << i;
+	WRITE(beaconEnable, enable);
+	for(uint8_t i = 0; i < 8; i++)
+		WRITE(beaconInterval[i], beacon[i].interval / 6000);
+	for(uint8_t i = 0; i < 8; i++)
+		WRITE(beaconDelay[i], beacon[i].delay / 60);
+	for(uint8_t i = 0; i < 8; i++)
+		WRITE_ARRAY(beaconData[i], beacon[i].data);
+	for(uint8_t i = 0; i < 8; i++)
+		WRITE_ARRAY(beaconPath[i], beacon[i].path);
 
+	WRITE(digiEnable, DigiConfig.enable);
+	WRITE(digiAliasEnable, DigiConfig.enableAlias);
+	WRITE_ARRAY(digiAlias, DigiConfig.alias);
+	WRITE_ARRAY(digiSsid, DigiConfig.ssid);
+	WRITE_ARRAY(digiMax, DigiConfig.max);
+	WRITE_ARRAY(digiRep, DigiConfig.rep);
+	WRITE(digiTraced, DigiConfig.traced);
+	WRITE(digiViscous, DigiConfig.viscous);
+	WRITE(digiDirectOnly, DigiConfig.directOnly);
+	WRITE(digiDupeTime, DigiConfig.dupeTime);
+	WRITE(digiCallFilterEnable, DigiConfig.callFilterEnable);
+	WRITE(digiFilterPolarity, DigiConfig.filterPolarity);
+	WRITE_ARRAY(digiCallFilter, DigiConfig.callFilter);
+	WRITE(digiThrottle, DigiConfig.throttle);
+	WRITE(digiLoadLimit, DigiConfig.loadLimit);
+	WRITE(beaconJitter, BeaconConfig.jitter);
+	uint8_t telemetry = 0;
+	for(uint8_t i = 0; i < 8; i++)
+		telemetry |= (beacon[i].telemetry > 0) << i;
+	WRITE(beaconTelemetry, (uint8_t)~telemetry);
+	WRITE(fx25MinParity, Ax25Config.fx25MinParity);
+	WRITE(fx25MaxParity, Ax25Config.fx25MaxParity);
+	WRITE(il2p, Ax25Config.il2p | (Ax25Config.il2pTx << 1) | (!Ax25Config.il2pCrc << 2));
 }
 
-uint8_t ConfigRead(void)
+/**
+ * @brief Write configuration to bank and commit it
+ * @param[in] start Bank address
+ * @param[in] pos Offset to start writing at
+ * @param[in] all True to write all fields, false to write only changed fields
+ * @return True on success
+ */
+static bool writeBank(uint32_t start, uint16_t pos, bool all)
+{
+	writeStart = start;
+	writePos = pos;
+	writeAll = all;
+	writeError = false;
+	recordOpen = false;
+
+	writeFields();
+	closeRecord();
+
+	if(!writeError) //all records written, commit them
+	{
+		openRecord(CONFIG_RECORD_COMMIT);
+		closeRecord();
+	}
+	return !writeError;
+}
+
+void ConfigWrite(void)
 {
-	if(read(CONFIG_FLAG) != CONFIG_FLAG_WRITTEN) //no configuration stored
+	findBank();
+
+	FLASH->KEYR = 0x45670123; //unlock memory
+    FLASH->KEYR = 0xCDEF89AB;
+
+	//append changes to the current bank if possible
+	if((bank.version == CONFIG_VERSION) && !bank.dirty && writeBank(bank.start, bank.end, false))
 	{
-		return 0;
+		FLASH->CR |= FLASH_CR_LOCK;
+		return;
 	}
-	readString(CONFIG_CALL, GeneralConfig.call, sizeof(GeneralConfig.call));
-	GeneralConfig.callSsid = (uint8_t)read(CONFIG_SSID);
+
+	//otherwise write complete configuration to the other bank
+	//the current bank stays valid until the new one is committed
+	uint32_t start = (bank.start == CONFIG_ADDRESS) ? (CONFIG_ADDRESS + CONFIG_BANK_SIZE) : CONFIG_ADDRESS;
+	uint16_t sequence = bank.sequence + 1;
+	if(flashErase(start, CONFIG_BANK_SIZE / CONFIG_PAGE_SIZE)
+			&& flashProgram(start, CONFIG_BANK_MAGIC)
+			&& flashProgram(start + 2, CONFIG_VERSION)
+			&& flashProgram(start + 4, sequence)
+			&& flashProgram(start + 6, ~sequence))
+	{
+		writeBank(start, CONFIG_BANK_HEADER_SIZE, true);
+	}
+
+	FLASH->CR |= FLASH_CR_LOCK;
+}
+
+/**
+ * @brief Load configuration image in current version
+ */
+static void load(void)
+{
+	READ_ARRAY(call, GeneralConfig.call);
+	GeneralConfig.callSsid = READ(callSsid);
 	uint8_t temp[6];
-	readString(CONFIG_DEST, temp, 6);
+	READ_ARRAY(dest, temp);
 	if((temp[0] >= ('A' << 1)) && (temp[0] <= ('Z' << 1)) && ((temp[0] & 1) == 0)) //check if stored destination address is correct (we just assume it by reading the first byte)
 	{
 		memcpy(GeneralConfig.dest, temp, 6);
 	}
-	Ax25Config.txDelayLength = read(CONFIG_TXDELAY);
-	Ax25Config.txTailLength = read(CONFIG_TXTAIL);
-	Ax25Config.quietTime = read(CONFIG_TXQUIET);
-	readString(CONFIG_RS1BAUD, (uint8_t*)&Uart1.baudrate, 4);
-	readString(CONFIG_RS2BAUD, (uint8_t*)&Uart2.baudrate, 4);
-	uint8_t bce = (uint8_t)read(CONFIG_BEACONS);
-	beacon[0].enable = (bce & 1) > 0;
-	beacon[1].enable = (bce & 2) > 0;
-	beacon[2].enable = (bce & 4) > 0;
-	beacon[3].enable = (bce & 8) > 0;
-	beacon[4].enable = (bce & 16) > 0;
-	beacon[5].enable = (bce & 32) > 0;
-	beacon[6].enable = (bce & 64) > 0;
-	beacon[7].enable = (bce & 128) > 0;
-	for(uint8_t s = 0; s < (sizeof(beacon) / sizeof(*beacon)); s++)
+	GeneralConfig.kissMonitor = (READ(kissMonitor) == 1);
+	ModemConfig.modem = READ(modem);
+	uint8_t t = READ(modemFlags);
+	ModemConfig.usePWM = t & 1;
+	ModemConfig.flatAudioIn = (t & 2) > 0;
+	UartUsb.defaultMode = READ(defaultMode[0]);
+	Uart1.defaultMode = READ(defaultMode[1]);
+	Uart2.defaultMode = READ(defaultMode[2]);
+	Uart1.baudrate = READ(baudrate[0]);
+	Uart2.baudrate = READ(baudrate[1]);
+	Ax25Config.txDelayLength = READ(txDelay);
+	Ax25Config.txTailLength = READ(txTail);
+	Ax25Config.quietTime = READ(quietTime);
+	Ax25Config.allowNonAprs = (READ(allowNonAprs) == 1);
+	t = READ(fx25);
+	Ax25Config.fx25 = t & 1;
+	Ax25Config.fx25Tx = (t & 2) > 0;
+	Ax25Config.fx25Adaptive = (t & 4) > 0;
+	Ax25Config.txWeighted = (READ(txWeighted) == 1);
+	Ax25Config.txMaxFrames = READ(txMaxFrames);
+	uint16_t t16 = READ(txMaxTime);
+	if(t16 <= 60000)
+		Ax25Config.txMaxTime = t16;
+	Ax25Config.persistence = READ(persistence);
+	t16 = READ(slotTime);
+	if((t16 >= 10) && (t16 <= 2550))
+		Ax25Config.slotTime = t16;
+	Ax25Config.fullDuplex = (READ(fullDuplex) == 1);
+
+	t = READ(beaconEnable);
+	for(uint8_t i = 0; i < 8; i++)
+	{
+		beacon[i].enable = (t >> i) & 1;
+		beacon[i].interval = READ(beaconInterval[i]) * 6000;
+		beacon[i].delay = READ(beaconDelay[i]) * 60;
+		READ_ARRAY(beaconData[i], beacon[i].data);
+		READ_ARRAY(beaconPath[i], beacon[i].path);
+	}
+
+	DigiConfig.enable = READ(digiEnable);
+	DigiConfig.enableAlias = READ(digiAliasEnable);
+	READ_ARRAY(digiAlias, DigiConfig.alias);
+	READ_ARRAY(digiSsid, DigiConfig.ssid);
+	READ_ARRAY(digiMax, DigiConfig.max);
+	READ_ARRAY(digiRep, DigiConfig.rep);
+	DigiConfig.traced = READ(digiTraced);
+	DigiConfig.viscous = READ(digiViscous);
+	DigiConfig.directOnly = READ(digiDirectOnly);
+	DigiConfig.dupeTime = READ(digiDupeTime);
+	DigiConfig.callFilterEnable = READ(digiCallFilterEnable);
+	DigiConfig.filterPolarity = READ(digiFilterPolarity);
+	READ_ARRAY(digiCallFilter, DigiConfig.callFilter);
+	DigiConfig.throttle = READ(digiThrottle);
+	t = READ(digiLoadLimit);
+	if(t <= 100)
+		DigiConfig.loadLimit = t;
+	t = READ(beaconJitter);
+	if(t <= BEACON_MAX_JITTER)
+		BeaconConfig.jitter = t;
+	t = ~READ(beaconTelemetry);
+	for(uint8_t i = 0; i < 8; i++)
+	{
+		beacon[i].telemetry = (t >> i) & 1;
+		if(beacon[i].telemetry)
+			t = 0; //only one beacon can send telemetry
+	}
+	t = READ(fx25MinParity);
+	uint8_t t2 = READ(fx25MaxParity);
+	if(((t == 16) || (t == 32) || (t == 64)) && ((t2 == 16) || (t2 == 32) || (t2 == 64)) && (t <= t2))
 	{
-		 beacon[s].interval = read(CONFIG_BCIV + (2 * s)) * 6000;
+		Ax25Config.fx25MinParity = t;
+		Ax25Config.fx25MaxParity = t2;
 	}
-	for(uint8_t s = 0; s < (sizeof(beacon) / sizeof(*beacon)); s++)
+	t = READ(il2p);
+	if(t <= 7) //0xFF if the field is missing
 	{
-		 beacon[s].delay = read(CONFIG_BCDL + (2 * s)) * 60;
+		Ax25Config.il2p = t & 1;
+		Ax25Config.il2pTx = (t & 2) > 0;
+		Ax25Config.il2pCrc = !(t & 4);
 	}
+}
 
-	for(uint8_t g = 0; g < (sizeof(beacon) / sizeof(*beacon)); g++)
+/**
+ * @brief Load configuration image in version 1 layout
+ * @details The configuration is migrated to the current version on next save
+ */
+static void loadV1(void)
+{
+	READ_ARRAY_V1(call, GeneralConfig.call);
+	GeneralConfig.callSsid = READ_V1(callSsid);
+	uint8_t temp[6];
+	READ_ARRAY_V1(dest, temp);
+	if((temp[0] >= ('A' << 1)) && (temp[0] <= ('Z' << 1)) && ((temp[0] & 1) == 0)) //check if stored destination address is correct (we just assume it by reading the first byte)
 	{
-		readString(CONFIG_BC0 + (g * 100), beacon[g].data, 100);
+		memcpy(GeneralConfig.dest, temp, 6);
 	}
-	for(uint8_t g = 0; g < (sizeof(beacon) / sizeof(*beacon)); g++)
+	Ax25Config.txDelayLength = READ_V1(txDelay);
+	Ax25Config.txTailLength = READ_V1(txTail);
+	Ax25Config.quietTime = READ_V1(quietTime);
+	Uart1.baudrate = READ_V1(baudrate[0]);
+	Uart2.baudrate = READ_V1(baudrate[1]);
+	uint8_t bce = READ_V1(beaconEnable);
+	for(uint8_t i = 0; i < 8; i++)
 	{
-		readString(CONFIG_BCP0 + (g * 14), beacon[g].path, 14);
+		beacon[i].enable = (bce >> i) & 1;
+		beacon[i].interval = READ_V1(beaconInterval[i]) * 6000;
+		beacon[i].delay = READ_V1(beaconDelay[i]) * 60;
+		READ_ARRAY_V1(beaconData[i], beacon[i].data);
+		READ_ARRAY_V1(beaconPath[i], beacon[i].path);
 	}
-	DigiConfig.enable = (uint8_t)read(CONFIG_DIGION);
-	DigiConfig.enableAlias = (uint8_t)read(CONFIG_DIGIEN);
-	uint16_t t = read(CONFIG_DIGIVISC);
+	DigiConfig.enable = READ_V1(digiEnable);
+	DigiConfig.enableAlias = READ_V1(digiAliasEnable);
+	uint16_t t = READ_V1(digiViscous);
 	DigiConfig.viscous = (t & 0xFF00) >> 8;
 	DigiConfig.directOnly = t & 0xFF;
-	readString(CONFIG_DIGIAL0, DigiConfig.alias[0], 5);
-	readString(CONFIG_DIGIAL1, DigiConfig.alias[1], 5);
-	readString(CONFIG_DIGIAL2, DigiConfig.alias[2], 5);
-	readString(CONFIG_DIGIAL3, DigiConfig.alias[3], 5);
-	readString(CONFIG_DIGIAL4, DigiConfig.alias[4], 6);
-	readString(CONFIG_DIGIAL5, DigiConfig.alias[5], 6);
-	readString(CONFIG_DIGIAL6, DigiConfig.alias[6], 6);
-	readString(CONFIG_DIGIAL7, DigiConfig.alias[7], 6);
-	DigiConfig.ssid[0] = (uint8_t)read(CONFIG_DIGISSID4);
-	DigiConfig.ssid[1] = (uint8_t)read(CONFIG_DIGISSID5);
-	DigiConfig.ssid[2] = (uint8_t)read(CONFIG_DIGISSID6);
-	DigiConfig.ssid[3] = (uint8_t)read(CONFIG_DIGISSID7);
-	DigiConfig.max[0] = (uint8_t)read(CONFIG_DIGIMAX0);
-	DigiConfig.max[1] = (uint8_t)read(CONFIG_DIGIMAX1);
-	DigiConfig.max[2] = (uint8_t)read(CONFIG_DIGIMAX2);
-	DigiConfig.max[3] = (uint8_t)read(CONFIG_DIGIMAX3);
-	DigiConfig.rep[0] = (uint8_t)read(CONFIG_DIGIREP0);
-	DigiConfig.rep[1] = (uint8_t)read(CONFIG_DIGIREP1);
-	DigiConfig.rep[2] = (uint8_t)read(CONFIG_DIGIREP2);
-	DigiConfig.rep[3] = (uint8_t)read(CONFIG_DIGIREP3);
-	DigiConfig.traced = (uint8_t)read(CONFIG_DIGITRACE);
-	DigiConfig.dupeTime = (uint8_t)read(CONFIG_DIGIDEDUPE);
-	DigiConfig.callFilterEnable = (uint8_t)read(CONFIG_DIGICALLFILEN);
-	DigiConfig.filterPolarity = (uint8_t)read(CONFIG_DIGIFILTYPE);
-	readString(CONFIG_DIGIFILLIST, DigiConfig.callFilter[0], 140);
-	t = (uint8_t)read(CONFIG_PWM_FLAT);
+	for(uint8_t i = 0; i < 4; i++)
+	{
+		READ_ARRAY_V1(digiAlias[i], DigiConfig.alias[i]);
+		readField(offsetof(struct ConfigImageV1, digiAliasNew[i]), DigiConfig.alias[i + 4], sizeof(DigiConfig.alias[i + 4]));
+		DigiConfig.ssid[i] = READ_V1(digiSsid[i]);
+		DigiConfig.max[i] = READ_V1(digiMax[i]);
+		DigiConfig.rep[i] = READ_V1(digiRep[i]);
+	}
+	DigiConfig.traced = READ_V1(digiTraced);
+	DigiConfig.dupeTime = READ_V1(digiDupeTime);
+	DigiConfig.callFilterEnable = READ_V1(digiCallFilterEnable);
+	DigiConfig.filterPolarity = READ_V1(digiFilterPolarity);
+	READ_ARRAY_V1(digiCallFilter, DigiConfig.callFilter);
+	t = READ_V1(digiThrottle);
+	if(t != 0xFFFF) //not present in configurations stored by older versions
+		DigiConfig.throttle = (uint8_t)t;
+	t = READ_V1(digiLoadLimit);
+	if(t <= 100)
+		DigiConfig.loadLimit = (uint8_t)t;
+	t = READ_V1(modemFlags);
 	ModemConfig.usePWM = t & 1;
 	ModemConfig.flatAudioIn = (t & 2) > 0;
-	GeneralConfig.kissMonitor = (read(CONFIG_KISSMONITOR) == 1);
-	Ax25Config.allowNonAprs = (read(CONFIG_ALLOWNONAPRS) == 1);
-	t = (uint8_t)read(CONFIG_FX25);
+	GeneralConfig.kissMonitor = (READ_V1(kissMonitor) == 1);
+	Ax25Config.allowNonAprs = (READ_V1(allowNonAprs) == 1);
+	t = READ_V1(fx25);
 	Ax25Config.fx25 = t & 1;
 	Ax25Config.fx25Tx = (t & 2) > 0;
-	ModemConfig.modem = read(CONFIG_MODEM);
-	UartUsb.defaultMode = read(CONFIG_MODE_USB);
-	Uart1.defaultMode = read(CONFIG_MODE_UART1);
-	Uart2.defaultMode = read(CONFIG_MODE_UART2);
+	ModemConfig.modem = READ_V1(modem);
+	UartUsb.defaultMode = READ_V1(defaultMode[0]);
+	Uart1.defaultMode = READ_V1(defaultMode[1]);
+	Uart2.defaultMode = READ_V1(defaultMode[2]);
+	Ax25Config.txWeighted = (READ_V1(txWeighted) == 1);
+	t = READ_V1(txMaxFrames);
+	if(t <= 255) //not present in configurations stored by older versions
+		Ax25Config.txMaxFrames = (uint8_t)t;
+	t = READ_V1(txMaxTime);
+	if(t <= 60000)
+		Ax25Config.txMaxTime = t;
+	t = READ_V1(persistence);
+	if(t <= 255)
+		Ax25Config.persistence = (uint8_t)t;
+	t = READ_V1(slotTime);
+	if((t >= 10) && (t <= 2550))
+		Ax25Config.slotTime = t;
+	Ax25Config.fullDuplex = (READ_V1(fullDuplex) == 1);
+}
 
-	return 1;
+uint8_t ConfigRead(void)
+{
+	findBank();
+	if(bank.version == CONFIG_VERSION)
+	{
+		load();
+		return 1;
+	}
+	if((bank.version != 0) && (READ_V1(flag) == CONFIG_FLAG_WRITTEN))
+	{
+		loadV1();
+		return 1;
+	}
+	return 0; //no configuration stored
 }
@@ -25,36 +25,47 @@ along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
 #include <math.h>
 #include <modem.h>
 #include <systick.h>
+#include "channel.h"
+#include "timer.h"
+#include "trace.h"
 #include "drivers/digipeater_ll.h"
 
 struct _DigiConfig DigiConfig;
 
-#define VISCOUS_MAX_FRAME_COUNT 10 //max frames in viscous-delay buffer
+#define VISCOUS_MAX_FRAME_COUNT 8 //max frames in viscous-delay buffer, more than a typical 1200 Bd channel carries from direct stations within the hold time
 #define VISCOUS_MAX_FRAME_SIZE 150
 
 struct ViscousData
 {
 	uint32_t hash;
-	uint32_t timeLimit;
+	uint32_t timeLimit; //lower 32 bits of SysTick counter, 0 if slot is free
 	uint8_t frame[VISCOUS_MAX_FRAME_SIZE];
 	uint16_t size;
 };
 static struct ViscousData viscous[VISCOUS_MAX_FRAME_COUNT];
 #define VISCOUS_HOLD_TIME 5000 //viscous-delay hold time in ms
+#define DIGI_STATE_INTERVAL 100 //digipeater disable input and LED update interval in ms
 
 struct DeDupeData
 {
 	uint32_t hash;
-	uint32_t timeLimit;
+	uint32_t timeLimit; //lower 32 bits of SysTick counter
 };
 
 #define DEDUPE_SIZE (50) //duplicate protection buffer size (number of hashes)
 static struct DeDupeData deDupe[DEDUPE_SIZE]; //duplicate protection hash buffer
 static uint8_t deDupeCount = 0; //duplicate protection buffer index
 
+static struct DigiStats digiStats;
+
 
 static uint8_t buf[AX25_FRAME_MAX_SIZE];
 
+static void viscousRefresh(void);
+static struct Timer viscousTimer = TIMER_INIT(viscousRefresh); //viscous-delay hold timer
+static void updateState(void);
+static struct Timer stateTimer = TIMER_INIT(updateState); //digipeater state update timer
+
 /**
  * @brief Check if frame with specified hash is already in viscous-delay buffer and delete it if so
  * @param[in] hash Frame hash
@@ -78,35 +89,48 @@ static uint8_t viscousCheckAndRemove(uint32_t hash)
 
 
 
-static void DigiViscousRefresh(void)
+/**
+ * @brief Transmit viscous-delayed frames whose hold time has elapsed and restart timer for the next one
+ */
+static void viscousRefresh(void)
 {
-    if(DigiConfig.viscous == 0) //viscous digipeating disabled on every alias
-    {
-    	return;
-    }
+	uint32_t now = SysTickGet();
+	uint32_t next = UINT32_MAX; //time to the nearest remaining frame
 
 	for(uint8_t i = 0; i < VISCOUS_MAX_FRAME_COUNT; i++)
-    {
-    	if((viscous[i].timeLimit > 0) && (SysTickGet() >= viscous[i].timeLimit)) //it's time to transmit this frame
-        {
-            void *handle = NULL;
-            if(NULL != (handle = Ax25WriteTxFrame(viscous[i].frame, viscous[i].size)))
-            {
-				if(GeneralConfig.kissMonitor) //monitoring mode, send own frames to KISS ports
-				{
-					TermSendToAll(MODE_KISS, viscous[i].frame, viscous[i].size);
-				}
-
-				TermSendToAll(MODE_MONITOR, (uint8_t*)"(AX.25) Transmitting viscous-delayed frame: ", 0);
-				SendTNC2(viscous[i].frame, viscous[i].size);
-				TermSendToAll(MODE_MONITOR, (uint8_t*)"\r\n", 0);
-            }
+	{
+		if(viscous[i].timeLimit == 0)
+			continue;
 
-    		viscous[i].hash = 0; //clear slot
-    		viscous[i].timeLimit = 0;
-    		viscous[i].size = 0;
-        }
-    }
+		int32_t remaining = (int32_t)(viscous[i].timeLimit - now);
+		if(remaining > 0) //not yet
+		{
+			if((uint32_t)remaining < next)
+				next = remaining;
+			continue;
+		}
+
+		//it's time to transmit this frame
+		void *handle = NULL;
+		if(NULL != (handle = Ax25WriteTxFrame(viscous[i].frame, viscous[i].size, AX25_TX_CLASS_DIGI)))
+		{
+			if(GeneralConfig.kissMonitor) //monitoring mode, send own frames to KISS ports
+			{
+				TermSendToAll(MODE_KISS, viscous[i].frame, viscous[i].size);
+			}
+
+			TermSendToAll(MODE_MONITOR, (uint8_t*)"(AX.25) Transmitting viscous-delayed frame: ", 0);
+			SendTNC2(viscous[i].frame, viscous[i].size);
+			TermSendToAll(MODE_MONITOR, (uint8_t*)"\r\n", 0);
+		}
+
+		viscous[i].hash = 0; //clear slot
+		viscous[i].timeLimit = 0;
+		viscous[i].size = 0;
+	}
+
+	if(next != UINT32_MAX)
+		TimerStart(&viscousTimer, next);
 }
 
 /**
@@ -163,6 +187,27 @@ static uint8_t filterFrameCheck(uint8_t *call, uint8_t alias)
 }
 
 
+/**
+ * @brief Check if frame should be dropped because of channel congestion
+ * @param[in] alias Alias number: 0-3 - n-N aliases, 4-7 - simple aliases
+ * @param[in] n Number in n-N type alias, e.g. in WIDE2-1 n=2
+ * @return 1 if frame should be dropped, 0 otherwise
+ * @attention n-N hops with n=1 (e.g. WIDE1-1) are never throttled
+ */
+static uint8_t throttleCheck(uint8_t alias, uint8_t n)
+{
+	if((DigiConfig.loadLimit == 0) || ((DigiConfig.throttle & (1 << alias)) == 0))
+		return 0;
+
+	if((alias < 4) && (n <= 1))
+		return 0;
+
+	if(ChannelGetUtilization(CHANNEL_WINDOW_1MIN) < ((uint16_t)DigiConfig.loadLimit * 10))
+		return 0;
+
+	return 1;
+}
+
 /**
  * @brief Produce and push digipeated frame to transmit buffer
  * @param[in] *frame Pointer to frame buffer
@@ -172,8 +217,9 @@ static uint8_t filterFrameCheck(uint8_t *call, uint8_t alias)
  * @param[in] alias Alias number: 0-3 - n-N aliases, 4-7 - simple aliases, 8 - own call
  * @param[in] simple If 1, it is a simple alias or should be treated as a simple alias
  * @param[in] n Number in n-N type alias, e.g. in WIDE2-1 n=2
+ * @return Decision taken for this frame
  */
-static void makeFrame(uint8_t *frame, uint16_t elStart, uint16_t len, uint32_t hash, uint8_t alias, uint8_t simple, uint8_t n)
+static enum DigiResult makeFrame(uint8_t *frame, uint16_t elStart, uint16_t len, uint32_t hash, uint8_t alias, uint8_t simple, uint8_t n)
 {
     uint16_t _index = 0; //underlying index for buffer if not in viscous-delay mode
     uint8_t *buffer; //buffer to store frame being prepared
@@ -192,7 +238,7 @@ static void makeFrame(uint8_t *frame, uint16_t elStart, uint16_t len, uint32_t h
         }
 
     	if((len + 7) > VISCOUS_MAX_FRAME_SIZE) //if frame length (+ 7 bytes for inserted call) is bigger than buffer size
-    		return; //drop
+    		return DIGI_DROPPED; //drop
 
     	buffer = viscous[viscousSlot].frame;
     	index = &(viscous[viscousSlot].size);
@@ -201,7 +247,7 @@ static void makeFrame(uint8_t *frame, uint16_t elStart, uint16_t len, uint32_t h
     else //normal mode
     {
     	if((uint16_t)sizeof(buf) < (len + 7))
-    		return;
+    		return DIGI_DROPPED;
     	buffer = buf;
     }
 
@@ -209,7 +255,10 @@ static void makeFrame(uint8_t *frame, uint16_t elStart, uint16_t len, uint32_t h
     if(alias < 8)
     {
     	if(!filterFrameCheck(&frame[7], alias)) //push source callsign through the filter
-    		return;
+    	{
+    		TermSendToAll(MODE_MONITOR, (uint8_t*)"Frame rejected by call filter, not digipeating\r\n", 0);
+    		return DIGI_FILTERED;
+    	}
     }
     uint8_t ssid = (frame[elStart + 6] >> 1) - 48; //store SSID (N)
 
@@ -219,9 +268,9 @@ static void makeFrame(uint8_t *frame, uint16_t elStart, uint16_t len, uint32_t h
     	if((DigiConfig.viscous & (1 << (alias))) || (DigiConfig.directOnly & (1 << alias))) //viscous-delay or direct-only enabled
     	{
     		if(elStart != 14)
-    			return; //this is not the very first path element, frame not received directly
+    			return DIGI_FILTERED; //this is not the very first path element, frame not received directly
     		if((alias <= 3) && (ssid != n))
-    			return; //n-N type alias, but n is not equal to N, frame not received directly
+    			return DIGI_FILTERED; //n-N type alias, but n is not equal to N, frame not received directly
     	}
     }
 
@@ -286,12 +335,17 @@ static void makeFrame(uint8_t *frame, uint16_t elStart, uint16_t len, uint32_t h
 	{
 		viscous[viscousSlot].hash = hash;
     	viscous[viscousSlot].timeLimit = SysTickGet() + (VISCOUS_HOLD_TIME / SYSTICK_INTERVAL);
+		if(viscous[viscousSlot].timeLimit == 0) //0 marks a free slot
+			viscous[viscousSlot].timeLimit = 1;
+		if(!TimerIsActive(&viscousTimer)) //hold time is constant, so a running timer already expires earlier
+			TimerStart(&viscousTimer, VISCOUS_HOLD_TIME / SYSTICK_INTERVAL);
 		TermSendToAll(MODE_MONITOR, (uint8_t*)"Saving frame for viscous-delay digipeating\r\n", 0);
+		return DIGI_VISCOUS_HELD;
 	}
 	else
 	{
 		void *handle = NULL;
-        if(NULL != (handle = Ax25WriteTxFrame(buffer, *index)))
+        if(NULL != (handle = Ax25WriteTxFrame(buffer, *index, AX25_TX_CLASS_DIGI)))
         {
             DigiStoreDeDupe(buffer, *index);
 
@@ -303,22 +357,27 @@ static void makeFrame(uint8_t *frame, uint16_t elStart, uint16_t len, uint32_t h
 			TermSendToAll(MODE_MONITOR, (uint8_t*)"(AX.25) Digipeating frame: ", 0);
 			SendTNC2(buffer, *index);
 			TermSendToAll(MODE_MONITOR, (uint8_t*)"\r\n", 0);
+			return DIGI_DIGIPEATED;
         }
+		TermSendToAll(MODE_MONITOR, (uint8_t*)"TX buffer full, dropping frame\r\n", 0);
+		return DIGI_DROPPED;
 	}
 }
 
 
 
-void DigiDigipeat(uint8_t *frame, uint16_t len)
+enum DigiResult DigiDigipeat(uint8_t *frame, uint16_t len)
 {
+	TraceStamp(TraceGetCurrent(), TRACE_STAGE_DIGI);
+
 	if(!DigiConfig.enable || DIGIPEATER_LL_GET_DISABLE_STATE())
-		return;
+		return DIGI_IGNORED;
 
     uint16_t t = 13; //start from first byte that can contain path end bit
     while((frame[t] & 1) == 0) //look for path end
     {
     	if((t + 7) >= len)
-    		return;
+    		return DIGI_IGNORED;
         t += 7;
     }
 
@@ -329,22 +388,29 @@ void DigiDigipeat(uint8_t *frame, uint16_t len)
     if(DigiConfig.viscous) //viscous-delay enabled on any slot
     {
     	if(viscousCheckAndRemove(hash)) //check if this frame was received twice
-    		return; //if so, drop it
+    	{
+    		digiStats.viscousCancelled++;
+    		return DIGI_VISCOUS_CANCELLED; //if so, drop it
+    	}
     }
 
     for(uint8_t i = 0; i < DEDUPE_SIZE; i++) //check if frame is already in duplicate filtering buffer
     {
         if(deDupe[i].hash == hash)
         {
-            if(SysTickGet() < (deDupe[i].timeLimit))
-            	return; //filter out duplicate frame
+            if((int32_t)(deDupe[i].timeLimit - SysTickGet()) > 0) //wrap-safe comparison
+            {
+            	TermSendToAll(MODE_MONITOR, (uint8_t*)"Duplicate frame, not digipeating\r\n", 0);
+            	digiStats.duplicates++;
+            	return DIGI_DUPLICATE; //filter out duplicate frame
+            }
         }
     }
 
 
     if(t == 13) //path end bit in source address, no path in this frame
     {
-        return; //drop it
+        return DIGI_IGNORED; //drop it
     }
 
 
@@ -375,8 +441,7 @@ void DigiDigipeat(uint8_t *frame, uint16_t len)
 
     if(err == 0) //our callsign is in the path
     {
-    	makeFrame(frame, t, len, hash, 8, 1, 0);
-    	return;
+    	return makeFrame(frame, t, len, hash, 8, 1, 0);
     }
 
     for(uint8_t i = 0; i < 4; i++) //check for simple alias match
@@ -395,15 +460,23 @@ void DigiDigipeat(uint8_t *frame, uint16_t len)
 
         if(err == 0) //no error
         {
-        	makeFrame(frame, t, len, hash, i + 4, 1, 0);
-        	return;
+        	if(throttleCheck(i + 4, 0))
+        	{
+        		TermSendToAll(MODE_MONITOR, (uint8_t*)"Channel congested, dropping frame received on throttled alias\r\n", 0);
+        		return DIGI_THROTTLED;
+        	}
+        	return makeFrame(frame, t, len, hash, i + 4, 1, 0);
         }
     }
 
     //n-N style alias handling
+    enum DigiResult result = DIGI_IGNORED;
 
     for(uint8_t i = 0; i < 4; i++)
     {
+    	if(DigiConfig.alias[i][0] == 0) //empty alias would match any path element
+    		continue;
+
         err = 0;
         uint8_t j = 0;
     	for(; j < strlen((const char *)DigiConfig.alias[i]); j++)
@@ -425,28 +498,42 @@ void DigiDigipeat(uint8_t *frame, uint16_t len)
             //0 < n < 8
             //0 < N < 8
             if(((ssid > 0) && (ssid < 8) && (n > 0) && (n < 8) && (ssid <= n)) == 0) //path is broken or already used (N=0)
-            	return;
+            	return DIGI_IGNORED;
 
             //check if n and N <= digi max
             if((n <= DigiConfig.max[i]) && (ssid <= DigiConfig.max[i]))
             {
                 if(DigiConfig.enableAlias & (1 << i))
-                	makeFrame(frame, t, len, hash, i, 0, n); //process as a standard n-N frame
+                {
+                	if(throttleCheck(i, n))
+                		result = DIGI_THROTTLED;
+                	else
+                		result = makeFrame(frame, t, len, hash, i, 0, n); //process as a standard n-N frame
+                }
             }
             else if((DigiConfig.rep[i] > 0) && (n >= DigiConfig.rep[i])) //else check if n and N >= digi replace
             {
                 if(DigiConfig.enableAlias & (1 << i))
-                	makeFrame(frame, t, len, hash, i, 1, n);
+                {
+                	if(throttleCheck(i, n))
+                		result = DIGI_THROTTLED;
+                	else
+                		result = makeFrame(frame, t, len, hash, i, 1, n);
+                }
             }
         }
     }
 
+    if(DIGI_THROTTLED == result)
+    	TermSendToAll(MODE_MONITOR, (uint8_t*)"Channel congested, dropping frame received on throttled alias\r\n", 0);
+
+    return result;
 
 }
 
 
 
-void DigiStoreDeDupe(uint8_t *buf, uint16_t size)
+uint32_t DigiGetHash(uint8_t *buf, uint16_t size)
 {
 	uint32_t hash = Crc32(CRC32_INIT, buf, 14); //calculate for destination and source address
 
@@ -456,12 +543,15 @@ void DigiStoreDeDupe(uint8_t *buf, uint16_t size)
     {
         i++;
         if(i == size)
-        	return;
+        	return 0;
     }
     i++;
 
-    hash = Crc32(hash, &buf[i], size - i);
+    return Crc32(hash, &buf[i], size - i);
+}
 
+void DigiStoreDeDupeHash(uint32_t hash)
+{
     deDupeCount %= DEDUPE_SIZE;
 
     deDupe[deDupeCount].hash = hash;
@@ -470,10 +560,28 @@ void DigiStoreDeDupe(uint8_t *buf, uint16_t size)
     deDupeCount++;
 }
 
+void DigiStoreDeDupe(uint8_t *buf, uint16_t size)
+{
+	uint32_t hash = DigiGetHash(buf, size);
+	if(hash)
+		DigiStoreDeDupeHash(hash);
+}
+
 void DigiInitialize(void)
 {
 	DIGIPEATER_LL_INITIALIZE_RCC();
 	DIGIPEATER_LL_INITIALIZE_INPUTS_OUTPUTS();
+	updateState();
+}
+
+/**
+ * @brief Update digipeater state and restart state timer
+ * @attention Called by state timer
+ */
+static void updateState(void)
+{
+	DigiUpdateState();
+	TimerStart(&stateTimer, DIGI_STATE_INTERVAL / SYSTICK_INTERVAL);
 }
 
 void DigiUpdateState(void)
@@ -487,6 +595,9 @@ void DigiUpdateState(void)
 	}
 	else
 		DIGIPEATER_LL_LED_OFF();
+}
 
-	DigiViscousRefresh();
+void DigiGetStats(struct DigiStats *stats)
+{
+	*stats = digiStats;
 }
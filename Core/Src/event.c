@@ -0,0 +1,62 @@
+/*
+Copyright 2020-2025 Piotr Wilkon
+
+This file is part of VP-Digi.
+
+VP-Digi is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+VP-Digi is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "event.h"
+#include "stm32f1xx.h"
+#include "profile.h"
+
+static volatile uint32_t events = 0; //posted events bitmap
+
+void EventPost(uint32_t e)
+{
+	uint32_t primask = __get_PRIMASK(); //may be called with interrupts already disabled
+	__disable_irq();
+	events |= e;
+	__set_PRIMASK(primask);
+}
+
+uint32_t EventGet(void)
+{
+	__disable_irq();
+	uint32_t e = events;
+	events = 0;
+	__enable_irq();
+	return e;
+}
+
+void EventSleep(void)
+{
+	//WFI with interrupts disabled still wakes up on pending interrupt
+	//so an event posted between the check and WFI can't be missed
+	//interrupts that post no event, e.g. SysTick with no timer due, are handled here without a main loop pass
+	__disable_irq();
+	while(0 == events)
+	{
+#ifdef ENABLE_PROFILING
+		uint32_t start = SysTickGetCycles();
+		__WFI();
+		ProfileIdle(SysTickGetCycles() - start); //interrupts are still disabled, so their time is not counted
+#else
+		__WFI();
+#endif
+		__enable_irq(); //handle the interrupt that woke the core up
+		__disable_irq();
+	}
+	__enable_irq();
+}
@@ -21,13 +21,28 @@ along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "fx25.h"
 #include <stddef.h>
+#include <string.h>
 #include "rs.h"
+#include "ax25.h"
+#ifdef ENABLE_PROFILING
+#include "systick.h"
+#include "common.h"
+#endif
 
 #define FX25_RS_FCR 1
 
 #define FX25_PREGENERATE_POLYS
 #define FX25_MAX_DISTANCE 10 //maximum Hamming distance when comparing tags
 
+//LwFEC is used unless ENABLE_FX25_INTREE_RS is defined
+//the benchmark compares both implementations, so both are built for it
+#if defined(ENABLE_FX25_INTREE_RS) || defined(ENABLE_PROFILING)
+#define FX25_BUILD_INTREE_RS
+#endif
+#if !defined(ENABLE_FX25_INTREE_RS) || defined(ENABLE_PROFILING)
+#define FX25_BUILD_LWFEC_RS
+#endif
+
 const struct Fx25Mode Fx25ModeList[11] =
 {
 	{.tag =  0xB74DB7DF8A532F3E, .K = 239, .T = 16},
@@ -45,18 +60,109 @@ const struct Fx25Mode Fx25ModeList[11] =
 
 
 
+//number of set bits in a byte
+#define FX25_POPCOUNT2(n) (n), (n) + 1, (n) + 1, (n) + 2
+#define FX25_POPCOUNT4(n) FX25_POPCOUNT2(n), FX25_POPCOUNT2((n) + 1), FX25_POPCOUNT2((n) + 1), FX25_POPCOUNT2((n) + 2)
+#define FX25_POPCOUNT6(n) FX25_POPCOUNT4(n), FX25_POPCOUNT4((n) + 1), FX25_POPCOUNT4((n) + 1), FX25_POPCOUNT4((n) + 2)
+static const uint8_t popcount8[256] =
+{
+	FX25_POPCOUNT6(0), FX25_POPCOUNT6(1), FX25_POPCOUNT6(1), FX25_POPCOUNT6(2)
+};
+
 const struct Fx25Mode* Fx25GetModeForTag(uint64_t tag)
 {
+	//this is called for every received bit, so the distance is calculated from a byte table in two halves
+	//and the comparison is abandoned if the lower half alone exceeds the limit, which is the case for almost any input
 	for(uint8_t i = 0; i < sizeof(Fx25ModeList) / sizeof(*Fx25ModeList); i++)
 	{
-		if(__builtin_popcountll(tag ^ Fx25ModeList[i].tag) <= FX25_MAX_DISTANCE)
+		uint32_t diff = (uint32_t)tag ^ (uint32_t)Fx25ModeList[i].tag;
+		uint8_t distance = popcount8[diff & 0xFF] + popcount8[(diff >> 8) & 0xFF] + popcount8[(diff >> 16) & 0xFF] + popcount8[diff >> 24];
+		if(distance > FX25_MAX_DISTANCE)
+			continue;
+		diff = (uint32_t)(tag >> 32) ^ (uint32_t)(Fx25ModeList[i].tag >> 32);
+		distance += popcount8[diff & 0xFF] + popcount8[(diff >> 8) & 0xFF] + popcount8[(diff >> 16) & 0xFF] + popcount8[diff >> 24];
+		if(distance <= FX25_MAX_DISTANCE)
 			return &Fx25ModeList[i];
 	}
 	return NULL;
 }
 
+//channel quality estimate: exponential average of byte errors per received block, scaled to 255-byte block, in 8.8 fixed point
+#define FX25_QUALITY_SHIFT 3 //average weight is 1/8
+#define FX25_QUALITY_BLOCK_SIZE 255 //block size the estimate is scaled to
+static uint16_t channelErrors = 0;
+
+//max expected byte errors in a block in 8.8 fixed point for parity 16, 32 and 64
+//the number of errors varies a lot from block to block, so the limits are well below T/2,
+//tuned with test/fx25_airtime, so that adaptive mode does not need more airtime than the standard one
+static const uint16_t fx25MaxExpectedErrors[3] = {576, 2304, 5120}; //2.25, 9 and 20
+
+void Fx25UpdateChannelQuality(uint8_t errors, const struct Fx25Mode *mode)
+{
+	int32_t avg = channelErrors;
+	avg += ((((int32_t)errors << 8) * FX25_QUALITY_BLOCK_SIZE / (mode->K + mode->T)) - avg) >> FX25_QUALITY_SHIFT;
+	channelErrors = avg;
+}
+
+/**
+ * @brief Check if block should be decoded on current channel
+ * @param *mode FX.25 mode
+ * @return True if expected number of byte errors in the block is within the limit for its parity size
+ */
+static bool isModeSuitable(const struct Fx25Mode *mode)
+{
+	uint32_t expected = (uint32_t)channelErrors * (mode->K + mode->T) / FX25_QUALITY_BLOCK_SIZE;
+	return expected <= fx25MaxExpectedErrors[(mode->T == 16) ? 0 : ((mode->T == 32) ? 1 : 2)];
+}
+
+uint16_t Fx25GetChannelErrors(void)
+{
+	return channelErrors;
+}
+
+uint8_t Fx25GetAdaptiveParity(void)
+{
+	//parity size for the biggest blocks, the expected number of errors is the estimate itself then
+	uint8_t parity = Ax25Config.fx25MinParity;
+	while((parity < Ax25Config.fx25MaxParity) && (channelErrors > fx25MaxExpectedErrors[(parity == 16) ? 0 : ((parity == 32) ? 1 : 2)]))
+		parity <<= 1;
+	return parity;
+}
+
 const struct Fx25Mode* Fx25GetModeForSize(uint16_t size)
 {
+	if(Ax25Config.fx25Adaptive)
+	{
+		//errors are counted per byte, so the smallest block that is suitable for current channel quality is used,
+		//which might have a different parity size for small and big frames
+		//if there is no such block, use the biggest parity size, but below the minimum only if the frame is too big for it
+		const struct Fx25Mode *best = NULL;
+		bool bestSuitable = false;
+		for(uint8_t i = 0; i < sizeof(Fx25ModeList) / sizeof(*Fx25ModeList); i++)
+		{
+			const struct Fx25Mode *mode = &Fx25ModeList[i];
+			if((mode->K < size) || (mode->T > Ax25Config.fx25MaxParity))
+				continue;
+			bool suitable = (mode->T >= Ax25Config.fx25MinParity) && isModeSuitable(mode);
+			if((NULL == best) || (suitable && !bestSuitable))
+			{
+				best = mode;
+				bestSuitable = suitable;
+			}
+			else if(suitable && bestSuitable)
+			{
+				if(((mode->K + mode->T) < (best->K + best->T)) || (((mode->K + mode->T) == (best->K + best->T)) && (mode->T > best->T)))
+					best = mode;
+			}
+			else if(!suitable && !bestSuitable)
+			{
+				if((mode->T > best->T) || ((mode->T == best->T) && (mode->K < best->K)))
+					best = mode;
+			}
+		}
+		return best; //NULL if frame is too big, do not use FX.25 then
+	}
+
 	//use "UZ7HO Soundmodem standard" for choosing FX.25 mode
 	if(size <= 32)
 		return &Fx25ModeList[3];
@@ -74,13 +180,269 @@ const struct Fx25Mode* Fx25GetModeForSize(uint16_t size)
 		return NULL; //frame too big, do not use FX.25
 }
 
+#ifdef FX25_BUILD_INTREE_RS
+#if FX25_RS_FCR != 1
+#error "In-tree Reed-Solomon decoder supports FX25_RS_FCR = 1 only"
+#endif
+
+//GF(256) with primitive polynomial 0x11D, the same as in LwFEC
+//the antilogarithm table is doubled, so that a sum of two logarithms can be used without modulo
+static const uint8_t gfExp[512] =
+{
+	0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1D, 0x3A, 0x74, 0xE8, 0xCD, 0x87, 0x13, 0x26,
+	0x4C, 0x98, 0x2D, 0x5A, 0xB4, 0x75, 0xEA, 0xC9, 0x8F, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xC0,
+	0x9D, 0x27, 0x4E, 0x9C, 0x25, 0x4A, 0x94, 0x35, 0x6A, 0xD4, 0xB5, 0x77, 0xEE, 0xC1, 0x9F, 0x23,
+	0x46, 0x8C, 0x05, 0x0A, 0x14, 0x28, 0x50, 0xA0, 0x5D, 0xBA, 0x69, 0xD2, 0xB9, 0x6F, 0xDE, 0xA1,
+	0x5F, 0xBE, 0x61, 0xC2, 0x99, 0x2F, 0x5E, 0xBC, 0x65, 0xCA, 0x89, 0x0F, 0x1E, 0x3C, 0x78, 0xF0,
+	0xFD, 0xE7, 0xD3, 0xBB, 0x6B, 0xD6, 0xB1, 0x7F, 0xFE, 0xE1, 0xDF, 0xA3, 0x5B, 0xB6, 0x71, 0xE2,
+	0xD9, 0xAF, 0x43, 0x86, 0x11, 0x22, 0x44, 0x88, 0x0D, 0x1A, 0x34, 0x68, 0xD0, 0xBD, 0x67, 0xCE,
+	0x81, 0x1F, 0x3E, 0x7C, 0xF8, 0xED, 0xC7, 0x93, 0x3B, 0x76, 0xEC, 0xC5, 0x97, 0x33, 0x66, 0xCC,
+	0x85, 0x17, 0x2E, 0x5C, 0xB8, 0x6D, 0xDA, 0xA9, 0x4F, 0x9E, 0x21, 0x42, 0x84, 0x15, 0x2A, 0x54,
+	0xA8, 0x4D, 0x9A, 0x29, 0x52, 0xA4, 0x55, 0xAA, 0x49, 0x92, 0x39, 0x72, 0xE4, 0xD5, 0xB7, 0x73,
+	0xE6, 0xD1, 0xBF, 0x63, 0xC6, 0x91, 0x3F, 0x7E, 0xFC, 0xE5, 0xD7, 0xB3, 0x7B, 0xF6, 0xF1, 0xFF,
+	0xE3, 0xDB, 0xAB, 0x4B, 0x96, 0x31, 0x62, 0xC4, 0x95, 0x37, 0x6E, 0xDC, 0xA5, 0x57, 0xAE, 0x41,
+	0x82, 0x19, 0x32, 0x64, 0xC8, 0x8D, 0x07, 0x0E, 0x1C, 0x38, 0x70, 0xE0, 0xDD, 0xA7, 0x53, 0xA6,
+	0x51, 0xA2, 0x59, 0xB2, 0x79, 0xF2, 0xF9, 0xEF, 0xC3, 0x9B, 0x2B, 0x56, 0xAC, 0x45, 0x8A, 0x09,
+	0x12, 0x24, 0x48, 0x90, 0x3D, 0x7A, 0xF4, 0xF5, 0xF7, 0xF3, 0xFB, 0xEB, 0xCB, 0x8B, 0x0B, 0x16,
+	0x2C, 0x58, 0xB0, 0x7D, 0xFA, 0xE9, 0xCF, 0x83, 0x1B, 0x36, 0x6C, 0xD8, 0xAD, 0x47, 0x8E, 0x01,
+	0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1D, 0x3A, 0x74, 0xE8, 0xCD, 0x87, 0x13, 0x26, 0x4C,
+	0x98, 0x2D, 0x5A, 0xB4, 0x75, 0xEA, 0xC9, 0x8F, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xC0, 0x9D,
+	0x27, 0x4E, 0x9C, 0x25, 0x4A, 0x94, 0x35, 0x6A, 0xD4, 0xB5, 0x77, 0xEE, 0xC1, 0x9F, 0x23, 0x46,
+	0x8C, 0x05, 0x0A, 0x14, 0x28, 0x50, 0xA0, 0x5D, 0xBA, 0x69, 0xD2, 0xB9, 0x6F, 0xDE, 0xA1, 0x5F,
+	0xBE, 0x61, 0xC2, 0x99, 0x2F, 0x5E, 0xBC, 0x65, 0xCA, 0x89, 0x0F, 0x1E, 0x3C, 0x78, 0xF0, 0xFD,
+	0xE7, 0xD3, 0xBB, 0x6B, 0xD6, 0xB1, 0x7F, 0xFE, 0xE1, 0xDF, 0xA3, 0x5B, 0xB6, 0x71, 0xE2, 0xD9,
+	0xAF, 0x43, 0x86, 0x11, 0x22, 0x44, 0x88, 0x0D, 0x1A, 0x34, 0x68, 0xD0, 0xBD, 0x67, 0xCE, 0x81,
+	0x1F, 0x3E, 0x7C, 0xF8, 0xED, 0xC7, 0x93, 0x3B, 0x76, 0xEC, 0xC5, 0x97, 0x33, 0x66, 0xCC, 0x85,
+	0x17, 0x2E, 0x5C, 0xB8, 0x6D, 0xDA, 0xA9, 0x4F, 0x9E, 0x21, 0x42, 0x84, 0x15, 0x2A, 0x54, 0xA8,
+	0x4D, 0x9A, 0x29, 0x52, 0xA4, 0x55, 0xAA, 0x49, 0x92, 0x39, 0x72, 0xE4, 0xD5, 0xB7, 0x73, 0xE6,
+	0xD1, 0xBF, 0x63, 0xC6, 0x91, 0x3F, 0x7E, 0xFC, 0xE5, 0xD7, 0xB3, 0x7B, 0xF6, 0xF1, 0xFF, 0xE3,
+	0xDB, 0xAB, 0x4B, 0x96, 0x31, 0x62, 0xC4, 0x95, 0x37, 0x6E, 0xDC, 0xA5, 0x57, 0xAE, 0x41, 0x82,
+	0x19, 0x32, 0x64, 0xC8, 0x8D, 0x07, 0x0E, 0x1C, 0x38, 0x70, 0xE0, 0xDD, 0xA7, 0x53, 0xA6, 0x51,
+	0xA2, 0x59, 0xB2, 0x79, 0xF2, 0xF9, 0xEF, 0xC3, 0x9B, 0x2B, 0x56, 0xAC, 0x45, 0x8A, 0x09, 0x12,
+	0x24, 0x48, 0x90, 0x3D, 0x7A, 0xF4, 0xF5, 0xF7, 0xF3, 0xFB, 0xEB, 0xCB, 0x8B, 0x0B, 0x16, 0x2C,
+	0x58, 0xB0, 0x7D, 0xFA, 0xE9, 0xCF, 0x83, 0x1B, 0x36, 0x6C, 0xD8, 0xAD, 0x47, 0x8E, 0x01, 0x02,
+};
+
+//logarithm table, gfLog[0] is not used
+static const uint8_t gfLog[256] =
+{
+	0x00, 0x00, 0x01, 0x19, 0x02, 0x32, 0x1A, 0xC6, 0x03, 0xDF, 0x33, 0xEE, 0x1B, 0x68, 0xC7, 0x4B,
+	0x04, 0x64, 0xE0, 0x0E, 0x34, 0x8D, 0xEF, 0x81, 0x1C, 0xC1, 0x69, 0xF8, 0xC8, 0x08, 0x4C, 0x71,
+	0x05, 0x8A, 0x65, 0x2F, 0xE1, 0x24, 0x0F, 0x21, 0x35, 0x93, 0x8E, 0xDA, 0xF0, 0x12, 0x82, 0x45,
+	0x1D, 0xB5, 0xC2, 0x7D, 0x6A, 0x27, 0xF9, 0xB9, 0xC9, 0x9A, 0x09, 0x78, 0x4D, 0xE4, 0x72, 0xA6,
+	0x06, 0xBF, 0x8B, 0x62, 0x66, 0xDD, 0x30, 0xFD, 0xE2, 0x98, 0x25, 0xB3, 0x10, 0x91, 0x22, 0x88,
+	0x36, 0xD0, 0x94, 0xCE, 0x8F, 0x96, 0xDB, 0xBD, 0xF1, 0xD2, 0x13, 0x5C, 0x83, 0x38, 0x46, 0x40,
+	0x1E, 0x42, 0xB6, 0xA3, 0xC3, 0x48, 0x7E, 0x6E, 0x6B, 0x3A, 0x28, 0x54, 0xFA, 0x85, 0xBA, 0x3D,
+	0xCA, 0x5E, 0x9B, 0x9F, 0x0A, 0x15, 0x79, 0x2B, 0x4E, 0xD4, 0xE5, 0xAC, 0x73, 0xF3, 0xA7, 0x57,
+	0x07, 0x70, 0xC0, 0xF7, 0x8C, 0x80, 0x63, 0x0D, 0x67, 0x4A, 0xDE, 0xED, 0x31, 0xC5, 0xFE, 0x18,
+	0xE3, 0xA5, 0x99, 0x77, 0x26, 0xB8, 0xB4, 0x7C, 0x11, 0x44, 0x92, 0xD9, 0x23, 0x20, 0x89, 0x2E,
+	0x37, 0x3F, 0xD1, 0x5B, 0x95, 0xBC, 0xCF, 0xCD, 0x90, 0x87, 0x97, 0xB2, 0xDC, 0xFC, 0xBE, 0x61,
+	0xF2, 0x56, 0xD3, 0xAB, 0x14, 0x2A, 0x5D, 0x9E, 0x84, 0x3C, 0x39, 0x53, 0x47, 0x6D, 0x41, 0xA2,
+	0x1F, 0x2D, 0x43, 0xD8, 0xB7, 0x7B, 0xA4, 0x76, 0xC4, 0x17, 0x49, 0xEC, 0x7F, 0x0C, 0x6F, 0xF6,
+	0x6C, 0xA1, 0x3B, 0x52, 0x29, 0x9D, 0x55, 0xAA, 0xFB, 0x60, 0x86, 0xB1, 0xBB, 0xCC, 0x3E, 0x5A,
+	0xCB, 0x59, 0x5F, 0xB0, 0x9C, 0xA9, 0xA0, 0x51, 0x0B, 0xF5, 0x16, 0xEB, 0x7A, 0x75, 0x2C, 0xD7,
+	0x4F, 0xAE, 0xD5, 0xE9, 0xE6, 0xE7, 0xAD, 0xE8, 0x74, 0xD6, 0xF4, 0xEA, 0xA8, 0x50, 0x58, 0xAF,
+};
+
+//logarithms of generator polynomial coefficients for roots alpha^1 to alpha^T, from x^(T-1) down to x^0
+static const uint8_t rsGenerator16[16] =
+{
+	121, 106, 110, 113, 107, 167, 83, 11, 100, 201, 158, 181, 195, 208, 240, 136,
+};
+
+static const uint8_t rsGenerator32[32] =
+{
+	11, 8, 109, 194, 254, 173, 11, 75, 218, 148, 149, 44, 0, 137, 104, 43,
+	137, 203, 99, 176, 59, 91, 194, 84, 53, 248, 107, 80, 28, 215, 251, 18,
+};
+
+static const uint8_t rsGenerator64[64] =
+{
+	46, 53, 178, 13, 12, 164, 166, 57, 77, 129, 103, 135, 190, 218, 202, 15,
+	217, 96, 160, 169, 140, 48, 150, 77, 185, 119, 226, 240, 58, 54, 176, 188,
+	241, 184, 253, 245, 41, 254, 130, 87, 225, 188, 90, 184, 240, 241, 172, 35,
+	32, 113, 150, 160, 193, 29, 42, 87, 6, 69, 237, 48, 23, 218, 21, 40,
+};
+
+/**
+ * @brief Encode FX.25 block using in-tree kernels
+ * @param *buffer Input buffer, parity is appended after K data bytes
+ * @param *mode FX.25 mode
+ */
+static void rsEncode(uint8_t *buffer, const struct Fx25Mode *mode)
+{
+	const uint8_t *generator = (64 == mode->T) ? rsGenerator64 : ((32 == mode->T) ? rsGenerator32 : rsGenerator16);
+	uint8_t T = mode->T;
+	uint8_t *parity = &buffer[mode->K];
+	memset(parity, 0, T);
+	for(uint16_t i = 0; i < mode->K; i++)
+	{
+		uint8_t feedback = buffer[i] ^ parity[0];
+		if(0 == feedback)
+		{
+			memmove(parity, &parity[1], T - 1);
+			parity[T - 1] = 0;
+			continue;
+		}
+		//shift and add the generator multiplied by feedback in one pass
+		uint16_t logFeedback = gfLog[feedback];
+		for(uint8_t j = 0; j < (T - 1); j++)
+			parity[j] = parity[j + 1] ^ gfExp[logFeedback + generator[j]];
+		parity[T - 1] = gfExp[logFeedback + generator[T - 1]];
+	}
+}
+
+/**
+ * @brief Decode/fix FX.25 block using in-tree kernels
+ * @param *buffer Input buffer
+ * @param *mode FX.25 mode
+ * @param *fixed Number of bytes fixed
+ * @return True if block is valid, false if uncorrectable
+ * @attention Buffer is not modified if block is uncorrectable
+ */
+static bool rsDecode(uint8_t *buffer, const struct Fx25Mode *mode, uint8_t *fixed)
+{
+	uint8_t T = mode->T;
+	uint16_t n = mode->K + T;
+	uint8_t syndrome[64];
+	uint8_t nonZero = 0;
+	*fixed = 0;
+
+	//syndromes S(i) = r(alpha^(i+1)) by Horner's rule, four at a time, so that each byte is loaded once for four syndromes
+	for(uint8_t i = 0; i < T; i += 4)
+	{
+		uint8_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+		for(uint16_t j = 0; j < n; j++)
+		{
+			uint8_t b = buffer[j];
+			s0 = (s0 ? gfExp[gfLog[s0] + i + FX25_RS_FCR] : 0) ^ b;
+			s1 = (s1 ? gfExp[gfLog[s1] + i + FX25_RS_FCR + 1] : 0) ^ b;
+			s2 = (s2 ? gfExp[gfLog[s2] + i + FX25_RS_FCR + 2] : 0) ^ b;
+			s3 = (s3 ? gfExp[gfLog[s3] + i + FX25_RS_FCR + 3] : 0) ^ b;
+		}
+		syndrome[i] = s0;
+		syndrome[i + 1] = s1;
+		syndrome[i + 2] = s2;
+		syndrome[i + 3] = s3;
+		nonZero |= s0 | s1 | s2 | s3;
+	}
+	if(0 == nonZero)
+		return true; //no errors
+
+	//Berlekamp-Massey: lambda is the error locator, b is the last locator before a length change divided by its discrepancy
+	//both are updated in the same pass, so no copy of lambda is needed
+	uint8_t lambda[65], b[65];
+	memset(lambda, 0, T + 1);
+	memset(b, 0, T + 1);
+	lambda[0] = 1;
+	b[0] = 1;
+	uint8_t L = 0;
+	for(uint8_t r = 0; r < T; r++)
+	{
+		uint8_t d = syndrome[r];
+		for(uint8_t j = 1; j <= L; j++)
+		{
+			if(lambda[j] && syndrome[r - j])
+				d ^= gfExp[gfLog[lambda[j]] + gfLog[syndrome[r - j]]];
+		}
+		uint8_t top = ((r + 1) < T) ? (r + 1) : T; //highest possible degree of x * b
+		if(0 == d)
+		{
+			memmove(&b[1], b, top); //b = x * b
+			b[0] = 0;
+			continue;
+		}
+		uint16_t logD = gfLog[d];
+		bool lengthChange = ((2 * L) <= r);
+		uint8_t previous = 0; //b[j - 1] before the update
+		for(uint8_t j = 0; j <= top; j++)
+		{
+			uint8_t oldLambda = lambda[j];
+			uint8_t oldB = b[j];
+			if(previous)
+				lambda[j] ^= gfExp[logD + gfLog[previous]];
+			if(lengthChange)
+				b[j] = oldLambda ? gfExp[gfLog[oldLambda] + 255 - logD] : 0;
+			else
+				b[j] = previous;
+			previous = oldB;
+		}
+		if(lengthChange)
+			L = r + 1 - L;
+	}
+	if((L > (T / 2)) || (0 == lambda[L]))
+		return false; //too many errors, or fewer roots than L
+
+	//error evaluator omega = S * lambda mod x^L, computed in place from the highest term
+	for(int8_t i = L - 1; i >= 0; i--)
+	{
+		uint8_t v = 0;
+		for(uint8_t j = 0; j <= i; j++)
+		{
+			if(lambda[j] && syndrome[i - j])
+				v ^= gfExp[gfLog[lambda[j]] + gfLog[syndrome[i - j]]];
+		}
+		syndrome[i] = v;
+	}
+	uint8_t *omega = syndrome;
+
+	//Chien search: byte p is at power n-1-p, so it is an error if lambda(alpha^-(n-1-p)) = 0
+	//the search stops when L roots are found or when there are not enough bytes left for them
+	uint8_t position[32];
+	uint8_t found = 0;
+	for(uint16_t p = 0; p < n; p++)
+	{
+		uint16_t logInverse = 255 - (n - 1 - p);
+		uint8_t v = lambda[L];
+		for(int8_t j = L - 1; j >= 0; j--)
+			v = (v ? gfExp[gfLog[v] + logInverse] : 0) ^ lambda[j];
+		if(0 == v)
+		{
+			position[found++] = p;
+			if(found == L)
+				break;
+		}
+		else if((n - 1 - p) < (L - found))
+			return false;
+	}
+	if(found != L)
+		return false;
+
+	//Forney: error value is X^(1-fcr) * omega(X^-1) / lambda'(X^-1), where X^(1-fcr) = 1 for fcr = 1
+	//the roots are distinct, so lambda' is never zero
+	for(uint8_t k = 0; k < L; k++)
+	{
+		uint16_t logInverse = 255 - (n - 1 - position[k]);
+		uint16_t logInverse2 = (2 * logInverse) % 255;
+		uint8_t num = omega[L - 1];
+		for(int8_t j = L - 2; j >= 0; j--)
+			num = (num ? gfExp[gfLog[num] + logInverse] : 0) ^ omega[j];
+		//lambda' has odd terms of lambda only: lambda[1] + lambda[3] * X^-2 + ...
+		int8_t j = (L & 1) ? L : (L - 1);
+		uint8_t den = lambda[j];
+		for(j -= 2; j > 0; j -= 2)
+			den = (den ? gfExp[gfLog[den] + logInverse2] : 0) ^ lambda[j];
+		if(num)
+			buffer[position[k]] ^= gfExp[gfLog[num] + 255 - gfLog[den]];
+	}
+	*fixed = L;
+	return true;
+}
+#endif
+
+#ifdef FX25_BUILD_LWFEC_RS
 #ifdef FX25_PREGENERATE_POLYS
 static struct LwFecRS rs16, rs32, rs64;
 #else
 static struct LwFecRS rs;
 #endif
 
-void Fx25Encode(uint8_t *buffer, const struct Fx25Mode *mode)
+/**
+ * @brief Encode FX.25 block using LwFEC
+ * @param *buffer Input buffer, parity is appended after K data bytes
+ * @param *mode FX.25 mode
+ */
+static void lwfecEncode(uint8_t *buffer, const struct Fx25Mode *mode)
 {
 #ifdef FX25_PREGENERATE_POLYS
 	struct LwFecRS *rs = NULL;
@@ -107,7 +469,14 @@ void Fx25Encode(uint8_t *buffer, const struct Fx25Mode *mode)
 
 }
 
-bool Fx25Decode(uint8_t *buffer, const struct Fx25Mode *mode, uint8_t *fixed)
+/**
+ * @brief Decode/fix FX.25 block using LwFEC
+ * @param *buffer Input buffer
+ * @param *mode FX.25 mode
+ * @param *fixed Number of bytes fixed
+ * @return True if block is valid, false if uncorrectable
+ */
+static bool lwfecDecode(uint8_t *buffer, const struct Fx25Mode *mode, uint8_t *fixed)
 {
 #ifdef FX25_PREGENERATE_POLYS
 	struct LwFecRS *rs = NULL;
@@ -133,14 +502,83 @@ bool Fx25Decode(uint8_t *buffer, const struct Fx25Mode *mode, uint8_t *fixed)
 #endif
 
 }
+#endif
+
+void Fx25Encode(uint8_t *buffer, const struct Fx25Mode *mode)
+{
+#ifdef ENABLE_FX25_INTREE_RS
+	rsEncode(buffer, mode);
+#else
+	lwfecEncode(buffer, mode);
+#endif
+}
+
+bool Fx25Decode(uint8_t *buffer, const struct Fx25Mode *mode, uint8_t *fixed)
+{
+#ifdef ENABLE_FX25_INTREE_RS
+	return rsDecode(buffer, mode, fixed);
+#else
+	return lwfecDecode(buffer, mode, fixed);
+#endif
+}
+
+#ifdef ENABLE_PROFILING
+#define FX25_BENCH_TRIALS 4 //number of measurements for each error count
+
+void Fx25Benchmark(const struct Fx25Mode *mode, bool lwfec, uint8_t *benchBuffer, struct Fx25BenchResult *result)
+{
+	void (*encode)(uint8_t*, const struct Fx25Mode*) = lwfec ? lwfecEncode : rsEncode;
+	bool (*decode)(uint8_t*, const struct Fx25Mode*, uint8_t*) = lwfec ? lwfecDecode : rsDecode;
+	uint16_t n = mode->K + mode->T;
+	result->encode = UINT32_MAX;
+	result->failed = false;
+	for(uint8_t step = 0; step < FX25_BENCH_ERROR_STEPS; step++)
+	{
+		uint8_t errors = (mode->T / 2) * step / (FX25_BENCH_ERROR_STEPS - 1);
+		result->decode[step] = UINT32_MAX;
+		for(uint8_t trial = 0; trial < FX25_BENCH_TRIALS; trial++)
+		{
+			//data is generated from a seed, so that it can be checked without a copy
+			uint8_t seed = Random(0, 256);
+			for(uint16_t i = 0; i < mode->K; i++)
+				benchBuffer[i] = (i * 73) + seed;
+
+			uint32_t start = SysTickGetCycles();
+			encode(benchBuffer, mode);
+			uint32_t cycles = SysTickGetCycles() - start;
+			if(cycles < result->encode)
+				result->encode = cycles;
+
+			//errors at evenly spaced positions, so that they never overlap
+			uint16_t offset = Random(0, n);
+			for(uint8_t i = 0; i < errors; i++)
+				benchBuffer[(offset + i * (n / errors)) % n] ^= Random(1, 256);
+
+			uint8_t fixed = 0;
+			start = SysTickGetCycles();
+			bool ok = decode(benchBuffer, mode, &fixed);
+			cycles = SysTickGetCycles() - start;
+			if(cycles < result->decode[step])
+				result->decode[step] = cycles;
+
+			if(!ok || (fixed != errors))
+				result->failed = true;
+			for(uint16_t i = 0; i < mode->K; i++)
+			{
+				if(benchBuffer[i] != (uint8_t)((i * 73) + seed))
+					result->failed = true;
+			}
+		}
+	}
+}
+#endif
 
 void Fx25Init(void)
 {
-#ifdef FX25_PREGENERATE_POLYS
+#if defined(FX25_BUILD_LWFEC_RS) && defined(FX25_PREGENERATE_POLYS)
 	RsInit(&rs16, 16, FX25_RS_FCR);
 	RsInit(&rs32, 32, FX25_RS_FCR);
 	RsInit(&rs64, 64, FX25_RS_FCR);
-#else
 #endif
 }
 
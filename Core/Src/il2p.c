@@ -0,0 +1,347 @@
+/*
+Copyright 2020-2025 Piotr Wilkon
+
+This file is part of VP-Digi.
+
+VP-Digi is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+VP-Digi is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef ENABLE_IL2P
+
+#include "il2p.h"
+#include <string.h>
+#include "rs.h"
+
+#define IL2P_RS_FCR 0
+
+#define IL2P_TX_LFSR_INIT 0x00F
+#define IL2P_RX_LFSR_INIT 0x1F0
+#define IL2P_SCRAMBLER_DELAY 5 //scrambler output is delayed by 5 bits
+
+#define IL2P_MAX_FEC_BLOCK_SIZE 239
+#define IL2P_MAX_FEC_PARITY 16
+#define IL2P_STD_FEC_BLOCK_SIZE 247
+
+#define IL2P_TRANSLATED_HEADER_SIZE 16 //AX.25 header rebuilt from type 1 header: 2 addresses, control and PID
+
+//header bits
+#define IL2P_HDR_MAX_FEC(h) ((h)[0] & 0x80)
+#define IL2P_HDR_TYPE_1(h) ((h)[1] & 0x80)
+#define IL2P_HDR_UI(h) ((h)[0] & 0x40)
+#define IL2P_HDR_PF(h) ((h)[5] & 0x40) //MSB of control field
+
+//AX.25 PID for each IL2P PID code, 0 if not allowed in UI frames
+static const uint8_t pidDecode[16] =
+{
+	0x00, 0x00, 0x20, 0x01, 0x06, 0x07, 0x08, 0x00,
+	0x00, 0x00, 0x00, 0xCC, 0xCD, 0xCE, 0xCF, 0xF0,
+};
+
+//Hamming(7,4) code for each nibble of the trailing CRC
+static const uint8_t crcHamming[16] =
+{
+	0x00, 0x71, 0x62, 0x13, 0x54, 0x25, 0x36, 0x47,
+	0x38, 0x49, 0x5A, 0x2B, 0x6C, 0x1D, 0x0E, 0x7F,
+};
+
+//header parity is always 2 bytes, standard FEC parity is 2, 4, 6 or 8 bytes, max FEC parity is always 16 bytes
+//all are generated at init, so that the generator is never computed in the modem interrupt
+static struct LwFecRS rs2, rs4, rs6, rs8, rs16;
+
+struct Il2pBlocks
+{
+	uint8_t count; //number of payload blocks
+	uint8_t size; //size of small blocks, large blocks are 1 byte longer
+	uint8_t largeCount; //number of large blocks (sent last)
+	uint8_t parity; //parity size for each block
+};
+
+/**
+ * @brief Split payload into blocks
+ * @param size Payload size
+ * @param maxFec True for max FEC, false for standard FEC
+ * @param *b Output block layout
+ */
+static void getBlocks(uint16_t size, bool maxFec, struct Il2pBlocks *b)
+{
+	if(0 == size)
+	{
+		memset(b, 0, sizeof(*b));
+		return;
+	}
+	uint8_t maxSize = maxFec ? IL2P_MAX_FEC_BLOCK_SIZE : IL2P_STD_FEC_BLOCK_SIZE;
+	b->count = (size + maxSize - 1) / maxSize;
+	b->size = size / b->count;
+	b->largeCount = size - (b->count * b->size);
+	if(maxFec)
+		b->parity = IL2P_MAX_FEC_PARITY;
+	else if(b->size <= 61)
+		b->parity = 2;
+	else if(b->size <= 123)
+		b->parity = 4;
+	else if(b->size <= 185)
+		b->parity = 6;
+	else
+		b->parity = 8;
+}
+
+/**
+ * @brief Get Reed-Solomon codec for given parity size
+ * @param parity Parity size
+ * @return Codec
+ */
+static struct LwFecRS *getRs(uint8_t parity)
+{
+	switch(parity)
+	{
+		case 2:
+			return &rs2;
+		case 4:
+			return &rs4;
+		case 6:
+			return &rs6;
+		case 8:
+			return &rs8;
+		default:
+			return &rs16;
+	}
+}
+
+/**
+ * @brief Read header field stored in one bit of consecutive header bytes
+ * @param *header Header
+ * @param bit Bit number
+ * @param first Index of byte containing the most significant bit
+ * @param last Index of byte containing the least significant bit
+ * @return Field value
+ */
+static uint16_t getField(const uint8_t *header, uint8_t bit, uint8_t first, uint8_t last)
+{
+	uint16_t value = 0;
+	for(uint8_t i = first; i <= last; i++)
+		value = (value << 1) | ((header[i] >> bit) & 1);
+	return value;
+}
+
+/**
+ * @brief Scramble block in place
+ * @param *buffer Block
+ * @param size Block size
+ * @details Scrambler output is delayed, so the first bits are discarded and the scrambler is flushed with zeros at the end
+ */
+static void scramble(uint8_t *buffer, uint16_t size)
+{
+	uint16_t state = IL2P_TX_LFSR_INIT;
+	uint8_t out = 0;
+	uint16_t outIdx = 0;
+	uint32_t bits = (uint32_t)size * 8;
+	//output byte n is complete only after input byte n + 1 is read, so the block can be scrambled in place
+	for(uint32_t n = 0; n < (bits + IL2P_SCRAMBLER_DELAY); n++)
+	{
+		uint8_t in = (n < bits) ? ((buffer[n >> 3] >> (7 - (n & 7))) & 1) : 0;
+		uint8_t s = ((state >> 4) ^ state) & 1;
+		state = ((((in ^ state) & 1) << 9) | (state ^ ((state & 1) << 4))) >> 1;
+		if(n < IL2P_SCRAMBLER_DELAY)
+			continue;
+		out = (out << 1) | s;
+		if(((n - IL2P_SCRAMBLER_DELAY) & 7) == 7)
+			buffer[outIdx++] = out;
+	}
+}
+
+/**
+ * @brief Descramble block
+ * @param *in Input block
+ * @param *out Output block, may be the same as input or start before it
+ * @param size Block size
+ */
+static void descramble(const uint8_t *in, uint8_t *out, uint16_t size)
+{
+	uint16_t state = IL2P_RX_LFSR_INIT;
+	for(uint16_t i = 0; i < size; i++)
+	{
+		uint8_t byte = in[i];
+		uint8_t result = 0;
+		for(uint8_t k = 0; k < 8; k++)
+		{
+			uint8_t bit = byte >> 7;
+			byte <<= 1;
+			result = (result << 1) | ((bit ^ state) & 1);
+			state = ((state >> 1) | (bit << 8)) ^ (bit << 3);
+		}
+		out[i] = result;
+	}
+}
+
+/**
+ * @brief Check if header byte contains a valid callsign character
+ * @param byte Header byte
+ * @return True if valid
+ */
+static bool isCallsignChar(uint8_t byte)
+{
+	char c = (byte & 0x3F) + 0x20; //6-bit characters start from space
+	return (c == ' ') || ((c >= '0') && (c <= '9')) || ((c >= 'A') && (c <= 'Z'));
+}
+
+uint16_t Il2pEncode(const uint8_t *frame, uint16_t size, uint8_t *buffer, uint16_t bufferSize)
+{
+	if((size == 0) || (size > IL2P_MAX_PAYLOAD_SIZE))
+		return 0;
+
+	struct Il2pBlocks b;
+	getBlocks(size, true, &b);
+	uint16_t total = IL2P_ENCODED_HEADER_SIZE + size + (b.count * b.parity);
+	if(total > bufferSize)
+		return 0;
+
+	//type 0 header: only max FEC flag and payload size are set
+	memset(buffer, 0, IL2P_HEADER_SIZE);
+	buffer[0] = 0x80;
+	for(uint8_t i = 0; i < 10; i++)
+	{
+		if(size & (1 << i))
+			buffer[11 - i] |= 0x80;
+	}
+	scramble(buffer, IL2P_HEADER_SIZE);
+	RsEncode(&rs2, buffer, IL2P_HEADER_SIZE);
+
+	uint8_t *out = &buffer[IL2P_ENCODED_HEADER_SIZE];
+	for(uint8_t i = 0; i < b.count; i++)
+	{
+		uint8_t k = b.size + (i >= (b.count - b.largeCount)); //small blocks are sent first
+		memcpy(out, frame, k);
+		scramble(out, k);
+		RsEncode(&rs16, out, k);
+		out += k + b.parity;
+		frame += k;
+	}
+	return total;
+}
+
+bool Il2pDecodeHeader(uint8_t *header, uint16_t *encodedSize, uint8_t *fixed)
+{
+	if(!RsDecode(&rs2, header, IL2P_HEADER_SIZE, fixed))
+		return false;
+
+	descramble(header, header, IL2P_HEADER_SIZE);
+
+	uint16_t size = getField(header, 7, 2, 11);
+	if(IL2P_HDR_TYPE_1(header))
+	{
+		//type 1 header contains AX.25 addresses, only UI frames are supported
+		if(!IL2P_HDR_UI(header) || (0 == pidDecode[getField(header, 6, 1, 4)]))
+			return false;
+		for(uint8_t i = 0; i < 12; i++)
+		{
+			if(!isCallsignChar(header[i]))
+				return false;
+		}
+		if(((header[0] & 0x3F) == 0) || ((header[6] & 0x3F) == 0)) //callsign can't start with space
+			return false;
+	}
+	else if(size < 15) //type 0 frame contains at least 2 addresses and control field
+		return false;
+
+	struct Il2pBlocks b;
+	getBlocks(size, IL2P_HDR_MAX_FEC(header), &b);
+	*encodedSize = size + (b.count * b.parity);
+	return true;
+}
+
+bool Il2pDecode(const uint8_t *header, uint8_t *buffer, uint16_t bufferSize, uint16_t *size, uint8_t *fixed)
+{
+	uint16_t payloadSize = getField(header, 7, 2, 11);
+	bool translated = IL2P_HDR_TYPE_1(header);
+	if((payloadSize + (translated ? IL2P_TRANSLATED_HEADER_SIZE : 0)) > bufferSize)
+		return false;
+
+	struct Il2pBlocks b;
+	getBlocks(payloadSize, IL2P_HDR_MAX_FEC(header), &b);
+	struct LwFecRS *rs = getRs(b.parity);
+
+	*fixed = 0;
+	//parity is dropped, so the payload can be decoded in place
+	uint16_t in = 0, out = 0;
+	for(uint8_t i = 0; i < b.count; i++)
+	{
+		uint8_t k = b.size + (i >= (b.count - b.largeCount));
+		uint8_t f = 0;
+		if(!RsDecode(rs, &buffer[in], k, &f))
+			return false;
+		*fixed += f;
+		descramble(&buffer[in], &buffer[out], k);
+		in += k + b.parity;
+		out += k;
+	}
+
+	if(!translated) //type 0 payload is the whole AX.25 frame
+	{
+		*size = payloadSize;
+		return true;
+	}
+
+	//rebuild AX.25 header: destination, source, control and PID
+	memmove(&buffer[IL2P_TRANSLATED_HEADER_SIZE], buffer, payloadSize);
+	for(uint8_t i = 0; i < 6; i++)
+	{
+		buffer[i] = ((header[i] & 0x3F) + 0x20) << 1;
+		buffer[7 + i] = ((header[6 + i] & 0x3F) + 0x20) << 1;
+	}
+	buffer[6] = 0xE0 | ((header[12] >> 3) & 0x1E); //command frame, C bit set in destination
+	buffer[13] = 0x61 | ((header[12] << 1) & 0x1E); //last address
+	buffer[14] = 0x03 | (IL2P_HDR_PF(header) ? 0x10 : 0);
+	buffer[15] = pidDecode[getField(header, 6, 1, 4)];
+	*size = payloadSize + IL2P_TRANSLATED_HEADER_SIZE;
+	return true;
+}
+
+void Il2pEncodeCrc(uint16_t crc, uint8_t *buffer)
+{
+	//most significant nibble first
+	for(uint8_t i = 0; i < IL2P_CRC_SIZE; i++)
+		buffer[i] = crcHamming[(crc >> (12 - 4 * i)) & 0xF];
+}
+
+uint16_t Il2pDecodeCrc(const uint8_t *buffer)
+{
+	uint16_t crc = 0;
+	for(uint8_t i = 0; i < IL2P_CRC_SIZE; i++)
+	{
+		//Hamming(7,4) is a perfect code, so there is always exactly one codeword within 1 bit
+		uint8_t nibble = 0;
+		for(uint8_t k = 0; k < 16; k++)
+		{
+			uint8_t diff = (buffer[i] & 0x7F) ^ crcHamming[k];
+			if(0 == (diff & (diff - 1)))
+			{
+				nibble = k;
+				break;
+			}
+		}
+		crc = (crc << 4) | nibble;
+	}
+	return crc;
+}
+
+void Il2pInit(void)
+{
+	RsInit(&rs2, 2, IL2P_RS_FCR);
+	RsInit(&rs4, 4, IL2P_RS_FCR);
+	RsInit(&rs6, 6, IL2P_RS_FCR);
+	RsInit(&rs8, 8, IL2P_RS_FCR);
+	RsInit(&rs16, IL2P_MAX_FEC_PARITY, IL2P_RS_FCR);
+}
+
+#endif
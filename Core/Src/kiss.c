@@ -18,149 +18,589 @@ along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "kiss.h"
+#include <string.h>
 #include "ax25.h"
 #include "digipeater.h"
+#include "modem.h"
 
-void KissSend(Uart *port, uint8_t *buf, uint16_t size)
+enum KissCommand
 {
-	if(port->mode == MODE_KISS)
+	KISS_CMD_DATA = 0,
+	KISS_CMD_TXDELAY,
+	KISS_CMD_P,
+	KISS_CMD_SLOTTIME,
+	KISS_CMD_TXTAIL,
+	KISS_CMD_FULLDUPLEX,
+	KISS_CMD_SETHARDWARE, //VP-Digi extension: statistics request and reply
+	KISS_CMD_ACKMODE = 0x0C, //data frame with 2-byte sequence number, acknowledged after transmission
+	KISS_CMD_NAK = 0x0E, //VP-Digi extension: ACKMODE frame refused, sent back to the host
+};
+
+#define KISS_ACK_TAG_FLAG 0x1000000 //makes the ACK tag non-zero
+
+#define KISS_HW_STATS 0x01 //SETHARDWARE subcommand: get statistics
+#define KISS_STATS_COUNT (MODEM_MAX_DEMODULATOR_COUNT * 6 + 4 + 3 * 5 + 2) //number of counters in statistics reply
+
+static volatile uint8_t statsRequest = 0; //bitmap of ports that requested statistics
+
+#define NAK_COUNT 4 //max number of refusals of dropped ACKMODE frames waiting to be sent
+static volatile uint32_t nak[NAK_COUNT]; //port index and sequence number of dropped ACKMODE frames
+static volatile uint8_t nakHead = 0, nakTail = 0;
+
+//remainder of a KISS frame that did not fit in UART TX buffer, sent as the buffer drains
+//shared by UART1 and UART2 (USB writes never block)
+static uint8_t pendingFrame[AX25_FRAME_MAX_SIZE];
+static uint16_t pendingSize = 0, pendingIndex = 0;
+static Uart *pendingPort = NULL;
+
+
+/**
+ * @brief Apply KISS parameter command
+ * @param command Command number
+ * @param value Parameter value
+ */
+static void setParameter(enum KissCommand command, uint8_t value)
+{
+	switch(command)
 	{
-		UartSendByte(port, 0xC0);
-		UartSendByte(port, 0x00);
-		for(uint16_t i = 0; i < size; i++)
+		case KISS_CMD_TXDELAY: //TXDelay in 10 ms units
+			Ax25Config.txDelayLength = (uint16_t)value * 10;
+			break;
+		case KISS_CMD_P: //persistence
+			Ax25Config.persistence = value;
+			break;
+		case KISS_CMD_SLOTTIME: //slot time in 10 ms units
+			Ax25Config.slotTime = (uint16_t)value * 10;
+			break;
+		case KISS_CMD_TXTAIL: //TXTail in 10 ms units
+			Ax25Config.txTailLength = (uint16_t)value * 10;
+			break;
+		case KISS_CMD_FULLDUPLEX:
+			Ax25Config.fullDuplex = (value != 0);
+			break;
+		default:
+			return;
+	}
+	Ax25UpdateTiming();
+}
+
+/**
+ * @brief Send byte with KISS escaping
+ * @param *port UART structure
+ * @param data Byte to send
+ */
+static void sendEscaped(Uart *port, uint8_t data)
+{
+	if(data == 0xC0) //frame end in data
+	{
+		UartSendByte(port, 0xDB); //frame escape
+		UartSendByte(port, 0xDC); //transposed frame end
+	}
+	else if(data == 0xDB) //frame escape in data
+	{
+		UartSendByte(port, 0xDB); //frame escape
+		UartSendByte(port, 0xDD); //transposed frame escape
+	}
+	else
+		UartSendByte(port, data);
+}
+
+/**
+ * @brief Write as much of the frame as fits in UART TX buffer, with KISS escaping
+ * @param *port UART structure
+ * @param *buf Frame buffer
+ * @param size Frame size
+ * @return Number of frame bytes written
+ */
+static uint16_t writeEscaped(Uart *port, const uint8_t *buf, uint16_t size)
+{
+	uint8_t chunk[32];
+	uint16_t free = UartGetTxFree(port);
+	uint16_t i = 0;
+	while(i < size)
+	{
+		uint8_t n = 0;
+		while((i < size) && (n < (sizeof(chunk) - 1)))
 		{
+			uint8_t extra = ((buf[i] == 0xC0) || (buf[i] == 0xDB)) ? 1 : 0;
+			if((n + 1 + extra) > free)
+				break;
 			if(buf[i] == 0xC0) //frame end in data
 			{
-				UartSendByte(port, 0xDB); //frame escape
-				UartSendByte(port, 0xDC); //transposed frame end
+				chunk[n++] = 0xDB; //frame escape
+				chunk[n++] = 0xDC; //transposed frame end
 			}
 			else if(buf[i] == 0xDB) //frame escape in data
 			{
-				UartSendByte(port, 0xDB); //frame escape
-				UartSendByte(port, 0xDD); //transposed frame escape
+				chunk[n++] = 0xDB; //frame escape
+				chunk[n++] = 0xDD; //transposed frame escape
 			}
 			else
-				UartSendByte(port, buf[i]);
+				chunk[n++] = buf[i];
+			i++;
 		}
-		UartSendByte(port, 0xC0);
+		if(0 == n) //no space left
+			break;
+		UartWrite(port, chunk, n);
+		free -= n;
 	}
+	return i;
 }
 
-
-void KissParse(Uart *port, uint8_t data)
+/**
+ * @brief Continue sending the remainder of a KISS frame as UART TX buffer drains
+ * @return True if there is nothing left to send
+ */
+static bool sendPending(void)
 {
+	if(NULL == pendingPort)
+		return true;
 
-	volatile uint8_t *buf = NULL;
-	volatile uint16_t *index = NULL;
-	bool useTempBuffer = port->kissProcessingOngoing;
-
-	if(!useTempBuffer)
-	{
-		buf = port->kissBuffer;
-		index = &port->kissBufferHead;
-	}
-	else
+	if(pendingPort->mode == MODE_KISS)
 	{
-		buf = port->kissTempBuffer;
-		index = &port->kissTempBufferHead;
+		pendingIndex += writeEscaped(pendingPort, &pendingFrame[pendingIndex], pendingSize - pendingIndex);
+		if((pendingIndex < pendingSize) || (0 == UartGetTxFree(pendingPort)))
+			return false;
+		uint8_t end = 0xC0;
+		UartWrite(pendingPort, &end, 1);
+		pendingPort->kissTxFrames++;
 	}
+	pendingPort = NULL;
+	return true;
+}
 
-	if(data == 0xC0) //frame end marker
+void KissSend(Uart *port, uint8_t *buf, uint16_t size)
+{
+	if(port->mode == MODE_KISS)
 	{
-		if(useTempBuffer) //temporary buffer is used = KISS processing is ongoing, must drop the incoming frame
+		if(port->isUsb) //USB writes never block
 		{
-			*index = 0;
+			UartSendByte(port, 0xC0);
+			UartSendByte(port, 0x00);
+			for(uint16_t i = 0; i < size; i++)
+				sendEscaped(port, buf[i]);
+			UartSendByte(port, 0xC0);
+			port->kissTxFrames++;
 			return;
 		}
 
-		if(port->kissBufferHead < 16) //command+source+destination+Control=16
+		uint16_t needed = size + 3; //frame end markers and command
+		for(uint16_t i = 0; i < size; i++)
 		{
-			port->kissBufferHead = 0;
-			return;
+			if((buf[i] == 0xC0) || (buf[i] == 0xDB))
+				needed++;
 		}
-
-		if((port->kissBuffer[0] & 0xF) != 0) //check if this is an actual frame
+		//don't wait for free space in TX buffer. If the frame does not fit, send its beginning now and the remainder
+		//as the buffer drains. Only one such frame can be pending, otherwise the frame is dropped.
+		uint16_t free = UartGetTxFree(port);
+		if((pendingPort == port) || ((needed > free) && ((NULL != pendingPort) || (free < 2) || (size > sizeof(pendingFrame)))))
 		{
-			port->kissBufferHead = 0;
+			port->txOverflow += needed;
 			return;
 		}
 
-		//simple sanity check
-		//check if LSbits in the first 13 bytes are set to 0
-		//they should always be in an AX.25 frame
-		for(uint8_t i = 0; i < 13; i++)
+		const uint8_t start[2] = {0xC0, 0x00};
+		UartWrite(port, start, 2);
+		uint16_t written = writeEscaped(port, buf, size);
+		if((written == size) && (UartGetTxFree(port) > 0))
 		{
-			if((port->kissBuffer[i + 1] & 1) != 0)
-			{
-				port->kissBufferHead = 0;
-				return;
-			}
+			UartWrite(port, &start[0], 1);
+			port->kissTxFrames++;
+			return;
 		}
+		memcpy(pendingFrame, &buf[written], size - written);
+		pendingSize = size - written;
+		pendingIndex = 0;
+		pendingPort = port;
+	}
+}
+
+/**
+ * @brief Send ACKMODE acknowledgment or refusal
+ * @param *port UART structure
+ * @param command KISS_CMD_ACKMODE or KISS_CMD_NAK
+ * @param id Sequence number from host
+ */
+static void sendAck(Uart *port, enum KissCommand command, uint16_t id)
+{
+	if(port->mode == MODE_KISS)
+	{
+		UartSendByte(port, 0xC0);
+		UartSendByte(port, command);
+		sendEscaped(port, id >> 8);
+		sendEscaped(port, id & 0xFF);
+		UartSendByte(port, 0xC0);
+	}
+}
+
+/**
+ * @brief Send 32-bit value with KISS escaping, little-endian
+ * @param *port UART structure
+ * @param value Value to send
+ */
+static void sendEscaped32(Uart *port, uint32_t value)
+{
+	for(uint8_t i = 0; i < 4; i++)
+	{
+		sendEscaped(port, value & 0xFF);
+		value >>= 8;
+	}
+}
+
+/**
+ * @brief Send statistics reply
+ * @param *port UART structure
+ */
+static void sendStats(Uart *port)
+{
+	if(port->mode != MODE_KISS)
+		return;
+
+	UartSendByte(port, 0xC0);
+	UartSendByte(port, KISS_CMD_SETHARDWARE);
+	sendEscaped(port, KISS_HW_STATS);
+	sendEscaped(port, KISS_STATS_COUNT);
+
+	struct Ax25RxStats rx;
+	for(uint8_t i = 0; i < MODEM_MAX_DEMODULATOR_COUNT; i++)
+	{
+		Ax25GetRxStats(i, &rx);
+		sendEscaped32(port, rx.decoded);
+		sendEscaped32(port, rx.crcErrors);
+		sendEscaped32(port, rx.aborted);
+		sendEscaped32(port, rx.tooLong);
+		sendEscaped32(port, rx.fx25Corrected);
+		sendEscaped32(port, rx.fx25Failed);
+	}
+
+	uint32_t txDropped = 0;
+	struct Ax25TxQueueStats tx;
+	for(uint8_t i = 0; i < AX25_TX_CLASS_COUNT; i++)
+	{
+		Ax25GetTxQueueStats(i, &tx);
+		txDropped += tx.dropped;
+	}
+	struct DigiStats digi;
+	DigiGetStats(&digi);
+	sendEscaped32(port, Ax25GetRxDropped());
+	sendEscaped32(port, txDropped);
+	sendEscaped32(port, digi.duplicates);
+	sendEscaped32(port, digi.viscousCancelled);
+
+	Uart *const ports[3] = {&UartUsb, &Uart1, &Uart2};
+	for(uint8_t i = 0; i < 3; i++)
+	{
+		sendEscaped32(port, ports[i]->kissRxFrames);
+		sendEscaped32(port, ports[i]->kissTxFrames);
+		sendEscaped32(port, ports[i]->rxBytes);
+		sendEscaped32(port, ports[i]->txBytes);
+		sendEscaped32(port, ports[i]->kissDropped);
+	}
+	sendEscaped32(port, Uart1.rxOverrun);
+	sendEscaped32(port, Uart2.rxOverrun);
+	UartSendByte(port, 0xC0);
+}
+
+/**
+ * @brief Get port index used in ACK tags
+ * @param *port UART structure
+ * @return 0 for USB, 1 for UART1, 2 for UART2
+ */
+static uint8_t getPortIndex(Uart *port)
+{
+	if(port == &Uart1)
+		return 1;
+	if(port == &Uart2)
+		return 2;
+	return 0;
+}
 
-		uint16_t pathEnd = 0;
+/**
+ * @brief Get KISS frame data offset for given command
+ * @param command KISS command
+ * @return Offset of AX.25 frame in KISS buffer
+ */
+static uint8_t getDataOffset(uint8_t command)
+{
+	if(command == KISS_CMD_ACKMODE)
+		return 3; //command + 2-byte sequence number
+	return 1; //command
+}
+
+/**
+ * @brief Check if KISS frame queue is empty
+ * @param *port UART structure
+ * @return True if empty
+ */
+static bool queueEmpty(Uart *port)
+{
+	return (port->kissFrameHead == port->kissFrameTail) && !port->kissFrameFull;
+}
 
-		//find path end bit (C-bit)
-		for(uint16_t i = 0; i < port->kissBufferHead; i++)
+/**
+ * @brief Store byte of the KISS frame being received
+ * @param *port UART structure
+ * @param data Byte to store
+ * @details Each frame is stored contiguously. If the frame does not fit before the end of the buffer,
+ * it is moved to the beginning of the buffer, if possible.
+ */
+static void storeByte(Uart *port, uint8_t data)
+{
+	bool empty = queueEmpty(port);
+	uint16_t oldest = port->kissFrame[port->kissFrameTail].start;
+
+	if(empty && (port->kissRxSize == 0)) //nothing stored, start from the beginning
+		port->kissRxStart = 0;
+
+	uint16_t limit = UART_KISS_BUFFER_SIZE; //first index that can not be written
+	if(!empty && (oldest >= port->kissRxStart)) //current frame is placed before the oldest queued frame
+		limit = oldest;
+
+	if((port->kissRxStart + port->kissRxSize) >= limit)
+	{
+		//no space until the end of the buffer, move the frame to the beginning if there is space there
+		if((limit == UART_KISS_BUFFER_SIZE) && (empty || (port->kissRxSize < oldest)))
 		{
-			if((port->kissBuffer[i + 1] & 1) != 0)
-			{
-				pathEnd = i + 1;
-				break;
-			}
+			for(uint16_t i = 0; i < port->kissRxSize; i++)
+				port->kissBuffer[i] = port->kissBuffer[port->kissRxStart + i];
+			port->kissRxStart = 0;
 		}
-
-		//C-bit must lay on a 7 byte boundary (every path element is 7 bytes long)
-		if(pathEnd % 7)
+		else
 		{
-			port->kissBufferHead = 0;
+			port->kissRxDrop = 1;
 			return;
 		}
+	}
+	port->kissBuffer[port->kissRxStart + port->kissRxSize] = data;
+	port->kissRxSize++;
+}
 
+/**
+ * @brief Check if received KISS frame can be queued for processing
+ * @param *frame KISS frame (starting with command byte)
+ * @param size Frame size
+ * @return True if valid
+ */
+static bool checkFrame(const uint8_t *frame, uint16_t size)
+{
+	uint8_t command = frame[0] & 0xF;
+	if((command != KISS_CMD_DATA) && (command != KISS_CMD_ACKMODE)) //check if this is an actual frame
+		return false;
 
-		__disable_irq();
-		port->kissProcessingOngoing = 1;
-		port->kissTempBufferHead = 0;
-		port->rxType = DATA_KISS;
-		__enable_irq();
+	uint8_t offset = getDataOffset(command);
+
+	if(size < (offset + 15)) //source+destination+Control=15
+		return false;
+
+	//simple sanity check
+	//check if LSbits in the first 13 bytes are set to 0
+	//they should always be in an AX.25 frame
+	for(uint8_t i = 0; i < 13; i++)
+	{
+		if((frame[i + offset] & 1) != 0)
+			return false;
+	}
+
+	uint16_t pathEnd = 0;
+
+	//find path end bit (C-bit)
+	for(uint16_t i = 0; i < (size - offset); i++)
+	{
+		if((frame[i + offset] & 1) != 0)
+		{
+			pathEnd = i + 1;
+			break;
+		}
+	}
+
+	//C-bit must lay on a 7 byte boundary (every path element is 7 bytes long)
+	if(pathEnd % 7)
+		return false;
+
+	return true;
+}
+
+/**
+ * @brief Count dropped KISS frame and queue refusal if it was an ACKMODE frame
+ * @param *port UART structure
+ * @param headerSize Number of bytes stored in port->kissRxHeader
+ * @details Refusal can not be sent from here (possibly interrupt context), so it is deferred to KissHandleAck()
+ */
+static void dropFrame(Uart *port, uint8_t headerSize)
+{
+	port->kissDropped++;
+	if((headerSize < 3) || ((port->kissRxHeader[0] & 0xF) != KISS_CMD_ACKMODE))
 		return;
+
+	__disable_irq();
+	uint8_t next = (nakHead + 1) % NAK_COUNT;
+	if(next != nakTail) //refusal is not sent if the queue is full, the drop is counted anyway
+	{
+		nak[nakHead] = ((uint32_t)getPortIndex(port) << 16) | ((uint16_t)port->kissRxHeader[1] << 8) | port->kissRxHeader[2];
+		nakHead = next;
 	}
-	else if(*index > 0)
+	__enable_irq();
+}
+
+void KissParse(Uart *port, uint8_t data)
+{
+	if(data == 0xC0) //frame end marker
 	{
-		if((data == 0xDC) && (buf[*index - 1] == 0xDB)) //escape character with transposed frame end
+		uint8_t *frame = (uint8_t*)&port->kissBuffer[port->kissRxStart];
+		uint16_t size = port->kissRxSize;
+		port->kissRxSize = 0;
+
+		bool drop = port->kissRxDrop;
+		uint8_t headerSize = port->kissRxHeaderSize;
+		port->kissRxDrop = 0;
+		port->kissRxEscape = 0;
+		port->kissRxHeaderSize = 0;
+
+		if(drop) //frame did not fit in the buffer
 		{
-			buf[*index - 1] = 0xC0;
+			dropFrame(port, headerSize);
 			return;
 		}
-		else if((data == 0xDD) && (buf[*index - 1] == 0xDB)) //escape character with transposed escape character
+
+		if(size == 0)
+			return;
+
+		uint8_t command = frame[0] & 0xF;
+		if((command >= KISS_CMD_TXDELAY) && (command <= KISS_CMD_FULLDUPLEX)) //parameter setting command
+		{
+			if(size >= 2)
+				setParameter(command, frame[1]);
+			return;
+		}
+		if(command == KISS_CMD_SETHARDWARE)
 		{
-			buf[*index - 1] = 0xDB;
+			//reply can not be sent from here (possibly interrupt context), defer it to KissHandleAck()
+			if((size >= 2) && (frame[1] == KISS_HW_STATS))
+				statsRequest |= (1 << getPortIndex(port));
 			return;
 		}
+
+		if(!checkFrame(frame, size))
+			return;
+
+		if(port->kissFrameFull) //no free frame slot
+		{
+			dropFrame(port, headerSize);
+			return;
+		}
+
+		port->kissFrame[port->kissFrameHead].start = port->kissRxStart;
+		port->kissFrame[port->kissFrameHead].size = size;
+		port->kissFrameHead++;
+		port->kissFrameHead %= UART_KISS_FRAME_COUNT;
+		if(port->kissFrameHead == port->kissFrameTail)
+			port->kissFrameFull = 1;
+		port->kissRxStart += size; //next frame is stored right after this one
+		port->rxType = DATA_KISS;
+		return;
 	}
-	buf[(*index)++] = data;
 
-	if(!useTempBuffer)
-		port->kissBufferHead %= sizeof(port->kissBuffer);
-	else
-		port->kissTempBufferHead %= sizeof(port->kissTempBuffer);
+	if(data == 0xDB) //frame escape
+	{
+		port->kissRxEscape = 1;
+		return;
+	}
+	if(port->kissRxEscape)
+	{
+		port->kissRxEscape = 0;
+		if(data == 0xDC) //transposed frame end
+			data = 0xC0;
+		else if(data == 0xDD) //transposed frame escape
+			data = 0xDB;
+	}
+
+	//command and ACKMODE sequence number are kept even if the frame is dropped, so that it can be refused
+	if(port->kissRxHeaderSize < sizeof(port->kissRxHeader))
+		port->kissRxHeader[port->kissRxHeaderSize++] = data;
+
+	if(port->kissRxDrop)
+		return;
+
+	storeByte(port, data);
+}
+
+void KissResync(Uart *port)
+{
+	port->kissRxDrop = 1;
+	port->kissRxEscape = 0;
+	if(port->kissRxHeaderSize < sizeof(port->kissRxHeader)) //sequence number incomplete, the rest would come from another frame
+	{
+		port->kissRxHeader[0] = KISS_CMD_DATA;
+		port->kissRxHeaderSize = sizeof(port->kissRxHeader);
+	}
 }
 
 void KissProcess(Uart *port)
 {
-	if(port->rxType == DATA_KISS)
+	while(!queueEmpty(port))
 	{
-		Ax25WriteTxFrame((uint8_t*)&port->kissBuffer[1], port->kissBufferHead - 1);
-		DigiStoreDeDupe((uint8_t*)&port->kissBuffer[1], port->kissBufferHead - 1);
-		port->kissBufferHead = 0;
-		__disable_irq();
-		port->kissProcessingOngoing = 0;
-		if(port->kissTempBufferHead > 0)
+		uint8_t *frame = (uint8_t*)&port->kissBuffer[port->kissFrame[port->kissFrameTail].start];
+		uint16_t size = port->kissFrame[port->kissFrameTail].size;
+
+		uint8_t command = frame[0] & 0xF;
+		uint8_t offset = getDataOffset(command);
+		void *handle = Ax25WriteTxFrame(&frame[offset], size - offset, AX25_TX_CLASS_HOST);
+		if(command == KISS_CMD_ACKMODE)
 		{
-			memcpy((uint8_t*)port->kissBuffer, (uint8_t*)port->kissTempBuffer, port->kissTempBufferHead);
-			port->kissBufferHead = port->kissTempBufferHead;
-			port->kissTempBufferHead = 0;
+			uint16_t id = ((uint16_t)frame[1] << 8) | frame[2];
+			if(NULL != handle)
+				Ax25SetTxFrameAckTag(handle, KISS_ACK_TAG_FLAG | ((uint32_t)getPortIndex(port) << 16) | id);
+			else
+				sendAck(port, KISS_CMD_NAK, id); //TX queue full, let the host know
 		}
+		DigiStoreDeDupe(&frame[offset], size - offset);
+		port->kissRxFrames++;
+
+		__disable_irq();
+		port->kissFrameTail++;
+		port->kissFrameTail %= UART_KISS_FRAME_COUNT;
+		port->kissFrameFull = 0;
+		__enable_irq();
+	}
+
+	__disable_irq();
+	if(queueEmpty(port) && (port->rxType == DATA_KISS)) //new frame might have been received in the meantime
 		port->rxType = DATA_NOTHING;
+	__enable_irq();
+}
+
+void KissHandleAck(void)
+{
+	static Uart *const port[] = {&UartUsb, &Uart1, &Uart2};
+
+	if(!sendPending()) //nothing else can be sent until the pending frame is complete
+		return;
+
+	uint32_t tag;
+	while(Ax25GetNextTxAck(&tag))
+	{
+		uint8_t index = (tag >> 16) & 0xFF;
+		if(index < (sizeof(port) / sizeof(*port)))
+			sendAck(port[index], KISS_CMD_ACKMODE, tag & 0xFFFF);
+	}
+
+	while(nakTail != nakHead) //frames dropped because of no space in KISS buffer
+	{
+		tag = nak[nakTail];
+		nakTail = (nakTail + 1) % NAK_COUNT;
+		sendAck(port[tag >> 16], KISS_CMD_NAK, tag & 0xFFFF);
+	}
+
+	if(statsRequest)
+	{
+		__disable_irq();
+		uint8_t request = statsRequest;
+		statsRequest = 0;
 		__enable_irq();
+		for(uint8_t i = 0; i < (sizeof(port) / sizeof(*port)); i++)
+		{
+			if(request & (1 << i))
+				sendStats(port[i]);
+		}
 	}
 }
@@ -52,10 +52,18 @@ along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
 #include "config.h"
 #include "uart.h"
 #include "drivers/usb.h"
+#include "usbd_cdc_if.h"
 #include "kiss.h"
+#include "event.h"
+#include "timer.h"
+#include "trace.h"
+#include "profile.h"
 #ifdef ENABLE_FX25
 #include "fx25.h"
 #endif
+#ifdef ENABLE_IL2P
+#include "il2p.h"
+#endif
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -88,6 +96,7 @@ static void MX_GPIO_Init(void);
 
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
+
 /**
  * @brief Handle received frame
  */
@@ -117,7 +126,8 @@ static void handleFrame(void)
 			{
 				TermSendToAll(MODE_MONITOR, (uint8_t*)"\r\nInput level too low! Please increase so most stations are around 30-50%.\r\n", 0);
 			}
-			TermSendToAll(MODE_MONITOR, (uint8_t*)"(AX.25) Frame received [", 0);
+			static char line[TERM_MONITOR_PREFIX_MAX_SIZE];
+			uint16_t n = StrAppend(line, 0, "(AX.25) Frame received [");
 			for(uint8_t i = 0; i < ModemGetDemodulatorCount(); i++)
 			{
 				if(modemBitmap & (1 << i))
@@ -126,35 +136,36 @@ static void handleFrame(void)
 					switch(m)
 					{
 						case PREFILTER_PREEMPHASIS:
-							TermSendToAll(MODE_MONITOR, (uint8_t*)"P", 1);
+							line[n++] = 'P';
 							break;
 						case PREFILTER_DEEMPHASIS:
-							TermSendToAll(MODE_MONITOR, (uint8_t*)"D", 1);
+							line[n++] = 'D';
 							break;
 						case PREFILTER_FLAT:
-							TermSendToAll(MODE_MONITOR, (uint8_t*)"F", 1);
+							line[n++] = 'F';
 							break;
 						case PREFILTER_NONE:
-							TermSendToAll(MODE_MONITOR, (uint8_t*)"N", 1);
+							line[n++] = 'N';
 					}
 				}
 				else
-					TermSendToAll(MODE_MONITOR, (uint8_t*)"_", 1);
+					line[n++] = '_';
 			}
 
-			TermSendToAll(MODE_MONITOR, (uint8_t*)"], ", 0);
+			n = StrAppend(line, n, "], ");
 			if(fixed != AX25_NOT_FX25)
 			{
-				TermSendNumberToAll(MODE_MONITOR, fixed);
-				TermSendToAll(MODE_MONITOR, (uint8_t*)" bytes fixed, ", 0);
+				n += NumberToString(fixed, &line[n]);
+				n = StrAppend(line, n, " bytes fixed, ");
 			}
-			TermSendToAll(MODE_MONITOR, (uint8_t*)"signal level ", 0);
-			TermSendNumberToAll(MODE_MONITOR, signalLevel);
-			TermSendToAll(MODE_MONITOR, (uint8_t*)"% (", 0);
-			TermSendNumberToAll(MODE_MONITOR, peak);
-			TermSendToAll(MODE_MONITOR, (uint8_t*)"%/", 0);
-			TermSendNumberToAll(MODE_MONITOR, valley);
-			TermSendToAll(MODE_MONITOR, (uint8_t*)"%): ", 0);
+			n = StrAppend(line, n, "signal level ");
+			n += NumberToString(signalLevel, &line[n]);
+			n = StrAppend(line, n, "% (");
+			n += NumberToString(peak, &line[n]);
+			n = StrAppend(line, n, "%/");
+			n += NumberToString(valley, &line[n]);
+			n = StrAppend(line, n, "%): ");
+			TermSendToAll(MODE_MONITOR, (uint8_t*)line, n); //send whole status line at once
 
 			SendTNC2(buf, size);
 			TermSendToAll(MODE_MONITOR, (uint8_t*)"\r\n", 0);
@@ -162,6 +173,7 @@ static void handleFrame(void)
 
 
 		DigiDigipeat(buf, size);
+		TraceSetCurrent(TRACE_NONE); //frames queued from now on don't originate from this frame
 	}
 }
 
@@ -174,7 +186,9 @@ static void handleFrame(void)
 int main(void)
 {
   /* USER CODE BEGIN 1 */
-
+#ifdef ENABLE_PROFILING
+	ProfileInit();
+#endif
   /* USER CODE END 1 */
 
   /* MCU Configuration--------------------------------------------------------*/
@@ -219,8 +233,15 @@ int main(void)
 	Ax25Config.quietTime = 300;
 	Ax25Config.txDelayLength = 300;
 	Ax25Config.txTailLength = 30;
+	Ax25Config.persistence = 127;
+	Ax25Config.slotTime = 100;
 	Ax25Config.fx25 = 0;
+	Ax25Config.fx25MinParity = 16;
+	Ax25Config.fx25MaxParity = 64;
+	Ax25Config.il2p = 0;
+	Ax25Config.il2pCrc = 1;
 	DigiConfig.dupeTime = 30;
+	BeaconConfig.jitter = 30;
 
 	ConfigRead();
 
@@ -229,6 +250,9 @@ int main(void)
 #ifdef ENABLE_FX25
 	Fx25Init();
 #endif
+#ifdef ENABLE_IL2P
+	Il2pInit();
+#endif
 
 	DigiInitialize();
 
@@ -250,72 +274,84 @@ int main(void)
     /* USER CODE END WHILE */
 
     /* USER CODE BEGIN 3 */
+	  PROFILE_BEGIN(PROFILE_MAIN);
 	  WdogReset();
 
-	  if(Ax25GetReceivedFrameBitmap())
+	  uint32_t events = EventGet(); //get events posted since last pass
+
+	  if(events & EVENT_FRAME_RECEIVED)
 		  handleFrame();
 
-	  DigiUpdateState(); //update digipeater state
+	  if(events & EVENT_TIMER)
+		  TimerProcess(); //handle expired timers (beacons, viscous delay, quiet time)
 
 	  Ax25TransmitBuffer(); //transmit buffer (will return if nothing to be transmitted)
 
-	  Ax25TransmitCheck(); //check for pending transmission request
+	  KissHandleAck(); //send KISS ACKMODE acknowledgments
 
-	  if(UartUsb.rxType != DATA_NOTHING)
-	  {
-		  TermHandleSpecial(&UartUsb);
-		  if(UartUsb.rxType == DATA_KISS)
-		  {
-			  KissProcess(&UartUsb);
-		  }
-		  else if(UartUsb.rxType != DATA_USB)
-		  {
+	  TermHandleMonitor(); //send queued monitor output
 
-			  TermParse(&UartUsb);
-		  	  UartClearRx(&UartUsb);
-		  }
-		  //previously there was just UartUsb.rxType = DATA_NOTHING, which could introduce deadlocks
-		  //assume that we were here, because rxType was DATA_USB, but in the meantime a new USB interrupt fired and rxType changed to DATA_KISS,
-		  //and the KISS parsing handler would set kissProcessingOngoing to 1. Then, we change rxType to DATA_NOTHING and are left in an incorrect scenario, when
-		  //rxType is DATA_NOTHING, and kissProcessingOngoing is 1, which is a clear deadlock, because then DATA_KISS can never be reached again.
-		  //That's why it is necessary to disable interrupts and check one more time for rxType before clearing it
-		  else
-		  {
-			  __disable_irq();
-			  if(UartUsb.rxType == DATA_USB)
-				  UartUsb.rxType = DATA_NOTHING;
-			  __enable_irq();
-		  }
-	  }
-	  if(Uart1.rxType != DATA_NOTHING)
+	  if(events & EVENT_RX_DATA)
 	  {
-		  if(Uart1.rxType == DATA_KISS)
+		  if(UartUsb.rxType != DATA_NOTHING)
 		  {
-			  KissProcess(&Uart1);
+			  TermHandleSpecial(&UartUsb);
+			  if(UartUsb.rxType == DATA_KISS)
+			  {
+				  KissProcess(&UartUsb);
+			  }
+			  else if(UartUsb.rxType != DATA_USB)
+			  {
+
+				  TermParse(&UartUsb);
+			  	  UartClearRx(&UartUsb);
+			  }
+			  //previously there was just UartUsb.rxType = DATA_NOTHING, which could introduce deadlocks
+			  //assume that we were here, because rxType was DATA_USB, but in the meantime a new USB interrupt fired and rxType changed to DATA_KISS,
+			  //and the KISS parsing handler would queue a KISS frame. Then, we change rxType to DATA_NOTHING and are left in an incorrect scenario, when
+			  //rxType is DATA_NOTHING, and a KISS frame is queued, which would not be processed until another KISS frame is received.
+			  //That's why it is necessary to disable interrupts and check one more time for rxType before clearing it
+			  else
+			  {
+				  __disable_irq();
+				  if(UartUsb.rxType == DATA_USB)
+					  UartUsb.rxType = DATA_NOTHING;
+				  __enable_irq();
+			  }
 		  }
-		  else
-		  {
-			  TermParse(&Uart1);
-			  UartClearRx(&Uart1);
-		  }
-	  }
-	  if(Uart2.rxType != DATA_NOTHING)
-	  {
-		  if(Uart2.rxType == DATA_KISS)
+		  CDC_ResumeReceive_FS(); //continue USB reception held until the received KISS frame was processed
+		  UartHandleRx(&Uart1); //process data received by UART RX DMA
+		  UartHandleRx(&Uart2);
+
+		  if(Uart1.rxType != DATA_NOTHING)
 		  {
-			  KissProcess(&Uart2);
+			  if(Uart1.rxType == DATA_KISS)
+			  {
+				  KissProcess(&Uart1);
+			  }
+			  else
+			  {
+				  TermParse(&Uart1);
+				  UartClearRx(&Uart1);
+			  }
 		  }
-		  else
+		  if(Uart2.rxType != DATA_NOTHING)
 		  {
-			  TermParse(&Uart2);
-			  UartClearRx(&Uart2);
+			  if(Uart2.rxType == DATA_KISS)
+			  {
+				  KissProcess(&Uart2);
+			  }
+			  else
+			  {
+				  TermParse(&Uart2);
+				  UartClearRx(&Uart2);
+			  }
 		  }
 	  }
 
-	  BeaconCheck(); //check beacons
+	  PROFILE_END(PROFILE_MAIN);
 
-	  if(SysTickGet() > 0xFFFFF000) //going to wrap around soon - hard reset the device
-		  NVIC_SystemReset();
+	  EventSleep(); //wait for interrupt if there is nothing to do
   }
   /* USER CODE END 3 */
 }
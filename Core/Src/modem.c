@@ -25,6 +25,7 @@ along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
 #include "common.h"
 #include "systick.h"
 #include "drivers/modem_ll.h"
+#include "profile.h"
 
 /*
  * Configuration for PLL-based data carrier detection
@@ -92,7 +93,7 @@ struct ModemDemodConfig ModemConfig;
 static uint8_t N; //samples per symbol
 static enum ModemTxTestMode txTestState; //current TX test mode
 static uint8_t demodCount; //actual number of parallel demodulators
-static uint16_t dacSine[DAC_SINE_SIZE]; //sine samples for DAC
+static uint8_t dacSine[DAC_SINE_SIZE]; //sine samples for DAC
 static uint8_t dacSineIdx; //current sine sample index
 static volatile uint16_t samples[MODEM_LL_OVERSAMPLING_FACTOR]; //very raw received samples, filled directly by DMA
 static uint8_t currentSymbol; //current symbol for NRZI encoding
@@ -105,6 +106,7 @@ static uint8_t spaceStep; //space timer step
 static uint16_t baudRateStep; //baudrate timer step
 static int16_t coeffHiI[NMAX], coeffLoI[NMAX], coeffHiQ[NMAX], coeffLoQ[NMAX]; //correlator IQ coefficients
 static uint8_t dcd = 0; //multiplexed DCD state from both demodulators
+static volatile uint8_t ptt = 0; //PTT state
 static uint32_t lfsr = 0xFFFFF; //LFSR for 9600 Bd
 
 /**
@@ -255,6 +257,11 @@ uint8_t ModemDcdState(void)
 	return dcd;
 }
 
+uint8_t ModemIsTransmitting(void)
+{
+	return ptt;
+}
+
 uint8_t ModemIsTxTestOngoing(void)
 {
 	if(txTestState != TEST_DISABLED)
@@ -317,6 +324,7 @@ static inline uint8_t scramble(uint8_t in)
 void MODEM_LL_DMA_INTERRUPT_HANDLER(void) __attribute__ ((interrupt));
 void MODEM_LL_DMA_INTERRUPT_HANDLER(void)
 {
+	 PROFILE_BEGIN(PROFILE_MODEM_RX);
 	 if(MODEM_LL_DMA_TRANSFER_COMPLETE_FLAG)
 	 {
 		 MODEM_LL_DMA_CLEAR_TRANSFER_COMPLETE_FLAG();
@@ -345,6 +353,7 @@ void MODEM_LL_DMA_INTERRUPT_HANDLER(void)
 			setDcd(false);
 		}
 	}
+	PROFILE_END(PROFILE_MODEM_RX);
 }
 
 /**
@@ -353,6 +362,7 @@ void MODEM_LL_DMA_INTERRUPT_HANDLER(void)
  void MODEM_LL_DAC_INTERRUPT_HANDLER(void) __attribute__ ((interrupt));
  void MODEM_LL_DAC_INTERRUPT_HANDLER(void)
  {
+	 PROFILE_BEGIN(PROFILE_MODEM_DAC);
 	 MODEM_LL_DAC_TIMER_CLEAR_INTERRUPT_FLAG;
 
  	int32_t sample = 0;
@@ -381,7 +391,7 @@ void MODEM_LL_DMA_INTERRUPT_HANDLER(void)
  	{
  		MODEM_LL_R2R_PUT_VALUE(sample);
  	}
-
+ 	PROFILE_END(PROFILE_MODEM_DAC);
 }
 
 
@@ -391,6 +401,7 @@ void MODEM_LL_DMA_INTERRUPT_HANDLER(void)
  void MODEM_LL_BAUDRATE_TIMER_INTERRUPT_HANDLER(void) __attribute__ ((interrupt));
  void MODEM_LL_BAUDRATE_TIMER_INTERRUPT_HANDLER(void)
  {
+	 PROFILE_BEGIN(PROFILE_MODEM_BAUD);
 	 MODEM_LL_BAUDRATE_TIMER_CLEAR_INTERRUPT_FLAG();
 
  	if(txTestState == TEST_DISABLED) //transmitting normal data
@@ -406,6 +417,7 @@ void MODEM_LL_DMA_INTERRUPT_HANDLER(void)
  		if(ModemConfig.modem == MODEM_9600)
  		{
  			scrambledSymbol ^= 1;
+ 			PROFILE_END(PROFILE_MODEM_BAUD);
  			return;
  		}
  		currentSymbol ^= 1; //change symbol
@@ -427,7 +439,7 @@ void MODEM_LL_DMA_INTERRUPT_HANDLER(void)
  			MODEM_LL_DAC_TIMER_SET_RELOAD_VALUE(markStep);
  		}
  	}
-
+ 	PROFILE_END(PROFILE_MODEM_BAUD);
 }
 
 /**
@@ -695,6 +707,7 @@ void ModemTransmitStop(void)
  */
 static void setPtt(bool state)
 {
+	 ptt = state;
 	 if(state)
 	 {
 	 	MODEM_LL_PTT_ON();
@@ -883,8 +896,8 @@ void ModemInit(void)
 	for(uint8_t i = 0; i < DAC_SINE_SIZE; i++) //calculate DAC sine samples
 	{
 		if(ModemConfig.usePWM)
-			//produce values in range 1 to 256
-			dacSine[i] = ((sinf(2.f * 3.1416f * (float)i / (float)DAC_SINE_SIZE) + 1.f) * 128.f);
+			//produce values in range 0 to 255
+			dacSine[i] = ((sinf(2.f * 3.1416f * (float)i / (float)DAC_SINE_SIZE) + 1.f) * 127.5f);
 		else
 			dacSine[i] = ((7.f * sinf(2.f * 3.1416f * (float)i / (float)DAC_SINE_SIZE)) + 8.f);
 	}
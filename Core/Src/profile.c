@@ -0,0 +1,124 @@
+/*
+Copyright 2020-2025 Piotr Wilkon
+
+This file is part of VP-Digi.
+
+VP-Digi is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+VP-Digi is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "profile.h"
+
+#ifdef ENABLE_PROFILING
+
+#include "stm32f1xx.h"
+
+static struct ProfileStats stats[PROFILE_ZONE_COUNT];
+static uint32_t idleCycles = 0; //cycles spent sleeping in current second
+static uint32_t idleStart = 0; //cycle counter value at the beginning of current second
+static uint8_t tickCount = 0;
+static uint16_t load = 0, loadPeak = 0; //CPU load in 0.1% units
+
+#define STACK_PAINT 0xC5C5C5C5 //pattern for unused stack
+//linker script symbols
+extern uint32_t _end; //end of static data
+extern uint32_t _estack; //initial stack pointer
+extern uint32_t _Min_Stack_Size; //reserved stack size (address of the symbol is its value)
+
+void ProfileInit(void)
+{
+	//paint everything below the current frame, interrupts are not enabled yet
+	uint32_t *p = &_end;
+	uint32_t *top = (uint32_t*)__get_MSP() - 16;
+	while(p < top)
+		*p++ = STACK_PAINT;
+}
+
+void ProfileRecord(enum ProfileZone zone, uint32_t cycles)
+{
+	uint32_t primask = __get_PRIMASK(); //may be called from interrupts of different priorities
+	__disable_irq();
+	struct ProfileStats *s = &stats[zone];
+	if((0 == s->count) || (cycles < s->min))
+		s->min = cycles;
+	if(cycles > s->max)
+		s->max = cycles;
+	s->sum += cycles;
+	s->count++;
+	__set_PRIMASK(primask);
+}
+
+void ProfileIdle(uint32_t cycles)
+{
+	idleCycles += cycles;
+}
+
+void ProfileTick(void)
+{
+	if(++tickCount < SYSTICK_FREQUENCY)
+		return;
+	tickCount = 0;
+
+	uint32_t now = SysTickGetCycles();
+	uint32_t elapsed = now - idleStart;
+	idleStart = now;
+
+	uint32_t idle = idleCycles;
+	idleCycles = 0;
+	if(idle > elapsed)
+		idle = elapsed;
+
+	load = 1000 - (uint16_t)(((uint64_t)idle * 1000) / elapsed);
+	if(load > loadPeak)
+		loadPeak = load;
+}
+
+void ProfileGetStats(enum ProfileZone zone, struct ProfileStats *s)
+{
+	__disable_irq();
+	*s = stats[zone];
+	__enable_irq();
+}
+
+void ProfileGetLoad(uint16_t *current, uint16_t *peak)
+{
+	*current = load;
+	*peak = loadPeak;
+}
+
+void ProfileClear(void)
+{
+	__disable_irq();
+	for(uint8_t i = 0; i < PROFILE_ZONE_COUNT; i++)
+	{
+		stats[i].count = 0;
+		stats[i].min = 0;
+		stats[i].max = 0;
+		stats[i].sum = 0;
+	}
+	loadPeak = load;
+	__enable_irq();
+}
+
+void ProfileGetStack(uint32_t *used, uint32_t *reserved, uint32_t *available)
+{
+	//the stack grows down, so the lowest overwritten word is the high-water mark
+	uint32_t *p = &_end;
+	while((p < &_estack) && (STACK_PAINT == *p))
+		p++;
+	*used = (&_estack - p) * sizeof(uint32_t);
+	*reserved = (uintptr_t)&_Min_Stack_Size;
+	*available = (&_estack - &_end) * sizeof(uint32_t);
+}
+
+#endif
@@ -22,6 +22,11 @@
 #include "stm32f1xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "channel.h"
+#include "event.h"
+#include "systick.h"
+#include "timer.h"
+#include "profile.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -187,8 +192,12 @@ void SysTick_Handler(void)
   /* USER CODE END SysTick_IRQn 0 */
   HAL_IncTick();
   /* USER CODE BEGIN SysTick_IRQn 1 */
-  extern volatile uint32_t ticks;
-  ticks++;
+  SysTickIncrement();
+  ChannelSample();
+  TimerCheck();
+#ifdef ENABLE_PROFILING
+  ProfileTick();
+#endif
   /* USER CODE END SysTick_IRQn 1 */
 }
 
@@ -205,10 +214,12 @@ void SysTick_Handler(void)
 void USB_LP_CAN1_RX0_IRQHandler(void)
 {
   /* USER CODE BEGIN USB_LP_CAN1_RX0_IRQn 0 */
+  PROFILE_BEGIN(PROFILE_USB);
 
   /* USER CODE END USB_LP_CAN1_RX0_IRQn 0 */
   HAL_PCD_IRQHandler(&hpcd_USB_FS);
   /* USER CODE BEGIN USB_LP_CAN1_RX0_IRQn 1 */
+  PROFILE_END(PROFILE_USB);
 
   /* USER CODE END USB_LP_CAN1_RX0_IRQn 1 */
 }
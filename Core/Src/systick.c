@@ -20,27 +20,46 @@ along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
 #include "stm32f1xx.h"
 #include "systick.h"
 
-volatile uint32_t ticks = 0; //SysTick counter
+static volatile uint64_t ticks = 0; //SysTick counter
 
 //with HAL enabled, the handler is in stm32f1xx_it.c
-//void SysTick_Handler(void)
-//{
-	//ticks++;
-//}
+void SysTickIncrement(void)
+{
+	ticks++;
+}
 
 void SysTickInit(void)
 {
 	SysTick_Config(SystemCoreClock / SYSTICK_FREQUENCY); //SysTick every 10 ms
+
+	//enable DWT cycle counter as a high resolution time source
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+uint32_t SysTickGetCycles(void)
+{
+	return DWT->CYCCNT;
 }
 
 uint32_t SysTickGet(void)
 {
-	return ticks;
+	return (uint32_t)ticks;
+}
+
+uint64_t SysTickGet64(void)
+{
+	uint32_t primask = __get_PRIMASK(); //may be called from interrupt
+	__disable_irq();
+	uint64_t t = ticks;
+	__set_PRIMASK(primask);
+	return t;
 }
 
 void Delay(uint32_t ms)
 {
-	uint32_t target = SysTickGet() + ms / SYSTICK_INTERVAL;
-	while(target > SysTickGet())
+	uint32_t start = SysTickGet();
+	while((SysTickGet() - start) < (ms / SYSTICK_INTERVAL))
 		;
 }
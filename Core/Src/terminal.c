@@ -24,8 +24,13 @@ along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
 #include "digipeater.h"
 #include "config.h"
 #include "ax25.h"
+#include "fx25.h"
 #include "systick.h"
 #include "kiss.h"
+#include "channel.h"
+#include "event.h"
+#include "trace.h"
+#include "profile.h"
 
 void TermHandleSpecial(Uart *u)
 {
@@ -61,6 +66,177 @@ void TermHandleSpecial(Uart *u)
 }
 
 
+struct MonitorReader
+{
+	Uart *port;
+	uint16_t tail; //next byte to be sent to this port
+	uint32_t lost; //number of messages dropped since last notice
+	uint8_t active : 1; //port is in monitor mode
+	uint8_t skip : 1; //remainder of a partially dropped message must be skipped
+};
+
+static uint8_t monitorBuffer[TERM_MONITOR_BUFFER_SIZE];
+static uint16_t monitorHead = 0;
+static struct MonitorReader monitorReader[3] = {{.port = &UartUsb}, {.port = &Uart1}, {.port = &Uart2}};
+
+/**
+ * @brief Update monitor readers state when ports enter or leave monitor mode
+ */
+static void updateMonitorReaders(void)
+{
+	for(uint8_t i = 0; i < 3; i++)
+	{
+		struct MonitorReader *r = &monitorReader[i];
+		bool active = (r->port->mode == MODE_MONITOR) && r->port->enabled;
+		if(active && !r->active) //start from the newest data
+		{
+			r->tail = monitorHead;
+			r->lost = 0;
+			r->skip = 0;
+		}
+		r->active = active;
+	}
+}
+
+/**
+ * @brief Get number of monitor bytes not yet sent to given reader
+ * @param *r Reader
+ * @return Number of bytes
+ */
+static uint16_t monitorPending(struct MonitorReader *r)
+{
+	return (monitorHead + TERM_MONITOR_BUFFER_SIZE - r->tail) % TERM_MONITOR_BUFFER_SIZE;
+}
+
+/**
+ * @brief Drop oldest message (up to the line end) waiting for given reader
+ * @param *r Reader
+ */
+static void dropMonitorMessage(struct MonitorReader *r)
+{
+	while(r->tail != monitorHead)
+	{
+		uint8_t c = monitorBuffer[r->tail];
+		r->tail = (r->tail + 1) % TERM_MONITOR_BUFFER_SIZE;
+		if('\n' == c)
+		{
+			r->lost++;
+			return;
+		}
+	}
+	//message is still being written, skip its remainder later
+	r->lost++;
+	r->skip = 1;
+}
+
+/**
+ * @brief Store data in monitor queue
+ * @param *data Data
+ * @param size Data size
+ */
+static void queueMonitor(const uint8_t *data, uint16_t size)
+{
+	if(0 == size)
+		return;
+
+	updateMonitorReaders();
+
+	for(uint8_t i = 0; i < 3; i++)
+	{
+		struct MonitorReader *r = &monitorReader[i];
+		if(!r->active)
+			continue;
+		if(size > (TERM_MONITOR_BUFFER_SIZE - 1)) //would never fit
+		{
+			r->lost++;
+			continue;
+		}
+		while(monitorPending(r) > (TERM_MONITOR_BUFFER_SIZE - 1 - size)) //make space by dropping oldest messages
+			dropMonitorMessage(r);
+	}
+
+	if(size > (TERM_MONITOR_BUFFER_SIZE - 1))
+		return;
+
+	for(uint16_t i = 0; i < size; i++)
+	{
+		monitorBuffer[monitorHead] = data[i];
+		monitorHead = (monitorHead + 1) % TERM_MONITOR_BUFFER_SIZE;
+	}
+	EventPost(EVENT_OUTPUT);
+}
+
+/**
+ * @brief Write data to port without blocking
+ * @param *port Port
+ * @param *data Data
+ * @param size Data size
+ * @param whole True if data must be written whole or not at all
+ * @return Number of bytes written
+ */
+static uint16_t writeMonitor(Uart *port, const uint8_t *data, uint16_t size, bool whole)
+{
+	if(port->isUsb)
+	{
+		if(whole && (size > (APP_TX_DATA_SIZE - 1)))
+			return 0;
+		size = CDC_TransmitCopy_FS(data, size);
+		port->txBytes += size;
+		return size;
+	}
+
+	uint16_t free = UartGetTxFree(port);
+	if(size > free)
+	{
+		if(whole || (0 == free))
+			return 0;
+		size = free;
+	}
+	return UartWrite(port, data, size);
+}
+
+void TermHandleMonitor(void)
+{
+	updateMonitorReaders();
+
+	for(uint8_t i = 0; i < 3; i++)
+	{
+		struct MonitorReader *r = &monitorReader[i];
+		if(!r->active)
+			continue;
+
+		while(r->skip && (r->tail != monitorHead)) //skip the remainder of dropped message
+		{
+			if('\n' == monitorBuffer[r->tail])
+				r->skip = 0;
+			r->tail = (r->tail + 1) % TERM_MONITOR_BUFFER_SIZE;
+		}
+		if(r->skip)
+			continue;
+
+		if(r->lost)
+		{
+			char notice[32];
+			uint8_t n = StrAppend(notice, 0, "\r\n");
+			n += NumberToString(r->lost, &notice[n]);
+			n = StrAppend(notice, n, " messages lost\r\n");
+			if(0 == writeMonitor(r->port, (uint8_t*)notice, n, true))
+				continue; //no space, try again later
+			r->lost = 0;
+		}
+
+		while(r->tail != monitorHead)
+		{
+			//send contiguous part of the queue
+			uint16_t size = (monitorHead > r->tail) ? (monitorHead - r->tail) : (TERM_MONITOR_BUFFER_SIZE - r->tail);
+			uint16_t written = writeMonitor(r->port, &monitorBuffer[r->tail], size, false);
+			r->tail = (r->tail + written) % TERM_MONITOR_BUFFER_SIZE;
+			if(written < size) //port is busy
+				break;
+		}
+	}
+}
+
 void TermSendToAll(enum UartMode mode, uint8_t *data, uint16_t size)
 {
 	if(MODE_KISS == mode)
@@ -71,12 +247,9 @@ void TermSendToAll(enum UartMode mode, uint8_t *data, uint16_t size)
 	}
 	else if(MODE_MONITOR == mode)
 	{
-		if(UartUsb.mode == MODE_MONITOR)
-			UartSendString(&UartUsb, data, size);
-		if(Uart1.mode == MODE_MONITOR)
-			UartSendString(&Uart1, data, size);
-		if(Uart2.mode == MODE_MONITOR)
-			UartSendString(&Uart2, data, size);
+		if(0 == size)
+			size = strlen((char*)data);
+		queueMonitor(data, size);
 	}
 }
 
@@ -84,14 +257,9 @@ void TermSendNumberToAll(enum UartMode mode, int32_t n)
 {
 	if(MODE_MONITOR == mode)
 	{
-		if(UartUsb.mode == MODE_MONITOR)
-			UartSendNumber(&UartUsb, n);
-		if(Uart1.mode == MODE_MONITOR)
-			UartSendNumber(&Uart1, n);
-		if(Uart2.mode == MODE_MONITOR)
-			UartSendNumber(&Uart2, n);
+		char buf[11];
+		queueMonitor((uint8_t*)buf, NumberToString(n, buf));
 	}
-
 }
 
 static const char monitorHelp[] = "\r\nCommands available in monitor mode:\r\n"
@@ -103,6 +271,18 @@ static const char monitorHelp[] = "\r\nCommands available in monitor mode:\r\n"
 		"config - switch to config mode\r\n"
 		"reboot - reboot the device\r\n"
 		"time - show time since boot\r\n"
+		"load - show channel utilization and TX duty cycle\r\n"
+		"txq - show transmit queue statistics\r\n"
+		"stats - show receiver, digipeater and port statistics\r\n"
+#ifdef ENABLE_TRACE
+		"latency [clear] - show/clear frame processing latency histograms\r\n"
+#endif
+#ifdef ENABLE_PROFILING
+		"cpu [clear] - show/clear CPU load, interrupt duration statistics and stack usage\r\n"
+#ifdef ENABLE_FX25
+		"fecbench - measure FX.25 Reed-Solomon encoding and decoding time of in-tree and LwFEC code\r\n"
+#endif
+#endif
 		"version - show full firmware version info\r\n\r\n\r\n";
 
 static const char configHelp[] = 	"\r\nCommands available in config mode:\r\n"
@@ -120,6 +300,12 @@ static const char configHelp[] = 	"\r\nCommands available in config mode:\r\n"
 		"txdelay <50-2550> - set TXDelay time (ms)\r\n"
 		"txtail <10-2550> - set TXTail time (ms)\r\n"
 		"quiet <100-2550> - set quiet time (ms)\r\n"
+		"txsched [strict/weighted] - set transmit queue scheduling (strict priority or weighted round-robin)\r\n"
+		"txframes <0-255> - set max frames per transmission, 0 for unlimited\r\n"
+		"txtime <0/500-60000> - set max transmission time (ms), 0 for unlimited\r\n"
+		"persist <0-255> - set p-persistence parameter (transmit probability is (value+1)/256)\r\n"
+		"slot <10-2550> - set p-persistence slot time (ms)\r\n"
+		"fullduplex [on/off] - transmit without waiting for a free channel\r\n"
 		"uart <1/2> baud <1200-115200> - set UART baud rate\r\n"
 		"uart <0/1/2> mode [kiss/monitor/config] - set UART default mode (0 for USB)\r\n"
 		"pwm [on/off] - enable/disable PWM. If PWM is off, R2R will be used instead\r\n"
@@ -128,6 +314,8 @@ static const char configHelp[] = 	"\r\nCommands available in config mode:\r\n"
 		"beacon <0-7> [iv/dl] <0-720> - set interval/delay for the specified beacon (min)\r\n"
 		"beacon <0-7> path <el1,[el2]>/none - set path for the specified beacon\r\n"
 		"beacon <0-7> data <data> - set information field for the specified beacon\r\n"
+		"beacon <0-7> telemetry [on/off] - send digipeater telemetry instead of information field\r\n"
+		"beacon jitter <0-120> - set max beacon deferral time when the channel is busy (s)\r\n"
 		"digi [on/off] - enable/disable whole digipeater\r\n"
 		"digi <0-7> [on/off] - enable/disable specified slot\r\n"
 		"digi <0-7> alias <alias> - set alias for the specified slot\r\n"
@@ -136,13 +324,20 @@ static const char configHelp[] = 	"\r\nCommands available in config mode:\r\n"
 		"digi <0-7> viscous [on/off] - enable/disable viscous-delay digipeating for the specified slot\r\n"
 		"digi <0-7> direct [on/off] - enable/disable direct-only digipeating for the specified slot\r\n"\
 		"digi <0-7> filter [on/off] - enable/disable packet filtering for the specified slot\r\n"
+		"digi <0-7> throttle [on/off] - enable/disable throttling of the specified slot on congested channel\r\n"
 		"digi filter [black/white] - set filter type to blacklist/whitelist\r\n"
 		"digi dupe <5-255> - set duplicate protection buffer time (s)\r\n"
+		"digi load <0/10-100> - set channel utilization (%) above which throttled slots are restricted, 0 to disable\r\n"
 		"digi list <0-19> [set <call>/remove] - set/clear given callsign slot in filter list\r\n"
 		"monkiss [on/off] - send own and digipeated frames to KISS ports\r\n"
 		"nonaprs [on/off] - enable reception of non-APRS frames\r\n"
 		"fx25 [on/off] - enable FX.25 protocol (AX.25 + FEC)\r\n"
-		"fx25tx [on/off] - enable TX in FX.25 mode\r\n";
+		"fx25tx [on/off] - enable TX in FX.25 mode\r\n"
+		"fx25fec [std/auto] - choose FX.25 parity size by frame size or by channel quality\r\n"
+		"fx25fec <16/32/64> <16/32/64> - set min and max parity size for automatic mode\r\n"
+		"il2p [on/off] - enable IL2P protocol reception\r\n"
+		"il2ptx [on/off] - enable TX in IL2P mode\r\n"
+		"il2pcrc [on/off] - append and check trailing IL2P CRC\r\n";
 
 
 static void sendUartParams(Uart *output, Uart *uart)
@@ -207,6 +402,30 @@ static void printConfig(Uart *src)
 	UartSendNumber(src, Ax25Config.txTailLength);
 	UartSendString(src, "\r\nQuiet time (ms): ", 0);
 	UartSendNumber(src, Ax25Config.quietTime);
+	UartSendString(src, "\r\nTX scheduling: ", 0);
+	if(Ax25Config.txWeighted)
+		UartSendString(src, "weighted", 0);
+	else
+		UartSendString(src, "strict", 0);
+	UartSendString(src, "\r\nMax frames per TX: ", 0);
+	if(Ax25Config.txMaxFrames)
+		UartSendNumber(src, Ax25Config.txMaxFrames);
+	else
+		UartSendString(src, "unlimited", 0);
+	UartSendString(src, "\r\nMax TX time (ms): ", 0);
+	if(Ax25Config.txMaxTime)
+		UartSendNumber(src, Ax25Config.txMaxTime);
+	else
+		UartSendString(src, "unlimited", 0);
+	UartSendString(src, "\r\nPersistence: ", 0);
+	UartSendNumber(src, Ax25Config.persistence);
+	UartSendString(src, "\r\nSlot time (ms): ", 0);
+	UartSendNumber(src, Ax25Config.slotTime);
+	UartSendString(src, "\r\nFull duplex: ", 0);
+	if(Ax25Config.fullDuplex)
+		UartSendString(src, "On", 0);
+	else
+		UartSendString(src, "Off", 0);
 	UartSendString(src, "\r\nUSB: ", 0);
 	sendUartParams(src, &UartUsb);
 	UartSendString(src, "\r\nUART1: ", 0);
@@ -262,8 +481,13 @@ static void printConfig(Uart *src)
 			UartSendString(src, "no path", 0);
 		UartSendByte(src, ',');
 		UartSendByte(src, ' ');
-		UartSendString(src, beacon[i].data, 0);
+		if(beacon[i].telemetry)
+			UartSendString(src, "telemetry", 0);
+		else
+			UartSendString(src, beacon[i].data, 0);
 	}
+	UartSendString(src, "\r\nBeacon jitter (s): ", 0);
+	UartSendNumber(src, BeaconConfig.jitter);
 
 	UartSendString(src, "\r\nDigipeater: ", 0);
 	if(DigiConfig.enable)
@@ -300,6 +524,8 @@ static void printConfig(Uart *src)
 			UartSendString(src, "viscous-delay, ", 0);
 		else if(DigiConfig.directOnly & (1 << i))
 			UartSendString(src, "direct-only, ", 0);
+		if(DigiConfig.throttle & (1 << i))
+			UartSendString(src, "throttled, ", 0);
 		if(DigiConfig.callFilterEnable & (1 << i))
 			UartSendString(src, "filtered\r\n", 0);
 		else
@@ -331,6 +557,8 @@ static void printConfig(Uart *src)
 			UartSendString(src, "viscous-delay, ", 0);
 		else if(DigiConfig.directOnly & (1 << (i + 4)))
 			UartSendString(src, "direct-only, ", 0);
+		if(DigiConfig.throttle & (1 << (i + 4)))
+			UartSendString(src, "throttled, ", 0);
 		if(DigiConfig.callFilterEnable & (1 << (i + 4)))
 			UartSendString(src, "filtered\r\n", 0);
 		else
@@ -338,6 +566,11 @@ static void printConfig(Uart *src)
 	}
 	UartSendString(src, "Anti-duplicate buffer hold time (s): ", 0);
 	UartSendNumber(src, DigiConfig.dupeTime);
+	UartSendString(src, "\r\nThrottling channel utilization limit (%): ", 0);
+	if(DigiConfig.loadLimit)
+		UartSendNumber(src, DigiConfig.loadLimit);
+	else
+		UartSendString(src, "disabled", 0);
 	UartSendString(src, "\r\nCallsign filter type: ", 0);
 	if(DigiConfig.filterPolarity)
 		UartSendString(src, "whitelist\r\n", 0);
@@ -371,15 +604,325 @@ static void printConfig(Uart *src)
 		UartSendString(src, "On\r\n", 0);
 	else
 		UartSendString(src, "Off\r\n", 0);
+	UartSendString(src, "FX.25 parity size: ", 0);
+	if(Ax25Config.fx25Adaptive == 1)
+	{
+		UartSendString(src, "auto, ", 0);
+		UartSendNumber(src, Ax25Config.fx25MinParity);
+		UartSendByte(src, '-');
+		UartSendNumber(src, Ax25Config.fx25MaxParity);
+		UartSendString(src, "\r\n", 0);
+	}
+	else
+		UartSendString(src, "standard\r\n", 0);
+	UartSendString(src, "IL2P protocol: ", 0);
+	if(Ax25Config.il2p == 1)
+		UartSendString(src, "On\r\n", 0);
+	else
+		UartSendString(src, "Off\r\n", 0);
+	UartSendString(src, "IL2P TX: ", 0);
+	if(Ax25Config.il2pTx == 1)
+		UartSendString(src, "On\r\n", 0);
+	else
+		UartSendString(src, "Off\r\n", 0);
+	UartSendString(src, "IL2P CRC: ", 0);
+	if(Ax25Config.il2pCrc == 1)
+		UartSendString(src, "On\r\n", 0);
+	else
+		UartSendString(src, "Off\r\n", 0);
 }
 
 static void sendTime(Uart *src)
 {
 	UartSendString(src, "Time since boot: ", 0);
-	UartSendNumber(src, SysTickGet() * SYSTICK_INTERVAL / 60000); //convert from ms to minutes
+	UartSendNumber(src, SysTickGet64() * SYSTICK_INTERVAL / 60000); //convert from ms to minutes
 	UartSendString(src, " minutes\r\n", 0);
 }
 
+static void sendPermille(Uart *src, uint16_t value)
+{
+	UartSendNumber(src, value / 10);
+	UartSendByte(src, '.');
+	UartSendNumber(src, value % 10);
+	UartSendByte(src, '%');
+}
+
+static void sendLoad(Uart *src)
+{
+	UartSendString(src, "Channel utilization (1/5/15 min): ", 0);
+	for(uint8_t i = 0; i < CHANNEL_WINDOW_COUNT; i++)
+	{
+		if(i > 0)
+			UartSendString(src, ", ", 0);
+		sendPermille(src, ChannelGetUtilization(i));
+	}
+	UartSendString(src, "\r\nTX duty cycle (1/5/15 min): ", 0);
+	for(uint8_t i = 0; i < CHANNEL_WINDOW_COUNT; i++)
+	{
+		if(i > 0)
+			UartSendString(src, ", ", 0);
+		sendPermille(src, ChannelGetDutyCycle(i));
+	}
+	UartSendString(src, "\r\n", 0);
+}
+
+#ifdef ENABLE_PROFILING
+static void sendCpuStats(Uart *src)
+{
+	static const char *const zoneName[PROFILE_ZONE_COUNT] = {"Demodulator ISR", "DAC ISR", "Baudrate ISR", "UART ISRs", "USB ISR", "Main loop"};
+	uint16_t load, peak;
+	ProfileGetLoad(&load, &peak);
+	UartSendString(src, "CPU load: ", 0);
+	sendPermille(src, load);
+	UartSendString(src, " (peak ", 0);
+	sendPermille(src, peak);
+	UartSendString(src, ")\r\n", 0);
+
+	struct ProfileStats stats;
+	for(uint8_t i = 0; i < PROFILE_ZONE_COUNT; i++)
+	{
+		ProfileGetStats(i, &stats);
+		UartSendString(src, (char*)zoneName[i], 0);
+		UartSendString(src, ": ", 0);
+		UartSendNumber(src, stats.count);
+		UartSendString(src, " calls, min/avg/max cycles: ", 0);
+		UartSendNumber(src, stats.min);
+		UartSendByte(src, '/');
+		UartSendNumber(src, stats.count ? (uint32_t)(stats.sum / stats.count) : 0);
+		UartSendByte(src, '/');
+		UartSendNumber(src, stats.max);
+		UartSendString(src, "\r\n", 0);
+	}
+
+	uint32_t used, reserved, available;
+	ProfileGetStack(&used, &reserved, &available);
+	UartSendString(src, "Stack high-water mark: ", 0);
+	UartSendNumber(src, used);
+	UartSendString(src, " bytes (reserved ", 0);
+	UartSendNumber(src, reserved);
+	UartSendString(src, ", available ", 0);
+	UartSendNumber(src, available);
+	UartSendString(src, ")\r\n", 0);
+}
+
+#ifdef ENABLE_FX25
+static uint8_t fecBenchBuffer[FX25_MAX_BLOCK_SIZE]; //FX.25 block for benchmark
+
+static void sendFecBenchmark(Uart *src)
+{
+	struct Fx25BenchResult result;
+	for(uint8_t i = 0; i < (sizeof(Fx25ModeList) / sizeof(Fx25ModeList[0])); i++)
+	{
+		const struct Fx25Mode *mode = &Fx25ModeList[i];
+		for(uint8_t lwfec = 0; lwfec < 2; lwfec++)
+		{
+			Fx25Benchmark(mode, lwfec, fecBenchBuffer, &result);
+			UartSendString(src, "K=", 0);
+			UartSendNumber(src, mode->K);
+			UartSendString(src, " T=", 0);
+			UartSendNumber(src, mode->T);
+			UartSendString(src, lwfec ? " LwFEC" : " in-tree", 0);
+			UartSendString(src, ": encode ", 0);
+			UartSendNumber(src, result.encode);
+			UartSendString(src, ", decode with ", 0);
+			for(uint8_t k = 0; k < FX25_BENCH_ERROR_STEPS; k++)
+			{
+				if(k > 0)
+					UartSendByte(src, '/');
+				UartSendNumber(src, (mode->T / 2) * k / (FX25_BENCH_ERROR_STEPS - 1));
+			}
+			UartSendString(src, " errors ", 0);
+			for(uint8_t k = 0; k < FX25_BENCH_ERROR_STEPS; k++)
+			{
+				if(k > 0)
+					UartSendByte(src, '/');
+				UartSendNumber(src, result.decode[k]);
+			}
+			UartSendString(src, " cycles", 0);
+			if(result.failed)
+				UartSendString(src, ", FAILED", 0);
+			UartSendString(src, "\r\n", 0);
+		}
+	}
+}
+#endif
+
+#endif
+#ifdef ENABLE_TRACE
+static void sendLatency(Uart *src)
+{
+	static const char *stageName[TRACE_STAGE_COUNT] = {"Total (RX to on air)", "RX to processing", "Processing to digipeater",
+			"Digipeater to TX queue", "TX queue to key-up", "Key-up to on air"};
+	uint16_t buckets[TRACE_BUCKET_COUNT];
+	for(uint8_t i = 0; i < TRACE_STAGE_COUNT; i++)
+	{
+		TraceGetHistogram(i, buckets);
+		UartSendString(src, (char*)stageName[i], 0);
+		UartSendString(src, ":", 0);
+		bool empty = true;
+		for(uint8_t k = 0; k < TRACE_BUCKET_COUNT; k++)
+		{
+			if(0 == buckets[k])
+				continue;
+			UartSendString(src, empty ? " " : ", ", 0);
+			empty = false;
+			if(k < (TRACE_BUCKET_COUNT - 1))
+			{
+				UartSendByte(src, '<');
+				UartSendNumber(src, (uint32_t)TRACE_BUCKET_MIN_US << k);
+			}
+			else
+			{
+				UartSendString(src, ">=", 0);
+				UartSendNumber(src, (uint32_t)TRACE_BUCKET_MIN_US << (k - 1));
+			}
+			UartSendString(src, "us: ", 0);
+			UartSendNumber(src, buckets[k]);
+		}
+		if(empty)
+			UartSendString(src, " no data", 0);
+		UartSendString(src, "\r\n", 0);
+	}
+}
+
+#endif
+static void sendTxQueueStats(Uart *src)
+{
+	static const char *const className[AX25_TX_CLASS_COUNT] = {"Digi", "Host", "Beacon"};
+	struct Ax25TxQueueStats stats;
+	for(uint8_t i = 0; i < AX25_TX_CLASS_COUNT; i++)
+	{
+		Ax25GetTxQueueStats(i, &stats);
+		UartSendString(src, (char*)className[i], 0);
+		UartSendString(src, " queue: ", 0);
+		UartSendNumber(src, stats.depth);
+		UartSendString(src, " queued (max ", 0);
+		UartSendNumber(src, stats.maxDepth);
+		UartSendString(src, "), ", 0);
+		UartSendNumber(src, stats.sent);
+		UartSendString(src, " sent, ", 0);
+		UartSendNumber(src, stats.dropped);
+		UartSendString(src, " dropped, wait avg/max (ms): ", 0);
+		if(stats.sent)
+			UartSendNumber(src, stats.waitSum / stats.sent * SYSTICK_INTERVAL);
+		else
+			UartSendByte(src, '0');
+		UartSendByte(src, '/');
+		UartSendNumber(src, stats.waitMax * SYSTICK_INTERVAL);
+		UartSendString(src, "\r\n", 0);
+	}
+	UartSendString(src, "KISS frames dropped (USB/UART1/UART2): ", 0);
+	UartSendNumber(src, UartUsb.kissDropped);
+	UartSendByte(src, '/');
+	UartSendNumber(src, Uart1.kissDropped);
+	UartSendByte(src, '/');
+	UartSendNumber(src, Uart2.kissDropped);
+	UartSendString(src, "\r\nUART TX bytes dropped (UART1/UART2): ", 0);
+	UartSendNumber(src, Uart1.txOverflow);
+	UartSendByte(src, '/');
+	UartSendNumber(src, Uart2.txOverflow);
+	UartSendString(src, "\r\n", 0);
+}
+
+static void sendStats(Uart *src)
+{
+	struct Ax25RxStats rx;
+	for(uint8_t i = 0; i < ModemGetDemodulatorCount(); i++)
+	{
+		Ax25GetRxStats(i, &rx);
+		UartSendString(src, "Demodulator ", 0);
+		UartSendNumber(src, i + 1);
+		UartSendString(src, ": ", 0);
+		UartSendNumber(src, rx.decoded);
+		UartSendString(src, " decoded, ", 0);
+		UartSendNumber(src, rx.crcErrors);
+		UartSendString(src, " CRC errors, ", 0);
+#ifndef ENABLE_FX25
+		UartSendNumber(src, rx.aborted);
+		UartSendString(src, " aborted, ", 0);
+#endif
+		UartSendNumber(src, rx.tooLong);
+		UartSendString(src, " too long", 0);
+#ifdef ENABLE_FX25
+		UartSendString(src, ", FX.25 ", 0);
+		UartSendNumber(src, rx.fx25Corrected);
+		UartSendString(src, " corrected, ", 0);
+		UartSendNumber(src, rx.fx25Failed);
+		UartSendString(src, " uncorrectable", 0);
+#endif
+#ifdef ENABLE_IL2P
+		UartSendString(src, ", IL2P ", 0);
+		UartSendNumber(src, rx.il2pCorrected);
+		UartSendString(src, " corrected, ", 0);
+		UartSendNumber(src, rx.il2pFailed);
+		UartSendString(src, " uncorrectable", 0);
+#endif
+		UartSendString(src, "\r\n", 0);
+	}
+
+	uint32_t txDropped = 0;
+	struct Ax25TxQueueStats tx;
+	for(uint8_t i = 0; i < AX25_TX_CLASS_COUNT; i++)
+	{
+		Ax25GetTxQueueStats(i, &tx);
+		txDropped += tx.dropped;
+	}
+	UartSendString(src, "RX buffer overflows: ", 0);
+	UartSendNumber(src, Ax25GetRxDropped());
+	UartSendString(src, ", TX queue overflows: ", 0);
+	UartSendNumber(src, txDropped);
+
+	struct DigiStats digi;
+	DigiGetStats(&digi);
+	UartSendString(src, "\r\nDigipeater: ", 0);
+	UartSendNumber(src, digi.duplicates);
+	UartSendString(src, " duplicates dropped, ", 0);
+	UartSendNumber(src, digi.viscousCancelled);
+	UartSendString(src, " viscous-delay cancelled\r\n", 0);
+
+#ifdef ENABLE_FX25
+	uint16_t errors = Fx25GetChannelErrors();
+	UartSendString(src, "FX.25 channel errors per 255-byte block: ", 0);
+	UartSendNumber(src, errors >> 8);
+	UartSendByte(src, '.');
+	UartSendNumber(src, ((errors & 0xFF) * 10) >> 8);
+	UartSendString(src, ", automatic parity size: ", 0);
+	UartSendNumber(src, Fx25GetAdaptiveParity());
+	UartSendString(src, "\r\n", 0);
+#endif
+
+	struct BeaconStats bc;
+	BeaconGetStats(&bc);
+	UartSendString(src, "Beacons: ", 0);
+	UartSendNumber(src, bc.sent);
+	UartSendString(src, " sent, ", 0);
+	UartSendNumber(src, bc.deferred);
+	UartSendString(src, " deferred, ", 0);
+	UartSendNumber(src, bc.forced);
+	UartSendString(src, " sent to busy channel\r\n", 0);
+
+	static const char *const portName[3] = {"USB", "UART1", "UART2"};
+	Uart *const port[3] = {&UartUsb, &Uart1, &Uart2};
+	for(uint8_t i = 0; i < 3; i++)
+	{
+		UartSendString(src, (char*)portName[i], 0);
+		UartSendString(src, ": KISS frames in/out: ", 0);
+		UartSendNumber(src, port[i]->kissRxFrames);
+		UartSendByte(src, '/');
+		UartSendNumber(src, port[i]->kissTxFrames);
+		UartSendString(src, ", bytes in/out: ", 0);
+		UartSendNumber(src, port[i]->rxBytes);
+		UartSendByte(src, '/');
+		UartSendNumber(src, port[i]->txBytes);
+		if(!port[i]->isUsb)
+		{
+			UartSendString(src, ", RX overruns: ", 0);
+			UartSendNumber(src, port[i]->rxOverrun);
+		}
+		UartSendString(src, "\r\n", 0);
+	}
+}
+
 void TermParse(Uart *src)
 {
 	const char *cmd = (char*)src->rxBuffer;
@@ -441,6 +984,54 @@ void TermParse(Uart *src)
 			sendTime(src);
 			return;
 		}
+		else if(!strncmp(cmd, "load", 4))
+		{
+			sendLoad(src);
+			return;
+		}
+		else if(!strncmp(cmd, "txq", 3))
+		{
+			sendTxQueueStats(src);
+			return;
+		}
+		else if(!strncmp(cmd, "stats", 5))
+		{
+			sendStats(src);
+			return;
+		}
+#ifdef ENABLE_PROFILING
+		else if(!strncmp(cmd, "cpu clear", 9))
+		{
+			ProfileClear();
+			UartSendString(src, "OK\r\n", 0);
+			return;
+		}
+		else if(!strncmp(cmd, "cpu", 3))
+		{
+			sendCpuStats(src);
+			return;
+		}
+#ifdef ENABLE_FX25
+		else if(!strncmp(cmd, "fecbench", 8))
+		{
+			sendFecBenchmark(src);
+			return;
+		}
+#endif
+#endif
+#ifdef ENABLE_TRACE
+		else if(!strncmp(cmd, "latency clear", 13))
+		{
+			TraceClear();
+			UartSendString(src, "OK\r\n", 0);
+			return;
+		}
+		else if(!strncmp(cmd, "latency", 7))
+		{
+			sendLatency(src);
+			return;
+		}
+#endif
 		else if(!strncmp(cmd, "beacon ", 7))
 		{
 			if((cmd[7] >= '0') && (cmd[7] <= '7'))
@@ -629,6 +1220,7 @@ void TermParse(Uart *src)
 			UartSendString(src, "Incorrect callsign!\r\n", 0);
 			return;
 		}
+		BeaconUpdate(); //recalculate cached beacon frame sizes and hashes
 	}
 	else if(!strncmp(cmd, "dest", 4))
 	{
@@ -637,6 +1229,7 @@ void TermParse(Uart *src)
 			UartSendString(src, "Incorrect address!\r\n", 0);
 			return;
 		}
+		BeaconUpdate(); //recalculate cached beacon frame sizes and hashes
 	}
 	else if(!strncmp(cmd, "txdelay", 7))
 	{
@@ -677,6 +1270,76 @@ void TermParse(Uart *src)
 			Ax25Config.quietTime = (uint16_t)t;
 		}
 	}
+	else if(!strncmp(cmd, "txsched ", 8))
+	{
+		if(!strncmp(&cmd[8], "strict", 6))
+			Ax25Config.txWeighted = 0;
+		else if(!strncmp(&cmd[8], "weighted", 8))
+			Ax25Config.txWeighted = 1;
+		else
+			err = true;
+	}
+	else if(!strncmp(cmd, "txframes ", 9))
+	{
+		int64_t t = StrToInt(&cmd[9], len - 9);
+		if((t > 255) || (t < 0))
+		{
+			UartSendString(src, "Incorrect frame count!\r\n", 0);
+			return;
+		}
+		else
+		{
+			Ax25Config.txMaxFrames = (uint8_t)t;
+		}
+	}
+	else if(!strncmp(cmd, "txtime ", 7))
+	{
+		int64_t t = StrToInt(&cmd[7], len - 7);
+		if((t > 60000) || ((t < 500) && (t != 0)))
+		{
+			UartSendString(src, "Incorrect TX time!\r\n", 0);
+			return;
+		}
+		else
+		{
+			Ax25Config.txMaxTime = (uint16_t)t;
+		}
+	}
+	else if(!strncmp(cmd, "persist ", 8))
+	{
+		int64_t t = StrToInt(&cmd[8], len - 8);
+		if((t > 255) || (t < 0))
+		{
+			UartSendString(src, "Incorrect persistence!\r\n", 0);
+			return;
+		}
+		else
+		{
+			Ax25Config.persistence = (uint8_t)t;
+		}
+	}
+	else if(!strncmp(cmd, "slot ", 5))
+	{
+		int64_t t = StrToInt(&cmd[5], len - 5);
+		if((t > 2550) || (t < 10))
+		{
+			UartSendString(src, "Incorrect slot time!\r\n", 0);
+			return;
+		}
+		else
+		{
+			Ax25Config.slotTime = (uint16_t)t;
+		}
+	}
+	else if(!strncmp(cmd, "fullduplex ", 11))
+	{
+		if(!strncmp(&cmd[11], "on", 2))
+			Ax25Config.fullDuplex = 1;
+		else if(!strncmp(&cmd[11], "off", 3))
+			Ax25Config.fullDuplex = 0;
+		else
+			err = true;
+	}
 	else if(!strncmp(cmd, "uart", 4))
 	{
 		Uart *u = NULL;
@@ -727,6 +1390,17 @@ void TermParse(Uart *src)
 			return;
 		}
 	}
+	else if(!strncmp(cmd, "beacon jitter", 13))
+	{
+		int64_t t = StrToInt(&cmd[14], len - 14);
+		if((t < 0) || (t > BEACON_MAX_JITTER))
+		{
+			UartSendString(src, "Incorrect jitter time!\r\n", 0);
+			return;
+		}
+		BeaconConfig.jitter = t;
+		BeaconCheck(); //reschedule deferred beacons
+	}
 	else if(!strncmp(cmd, "beacon", 6))
 	{
 		uint8_t bcno = 0;
@@ -737,9 +1411,16 @@ void TermParse(Uart *src)
 			return;
 		}
 		if(!strncmp(&cmd[9], "on", 2))
+		{
 			beacon[bcno].enable = 1;
+			BeaconUpdate(); //calculate cached beacon frame size and hash
+			BeaconReschedule(); //recompute beacon slots
+		}
 		else if(!strncmp(&cmd[9], "off", 3))
+		{
 			beacon[bcno].enable = 0;
+			BeaconReschedule(); //recompute beacon slots
+		}
 		else if(!strncmp(&cmd[9], "iv", 2) || !strncmp(&cmd[9], "dl", 2)) //interval or delay
 		{
 			int64_t t = StrToInt(&cmd[12], len - 12);
@@ -752,8 +1433,29 @@ void TermParse(Uart *src)
 				beacon[bcno].interval = t * 6000;
 			else
 				beacon[bcno].delay = t * 60;
+			BeaconReschedule(); //recompute beacon slots
 
 		}
+		else if(!strncmp(&cmd[9], "telemetry", 9))
+		{
+			if(!strncmp(&cmd[19], "on", 2))
+			{
+				for(uint8_t i = 0; i < 8; i++)
+				{
+					if((i != bcno) && beacon[i].telemetry) //there is only one telemetry sequence and counter state
+					{
+						UartSendString(src, "Only one beacon can send telemetry\r\n", 0);
+						return;
+					}
+				}
+				beacon[bcno].telemetry = 1;
+			}
+			else if(!strncmp(&cmd[19], "off", 3))
+				beacon[bcno].telemetry = 0;
+			else
+				err = true;
+			BeaconUpdate(); //recalculate cached beacon frame sizes and hashes
+		}
 		else if(!strncmp(&cmd[9], "data", 4))
 		{
 			if((len - 14) > BEACON_MAX_PAYLOAD_SIZE)
@@ -765,6 +1467,7 @@ void TermParse(Uart *src)
 			for(; i < (len - 14); i++)
 				beacon[bcno].data[i] = cmd[14 + i];
 			beacon[bcno].data[i] = 0;
+			BeaconUpdate(); //recalculate cached beacon frame sizes and hashes
 		}
 		else if(!strncmp(&cmd[9], "path", 4))
 		{
@@ -777,6 +1480,7 @@ void TermParse(Uart *src)
 			if(((len - 14) == 4) && !strncmp(&cmd[14], "none", 4)) //"none" path
 			{
 				memset(beacon[bcno].path, 0, sizeof(beacon[bcno].path));
+				BeaconUpdate(); //recalculate cached beacon frame sizes and hashes
 
 				UartSendString(src, "OK\r\n", 0);
 				return;
@@ -816,6 +1520,7 @@ void TermParse(Uart *src)
 			}
 
 			memcpy(beacon[bcno].path, tmp, 14);
+			BeaconUpdate(); //recalculate cached beacon frame sizes and hashes
 		}
 		else
 		{
@@ -919,6 +1624,17 @@ void TermParse(Uart *src)
 					err = true;
 				}
 			}
+			else if(!strncmp(&cmd[7], "throttle ", 9))
+			{
+				if(!strncmp(&cmd[16], "on", 2))
+					DigiConfig.throttle |= (1 << alno);
+				else if(!strncmp(&cmd[16], "off", 3))
+					DigiConfig.throttle &= ~(1 << alno);
+				else
+				{
+					err = true;
+				}
+			}
 			else if(!strncmp(&cmd[7], "direct ", 7))
 			{
 				if(!strncmp(&cmd[14], "on", 2))
@@ -958,6 +1674,17 @@ void TermParse(Uart *src)
 			else
 				DigiConfig.dupeTime = (uint8_t)t;
 		}
+		else if(!strncmp(&cmd[5], "load ", 5))
+		{
+			int64_t t = StrToInt(&cmd[10], len - 10);
+			if((t > 100) || ((t < 10) && (t != 0)))
+			{
+				UartSendString(src, "Incorrect channel utilization limit!\r\n", 0);
+				return;
+			}
+			else
+				DigiConfig.loadLimit = (uint8_t)t;
+		}
 		else if(!strncmp(&cmd[5], "list ", 5))
 		{
 			uint16_t shift = 10;
@@ -1099,6 +1826,52 @@ void TermParse(Uart *src)
 		else
 			err = true;
 	}
+	else if(!strncmp(cmd, "fx25fec ", 8))
+	{
+		if(!strncmp(&cmd[8], "std", 3))
+			Ax25Config.fx25Adaptive = 0;
+		else if(!strncmp(&cmd[8], "auto", 4))
+			Ax25Config.fx25Adaptive = 1;
+		else
+		{
+			int64_t min = StrToInt(&cmd[8], 2);
+			int64_t max = (len > 11) ? StrToInt(&cmd[11], len - 11) : 0;
+			if(((min != 16) && (min != 32) && (min != 64)) || ((max != 16) && (max != 32) && (max != 64)) || (min > max))
+			{
+				UartSendString(src, "Incorrect parity size!\r\n", 0);
+				return;
+			}
+			Ax25Config.fx25MinParity = min;
+			Ax25Config.fx25MaxParity = max;
+		}
+	}
+	else if(!strncmp(cmd, "il2p ", 5))
+	{
+		if(!strncmp(&cmd[5], "on", 2))
+			Ax25Config.il2p = 1;
+		else if(!strncmp(&cmd[5], "off", 2))
+			Ax25Config.il2p = 0;
+		else
+			err = true;
+	}
+	else if(!strncmp(cmd, "il2ptx ", 7))
+	{
+		if(!strncmp(&cmd[7], "on", 2))
+			Ax25Config.il2pTx = 1;
+		else if(!strncmp(&cmd[7], "off", 2))
+			Ax25Config.il2pTx = 0;
+		else
+			err = true;
+	}
+	else if(!strncmp(cmd, "il2pcrc ", 8))
+	{
+		if(!strncmp(&cmd[8], "on", 2))
+			Ax25Config.il2pCrc = 1;
+		else if(!strncmp(&cmd[8], "off", 2))
+			Ax25Config.il2pCrc = 0;
+		else
+			err = true;
+	}
 	else
 	{
 		UartSendString(src, "Unknown command. For command list type \"help\"\r\n", 0);
@@ -0,0 +1,177 @@
+/*
+Copyright 2020-2025 Piotr Wilkon
+
+This file is part of VP-Digi.
+
+VP-Digi is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+VP-Digi is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "timer.h"
+#include "systick.h"
+#include "event.h"
+#include "stm32f1xx.h"
+
+//running timers are kept in a binary min-heap ordered by deadline
+static struct Timer *heap[TIMER_MAX_COUNT];
+static uint8_t heapSize = 0;
+static volatile uint64_t nearest = UINT64_MAX; //nearest deadline, checked in SysTick interrupt
+
+/**
+ * @brief Place timer at given heap position
+ * @param *t Timer
+ * @param index Heap index
+ */
+static void heapSet(struct Timer *t, uint8_t index)
+{
+	heap[index] = t;
+	t->index = index;
+}
+
+/**
+ * @brief Move heap element up until heap order is restored
+ * @param index Heap index
+ */
+static void siftUp(uint8_t index)
+{
+	struct Timer *t = heap[index];
+	while(index > 0)
+	{
+		uint8_t parent = (index - 1) >> 1;
+		if(heap[parent]->deadline <= t->deadline)
+			break;
+		heapSet(heap[parent], index);
+		index = parent;
+	}
+	heapSet(t, index);
+}
+
+/**
+ * @brief Move heap element down until heap order is restored
+ * @param index Heap index
+ */
+static void siftDown(uint8_t index)
+{
+	struct Timer *t = heap[index];
+	while(1)
+	{
+		uint8_t child = (index << 1) + 1;
+		if(child >= heapSize)
+			break;
+		if(((child + 1) < heapSize) && (heap[child + 1]->deadline < heap[child]->deadline))
+			child++;
+		if(t->deadline <= heap[child]->deadline)
+			break;
+		heapSet(heap[child], index);
+		index = child;
+	}
+	heapSet(t, index);
+}
+
+/**
+ * @brief Remove element from heap
+ * @param index Heap index
+ */
+static void heapRemove(uint8_t index)
+{
+	heap[index]->index = TIMER_INACTIVE;
+	heapSize--;
+	if(index == heapSize) //last element
+		return;
+
+	heapSet(heap[heapSize], index);
+	if((index > 0) && (heap[index]->deadline < heap[(index - 1) >> 1]->deadline))
+		siftUp(index);
+	else
+		siftDown(index);
+}
+
+/**
+ * @brief Update the nearest deadline checked by interrupt
+ */
+static void updateNearest(void)
+{
+	uint64_t n = (heapSize > 0) ? heap[0]->deadline : UINT64_MAX;
+	__disable_irq();
+	nearest = n;
+	__enable_irq();
+}
+
+bool TimerStartAt(struct Timer *t, uint64_t deadline)
+{
+	if(t->index != TIMER_INACTIVE)
+		heapRemove(t->index);
+
+	if(heapSize == TIMER_MAX_COUNT)
+	{
+		updateNearest();
+		return false;
+	}
+
+	t->deadline = deadline;
+	heapSet(t, heapSize++);
+	siftUp(t->index);
+	updateNearest();
+
+	if(deadline <= SysTickGet64()) //already expired, don't wait for next tick
+		EventPost(EVENT_TIMER);
+	return true;
+}
+
+bool TimerStart(struct Timer *t, uint32_t delay)
+{
+	return TimerStartAt(t, SysTickGet64() + delay);
+}
+
+void TimerStop(struct Timer *t)
+{
+	t->deadline = UINT64_MAX; //a timer already expired but not yet processed must not be called
+	if(t->index == TIMER_INACTIVE)
+		return;
+	heapRemove(t->index);
+	updateNearest();
+}
+
+bool TimerIsActive(struct Timer *t)
+{
+	return t->index != TIMER_INACTIVE;
+}
+
+void TimerCheck(void)
+{
+	if(SysTickGet64() >= nearest)
+		EventPost(EVENT_TIMER);
+}
+
+void TimerProcess(void)
+{
+	struct Timer *expired[TIMER_MAX_COUNT];
+	uint8_t count = 0;
+
+	//collect expired timers first, so that a timer restarted by its callback is handled in next pass
+	uint64_t now = SysTickGet64();
+	while((heapSize > 0) && (heap[0]->deadline <= now))
+	{
+		expired[count++] = heap[0];
+		heapRemove(0);
+	}
+	updateNearest();
+
+	for(uint8_t i = 0; i < count; i++)
+	{
+		//skip timers restarted or stopped by an earlier callback in this pass
+		if((expired[i]->index != TIMER_INACTIVE) || (expired[i]->deadline > now))
+			continue;
+		expired[i]->callback(); //callback may restart this or any other timer
+	}
+}
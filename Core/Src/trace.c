@@ -0,0 +1,161 @@
+/*
+Copyright 2020-2025 Piotr Wilkon
+
+This file is part of VP-Digi.
+
+VP-Digi is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+VP-Digi is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "trace.h"
+
+#ifdef ENABLE_TRACE
+
+#include "systick.h"
+#include "stm32f1xx.h"
+
+#define TRACE_RECORD_COUNT 8 //max number of frames traced at once
+
+struct TraceRecord
+{
+	uint16_t id;
+	uint8_t stamped; //bitmap of stamped stages
+	uint32_t stamp[TRACE_STAGE_KEYUP]; //cycle counter values, stages after queueing are not stored
+};
+
+static struct TraceRecord record[TRACE_RECORD_COUNT];
+static uint16_t lastId = TRACE_NONE;
+static uint16_t currentId = TRACE_NONE;
+static volatile uint32_t keyUp = 0; //cycle counter value at last key-up
+//histograms of latency from the previous stage to given stage, index 0 is the total RX to air latency
+static uint16_t histogram[TRACE_STAGE_COUNT][TRACE_BUCKET_COUNT];
+
+/**
+ * @brief Add latency to histogram
+ * @param stage Histogram index
+ * @param cycles Latency in CPU cycles
+ */
+static void addLatency(enum TraceStage stage, uint32_t cycles)
+{
+	uint32_t us = cycles / (SystemCoreClock / 1000000);
+	uint8_t bucket = 0;
+	while((us >= TRACE_BUCKET_MIN_US) && (bucket < (TRACE_BUCKET_COUNT - 1)))
+	{
+		us >>= 1;
+		bucket++;
+	}
+	if(histogram[stage][bucket] < UINT16_MAX)
+		histogram[stage][bucket]++;
+}
+
+/**
+ * @brief Find active record with given ID
+ * @param id Trace record ID
+ * @return Record or NULL if not found or already reused
+ */
+static struct TraceRecord *findRecord(uint16_t id)
+{
+	if(TRACE_NONE == id)
+		return NULL;
+	struct TraceRecord *r = &record[id % TRACE_RECORD_COUNT];
+	if(r->id != id)
+		return NULL;
+	return r;
+}
+
+uint16_t TraceStart(void)
+{
+	uint32_t now = SysTickGetCycles();
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	lastId++;
+	if(TRACE_NONE == lastId)
+		lastId++;
+	struct TraceRecord *r = &record[lastId % TRACE_RECORD_COUNT]; //oldest record is overwritten
+	r->id = lastId;
+	r->stamped = 1 << TRACE_STAGE_RX;
+	r->stamp[TRACE_STAGE_RX] = now;
+	__set_PRIMASK(primask);
+	return lastId;
+}
+
+void TraceStamp(uint16_t id, enum TraceStage stage)
+{
+	uint32_t now = SysTickGetCycles();
+	uint32_t primask = __get_PRIMASK(); //called from main loop and TX interrupt
+	__disable_irq();
+	struct TraceRecord *r = findRecord(id);
+	//stages after queueing are stamped at once when frame goes on air
+	enum TraceStage previous = (TRACE_STAGE_AIR == stage) ? TRACE_STAGE_QUEUE : (stage - 1);
+	if((NULL == r) || (stage == TRACE_STAGE_RX) || (stage == TRACE_STAGE_KEYUP) || !(r->stamped & (1 << previous)))
+	{
+		//unknown record or previous stage not reached
+		__set_PRIMASK(primask);
+		return;
+	}
+
+	if(TRACE_STAGE_AIR == stage)
+	{
+		//key-up is shared by all frames in transmission, so use queueing time if transmitter was already keyed up
+		uint32_t k = keyUp;
+		if((int32_t)(k - r->stamp[TRACE_STAGE_QUEUE]) < 0)
+			k = r->stamp[TRACE_STAGE_QUEUE];
+		addLatency(TRACE_STAGE_KEYUP, k - r->stamp[TRACE_STAGE_QUEUE]);
+		addLatency(TRACE_STAGE_AIR, now - k);
+		addLatency(TRACE_STAGE_RX, now - r->stamp[TRACE_STAGE_RX]); //total
+		r->id = TRACE_NONE; //record is complete
+	}
+	else if(stage < TRACE_STAGE_KEYUP)
+	{
+		addLatency(stage, now - r->stamp[stage - 1]);
+		r->stamp[stage] = now;
+		r->stamped |= (1 << stage);
+	}
+	__set_PRIMASK(primask);
+}
+
+void TraceKeyUp(void)
+{
+	keyUp = SysTickGetCycles();
+}
+
+void TraceSetCurrent(uint16_t id)
+{
+	currentId = id;
+}
+
+uint16_t TraceGetCurrent(void)
+{
+	return currentId;
+}
+
+void TraceGetHistogram(enum TraceStage stage, uint16_t *buckets)
+{
+	__disable_irq();
+	for(uint8_t i = 0; i < TRACE_BUCKET_COUNT; i++)
+		buckets[i] = histogram[stage][i];
+	__enable_irq();
+}
+
+void TraceClear(void)
+{
+	__disable_irq();
+	for(uint8_t i = 0; i < TRACE_STAGE_COUNT; i++)
+	{
+		for(uint8_t k = 0; k < TRACE_BUCKET_COUNT; k++)
+			histogram[i][k] = 0;
+	}
+	__enable_irq();
+}
+
+#endif
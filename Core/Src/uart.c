@@ -24,83 +24,247 @@ along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
 #include <uart.h>
 #include "digipeater.h"
 #include "kiss.h"
+#include "event.h"
+#include "profile.h"
 
 Uart Uart1 = {.defaultMode = MODE_KISS}, Uart2 = {.defaultMode = MODE_KISS}, UartUsb= {.defaultMode = MODE_KISS};
 
+static uint8_t uart1TxBuffer[UART_TX_BUFFER_SIZE], uart2TxBuffer[UART_TX_BUFFER_SIZE];
+static uint8_t uart1RxBuffer[UART_RX_DMA_BUFFER_SIZE], uart2RxBuffer[UART_RX_DMA_BUFFER_SIZE];
+
 static void handleInterrupt(Uart *port)
 {
-	if(UART_LL_CHECK_RX_NOT_EMPTY(port->port)) //byte received
+	if(UART_LL_CHECK_RX_IDLE(port->port)) //line is idle, end of data reception
 	{
-		UART_LL_CLEAR_RX_NOT_EMPTY(port->port);
-		uint8_t data = port->port->DR;
-		port->rxBuffer[port->rxBufferHead++] = data; //store it
-		port->rxBufferHead %= UART_BUFFER_SIZE;
+		UART_LL_GET_DATA(port->port); //reset idle flag by dummy read
+		port->rxIdle = 1;
+		port->rxEvent = 1;
+		EventPost(EVENT_RX_DATA);
+	}
+}
 
-		KissParse(port, data);
-		TermHandleSpecial(port);
+void UartHandleRx(Uart *port)
+{
+	if(!port->rxEvent || (NULL == port->rxDmaBuffer))
+		return;
 
+	bool idle = port->rxIdle;
+	port->rxEvent = 0;
+	port->rxIdle = 0;
+
+	__disable_irq();
+	uint32_t halves = port->rxDmaHalves;
+	uint16_t head = (UART_RX_DMA_BUFFER_SIZE - UART_LL_RX_DMA_GET_REMAINING(port->rxDma)) % UART_RX_DMA_BUFFER_SIZE;
+	__enable_irq();
+
+	//total number of bytes written by DMA: the only value matching DMA position that is not lower than
+	//the last half buffer boundary passed (at most one boundary can be passed while reading these)
+	uint32_t boundary = halves * (UART_RX_DMA_BUFFER_SIZE / 2);
+	uint32_t written = boundary + ((head + UART_RX_DMA_BUFFER_SIZE - (boundary % UART_RX_DMA_BUFFER_SIZE)) % UART_RX_DMA_BUFFER_SIZE);
+
+	if((written - port->rxDmaRead) > UART_RX_DMA_BUFFER_SIZE) //unprocessed data was overwritten
+	{
+		port->rxOverrun++;
+		port->rxDmaTail = head; //discard everything
+		port->rxDmaRead = written;
+		KissResync(port);
 	}
-	if(UART_LL_CHECK_RX_IDLE(port->port)) //line is idle, end of data reception
+
+	uint16_t count = written - port->rxDmaRead;
+	port->rxDmaRead = written;
+	while(count > 0)
 	{
-		UART_LL_GET_DATA(port->port); //reset idle flag by dummy read
-		if(port->rxBufferHead != 0)
+		//process contiguous span of received bytes
+		uint16_t end = port->rxDmaTail + count;
+		if(end > UART_RX_DMA_BUFFER_SIZE)
+			end = UART_RX_DMA_BUFFER_SIZE;
+		for(uint16_t i = port->rxDmaTail; i < end; i++)
 		{
-			if(((port->rxBuffer[port->rxBufferHead - 1] == '\r') || (port->rxBuffer[port->rxBufferHead - 1] == '\n'))) //data ends with \r or \n, process as data
-			{
-				port->rxType = DATA_TERM;
-			}
+			uint8_t data = port->rxDmaBuffer[i];
+			port->rxBytes++;
+			port->rxBuffer[port->rxBufferHead++] = data; //store it
+			port->rxBufferHead %= UART_BUFFER_SIZE;
+
+			KissParse(port, data);
+			if(port->rxType == DATA_KISS) //process the frame right away, so that the next one has the whole KISS buffer
+				KissProcess(port);
+			TermHandleSpecial(port);
 		}
+		count -= end - port->rxDmaTail;
+		port->rxDmaTail = end % UART_RX_DMA_BUFFER_SIZE;
 	}
-	if(UART_LL_CHECK_TX_EMPTY(port->port)) //TX buffer empty
+
+	if(idle && (port->rxBufferHead != 0))
 	{
-		if((port->txBufferHead != port->txBufferTail) || port->txBufferFull) //if there is anything to transmit
+		if(((port->rxBuffer[port->rxBufferHead - 1] == '\r') || (port->rxBuffer[port->rxBufferHead - 1] == '\n'))) //data ends with \r or \n, process as data
 		{
-			UART_LL_PUT_DATA(port->port, port->txBuffer[port->txBufferTail++]);
-			port->txBufferTail %= UART_BUFFER_SIZE;
-			port->txBufferFull = 0;
-		}
-		else //nothing more to be transmitted
-		{
-			UART_LL_DISABLE_TX_EMPTY_INTERRUPT(port->port);
+			port->rxType = DATA_TERM;
 		}
 	}
 }
 
+/**
+ * @brief Start DMA transfer of the next contiguous part of TX ring, if DMA is idle
+ * @param *port UART
+ * @attention Must be called with interrupts disabled or from TX DMA interrupt
+ */
+static void startTxDma(Uart *port)
+{
+	if(port->txDmaSize != 0) //already transmitting
+		return;
+
+	uint16_t head = port->txBufferHead;
+	uint16_t tail = port->txBufferTail;
+	if(head == tail) //nothing to transmit
+		return;
+
+	if(head > tail)
+		port->txDmaSize = head - tail;
+	else
+		port->txDmaSize = UART_TX_BUFFER_SIZE - tail; //transmit up to the end of the buffer first
+
+	UART_LL_TX_DMA_START(port->txDma, &port->txBuffer[tail], port->txDmaSize);
+}
+
+/**
+ * @brief Handle TX DMA transfer complete
+ * @param *port UART
+ */
+static void handleTxDmaInterrupt(Uart *port)
+{
+	port->txBufferTail = (port->txBufferTail + port->txDmaSize) % UART_TX_BUFFER_SIZE;
+	port->txDmaSize = 0;
+	startTxDma(port);
+	if(0 == port->txDmaSize) //TX buffer drained, let main loop send pending output
+		EventPost(EVENT_OUTPUT);
+}
+
 void UART_LL_UART1_INTERUPT_HANDLER(void) __attribute__ ((interrupt));
 void UART_LL_UART1_INTERUPT_HANDLER(void)
 {
+	PROFILE_BEGIN(PROFILE_UART);
 	handleInterrupt(&Uart1);
+	PROFILE_END(PROFILE_UART);
 }
 
 void UART_LL_UART2_INTERUPT_HANDLER(void) __attribute__ ((interrupt));
 void UART_LL_UART2_INTERUPT_HANDLER(void)
 {
+	PROFILE_BEGIN(PROFILE_UART);
 	handleInterrupt(&Uart2);
+	PROFILE_END(PROFILE_UART);
 }
 
+void UART_LL_UART1_RX_DMA_INTERRUPT_HANDLER(void) __attribute__ ((interrupt));
+void UART_LL_UART1_RX_DMA_INTERRUPT_HANDLER(void)
+{
+	PROFILE_BEGIN(PROFILE_UART);
+	if(UART_LL_UART1_RX_DMA_TRANSFER_FLAG)
+	{
+		Uart1.rxDmaHalves += UART_LL_UART1_RX_DMA_HALVES_PASSED;
+		UART_LL_UART1_RX_DMA_CLEAR_TRANSFER_FLAG();
+		Uart1.rxEvent = 1;
+		EventPost(EVENT_RX_DATA);
+	}
+	PROFILE_END(PROFILE_UART);
+}
 
-void UartSendByte(Uart *port, uint8_t data)
+void UART_LL_UART2_RX_DMA_INTERRUPT_HANDLER(void) __attribute__ ((interrupt));
+void UART_LL_UART2_RX_DMA_INTERRUPT_HANDLER(void)
+{
+	PROFILE_BEGIN(PROFILE_UART);
+	if(UART_LL_UART2_RX_DMA_TRANSFER_FLAG)
+	{
+		Uart2.rxDmaHalves += UART_LL_UART2_RX_DMA_HALVES_PASSED;
+		UART_LL_UART2_RX_DMA_CLEAR_TRANSFER_FLAG();
+		Uart2.rxEvent = 1;
+		EventPost(EVENT_RX_DATA);
+	}
+	PROFILE_END(PROFILE_UART);
+}
+
+void UART_LL_UART1_TX_DMA_INTERRUPT_HANDLER(void) __attribute__ ((interrupt));
+void UART_LL_UART1_TX_DMA_INTERRUPT_HANDLER(void)
+{
+	PROFILE_BEGIN(PROFILE_UART);
+	if(UART_LL_UART1_TX_DMA_TRANSFER_COMPLETE_FLAG)
+	{
+		UART_LL_UART1_TX_DMA_CLEAR_TRANSFER_COMPLETE_FLAG();
+		handleTxDmaInterrupt(&Uart1);
+	}
+	PROFILE_END(PROFILE_UART);
+}
+
+void UART_LL_UART2_TX_DMA_INTERRUPT_HANDLER(void) __attribute__ ((interrupt));
+void UART_LL_UART2_TX_DMA_INTERRUPT_HANDLER(void)
+{
+	PROFILE_BEGIN(PROFILE_UART);
+	if(UART_LL_UART2_TX_DMA_TRANSFER_COMPLETE_FLAG)
+	{
+		UART_LL_UART2_TX_DMA_CLEAR_TRANSFER_COMPLETE_FLAG();
+		handleTxDmaInterrupt(&Uart2);
+	}
+	PROFILE_END(PROFILE_UART);
+}
+
+
+uint16_t UartGetTxFree(Uart *port)
+{
+	if(port->isUsb)
+		return 0xFFFF;
+
+	return (UART_TX_BUFFER_SIZE - 1) - ((port->txBufferHead + UART_TX_BUFFER_SIZE - port->txBufferTail) % UART_TX_BUFFER_SIZE);
+}
+
+/**
+ * @brief Store data in TX buffer and start transmission
+ * @param *port UART
+ * @param *data Data
+ * @param len Data length
+ * @param blocking True to wait for free space, false to drop data that does not fit
+ * @return Number of bytes written
+ */
+static uint16_t write(Uart *port, const uint8_t *data, uint16_t len, bool blocking)
 {
 	if(!port->enabled)
-		return;
+		return 0;
 
 	if(port->isUsb)
 	{
-		CDC_Transmit_FS(&data, 1);
+		for(uint16_t i = 0; i < len; i++)
+			CDC_Transmit_FS((uint8_t*)&data[i], 1);
+		port->txBytes += len;
+		return len;
 	}
-	else
+
+	uint16_t written = 0;
+	while(written < len)
 	{
-		while(port->txBufferFull)
-			;
-		port->txBuffer[port->txBufferHead++] = data;
-		port->txBufferHead %= UART_BUFFER_SIZE;
 		__disable_irq();
-		if(port->txBufferHead == port->txBufferTail)
-			port->txBufferFull = 1;
-		if(0 == (UART_LL_CHECK_ENABLED_TX_EMPTY_INTERRUPT(port->port)))
-			UART_LL_ENABLE_TX_EMPTY_INTERRUPT(port->port);
+		uint16_t free = UartGetTxFree(port);
+		if(free > (len - written))
+			free = len - written;
+		for(uint16_t i = 0; i < free; i++)
+		{
+			port->txBuffer[port->txBufferHead] = data[written++];
+			port->txBufferHead = (port->txBufferHead + 1) % UART_TX_BUFFER_SIZE;
+		}
+		startTxDma(port);
 		__enable_irq();
+
+		if((0 == free) && !blocking) //no space and not allowed to wait
+		{
+			port->txOverflow += len - written;
+			break;
+		}
 	}
+	port->txBytes += written;
+	return written;
+}
+
+void UartSendByte(Uart *port, uint8_t data)
+{
+	write(port, &data, 1, true);
 }
 
 
@@ -109,35 +273,27 @@ void UartSendString(Uart *port, void *data, uint16_t len)
 	if(0 == len)
 		len = strlen((char*)data);
 
-	for(uint16_t i = 0; i < len; i++)
-	{
-		UartSendByte(port, ((uint8_t*)data)[i]);
-	}
+	write(port, data, len, true);
 }
 
-
-static unsigned int findHighestPosition(unsigned int n)
+uint16_t UartWrite(Uart *port, const void *data, uint16_t len)
 {
-    unsigned int i = 1;
-    while((i * 10) <= n)
-        i *= 10;
+	if(0 == len)
+		len = strlen((char*)data);
 
-    return i;
+	return write(port, data, len, false);
 }
 
 void UartSendNumber(Uart *port, int32_t n)
 {
-	if(n < 0)
-		UartSendByte(port, '-');
-	n = abs(n);
-    unsigned int position = findHighestPosition(n);
-    while(position)
-    {
-        unsigned int number = n / position;
-        UartSendByte(port, (number + 48));
-        n -= (number * position);
-        position /= 10;
-    }
+	char buf[11];
+	write(port, (uint8_t*)buf, NumberToString(n, buf), true);
+}
+
+uint16_t UartWriteNumber(Uart *port, int32_t n)
+{
+	char buf[11];
+	return write(port, (uint8_t*)buf, NumberToString(n, buf), false);
 }
 
 void UartInit(Uart *port, USART_TypeDef *uart, uint32_t baud)
@@ -148,15 +304,54 @@ void UartInit(Uart *port, USART_TypeDef *uart, uint32_t baud)
 	port->rxBufferHead = 0;
 	port->txBufferHead = 0;
 	port->txBufferTail = 0;
-	port->txBufferFull = 0;
+	port->txDmaSize = 0;
+	port->txOverflow = 0;
+	port->rxDmaTail = 0;
+	port->rxDmaRead = 0;
+	port->rxDmaHalves = 0;
+	port->rxOverrun = 0;
+	port->rxEvent = 0;
+	port->rxIdle = 0;
+	if(uart == UART_LL_UART1_STRUCTURE)
+	{
+		port->txBuffer = uart1TxBuffer;
+		port->txDma = UART_LL_UART1_TX_DMA_CHANNEL;
+		port->rxDmaBuffer = uart1RxBuffer;
+		port->rxDma = UART_LL_UART1_RX_DMA_CHANNEL;
+	}
+	else if(uart == UART_LL_UART2_STRUCTURE)
+	{
+		port->txBuffer = uart2TxBuffer;
+		port->txDma = UART_LL_UART2_TX_DMA_CHANNEL;
+		port->rxDmaBuffer = uart2RxBuffer;
+		port->rxDma = UART_LL_UART2_RX_DMA_CHANNEL;
+	}
+	else
+	{
+		port->txBuffer = NULL;
+		port->txDma = NULL;
+		port->rxDmaBuffer = NULL;
+		port->rxDma = NULL;
+	}
 	if(port->defaultMode > MODE_MONITOR)
 		port->defaultMode = MODE_KISS;
 	port->mode = port->defaultMode;
 	port->enabled = 0;
-	port->kissBufferHead = 0;
+	port->kissRxStart = 0;
+	port->kissRxSize = 0;
+	port->kissRxDrop = 0;
+	port->kissRxEscape = 0;
+	port->kissRxHeaderSize = 0;
+	port->kissFrameHead = 0;
+	port->kissFrameTail = 0;
+	port->kissFrameFull = 0;
+	port->kissDropped = 0;
+	port->kissRxFrames = 0;
+	port->kissTxFrames = 0;
+	port->rxBytes = 0;
+	port->txBytes = 0;
 	port->lastRxBufferHead = 0;
 	memset((void*)port->rxBuffer, 0, sizeof(port->rxBuffer));
-	memset((void*)port->txBuffer, 0, sizeof(port->txBuffer));
 	memset((void*)port->kissBuffer, 0, sizeof(port->kissBuffer));
 }
 
@@ -167,20 +362,47 @@ void UartConfig(Uart *port, uint8_t state)
 	{
 		UART_LL_UART1_INITIALIZE_PERIPHERAL(port->baudrate);
 
+		UART_LL_TX_DMA_INITIALIZE(UART_LL_UART1_TX_DMA_CHANNEL, UART_LL_UART1_STRUCTURE);
+		UART_LL_RX_DMA_INITIALIZE(UART_LL_UART1_RX_DMA_CHANNEL, UART_LL_UART1_STRUCTURE, port->rxDmaBuffer, UART_RX_DMA_BUFFER_SIZE);
+		port->rxDmaTail = 0;
+		port->rxDmaRead = 0;
+		port->rxDmaHalves = 0;
+
 		if(state)
 		{
 			UART_LL_ENABLE(port->port);
+			UART_LL_ENABLE_TX_DMA(port->port);
+			UART_LL_ENABLE_RX_DMA(port->port);
 		}
 		else
 		{
+			UART_LL_DISABLE_RX_DMA(port->port);
+			UART_LL_DISABLE_TX_DMA(port->port);
 			UART_LL_DISABLE(port->port);
 		}
 
 		NVIC_SetPriority(UART_LL_UART1_IRQ, 2);
+		//TX DMA interrupt has higher priority than other UART interrupts, so that blocking writes from these interrupts can complete
+		NVIC_SetPriority(UART_LL_UART1_TX_DMA_IRQ, 1);
+		NVIC_SetPriority(UART_LL_UART1_RX_DMA_IRQ, 2);
 		if(state)
+		{
 			NVIC_EnableIRQ(UART_LL_UART1_IRQ);
+			NVIC_EnableIRQ(UART_LL_UART1_TX_DMA_IRQ);
+			NVIC_EnableIRQ(UART_LL_UART1_RX_DMA_IRQ);
+		}
 		else
+		{
 			NVIC_DisableIRQ(UART_LL_UART1_IRQ);
+			NVIC_DisableIRQ(UART_LL_UART1_TX_DMA_IRQ);
+			NVIC_DisableIRQ(UART_LL_UART1_RX_DMA_IRQ);
+		}
+
+		__disable_irq();
+		port->txDmaSize = 0; //DMA was reinitialized, restart transmission of pending data
+		if(state)
+			startTxDma(port);
+		__enable_irq();
 
 		port->enabled = state > 0;
 		port->isUsb = 0;
@@ -189,20 +411,47 @@ void UartConfig(Uart *port, uint8_t state)
 	{
 		UART_LL_UART2_INITIALIZE_PERIPHERAL(port->baudrate);
 
+		UART_LL_TX_DMA_INITIALIZE(UART_LL_UART2_TX_DMA_CHANNEL, UART_LL_UART2_STRUCTURE);
+		UART_LL_RX_DMA_INITIALIZE(UART_LL_UART2_RX_DMA_CHANNEL, UART_LL_UART2_STRUCTURE, port->rxDmaBuffer, UART_RX_DMA_BUFFER_SIZE);
+		port->rxDmaTail = 0;
+		port->rxDmaRead = 0;
+		port->rxDmaHalves = 0;
+
 		if(state)
 		{
 			UART_LL_ENABLE(port->port);
+			UART_LL_ENABLE_TX_DMA(port->port);
+			UART_LL_ENABLE_RX_DMA(port->port);
 		}
 		else
 		{
+			UART_LL_DISABLE_RX_DMA(port->port);
+			UART_LL_DISABLE_TX_DMA(port->port);
 			UART_LL_DISABLE(port->port);
 		}
 
 		NVIC_SetPriority(UART_LL_UART2_IRQ, 2);
+		//TX DMA interrupt has higher priority than other UART interrupts, so that blocking writes from these interrupts can complete
+		NVIC_SetPriority(UART_LL_UART2_TX_DMA_IRQ, 1);
+		NVIC_SetPriority(UART_LL_UART2_RX_DMA_IRQ, 2);
 		if(state)
+		{
 			NVIC_EnableIRQ(UART_LL_UART2_IRQ);
+			NVIC_EnableIRQ(UART_LL_UART2_TX_DMA_IRQ);
+			NVIC_EnableIRQ(UART_LL_UART2_RX_DMA_IRQ);
+		}
 		else
+		{
 			NVIC_DisableIRQ(UART_LL_UART2_IRQ);
+			NVIC_DisableIRQ(UART_LL_UART2_TX_DMA_IRQ);
+			NVIC_DisableIRQ(UART_LL_UART2_RX_DMA_IRQ);
+		}
+
+		__disable_irq();
+		port->txDmaSize = 0; //DMA was reinitialized, restart transmission of pending data
+		if(state)
+			startTxDma(port);
+		__enable_irq();
 
 		port->enabled = state > 0;
 		port->isUsb = 0;
@@ -24,6 +24,8 @@
 /* USER CODE BEGIN INCLUDE */
 #include "terminal.h"
 #include "kiss.h"
+#include <string.h>
+#include "event.h"
 /* USER CODE END INCLUDE */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -95,7 +97,11 @@ uint8_t UserRxBufferFS[APP_RX_DATA_SIZE];
 uint8_t UserTxBufferFS[APP_TX_DATA_SIZE];
 
 /* USER CODE BEGIN PRIVATE_VARIABLES */
-
+//when a KISS frame is queued, the rest of the packet is kept in UserRxBufferFS and no more packets are received
+//until the frame is processed, so that each frame has the whole KISS buffer
+static uint8_t *rxHeldData = NULL; //remaining part of held packet
+static uint16_t rxHeldSize = 0; //remaining size of held packet
+static volatile uint8_t rxHeld = 0; //reception is held
 /* USER CODE END PRIVATE_VARIABLES */
 
 /**
@@ -129,6 +135,7 @@ static int8_t CDC_Receive_FS(uint8_t* pbuf, uint32_t *Len);
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_DECLARATION */
 static void handleUsbInterrupt(Uart *port);
+static uint16_t parseReceived(uint8_t *Buf, uint16_t Len);
 /* USER CODE END PRIVATE_FUNCTIONS_DECLARATION */
 
 /**
@@ -154,6 +161,7 @@ static int8_t CDC_Init_FS(void)
   /* Set Application Buffers */
   USBD_CDC_SetTxBuffer(&hUsbDeviceFS, UserTxBufferFS, 0);
   USBD_CDC_SetRxBuffer(&hUsbDeviceFS, UserRxBufferFS);
+  rxHeld = 0; //OUT endpoint is prepared by the class driver
   return (USBD_OK);
   /* USER CODE END 3 */
 }
@@ -260,18 +268,21 @@ static int8_t CDC_Control_FS(uint8_t cmd, uint8_t* pbuf, uint16_t length)
 static int8_t CDC_Receive_FS(uint8_t* Buf, uint32_t *Len)
 {
   /* USER CODE BEGIN 6 */
-	USBD_CDC_SetRxBuffer(&hUsbDeviceFS, &Buf[0]);
-	USBD_CDC_ReceivePacket(&hUsbDeviceFS);
-
-	for(uint16_t i = 0; i < *Len; i++)
+	uint16_t parsed = parseReceived(Buf, *Len);
+	if(UartUsb.rxType == DATA_KISS) //KISS frame queued, hold the rest of the packet and NAK next packets
 	{
-		UartUsb.rxBuffer[UartUsb.rxBufferHead++] = Buf[i];
-		KissParse(&UartUsb, Buf[i]);
-		UartUsb.rxBufferHead %= UART_BUFFER_SIZE;
+		rxHeldData = &Buf[parsed];
+		rxHeldSize = *Len - parsed;
+		rxHeld = 1;
 	}
-	if(UartUsb.rxType != DATA_KISS)
+	else
+	{
+		USBD_CDC_SetRxBuffer(&hUsbDeviceFS, &Buf[0]);
+		USBD_CDC_ReceivePacket(&hUsbDeviceFS);
 		UartUsb.rxType = DATA_USB;
+	}
 	handleUsbInterrupt(&UartUsb);
+	EventPost(EVENT_RX_DATA);
 
 	return (USBD_OK);
   /* USER CODE END 6 */
@@ -312,6 +323,74 @@ uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len)
 }
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_IMPLEMENTATION */
+/**
+  * @brief  Copy data to CDC TX buffer and start transmission without waiting
+  * @param  Buf: Buffer of data to be sent
+  * @param  Len: Number of data to be sent (in bytes)
+  * @retval Number of bytes accepted, 0 if USB is busy or not configured
+  */
+uint16_t CDC_TransmitCopy_FS(const uint8_t *Buf, uint16_t Len)
+{
+  USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef*)hUsbDeviceFS.pClassData;
+  if((hcdc == NULL) || (hcdc->TxState != 0))
+    return 0;
+
+  if(Len > (APP_TX_DATA_SIZE - 1)) //keep transfer shorter than max packet size, so it is always terminated by a short packet
+    Len = APP_TX_DATA_SIZE - 1;
+  memcpy(UserTxBufferFS, Buf, Len);
+  USBD_CDC_SetTxBuffer(&hUsbDeviceFS, UserTxBufferFS, Len);
+  if(USBD_CDC_TransmitPacket(&hUsbDeviceFS) != USBD_OK)
+    return 0;
+  return Len;
+}
+
+/**
+  * @brief  Continue reception held because of a queued KISS frame
+  * @note   Must be called from the main loop after the KISS frame queue is processed
+  */
+void CDC_ResumeReceive_FS(void)
+{
+  if(!rxHeld)
+    return;
+
+  KissProcess(&UartUsb); //the queue must be empty, so that the next frame has the whole KISS buffer
+  uint16_t parsed = parseReceived(rxHeldData, rxHeldSize);
+  rxHeldData += parsed;
+  rxHeldSize -= parsed;
+  if(UartUsb.rxType != DATA_KISS) //whole packet parsed without queuing another frame
+  {
+    UartUsb.rxType = DATA_USB;
+    rxHeld = 0;
+    __disable_irq();
+    USBD_CDC_SetRxBuffer(&hUsbDeviceFS, UserRxBufferFS);
+    USBD_CDC_ReceivePacket(&hUsbDeviceFS);
+    __enable_irq();
+  }
+  handleUsbInterrupt(&UartUsb);
+  EventPost(EVENT_RX_DATA);
+}
+
+/**
+  * @brief  Parse received data until a KISS frame is queued
+  * @param  Buf: Received data
+  * @param  Len: Number of received bytes
+  * @retval Number of bytes parsed
+  */
+static uint16_t parseReceived(uint8_t *Buf, uint16_t Len)
+{
+	uint16_t i = 0;
+	while(i < Len)
+	{
+		UartUsb.rxBuffer[UartUsb.rxBufferHead++] = Buf[i];
+		UartUsb.rxBufferHead %= UART_BUFFER_SIZE;
+		KissParse(&UartUsb, Buf[i++]);
+		if(UartUsb.rxType == DATA_KISS)
+			break;
+	}
+	UartUsb.rxBytes += i;
+	return i;
+}
+
 static void handleUsbInterrupt(Uart *port)
 {
 	if(port->rxBufferHead != 0)
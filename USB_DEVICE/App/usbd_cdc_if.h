@@ -48,7 +48,7 @@
   * @{
   */
 /* Define size for the receive and transmit buffer over CDC */
-#define APP_RX_DATA_SIZE  256
+#define APP_RX_DATA_SIZE  64
 #define APP_TX_DATA_SIZE  64
 /* USER CODE BEGIN EXPORTED_DEFINES */
 
@@ -108,6 +108,8 @@ extern USBD_CDC_ItfTypeDef USBD_Interface_fops_FS;
 uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len);
 
 /* USER CODE BEGIN EXPORTED_FUNCTIONS */
+uint16_t CDC_TransmitCopy_FS(const uint8_t *Buf, uint16_t Len);
+void CDC_ResumeReceive_FS(void);
 
 /* USER CODE END EXPORTED_FUNCTIONS */
 
@@ -0,0 +1,374 @@
+/*
+Copyright 2020-2025 Piotr Wilkon
+
+This file is part of VP-Digi.
+
+VP-Digi is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+VP-Digi is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Configuration storage test.
+ * config.c is run against RAM mapped at the configuration flash address. The flash
+ * controller model only allows erased halfwords to be programmed, like the real one.
+ * A power loss is simulated by ignoring all flash operations after a given count,
+ * then the configuration is read back as after a reboot. Every save is checked this
+ * way at each possible interruption point: the previous or the new configuration
+ * must be read, never a mix of both, and the next save must still work.
+ * Finally, single bytes are saved until the bank is full of small records and the time
+ * of loading it is reported (host time), as all records are scanned for every field.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <limits.h>
+#include "stm32f1xx.h"
+#include "config.h"
+#include "common.h"
+#include "beacon.h"
+#include "digipeater.h"
+#include "modem.h"
+#include "ax25.h"
+#include "terminal.h"
+
+#define FLASH_START 0x800F000 //CONFIG_ADDRESS in config.c
+#define FLASH_SIZE 4096
+#define FLASH_PAGE_SIZE 1024
+#define FLASH_BANK_SIZE 2048
+#define SAVE_COUNT 60
+#define LOAD_COUNT 20 //number of loads of the full bank, the shortest time is reported
+
+struct ModemDemodConfig ModemConfig;
+struct Ax25ProtoConfig Ax25Config;
+struct Beacon beacon[8];
+struct BeaconConfig BeaconConfig;
+struct _DigiConfig DigiConfig;
+Uart Uart1, Uart2, UartUsb;
+
+void TermSendToAll(enum UartMode mode, uint8_t *data, uint16_t size)
+{
+}
+
+static uint8_t *flash; //memory read and written directly by config.c
+static uint8_t programmed[FLASH_SIZE]; //flash contents as accepted by the controller model
+static FLASH_TypeDef regs;
+static long operationsLeft; //flash operations left until power loss, negative for no power loss
+static unsigned operationCount; //erase and program operations performed
+
+/**
+ * @brief Check if the next flash operation can be carried out
+ * @return False if power was lost
+ */
+static bool operation(void)
+{
+	if(0 == operationsLeft)
+		return false;
+	if(operationsLeft > 0)
+		operationsLeft--;
+	operationCount++;
+	return true;
+}
+
+FLASH_TypeDef *HostFlash(void)
+{
+	if(0xCDEF89AB == regs.KEYR) //second unlock key written
+	{
+		regs.CR &= ~FLASH_CR_LOCK;
+		regs.KEYR = 0;
+	}
+
+	if((regs.CR & FLASH_CR_PER) && (regs.CR & FLASH_CR_STRT))
+	{
+		regs.CR &= ~FLASH_CR_STRT;
+		uint32_t offset = regs.AR - FLASH_START;
+		if((offset < FLASH_SIZE) && !(offset % FLASH_PAGE_SIZE) && !(regs.CR & FLASH_CR_LOCK) && operation())
+		{
+			memset(&programmed[offset], 0xFF, FLASH_PAGE_SIZE);
+			regs.SR |= FLASH_SR_EOP;
+		}
+	}
+
+	if(!memcmp(flash, programmed, FLASH_SIZE))
+		return &regs;
+	//halfwords stored by config.c since the last access are accepted or reverted
+	for(uint16_t i = 0; i < FLASH_SIZE; i += 2)
+	{
+		if(!memcmp(&flash[i], &programmed[i], 2))
+			continue;
+		uint16_t old, new;
+		memcpy(&old, &programmed[i], 2);
+		memcpy(&new, &flash[i], 2);
+		if((regs.CR & FLASH_CR_PG) && !(regs.CR & FLASH_CR_LOCK) && ((0xFFFF == old) || (0 == new)) && operation())
+		{
+			memcpy(&programmed[i], &new, 2);
+			regs.SR |= FLASH_SR_EOP;
+		}
+		else
+		{
+			memcpy(&flash[i], &old, 2);
+			if(0 != operationsLeft)
+				regs.SR |= FLASH_SR_PGERR;
+		}
+	}
+	return &regs;
+}
+
+/**
+ * @brief Restart the device with power restored
+ */
+static void reboot(void)
+{
+	memset(&regs, 0, sizeof(regs));
+	regs.CR = FLASH_CR_LOCK;
+	operationsLeft = -1;
+}
+
+/**
+ * @brief Set configuration to a pattern depending on given number
+ * @param n Pattern number
+ * @details Beacon text length changes, so that records of different sizes are written
+ */
+static void setConfig(unsigned n)
+{
+	memcpy(GeneralConfig.call, "N0CALL", 6);
+	GeneralConfig.call[5] = 'A' + (n % 26);
+	GeneralConfig.callSsid = n % 16;
+	Ax25Config.txDelayLength = 100 + n;
+	Ax25Config.fx25MinParity = 16;
+	Ax25Config.fx25MaxParity = 64;
+	BeaconConfig.jitter = n % BEACON_MAX_JITTER;
+	DigiConfig.dupeTime = 10 + (n % 50);
+	snprintf((char*)beacon[n % 8].data, sizeof(beacon[0].data), "!5000.00N/02000.00E#beacon %u %.*s", n, (int)(n % 70), "..........................................................................");
+}
+
+/**
+ * @brief Clear configuration before it is read
+ */
+static void clearConfig(void)
+{
+	memset(&GeneralConfig, 0, sizeof(GeneralConfig));
+	memset(&Ax25Config, 0, sizeof(Ax25Config));
+	memset(&BeaconConfig, 0, sizeof(BeaconConfig));
+	memset(&DigiConfig, 0, sizeof(DigiConfig));
+	memset(beacon, 0, sizeof(beacon));
+}
+
+/**
+ * @brief Configuration snapshot used for comparison
+ */
+struct Snapshot
+{
+	uint8_t call[6];
+	uint8_t callSsid;
+	uint16_t txDelay;
+	uint8_t jitter;
+	uint8_t dupeTime;
+	uint8_t data[8][BEACON_MAX_PAYLOAD_SIZE + 1];
+};
+
+static void snapshot(struct Snapshot *s)
+{
+	memset(s, 0, sizeof(*s));
+	memcpy(s->call, GeneralConfig.call, 6);
+	s->callSsid = GeneralConfig.callSsid;
+	s->txDelay = Ax25Config.txDelayLength;
+	s->jitter = BeaconConfig.jitter;
+	s->dupeTime = DigiConfig.dupeTime;
+	for(uint8_t i = 0; i < 8; i++)
+		memcpy(s->data[i], beacon[i].data, sizeof(s->data[i]));
+}
+
+/**
+ * @brief Get number of the bank with the higher sequence number
+ * @return Bank number
+ */
+static int activeBank(void)
+{
+	uint16_t seq[2];
+	for(uint8_t i = 0; i < 2; i++)
+		memcpy(&seq[i], &flash[i * FLASH_BANK_SIZE + 4], 2);
+	return ((int16_t)(seq[1] - seq[0]) > 0) ? 1 : 0;
+}
+
+/**
+ * @brief Count records written to bank, including the ones not committed
+ * @param bank Bank number
+ * @return Number of records
+ */
+static unsigned countRecords(int bank)
+{
+	unsigned count = 0;
+	uint16_t pos = 8; //bank header
+	while((pos + 8) <= FLASH_BANK_SIZE)
+	{
+		uint16_t address, size;
+		memcpy(&address, &flash[bank * FLASH_BANK_SIZE + pos], 2);
+		memcpy(&size, &flash[bank * FLASH_BANK_SIZE + pos + 2], 2);
+		if((0xFFFF == address) || (0xFFFF == size))
+			break;
+		pos += 8 + ((size + 1) & ~1);
+		count++;
+	}
+	return count;
+}
+
+/**
+ * @brief Read configuration after reboot
+ * @param *s Output snapshot
+ * @return True if configuration was found
+ */
+static bool readBack(struct Snapshot *s)
+{
+	reboot();
+	clearConfig();
+	bool found = ConfigRead();
+	snapshot(s);
+	return found;
+}
+
+int main(void)
+{
+	flash = mmap((void*)FLASH_START, FLASH_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+	if((MAP_FAILED == flash) || ((uint8_t*)FLASH_START != flash))
+	{
+		perror("mmap");
+		return 1;
+	}
+	memset(flash, 0xFF, FLASH_SIZE);
+	memset(programmed, 0xFF, FLASH_SIZE);
+
+	struct Snapshot previous, expected, read;
+	if(readBack(&read))
+	{
+		printf("FAIL: configuration found in erased flash\n");
+		return 1;
+	}
+
+	static uint8_t savedFlash[FLASH_SIZE], savedProgrammed[FLASH_SIZE];
+	unsigned failures = 0, switches = 0, interruptions = 0, appendOps = 0, switchOps = 0;
+	bool havePrevious = false;
+	int bank = activeBank();
+	for(unsigned n = 0; n < SAVE_COUNT; n++)
+	{
+		//configuration in RAM is the last one read back, so only the changes are saved
+		setConfig(n);
+		snapshot(&expected);
+		memcpy(savedFlash, flash, FLASH_SIZE);
+		memcpy(savedProgrammed, programmed, FLASH_SIZE);
+
+		reboot();
+		operationCount = 0;
+		ConfigWrite();
+		unsigned total = operationCount;
+		if(!(regs.CR & FLASH_CR_LOCK))
+		{
+			printf("save %u: FAIL: flash left unlocked\n", n);
+			failures++;
+		}
+		bool switched = (activeBank() != bank);
+		if(switched)
+		{
+			switches++;
+			switchOps += total;
+		}
+		else
+			appendOps += total;
+		bank = activeBank();
+
+		//interrupt the same save after each operation
+		static uint8_t completeFlash[FLASH_SIZE], completeProgrammed[FLASH_SIZE];
+		memcpy(completeFlash, flash, FLASH_SIZE);
+		memcpy(completeProgrammed, programmed, FLASH_SIZE);
+		for(unsigned k = 0; k < total; k++)
+		{
+			memcpy(flash, savedFlash, FLASH_SIZE);
+			memcpy(programmed, savedProgrammed, FLASH_SIZE);
+			setConfig(n);
+			reboot();
+			operationsLeft = k;
+			ConfigWrite();
+			bool found = readBack(&read);
+			if(havePrevious ? (!found || memcmp(&read, &previous, sizeof(read))) : found)
+			{
+				printf("save %u interrupted after %u of %u operations: FAIL: previous configuration not read\n", n, k, total);
+				failures++;
+			}
+			//save again after the interrupted one
+			setConfig(n);
+			reboot();
+			ConfigWrite();
+			if(!readBack(&read) || memcmp(&read, &expected, sizeof(read)))
+			{
+				printf("save %u interrupted after %u of %u operations: FAIL: repeated save not read\n", n, k, total);
+				failures++;
+			}
+			interruptions++;
+		}
+		memcpy(flash, completeFlash, FLASH_SIZE);
+		memcpy(programmed, completeProgrammed, FLASH_SIZE);
+
+		if(!readBack(&read) || memcmp(&read, &expected, sizeof(read)))
+		{
+			printf("save %u: FAIL: saved configuration not read\n", n);
+			failures++;
+		}
+		previous = expected;
+		havePrevious = true;
+	}
+
+	printf("saves: %u, bank switches: %u, interrupted saves checked: %u\n", SAVE_COUNT, switches, interruptions);
+	printf("flash operations per save: %u when appending, %u when switching banks\n",
+			(SAVE_COUNT > switches) ? appendOps / (SAVE_COUNT - switches) : 0, switches ? switchOps / switches : 0);
+
+	//fill the bank with small records, one changed byte per save, and measure loading the full bank
+	static uint8_t fullFlash[FLASH_SIZE];
+	unsigned records = 0;
+	while(activeBank() == bank)
+	{
+		memcpy(fullFlash, flash, FLASH_SIZE);
+		snapshot(&expected);
+		records = countRecords(bank);
+		GeneralConfig.callSsid = (GeneralConfig.callSsid + 1) % 16;
+		reboot();
+		ConfigWrite();
+	}
+	memcpy(flash, fullFlash, FLASH_SIZE);
+	memcpy(programmed, fullFlash, FLASH_SIZE);
+	unsigned loadTime = UINT_MAX;
+	for(unsigned k = 0; k < LOAD_COUNT; k++)
+	{
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		bool found = readBack(&read);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		unsigned time = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000;
+		if(time < loadTime)
+			loadTime = time;
+		if(!found || memcmp(&read, &expected, sizeof(read)))
+		{
+			printf("FAIL: full bank not read\n");
+			failures++;
+			break;
+		}
+	}
+	printf("load of a bank with %u records: %u us (host time)\n", records, loadTime);
+	if(switches < 2)
+	{
+		printf("FAIL: banks were not switched\n");
+		failures++;
+	}
+	printf("%s\n", failures ? "FAILED" : "OK");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,378 @@
+/*
+Copyright 2020-2025 Piotr Wilkon
+
+This file is part of VP-Digi.
+
+VP-Digi is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+VP-Digi is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Digipeater replay harness.
+ * Recorded frames (one TNC2 line each) are fed through DigiDigipeat() and the decision
+ * for every frame is printed together with frames transmitted by the digipeater.
+ * A line may be prefixed with "+<ms> " to set the time elapsed since the previous frame.
+ * With -n the recording is replayed repeatedly without output and the frame rate is reported.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "digipeater.h"
+#include "common.h"
+#include "ax25.h"
+#include "terminal.h"
+#include "channel.h"
+#include "timer.h"
+#include "systick.h"
+
+#define MAX_FRAMES 1024
+#define DEFAULT_INTERVAL 1000 //default time between frames in ms
+#define REPLAY_GAP 60000 //time between replays in ms, longer than duplicate filtering time
+
+struct Frame
+{
+	uint8_t data[AX25_FRAME_MAX_SIZE];
+	uint16_t size;
+	uint32_t delay; //time since previous frame in SysTick ticks
+	unsigned line; //line number in recording
+};
+
+static struct Frame frames[MAX_FRAMES];
+static unsigned frameCount = 0;
+
+static const char *resultName[] =
+{
+	[DIGI_IGNORED] = "IGNORED",
+	[DIGI_DIGIPEATED] = "DIGIPEATED",
+	[DIGI_DUPLICATE] = "DUPLICATE",
+	[DIGI_FILTERED] = "FILTERED",
+	[DIGI_THROTTLED] = "THROTTLED",
+	[DIGI_VISCOUS_HELD] = "VISCOUS_HELD",
+	[DIGI_VISCOUS_CANCELLED] = "VISCOUS_CANCELLED",
+	[DIGI_DROPPED] = "DROPPED",
+};
+
+static uint32_t now = 0; //simulated SysTick counter
+static bool quiet = false;
+static struct Timer *timers[TIMER_MAX_COUNT];
+
+Uart Uart1, Uart2, UartUsb;
+
+/**
+ * @brief Print frame in TNC2 format
+ * @param *prefix Line prefix
+ * @param *frame Frame
+ * @param size Frame size
+ */
+static void printFrame(const char *prefix, const uint8_t *frame, uint16_t size)
+{
+	char header[TNC2_HEADER_MAX_SIZE];
+	const uint8_t *info;
+	uint16_t infoLen;
+	uint16_t n = ConvertToTNC2(frame, size, header, &info, &infoLen);
+	printf("%s%.*s%.*s\n", prefix, n, header, (NULL != info) ? infoLen : 0, (NULL != info) ? (const char*)info : "");
+}
+
+void *Ax25WriteTxFrame(uint8_t *data, uint16_t size, enum Ax25TxClass class)
+{
+	static uint8_t handle;
+	if(!quiet)
+		printFrame("\ttx: ", data, size);
+	return &handle;
+}
+
+void TermSendToAll(enum UartMode mode, uint8_t *data, uint16_t size)
+{
+}
+
+uint32_t SysTickGet(void)
+{
+	return now;
+}
+
+uint16_t ChannelGetUtilization(enum ChannelWindow window)
+{
+	return 0;
+}
+
+bool TimerIsActive(struct Timer *t)
+{
+	return t->index != TIMER_INACTIVE;
+}
+
+bool TimerStart(struct Timer *t, uint32_t delay)
+{
+	t->deadline = (uint64_t)now + delay;
+	if(TimerIsActive(t))
+		return true;
+	for(uint8_t i = 0; i < TIMER_MAX_COUNT; i++)
+	{
+		if(NULL == timers[i])
+		{
+			timers[i] = t;
+			t->index = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Advance simulated time and call callbacks of expired timers
+ * @param ticks Number of SysTick ticks
+ */
+static void advance(uint32_t ticks)
+{
+	uint32_t target = now + ticks;
+	while(1)
+	{
+		struct Timer *nearest = NULL;
+		for(uint8_t i = 0; i < TIMER_MAX_COUNT; i++)
+		{
+			if((NULL != timers[i]) && (timers[i]->deadline <= target) && ((NULL == nearest) || (timers[i]->deadline < nearest->deadline)))
+				nearest = timers[i];
+		}
+		if(NULL == nearest)
+			break;
+		if(nearest->deadline > now)
+			now = nearest->deadline;
+		timers[nearest->index] = NULL;
+		nearest->index = TIMER_INACTIVE;
+		nearest->callback();
+	}
+	now = target;
+}
+
+/**
+ * @brief Convert TNC2 address to AX.25 address
+ * @param *in Address with optional SSID and H-bit marker ('*')
+ * @param size Address length
+ * @param *out Output buffer, 7 bytes
+ * @param *used Output H-bit marker presence
+ * @return True if address is valid
+ */
+static bool parseAddress(const char *in, uint16_t size, uint8_t *out, bool *used)
+{
+	*used = (size > 0) && (in[size - 1] == '*');
+	if(*used)
+		size--;
+	uint8_t ssid;
+	if(!ParseCallsignWithSsid(in, size, out, &ssid))
+		return false;
+	out[6] = 0x60 | (ssid << 1);
+	return true;
+}
+
+/**
+ * @brief Convert TNC2 line to AX.25 UI frame
+ * @param *line TNC2 line
+ * @param *f Output frame
+ * @return True if line is valid
+ */
+static bool parseTnc2(const char *line, struct Frame *f)
+{
+	const char *info = strchr(line, ':');
+	const char *dest = strchr(line, '>');
+	if((NULL == info) || (NULL == dest) || (dest > info))
+		return false;
+
+	bool used;
+	uint16_t n = 7; //destination is stored first, source is parsed first
+	if(!parseAddress(line, dest - line, &f->data[7], &used) || used)
+		return false;
+	dest++;
+	const char *end = dest;
+	while((end < info) && (*end != ','))
+		end++;
+	if(!parseAddress(dest, end - dest, f->data, &used) || used)
+		return false;
+	f->data[6] |= 0x80; //command frame
+	n = 14;
+
+	uint16_t lastUsed = 0;
+	while(end < info)
+	{
+		const char *el = end + 1;
+		end = el;
+		while((end < info) && (*end != ','))
+			end++;
+		if((n + 7) > (AX25_FRAME_MAX_SIZE - 2))
+			return false;
+		if(!parseAddress(el, end - el, &f->data[n], &used))
+			return false;
+		n += 7;
+		if(used)
+			lastUsed = n;
+	}
+	for(uint16_t i = 14; i < lastUsed; i += 7) //all elements up to the last used one are used
+		f->data[i + 6] |= 0x80;
+	f->data[n - 1] |= 1; //path end
+
+	info++;
+	uint16_t infoLen = strlen(info);
+	if((n + 2 + infoLen) > AX25_FRAME_MAX_SIZE)
+		return false;
+	f->data[n++] = 0x03; //UI frame
+	f->data[n++] = 0xF0; //no layer 3
+	memcpy(&f->data[n], info, infoLen);
+	f->size = n + infoLen;
+	return true;
+}
+
+/**
+ * @brief Load recorded frames
+ * @param *name File name
+ * @return True on success
+ */
+static bool load(const char *name)
+{
+	FILE *in = fopen(name, "r");
+	if(NULL == in)
+	{
+		perror(name);
+		return false;
+	}
+
+	char line[512];
+	unsigned lineNumber = 0;
+	while(NULL != fgets(line, sizeof(line), in))
+	{
+		lineNumber++;
+		line[strcspn(line, "\r\n")] = 0;
+		if((line[0] == 0) || (line[0] == '#'))
+			continue;
+		if(frameCount == MAX_FRAMES)
+		{
+			fprintf(stderr, "%s: too many frames\n", name);
+			break;
+		}
+
+		struct Frame *f = &frames[frameCount];
+		const char *tnc2 = line;
+		uint32_t delay = DEFAULT_INTERVAL;
+		if(line[0] == '+')
+		{
+			char *end;
+			delay = strtoul(&line[1], &end, 10);
+			tnc2 = end + strspn(end, " ");
+		}
+		f->delay = delay / SYSTICK_INTERVAL;
+		f->line = lineNumber;
+		if(!parseTnc2(tnc2, f))
+		{
+			fprintf(stderr, "%s:%u: invalid frame\n", name, lineNumber);
+			fclose(in);
+			return false;
+		}
+		frameCount++;
+	}
+	fclose(in);
+	return true;
+}
+
+/**
+ * @brief Set up digipeater as a typical fill-in/wide digipeater
+ */
+static void configure(void)
+{
+	memset(&DigiConfig, 0, sizeof(DigiConfig));
+	ParseCallsign("N0CALL", 6, GeneralConfig.call);
+	GeneralConfig.callSsid = 10;
+
+	DigiConfig.enable = 1;
+	DigiConfig.dupeTime = 30;
+
+	//WIDEn-N: traced, up to WIDE2-2, WIDE3-3 and above treated as a simple alias
+	ParseCallsign("WIDE", 4, DigiConfig.alias[0]);
+	DigiConfig.alias[0][4] = 0;
+	DigiConfig.max[0] = 2;
+	DigiConfig.rep[0] = 3;
+	DigiConfig.traced |= 1 << 0;
+	DigiConfig.enableAlias |= 1 << 0;
+
+	//SPn-N: untraced, direct only, call filter blacklist
+	ParseCallsign("SP", 2, DigiConfig.alias[1]);
+	DigiConfig.alias[1][2] = 0;
+	DigiConfig.max[1] = 2;
+	DigiConfig.enableAlias |= 1 << 1;
+	DigiConfig.directOnly |= 1 << 1;
+	DigiConfig.callFilterEnable |= 1 << 1;
+	memcpy(DigiConfig.callFilter[0], "SQ9BAD", 6);
+	DigiConfig.callFilter[0][6] = 0xFF; //any SSID
+
+	//RELAY: simple alias with viscous delay
+	ParseCallsignWithSsid("RELAY", 5, DigiConfig.alias[4], &DigiConfig.ssid[0]);
+	DigiConfig.viscous |= 1 << 4;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned repetitions = 0;
+	const char *name = NULL;
+	for(int i = 1; i < argc; i++)
+	{
+		if(!strcmp(argv[i], "-n") && ((i + 1) < argc))
+			repetitions = strtoul(argv[++i], NULL, 10);
+		else
+			name = argv[i];
+	}
+	if(NULL == name)
+	{
+		fprintf(stderr, "usage: %s [-n repetitions] recording.tnc2\n", argv[0]);
+		return 1;
+	}
+
+	configure();
+	if(!load(name))
+		return 1;
+
+	unsigned count[DIGI_DROPPED + 1] = {0};
+	for(unsigned i = 0; i < frameCount; i++)
+	{
+		struct Frame *f = &frames[i];
+		advance(f->delay);
+		uint8_t frame[AX25_FRAME_MAX_SIZE];
+		memcpy(frame, f->data, f->size); //digipeater may modify the frame
+		enum DigiResult r = DigiDigipeat(frame, f->size);
+		count[r]++;
+		printf("%u: %s\n", f->line, resultName[r]);
+	}
+	advance(REPLAY_GAP / SYSTICK_INTERVAL); //flush viscous-delay buffer
+
+	printf("--\n");
+	for(unsigned i = 0; i <= DIGI_DROPPED; i++)
+		printf("%s: %u\n", resultName[i], count[i]);
+
+	if(0 == repetitions)
+		return 0;
+
+	quiet = true;
+	uint8_t frame[AX25_FRAME_MAX_SIZE];
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(unsigned k = 0; k < repetitions; k++)
+	{
+		for(unsigned i = 0; i < frameCount; i++)
+		{
+			advance(frames[i].delay);
+			memcpy(frame, frames[i].data, frames[i].size);
+			DigiDigipeat(frame, frames[i].size);
+		}
+		advance(REPLAY_GAP / SYSTICK_INTERVAL);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+	fprintf(stderr, "%u frames in %.3f s, %.0f frames/s\n", frameCount * repetitions, seconds, frameCount * repetitions / seconds);
+	return 0;
+}
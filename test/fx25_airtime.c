@@ -0,0 +1,140 @@
+/*
+Copyright 2020-2025 Piotr Wilkon
+
+This file is part of VP-Digi.
+
+VP-Digi is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+VP-Digi is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * FX.25 parity size selection airtime model.
+ * Frames of random size are sent over a channel with independent byte errors,
+ * using the standard (size-based) and the automatic (channel quality based) parity size.
+ * The blocks are decoded by counting errors against T/2, and the channel quality
+ * estimate is updated as the receiver does it, assuming that other stations use
+ * the same parity size and the channel is similar in both directions.
+ * The bytes sent per frame (tag and block) and the percentage of recovered frames are reported.
+ * The automatic parity size must not be worse than the standard one: it must not recover fewer frames
+ * and it can use more airtime only if it recovers noticeably more frames.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "fx25.h"
+#include "ax25.h"
+
+#define FRAME_COUNT 20000 //frames per channel and mode
+#define WARMUP_COUNT 200 //frames sent before measurement, so that the estimate settles
+#define MIN_FRAME_SIZE 40
+#define MAX_FRAME_SIZE 170
+#define TAG_SIZE 8
+#define AIRTIME_TOLERANCE 0.5 //percentage of airtime that can differ due to random frame sizes
+#define RECOVERED_TOLERANCE 0.05 //percentage points of recovered frames that can differ due to random errors
+#define RECOVERED_GAIN 0.5 //percentage points of recovered frames that justify more airtime
+
+struct Ax25ProtoConfig Ax25Config;
+
+static uint64_t state = 0x9E3779B97F4A7C15;
+
+/**
+ * @brief Get pseudorandom number (xorshift64), the same on every host
+ * @return Random number
+ */
+static uint64_t random64(void)
+{
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+struct Result
+{
+	double bytes; //average bytes sent per frame
+	double recovered; //percentage of recovered frames
+	unsigned parity[3]; //number of frames sent with parity 16, 32 and 64
+};
+
+/**
+ * @brief Send frames over a channel
+ * @param errorRate Byte error rate in 1/1000000 units
+ * @param adaptive True for automatic parity size
+ * @param *result Output result
+ */
+static void simulate(uint32_t errorRate, bool adaptive, struct Result *result)
+{
+	Ax25Config.fx25Adaptive = adaptive;
+	//clear the estimate left by the previous channel
+	for(uint8_t i = 0; i < 100; i++)
+		Fx25UpdateChannelQuality(0, &Fx25ModeList[0]);
+
+	unsigned long bytes = 0, recovered = 0;
+	memset(result, 0, sizeof(*result));
+	for(unsigned n = 0; n < (WARMUP_COUNT + FRAME_COUNT); n++)
+	{
+		uint16_t size = MIN_FRAME_SIZE + (random64() % (MAX_FRAME_SIZE - MIN_FRAME_SIZE + 1));
+		const struct Fx25Mode *mode = Fx25GetModeForSize(size + 4 + (size / 5) + 1); //as in encodeFx25Frame()
+		uint8_t errors = 0;
+		for(uint16_t i = 0; i < (mode->K + mode->T); i++)
+			errors += ((random64() % 1000000) < errorRate);
+		bool ok = (errors <= (mode->T / 2));
+		Fx25UpdateChannelQuality(ok ? errors : ((mode->T / 2) + 1), mode);
+
+		if(n < WARMUP_COUNT)
+			continue;
+		bytes += TAG_SIZE + mode->K + mode->T;
+		recovered += ok;
+		result->parity[(mode->T == 16) ? 0 : ((mode->T == 32) ? 1 : 2)]++;
+	}
+	result->bytes = (double)bytes / FRAME_COUNT;
+	result->recovered = 100. * recovered / FRAME_COUNT;
+}
+
+int main(void)
+{
+	static const uint32_t errorRates[] = {0, 1000, 5000, 10000, 20000, 40000, 60000, 80000};
+	Ax25Config.fx25MinParity = 16;
+	Ax25Config.fx25MaxParity = 64;
+	Fx25Init();
+
+	unsigned failures = 0;
+	printf("byte errors  standard: bytes recovered  auto: bytes recovered  parity 16/32/64\n");
+	for(uint8_t i = 0; i < sizeof(errorRates) / sizeof(*errorRates); i++)
+	{
+		struct Result std, adaptive;
+		simulate(errorRates[i], false, &std);
+		simulate(errorRates[i], true, &adaptive);
+		printf("%9.1f%%  %17.1f %8.2f%%  %13.1f %8.2f%%  %5u/%u/%u\n", errorRates[i] / 10000., std.bytes, std.recovered,
+				adaptive.bytes, adaptive.recovered, adaptive.parity[0], adaptive.parity[1], adaptive.parity[2]);
+
+		if(adaptive.recovered < (std.recovered - RECOVERED_TOLERANCE))
+		{
+			printf("FAIL: automatic parity size recovers fewer frames\n");
+			failures++;
+		}
+		if((adaptive.bytes > (std.bytes * (1. + AIRTIME_TOLERANCE / 100.))) && (adaptive.recovered < (std.recovered + RECOVERED_GAIN)))
+		{
+			printf("FAIL: automatic parity size uses more airtime for the same recovery\n");
+			failures++;
+		}
+		//a very bad channel must use the biggest parity, except for frames too big for it
+		if(((i + 1) == (sizeof(errorRates) / sizeof(*errorRates))) && (adaptive.parity[2] < (FRAME_COUNT * 3 / 4)))
+		{
+			printf("FAIL: parity 64 not used on a bad channel\n");
+			failures++;
+		}
+	}
+	printf("%s\n", failures ? "FAILED" : "OK");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,244 @@
+/*
+Copyright 2020-2025 Piotr Wilkon
+
+This file is part of VP-Digi.
+
+VP-Digi is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+VP-Digi is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * FX.25 Reed-Solomon kernel test.
+ * fx25.c is included with ENABLE_PROFILING, so that both the in-tree kernels and LwFEC
+ * are built and their static functions can be called. Parity from both must be the same.
+ * A known block with T/2 errors at fixed positions, including the first and last data
+ * and parity bytes, and random blocks with up to T/2+4 errors are decoded by both:
+ * the result, the number of fixed bytes and the data must be the same.
+ * With -n the on-target benchmark (fecbench) is run with host time instead of CPU cycles,
+ * and the shortest times of both implementations are reported.
+ */
+
+#include "../Core/Src/fx25.c"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define CHECK_COUNT 4000 //number of random blocks per mode
+#define EXTRA_ERRORS 4 //max number of errors above T/2 in random blocks
+
+struct Ax25ProtoConfig Ax25Config;
+
+static uint64_t state = 0x9E3779B97F4A7C15;
+
+/**
+ * @brief Get pseudorandom number (xorshift64), the same on every host
+ * @return Random number
+ */
+static uint64_t random64(void)
+{
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+int16_t Random(int16_t min, int16_t max)
+{
+	return (max > min) ? (min + (random64() % (max - min))) : min;
+}
+
+//the benchmark measures time in nanoseconds on the host
+uint32_t SysTickGetCycles(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/**
+ * @brief Decode block with both implementations and compare results
+ * @param *block Damaged block
+ * @param *original Original block
+ * @param *mode FX.25 mode
+ * @param errors Number of damaged bytes
+ * @return 0 if both results are the same and correct, 1 otherwise
+ */
+static unsigned compare(const uint8_t *block, const uint8_t *original, const struct Fx25Mode *mode, uint8_t errors)
+{
+	uint16_t n = mode->K + mode->T;
+	uint8_t intree[FX25_MAX_BLOCK_SIZE], lwfec[FX25_MAX_BLOCK_SIZE];
+	memcpy(intree, block, n);
+	memcpy(lwfec, block, n);
+	uint8_t intreeFixed = 0xFF, lwfecFixed = 0xFF;
+	bool intreeOk = rsDecode(intree, mode, &intreeFixed);
+	bool lwfecOk = lwfecDecode(lwfec, mode, &lwfecFixed);
+
+	if((intreeOk != lwfecOk) || (intreeOk && ((intreeFixed != lwfecFixed) || memcmp(intree, lwfec, n))))
+		return 1;
+	//both must correct up to T/2 errors, and the in-tree decoder must leave an uncorrectable block untouched
+	if((errors <= (mode->T / 2)) && (!intreeOk || (intreeFixed != errors) || memcmp(intree, original, n)))
+		return 1;
+	if(!intreeOk && memcmp(intree, block, n))
+		return 1;
+	return 0;
+}
+
+/**
+ * @brief Check the known error vector: K=223, T=32 with 16 errors
+ * @return Number of failures
+ */
+static unsigned checkKnownVector(void)
+{
+	static const struct
+	{
+		uint8_t position;
+		uint8_t value;
+	} damage[] =
+	{
+		{0, 0x01}, {1, 0xFF}, {17, 0x80}, {54, 0x5A}, {100, 0xA5}, {101, 0x3C}, {150, 0x11}, {199, 0xFE},
+		{221, 0x42}, {222, 0x99}, {223, 0x01}, {224, 0x7F}, {230, 0xC3}, {240, 0x24}, {253, 0xE7}, {254, 0x10},
+	};
+	const struct Fx25Mode *mode = &Fx25ModeList[4];
+	uint16_t n = mode->K + mode->T;
+	uint8_t original[FX25_MAX_BLOCK_SIZE], reference[FX25_MAX_BLOCK_SIZE], block[FX25_MAX_BLOCK_SIZE];
+	for(uint16_t i = 0; i < mode->K; i++)
+		original[i] = (i * 73) + 0x21;
+	memcpy(reference, original, mode->K);
+	rsEncode(original, mode);
+	lwfecEncode(reference, mode);
+	if(memcmp(original, reference, n))
+	{
+		printf("FAIL: known vector encoded differently\n");
+		return 1;
+	}
+
+	unsigned failures = 0;
+	memcpy(block, original, n);
+	for(uint8_t i = 0; i < sizeof(damage) / sizeof(*damage); i++)
+	{
+		block[damage[i].position] ^= damage[i].value;
+		//decode with each number of errors up to T/2
+		if(compare(block, original, mode, i + 1))
+		{
+			printf("FAIL: known vector with %u errors decoded differently or incorrectly\n", i + 1);
+			failures++;
+		}
+	}
+	//one more error is uncorrectable for both
+	block[120] ^= 0x55;
+	uint8_t fixed;
+	if(rsDecode(block, mode, &fixed) || lwfecDecode(block, mode, &fixed))
+	{
+		printf("FAIL: known vector with 17 errors decoded\n");
+		failures++;
+	}
+	return failures;
+}
+
+/**
+ * @brief Run benchmark for both implementations and print shortest times
+ * @param count Number of benchmark runs
+ */
+static void benchmark(unsigned long count)
+{
+	uint8_t buffer[FX25_MAX_BLOCK_SIZE];
+	for(uint8_t i = 0; i < sizeof(Fx25ModeList) / sizeof(*Fx25ModeList); i++)
+	{
+		const struct Fx25Mode *mode = &Fx25ModeList[i];
+		for(uint8_t lwfec = 0; lwfec < 2; lwfec++)
+		{
+			struct Fx25BenchResult best, result;
+			Fx25Benchmark(mode, lwfec, buffer, &best);
+			for(unsigned long k = 1; k < count; k++)
+			{
+				Fx25Benchmark(mode, lwfec, buffer, &result);
+				if(result.encode < best.encode)
+					best.encode = result.encode;
+				for(uint8_t s = 0; s < FX25_BENCH_ERROR_STEPS; s++)
+				{
+					if(result.decode[s] < best.decode[s])
+						best.decode[s] = result.decode[s];
+				}
+				best.failed |= result.failed;
+			}
+			fprintf(stderr, "K=%u T=%u %-7s: encode %5u ns, decode with 0/%u/%u/%u/%u errors %u/%u/%u/%u/%u ns%s\n", mode->K, mode->T,
+					lwfec ? "LwFEC" : "in-tree", best.encode, mode->T / 8, mode->T / 4, 3 * mode->T / 8, mode->T / 2,
+					best.decode[0], best.decode[1], best.decode[2], best.decode[3], best.decode[4], best.failed ? ", FAILED" : "");
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long count = 0;
+	if((argc == 3) && !strcmp(argv[1], "-n"))
+		count = strtoul(argv[2], NULL, 10);
+
+	Fx25Init();
+	unsigned failures = checkKnownVector();
+
+	unsigned long blocks = 0, corrected = 0, uncorrectable = 0, mismatches = 0;
+	for(uint8_t i = 0; i < sizeof(Fx25ModeList) / sizeof(*Fx25ModeList); i++)
+	{
+		const struct Fx25Mode *mode = &Fx25ModeList[i];
+		uint16_t n = mode->K + mode->T;
+		for(unsigned k = 0; k < CHECK_COUNT; k++)
+		{
+			uint8_t original[FX25_MAX_BLOCK_SIZE], reference[FX25_MAX_BLOCK_SIZE], block[FX25_MAX_BLOCK_SIZE];
+			for(uint16_t j = 0; j < mode->K; j++)
+				original[j] = random64();
+			memcpy(reference, original, mode->K);
+			rsEncode(original, mode);
+			lwfecEncode(reference, mode);
+			if(memcmp(original, reference, n))
+			{
+				if(mismatches < 10)
+					printf("K=%u T=%u: FAIL: block %u encoded differently\n", mode->K, mode->T, k);
+				mismatches++;
+				continue;
+			}
+
+			//damage distinct bytes
+			uint8_t errors = random64() % ((mode->T / 2) + EXTRA_ERRORS + 1);
+			memcpy(block, original, n);
+			for(uint8_t j = 0; j < errors; j++)
+			{
+				uint16_t position;
+				do
+					position = random64() % n;
+				while(block[position] != original[position]);
+				block[position] ^= 1 + (random64() % 255);
+			}
+
+			uint8_t fixed;
+			memcpy(reference, block, n);
+			bool ok = lwfecDecode(reference, mode, &fixed);
+			corrected += ok;
+			uncorrectable += !ok;
+			if(compare(block, original, mode, errors))
+			{
+				if(mismatches < 10)
+					printf("K=%u T=%u: FAIL: block %u with %u errors decoded differently or incorrectly\n", mode->K, mode->T, k, errors);
+				mismatches++;
+			}
+			blocks++;
+		}
+	}
+	failures += mismatches;
+	printf("known vector checked, blocks: %lu, decoded: %lu, uncorrectable: %lu, mismatches: %lu\n", blocks, corrected, uncorrectable, mismatches);
+
+	if(count)
+		benchmark(count);
+	printf("%s\n", failures ? "FAILED" : "OK");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,421 @@
+/*
+Copyright 2020-2025 Piotr Wilkon
+
+This file is part of VP-Digi.
+
+VP-Digi is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+VP-Digi is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * FX.25 bit stuffing test.
+ * ax25.c is included, so that its static FX.25 frame encoder and parser can be called.
+ * They are compared bit for bit with the previous implementation, which processed
+ * frames one bit at a time, on random frames and on blocks with flipped bits.
+ * With -n both are timed on a 120-byte frame.
+ */
+
+#include "../Core/Src/ax25.c"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define CHECK_COUNT 100000 //number of random frames
+#define BENCH_FRAME_SIZE 120
+
+void EventPost(uint32_t events) {}
+uint32_t SysTickGet(void) {return 0;}
+bool TimerStart(struct Timer *t, uint32_t delay) {return true;}
+uint32_t ChannelGetLastBusy(void) {return 0;}
+uint8_t ModemDcdState(void) {return 0;}
+float ModemGetBaudrate(void) {return 1200;}
+void ModemGetSignalLevel(uint8_t modem, int8_t *peak, int8_t *valley, uint8_t *level) {*peak = 0; *valley = 0; *level = 0;}
+uint8_t ModemIsTxTestOngoing(void) {return 0;}
+void ModemTransmitStart(void) {}
+void ModemTransmitStop(void) {}
+int16_t Random(int16_t min, int16_t max) {return min;}
+
+static uint8_t oldBlock[FX25_MAX_BLOCK_SIZE];
+
+/**
+ * @brief Previous implementation of encodeFx25Frame()
+ * @param *data Frame data
+ * @param size Frame size
+ * @return FX.25 mode used or NULL if frame does not fit in FX.25
+ */
+static const struct Fx25Mode *oldEncodeFx25Frame(uint8_t *data, uint16_t size)
+{
+	const struct Fx25Mode *fx25Mode = Fx25GetModeForSize(size + 4 + (size / 5) + 1);
+	if(NULL == fx25Mode)
+		return NULL;
+
+	memset(oldBlock, 0, sizeof(oldBlock));
+
+	uint16_t index = 0;
+	oldBlock[index++] = 0x7E;
+
+	uint16_t crc = 0xFFFF;
+
+	uint8_t bits = 0; //bit counter within a byte
+	uint8_t bitstuff = 0;
+	for(uint16_t i = 0; i < size + 2; i++)
+	{
+		for(uint8_t k = 0; k < 8; k++)
+		{
+			oldBlock[index] >>= 1;
+			bits++;
+			if(i < size) //frame data
+			{
+				if((data[i] >> k) & 1)
+				{
+					calculateCRC(1, &crc);
+					bitstuff++;
+					oldBlock[index] |= 0x80;
+				}
+				else
+				{
+					calculateCRC(0, &crc);
+					bitstuff = 0;
+				}
+			}
+			else //crc
+			{
+				uint8_t c = 0;
+				if(i == size)
+					c = (crc & 0xFF) ^ 0xFF;
+				else
+					c = (crc >> 8) ^ 0xFF;
+
+				if((c >> k) & 1)
+				{
+					bitstuff++;
+					oldBlock[index] |= 0x80;
+				}
+				else
+				{
+					bitstuff = 0;
+				}
+			}
+
+			if(bits == 8)
+			{
+				bits = 0;
+				index++;
+			}
+			if(bitstuff == 5)
+			{
+				bits++;
+				bitstuff = 0;
+				oldBlock[index] >>= 1;
+				if(bits == 8)
+				{
+					bits = 0;
+					index++;
+				}
+			}
+		}
+	}
+
+	//pad with flags
+	while(index < fx25Mode->K)
+	{
+		for(uint8_t k = 0; k < 8; k++)
+		{
+			oldBlock[index] >>= 1;
+			bits++;
+
+			if((0x7E >> k) & 1)
+			{
+				oldBlock[index] |= 0x80;
+			}
+
+			if(bits == 8)
+			{
+				bits = 0;
+				index++;
+			}
+		}
+	}
+
+	Fx25Encode(oldBlock, fx25Mode);
+
+	return fx25Mode;
+}
+
+/**
+ * @brief Previous implementation of parseFx25Frame(), writing to a linear buffer instead of RX buffer
+ * @param *frame Decoded FX.25 block
+ * @param size Block size
+ * @param *out Output frame
+ * @param *outSize Output frame size
+ * @param *crc Output frame CRC
+ * @return True if frame is correct
+ */
+static bool oldParseFx25Frame(uint8_t *frame, uint16_t size, uint8_t *out, uint16_t *outSize, uint16_t *crc)
+{
+	memset(out, 0, FX25_MAX_BLOCK_SIZE);
+	uint16_t i = 0; //input data index
+	uint16_t k = 0; //output data size
+	while((i < size) && (frame[i] == 0x7E))
+		i++;
+
+	uint8_t bitstuff = 0;
+	uint8_t outBit = 0;
+	for(; i < size; i++)
+	{
+		for(uint8_t b = 0; b < 8; b++)
+		{
+			if(frame[i] & (1 << b))
+			{
+				out[k] >>= 1;
+				out[k] |= 0x80;
+				bitstuff++;
+			}
+			else
+			{
+				if(bitstuff == 5) //zero after 5 ones, normal bitstuffing
+				{
+					bitstuff = 0;
+					continue;
+				}
+				else if(bitstuff == 6) //zero after 6 ones, this is a flag
+				{
+					goto endParseFx25Frame;
+				}
+				else if(bitstuff >= 7) //zero after 7 ones, illegal byte
+				{
+					return false;
+				}
+				bitstuff = 0;
+				out[k] >>= 1;
+			}
+			outBit++;
+			if(outBit == 8)
+			{
+				k++;
+				outBit = 0;
+			}
+		}
+	}
+
+endParseFx25Frame:
+	if(k <= 2) //the previous implementation read outside the frame here
+		return false;
+
+	*crc = 0xFFFF;
+	for(uint16_t j = 0; j < (k - 2); j++)
+	{
+		for(uint8_t b = 0; b < 8; b++)
+			calculateCRC((out[j] >> b) & 1, crc);
+	}
+	*crc ^= 0xFFFF;
+	if((out[k - 2] == (*crc & 0xFF)) && (out[k - 1] == ((*crc >> 8) & 0xFF))) //check CRC
+	{
+		uint16_t pathEnd = 0;
+		for(uint16_t j = 0; j < (k - 2); j++)
+		{
+			if(out[pathEnd] & 1)
+				break;
+			pathEnd++;
+		}
+
+		if(Ax25Config.allowNonAprs || ((out[pathEnd + 1] == 0x03) && (out[pathEnd + 2] == 0xF0)))
+		{
+			*outSize = k - 2;
+			return true;
+		}
+	}
+	return false;
+}
+
+static uint64_t state = 0x9E3779B97F4A7C15;
+
+/**
+ * @brief Get pseudorandom number (xorshift64), the same on every host
+ * @return Random number
+ */
+static uint64_t random64(void)
+{
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+/**
+ * @brief Generate random frame
+ * @param *frame Output frame
+ * @param size Frame size
+ * @details Most frames are APRS frames with a path of 2-4 addresses, the rest is random data
+ */
+static void randomFrame(uint8_t *frame, uint16_t size)
+{
+	for(uint16_t i = 0; i < size; i++)
+		frame[i] = random64();
+	if((random64() % 4) && (size >= 30))
+	{
+		uint8_t addresses = 2 + (random64() % 3);
+		for(uint16_t i = 0; i < (addresses * 7); i++)
+			frame[i] &= 0xFE;
+		frame[addresses * 7 - 1] |= 1;
+		frame[addresses * 7] = 0x03;
+		frame[addresses * 7 + 1] = 0xF0;
+	}
+	else if(random64() % 2) //long runs of ones
+	{
+		for(uint16_t i = 0; i < size; i++)
+			frame[i] |= random64();
+	}
+}
+
+/**
+ * @brief Parse block with the current implementation
+ * @param *block Block, modified
+ * @param size Block size
+ * @param *out Output frame
+ * @param *outSize Output frame size
+ * @param *crc Output frame CRC
+ * @return True if frame is correct
+ */
+static bool parse(uint8_t *block, uint16_t size, uint8_t *out, uint16_t *outSize, uint16_t *crc)
+{
+	*outSize = parseFx25Frame(block, size, crc);
+	if(0 == *outSize)
+		return false;
+	memcpy(out, block, *outSize);
+	return true;
+}
+
+/**
+ * @brief Get time in nanoseconds
+ * @return Time
+ */
+static double now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long repetitions = 0;
+	if((argc == 3) && !strcmp(argv[1], "-n"))
+		repetitions = strtoul(argv[2], NULL, 10);
+
+	Fx25Init();
+	unsigned long encoded = 0, parsed = 0, accepted = 0, mismatches = 0;
+	uint8_t frame[AX25_FRAME_MAX_SIZE];
+	uint8_t block[FX25_MAX_BLOCK_SIZE], oldInput[FX25_MAX_BLOCK_SIZE];
+	uint8_t out[FX25_MAX_BLOCK_SIZE], oldOut[FX25_MAX_BLOCK_SIZE];
+	for(unsigned long n = 0; n < CHECK_COUNT; n++)
+	{
+		uint16_t size = 15 + (random64() % 225);
+		randomFrame(frame, size);
+		Ax25Config.allowNonAprs = (0 == (random64() % 8));
+
+		const struct Fx25Mode *mode = encodeFx25Frame(frame, size);
+		if(mode != oldEncodeFx25Frame(frame, size))
+		{
+			printf("frame %lu: FX.25 mode differs\n", n);
+			mismatches++;
+			continue;
+		}
+		if(NULL == mode)
+			continue;
+		encoded++;
+		if(memcmp(txFecBuffer, oldBlock, mode->K + mode->T))
+		{
+			printf("frame %lu: encoded block differs\n", n);
+			mismatches++;
+		}
+
+		//parse the block as received, with some bits flipped or with a run of ones
+		for(uint8_t variant = 0; variant < 5; variant++)
+		{
+			memcpy(block, oldBlock, mode->K);
+			if(variant < 4)
+			{
+				for(uint8_t i = 0; i < variant; i++)
+					block[random64() % mode->K] ^= 1 << (random64() % 8);
+			}
+			else
+				block[1 + (random64() % (mode->K - 1))] = 0xFF;
+			memcpy(oldInput, block, mode->K);
+
+			uint16_t outSize = 0, oldOutSize = 0, crc = 0, oldCrc = 0;
+			bool ok = parse(block, mode->K, out, &outSize, &crc);
+			bool oldOk = oldParseFx25Frame(oldInput, mode->K, oldOut, &oldOutSize, &oldCrc);
+			parsed++;
+			accepted += ok;
+			if((ok != oldOk) || (ok && ((outSize != oldOutSize) || (crc != oldCrc) || memcmp(out, oldOut, outSize))))
+			{
+				if(mismatches < 10)
+					printf("frame %lu, variant %u: parser result differs\n", n, variant);
+				mismatches++;
+			}
+			//non-APRS frames are rejected unless allowed
+			if((0 == variant) && (ok ? ((outSize != size) || memcmp(out, frame, size)) : Ax25Config.allowNonAprs))
+			{
+				if(mismatches < 10)
+					printf("frame %lu: decoded frame differs from the original\n", n);
+				mismatches++;
+			}
+		}
+	}
+	printf("frames encoded: %lu, blocks parsed: %lu, accepted: %lu, mismatches: %lu\n", encoded, parsed, accepted, mismatches);
+
+	if(repetitions)
+	{
+		do
+			randomFrame(frame, BENCH_FRAME_SIZE);
+		while(frame[14] != 0x03); //APRS frame
+		const struct Fx25Mode *mode = encodeFx25Frame(frame, BENCH_FRAME_SIZE);
+		memcpy(oldInput, txFecBuffer, mode->K);
+		uint16_t outSize, crc;
+
+		double start = now();
+		for(unsigned long i = 0; i < repetitions; i++)
+			encodeFx25Frame(frame, BENCH_FRAME_SIZE);
+		double encode = (now() - start) / repetitions;
+		start = now();
+		for(unsigned long i = 0; i < repetitions; i++)
+			oldEncodeFx25Frame(frame, BENCH_FRAME_SIZE);
+		double oldEncode = (now() - start) / repetitions;
+
+		//RS encoding is a part of both encoders, so it is measured separately
+		start = now();
+		for(unsigned long i = 0; i < repetitions; i++)
+			Fx25Encode(txFecBuffer, mode);
+		double rs = (now() - start) / repetitions;
+
+		start = now();
+		for(unsigned long i = 0; i < repetitions; i++)
+		{
+			memcpy(block, oldInput, mode->K);
+			parse(block, mode->K, out, &outSize, &crc);
+		}
+		double parseTime = (now() - start) / repetitions;
+		start = now();
+		for(unsigned long i = 0; i < repetitions; i++)
+		{
+			memcpy(block, oldInput, mode->K);
+			oldParseFx25Frame(block, mode->K, oldOut, &outSize, &crc);
+		}
+		double oldParseTime = (now() - start) / repetitions;
+
+		fprintf(stderr, "%u-byte frame, K=%u T=%u: encode %.0f ns (previous %.0f ns), of which RS %.0f ns; parse %.0f ns (previous %.0f ns)\n",
+				BENCH_FRAME_SIZE, mode->K, mode->T, encode, oldEncode, rs, parseTime, oldParseTime);
+	}
+	return mismatches ? 1 : 0;
+}
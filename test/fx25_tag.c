@@ -0,0 +1,143 @@
+/*
+Copyright 2020-2025 Piotr Wilkon
+
+This file is part of VP-Digi.
+
+VP-Digi is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+VP-Digi is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * FX.25 correlation tag detector test.
+ * Fx25GetModeForTag() is compared with the previous implementation (64-bit popcount
+ * of each tag difference) on random input and on real tags with flipped bits.
+ * With -n both are run on a stream of random bits, as in the receiver, and the time
+ * per received bit is reported.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "fx25.h"
+#include "ax25.h"
+
+#define FX25_MAX_DISTANCE 10 //same as in fx25.c
+#define CHECK_COUNT 4000000 //number of tags checked, half of them random
+#define MAX_FLIPPED 13 //max number of bits flipped in real tags
+
+struct Ax25ProtoConfig Ax25Config;
+
+static uint64_t state = 0x9E3779B97F4A7C15;
+
+/**
+ * @brief Get pseudorandom number (xorshift64), the same on every host
+ * @return Random number
+ */
+static uint64_t random64(void)
+{
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+/**
+ * @brief Previous implementation of Fx25GetModeForTag()
+ * @param tag Received tag
+ * @return Matching mode or NULL
+ */
+static const struct Fx25Mode* oldGetModeForTag(uint64_t tag)
+{
+	for(uint8_t i = 0; i < sizeof(Fx25ModeList) / sizeof(*Fx25ModeList); i++)
+	{
+		if(__builtin_popcountll(tag ^ Fx25ModeList[i].tag) <= FX25_MAX_DISTANCE)
+			return &Fx25ModeList[i];
+	}
+	return NULL;
+}
+
+/**
+ * @brief Measure detector time per received bit
+ * @param *detect Detector
+ * @param bits Number of bits
+ * @return Time in nanoseconds
+ */
+static double measure(const struct Fx25Mode* (*detect)(uint64_t), unsigned long bits)
+{
+	uint64_t tag = 0;
+	uint64_t input = 0;
+	unsigned long found = 0;
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(unsigned long n = 0; n < bits; n++)
+	{
+		if(0 == (n & 63))
+			input = random64();
+		tag = (tag >> 1) | ((input & 1) << 63);
+		input >>= 1;
+		found += (NULL != detect(tag));
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	if(found > bits) //keep the result in use
+		printf("?\n");
+	return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / bits;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long bits = 0;
+	if((argc == 3) && !strcmp(argv[1], "-n"))
+		bits = strtoul(argv[2], NULL, 10);
+
+	unsigned long detected = 0, mismatches = 0, upperHalf = 0, comparisons = 0;
+	for(unsigned long n = 0; n < CHECK_COUNT; n++)
+	{
+		uint64_t tag;
+		if(n & 1) //real tag with flipped bits
+		{
+			tag = Fx25ModeList[random64() % (sizeof(Fx25ModeList) / sizeof(*Fx25ModeList))].tag;
+			uint8_t flipped = random64() % (MAX_FLIPPED + 1);
+			for(uint8_t i = 0; i < flipped; i++)
+				tag ^= 1ULL << (random64() % 64);
+		}
+		else
+		{
+			tag = random64();
+			//the detector compares the upper half only if the lower half is within the limit
+			for(uint8_t i = 0; i < sizeof(Fx25ModeList) / sizeof(*Fx25ModeList); i++)
+			{
+				upperHalf += (__builtin_popcount((uint32_t)(tag ^ Fx25ModeList[i].tag)) <= FX25_MAX_DISTANCE);
+				comparisons++;
+			}
+		}
+
+		const struct Fx25Mode *mode = Fx25GetModeForTag(tag);
+		if(mode != oldGetModeForTag(tag))
+		{
+			if(mismatches < 10)
+				printf("mismatch for tag %016llX\n", (unsigned long long)tag);
+			mismatches++;
+		}
+		detected += (NULL != mode);
+	}
+	printf("tags checked: %u, detected: %lu, mismatches: %lu\n", CHECK_COUNT, detected, mismatches);
+	printf("upper half compared for random input: %.2f%% of modes\n", 100. * upperHalf / comparisons);
+
+	if(bits)
+	{
+		double current = measure(Fx25GetModeForTag, bits);
+		double old = measure(oldGetModeForTag, bits);
+		fprintf(stderr, "%lu bits: %.1f ns/bit, previous implementation %.1f ns/bit\n", bits, current, old);
+	}
+	return mismatches ? 1 : 0;
+}
@@ -0,0 +1,45 @@
+/*
+Copyright 2020-2025 Piotr Wilkon
+
+This file is part of VP-Digi.
+
+VP-Digi is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+VP-Digi is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Included before every source file in host builds (see Makefile).
+ * STM32F103xB is not defined, so the low-level drivers are left out and
+ * only what the pure C modules need from them is provided here.
+ */
+
+#ifndef HOST_H_
+#define HOST_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+typedef struct {uint32_t unused;} USART_TypeDef;
+typedef struct {uint32_t unused;} DMA_Channel_TypeDef;
+
+#define __disable_irq()
+#define __enable_irq()
+
+#define DIGIPEATER_LL_GET_DISABLE_STATE() 0
+#define DIGIPEATER_LL_LED_ON()
+#define DIGIPEATER_LL_LED_OFF()
+#define DIGIPEATER_LL_INITIALIZE_RCC()
+#define DIGIPEATER_LL_INITIALIZE_INPUTS_OUTPUTS()
+
+#endif /* HOST_H_ */
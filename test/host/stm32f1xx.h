@@ -0,0 +1,55 @@
+/*
+Copyright 2020-2025 Piotr Wilkon
+
+This file is part of VP-Digi.
+
+VP-Digi is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+VP-Digi is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Flash controller registers for host builds.
+ * Every register access goes through HostFlash(), which is provided by the test
+ * and carries out the operation requested by the previous accesses.
+ */
+
+#ifndef STM32F1XX_H_
+#define STM32F1XX_H_
+
+#include <stdint.h>
+
+typedef struct
+{
+	volatile uint32_t ACR;
+	volatile uint32_t KEYR;
+	volatile uint32_t OPTKEYR;
+	volatile uint32_t SR;
+	volatile uint32_t CR;
+	volatile uint32_t AR;
+} FLASH_TypeDef;
+
+FLASH_TypeDef *HostFlash(void);
+
+#define FLASH (HostFlash())
+
+#define FLASH_SR_BSY (1 << 0)
+#define FLASH_SR_PGERR (1 << 2)
+#define FLASH_SR_WRPRTERR (1 << 4)
+#define FLASH_SR_EOP (1 << 5)
+
+#define FLASH_CR_PG (1 << 0)
+#define FLASH_CR_PER (1 << 1)
+#define FLASH_CR_STRT (1 << 6)
+#define FLASH_CR_LOCK (1 << 7)
+
+#endif /* STM32F1XX_H_ */
@@ -0,0 +1,10 @@
+/*
+ * Host build: there is no USB device, this header replaces the CubeMX one.
+ */
+
+#ifndef USBD_CDC_IF_H_
+#define USBD_CDC_IF_H_
+
+#include <stdint.h>
+
+#endif /* USBD_CDC_IF_H_ */
@@ -0,0 +1,189 @@
+/*
+Copyright 2020-2025 Piotr Wilkon
+
+This file is part of VP-Digi.
+
+VP-Digi is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 3 of the License, or
+(at your option) any later version.
+
+VP-Digi is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with VP-Digi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * IL2P codec test.
+ * il2p.c is included, so that its static scrambler can be called.
+ * The header example from the IL2P specification (also used by Direwolf tests),
+ * a type 1 UI frame from KK4HEJ-15 to CQ with no payload, must be encoded and decoded
+ * to the same bytes. Random frames are encoded, damaged up to the correction limit
+ * and decoded. The trailing CRC is checked for every value and every single bit error.
+ */
+
+#include "../Core/Src/il2p.c"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CHECK_COUNT 20000 //number of random frames
+#define MAX_FRAME_SIZE 1023
+
+static uint64_t state = 0x9E3779B97F4A7C15;
+
+/**
+ * @brief Get pseudorandom number (xorshift64), the same on every host
+ * @return Random number
+ */
+static uint64_t random64(void)
+{
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return state;
+}
+
+//IL2P specification header example: type 1, UI, PID 0xF0, KK4HEJ-15 > CQ, no payload
+static const uint8_t specHeader[IL2P_HEADER_SIZE] =
+{
+	0x63, 0xF1, 0x40, 0x40, 0x40, 0x00, 0x6B, 0x2B, 0x54, 0x28, 0x25, 0x2A, 0x0F,
+};
+//the same header scrambled, with parity
+static const uint8_t specEncoded[IL2P_ENCODED_HEADER_SIZE] =
+{
+	0x6A, 0xEA, 0x9C, 0xC2, 0x01, 0x11, 0xFC, 0x14, 0x1F, 0xDA, 0x6E, 0xF2, 0x53, 0x91, 0xBD,
+};
+//AX.25 frame rebuilt from this header
+static const uint8_t specFrame[] =
+{
+	'C' << 1, 'Q' << 1, ' ' << 1, ' ' << 1, ' ' << 1, ' ' << 1, 0xE0,
+	'K' << 1, 'K' << 1, '4' << 1, 'H' << 1, 'E' << 1, 'J' << 1, 0x7F,
+	0x03, 0xF0,
+};
+
+/**
+ * @brief Check the specification example
+ * @return Number of failures
+ */
+static unsigned checkSpecExample(void)
+{
+	unsigned failures = 0;
+	uint8_t buf[IL2P_ENCODED_HEADER_SIZE];
+	memcpy(buf, specHeader, IL2P_HEADER_SIZE);
+	scramble(buf, IL2P_HEADER_SIZE);
+	RsEncode(&rs2, buf, IL2P_HEADER_SIZE);
+	if(memcmp(buf, specEncoded, sizeof(buf)))
+	{
+		printf("FAIL: specification header encoded incorrectly\n");
+		failures++;
+	}
+
+	//decode it without errors and with an error in each byte
+	for(int8_t damaged = -1; damaged < IL2P_ENCODED_HEADER_SIZE; damaged++)
+	{
+		uint8_t header[IL2P_ENCODED_HEADER_SIZE];
+		memcpy(header, specEncoded, sizeof(header));
+		if(damaged >= 0)
+			header[damaged] ^= 0x5A;
+		uint16_t encodedSize = 0xFFFF, size = 0;
+		uint8_t fixed = 0, frame[64];
+		if(!Il2pDecodeHeader(header, &encodedSize, &fixed) || (0 != encodedSize) || memcmp(header, specHeader, IL2P_HEADER_SIZE)
+				|| !Il2pDecode(header, frame, sizeof(frame), &size, &fixed) || (size != sizeof(specFrame)) || memcmp(frame, specFrame, size))
+		{
+			printf("FAIL: specification header with byte %d damaged decoded incorrectly\n", damaged);
+			failures++;
+		}
+	}
+	return failures;
+}
+
+/**
+ * @brief Check the trailing CRC
+ * @return Number of failures
+ */
+static unsigned checkCrc(void)
+{
+	unsigned failures = 0;
+	for(uint32_t crc = 0; crc <= 0xFFFF; crc++)
+	{
+		uint8_t buf[IL2P_CRC_SIZE];
+		Il2pEncodeCrc(crc, buf);
+		if(Il2pDecodeCrc(buf) != crc)
+			failures++;
+		uint8_t byte = random64() % IL2P_CRC_SIZE;
+		buf[byte] ^= 1 << (random64() % 7);
+		if(Il2pDecodeCrc(buf) != crc)
+			failures++;
+	}
+	//any two codewords differ in at least 3 bits
+	for(uint8_t i = 0; i < 16; i++)
+	{
+		for(uint8_t k = i + 1; k < 16; k++)
+		{
+			if(__builtin_popcount(crcHamming[i] ^ crcHamming[k]) < 3)
+				failures++;
+		}
+	}
+	if(failures)
+		printf("FAIL: %u CRC errors\n", failures);
+	return failures;
+}
+
+int main(void)
+{
+	Il2pInit();
+	unsigned failures = checkSpecExample() + checkCrc();
+
+	static uint8_t frame[MAX_FRAME_SIZE], buffer[1400];
+	unsigned long decoded = 0, errors = 0, blocks = 0;
+	for(unsigned long n = 0; n < CHECK_COUNT; n++)
+	{
+		//mostly single block frames, as sent by the digipeater
+		uint16_t size = (n % 8) ? (15 + (random64() % 225)) : (15 + (random64() % (MAX_FRAME_SIZE - 14)));
+		for(uint16_t i = 0; i < size; i++)
+			frame[i] = random64();
+		uint16_t encoded = Il2pEncode(frame, size, buffer, sizeof(buffer));
+		if(0 == encoded)
+		{
+			printf("frame %lu: FAIL: %u bytes not encoded\n", n, size);
+			failures++;
+			continue;
+		}
+
+		//damage one header byte and up to 8 bytes in each block
+		struct Il2pBlocks b;
+		getBlocks(size, true, &b);
+		buffer[random64() % IL2P_ENCODED_HEADER_SIZE] ^= 1 + (random64() % 255);
+		uint16_t offset = IL2P_ENCODED_HEADER_SIZE;
+		for(uint8_t i = 0; i < b.count; i++)
+		{
+			uint16_t k = b.size + (i >= (b.count - b.largeCount)) + b.parity;
+			uint8_t count = random64() % (IL2P_MAX_FEC_PARITY / 2 + 1);
+			for(uint8_t j = 0; j < count; j++)
+				buffer[offset + (random64() % k)] ^= 1 + (random64() % 255);
+			offset += k;
+			errors += count;
+			blocks++;
+		}
+
+		uint16_t encodedSize, decodedSize;
+		uint8_t fixed;
+		if(!Il2pDecodeHeader(buffer, &encodedSize, &fixed) || ((IL2P_ENCODED_HEADER_SIZE + encodedSize) != encoded)
+				|| !Il2pDecode(buffer, &buffer[IL2P_ENCODED_HEADER_SIZE], sizeof(buffer) - IL2P_ENCODED_HEADER_SIZE, &decodedSize, &fixed)
+				|| (decodedSize != size) || memcmp(&buffer[IL2P_ENCODED_HEADER_SIZE], frame, size))
+		{
+			if(failures < 10)
+				printf("frame %lu: FAIL: %u-byte frame decoded incorrectly\n", n, size);
+			failures++;
+		}
+		else
+			decoded++;
+	}
+	printf("specification example and CRC checked, frames decoded: %lu of %u, blocks: %lu, damaged bytes: %lu\n", decoded, CHECK_COUNT, blocks, errors);
+	printf("%s\n", failures ? "FAILED" : "OK");
+	return failures ? 1 : 0;
+}